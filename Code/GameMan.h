@@ -14,13 +14,26 @@
 #include "menu.h"
 #include "button.h"
 #include "network.h"
+#include "activity.h"
+#include "power.h"
+#include "screen.h"
+#include "battery.h"
+#include "stats.h"
+#include "trace.h"
+#include "prof.h"
 
 
 // Globals from the .ino
-extern Adafruit_SSD1327 display;
+extern GMDisplay display;
 extern MenuTask menuTask;
 extern ButtonTask buttonTask;
 extern NetworkTask netTask;
+extern ActivityRunner coopTask;
+extern PowerManager power;
+extern BatteryTask battery;
+extern RunStats runStats;
+extern TraceTask tracer;
+extern Profiler profiler;
 
 extern QueueHandle_t buttonEvents;
 
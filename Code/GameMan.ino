@@ -26,36 +26,51 @@
 #include "button.h"
 #include "menu.h"
 #include "network.h"
+#include "activity.h"
 #include "about.h"
+#include "boot.h"
+#include "power.h"
+#include "screen.h"
+#include "battery.h"
+#include "stats.h"
+#include "trace.h"
+#include "prof.h"
+
+#define SERIAL_POLL_MS  250     // how often loop() looks for a command
+#define TASK_DUMP_MS    10000   // how often it dumps the task table
 
 /*
  * Globals
  */
 
 // Display (connected through software SPI)
-Adafruit_SSD1327 display(128, 128, OLED_MOSI, OLED_CLK, OLED_DC, OLED_RESET, OLED_CS);
+GMDisplay display(128, 128, OLED_MOSI, OLED_CLK, OLED_DC, OLED_RESET, OLED_CS);
 
 // Create the main menu / button task
 MenuTask menuTask;
 ButtonTask buttonTask;
 NetworkTask netTask;
+ActivityRunner coopTask;
+BootTask bootTask;
+PowerManager power;
+BatteryTask battery;
+RunStats runStats;
+TraceTask tracer;
+Profiler profiler;
 
 QueueHandle_t buttonEvents;
 
-// debug
-TickType_t last = 0;
-
 void showTasks() {
 
-  // Courtesy of Espressif: https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/system/freertos_idf.html#misc
-  //char writeBuf[1280];      // estimated 32 tasks * 40 bytes
-  //vTaskList(writeBuf);      // not available in standard arduino esp-idf build?
-  //Serial.println(writeBuf); // so it doesn't work. :-(
-
+  // vTaskList() isn't in the standard Arduino esp-idf build, so the
+  // per-task table comes from our own collector (stats.h)
   Serial.printf("System: %d tasks  Stack: %d  Heap: %lu\n",
                 uxTaskGetNumberOfTasks(),
                 uxTaskGetStackHighWaterMark(NULL),
                 (unsigned long)ESP.getFreeHeap());
+
+  runStats.dump();
+  coopTask.dumpStats();
 }
 
 /*
@@ -118,7 +133,6 @@ void showSplash() {
   display.setCursor(getCenterX("[Initializing]"), display.height() - 10);
   display.print("[Initializing]");
   display.display();
-  delay(1000);
 }
 
 /*
@@ -160,9 +174,9 @@ void fadeSplash() {
     delay(dly);
   }
 
-  // Let the welcome message linger for a sec; menu will clear it
-  // when the rest of the initialization is done
-  delay(1000);
+  // Let the welcome message linger a moment; menu will clear it
+  // when the background tasks are up
+  delay(500);
 }
 
 /*
@@ -172,10 +186,29 @@ void setup() {
 
   // Setup serial port and announce ourselves
   Serial.begin(115200);
-  delay(800);
+
+  // Skipping the splash skips the wait for the serial monitor, too
+  bool fast = BootTask::fastBoot();
+  if (!fast) delay(800);
 
   Serial.println();
   Serial.println("GameMan v" + String(GM_VERSION) + " initializing");
+  bootMark("serial");
+
+  // Start counting CPU time right away
+  runStats.begin();
+
+  // The trace rings are static, but the drain lock isn't
+  tracer.setup(false);
+
+  // Create the event queues
+  buttonEvents = xQueueCreate(10, sizeof(button_event_t));
+  if (buttonEvents == 0) {
+    Serial.println("ERROR: could not create button event queue?");
+  }
+
+  // Kick off the rest of the initialization on the other core
+  bootTask.start();
 
   // Initialize and clear the display
   if (!display.begin(0x3D)) {
@@ -185,28 +218,23 @@ void setup() {
 
   display.clearDisplay();
   display.display();
-  delay(100);
-
-  // Show the splash screen
-  showSplash();
-
-  // Initialize the button(s)
-  buttonTask.setup(false);
+  bootMark("display");
 
-  // Set up the network/player info
-  netTask.setup(false);
-
-  // Build the menu
-  menuTask.setup(false);
-
-  // Create the event queues
-  buttonEvents = xQueueCreate(10, sizeof(button_event_t));
-  if (buttonEvents == 0) {
-    Serial.println("ERROR: could not create button event queue?");
+  // Show the splash screen while that runs, then wait for it to finish
+  if (!fast) {
+    delay(100);
+    showSplash();
+    bootMark("splash");
   }
 
+  bootTask.finish();
+  bootMark("init done");
+
   // Fade the splash and show the welcome message
-  fadeSplash();
+  if (!fast) {
+    fadeSplash();
+    bootMark("welcome");
+  }
 
   // debug
   showTasks();
@@ -214,17 +242,42 @@ void setup() {
   // Start up the background tasks
   netTask.start();
   buttonTask.start();
+  coopTask.start();
+  battery.start();
+  tracer.start();
   menuTask.start();
 }
 
 
+/*
+ *  One-letter debug commands from the serial console.
+ */
+void serialCommand(int c) {
+  switch (c) {
+    case 't':  showTasks(); break;
+    case 'p':  profiler.dump(); break;
+    case 'r':  profiler.reset(); Serial.println("prof: Reset"); break;
+    case '\r':
+    case '\n':  break;
+    default:
+      Serial.println("Commands: t = tasks, p = profile, r = reset profile");
+      break;
+  }
+}
+
 void loop() {
-  // Nothing to do here?  should periodically dump task status!
-  // Could have this be a battery monitor or something...
+  static uint32_t lastDump = millis();
+
+  // Nothing to do here but take serial commands and periodically
+  // dump task status.  Block in between rather than spin, or this
+  // core never goes idle (and never clocks down or sleeps).
+  while (Serial.available() > 0) serialCommand(Serial.read());
 
   // temporary - debug
-  if (((xTaskGetTickCount() - last) / portTICK_PERIOD_MS) >= 10000) {
+  if (millis() - lastDump >= TASK_DUMP_MS) {
+    lastDump = millis();
     showTasks();
-    last = xTaskGetTickCount();
   }
+
+  delay(SERIAL_POLL_MS);
 }
@@ -14,11 +14,13 @@
 #include "about.h"
 
 AboutBox::AboutBox()
-  : GMTask("ABOUT") {
+  : Activity("ABOUT") {
 }
 
 const String AboutBox::appName = "About";
 
+static const char *prompt = "Press any button";
+
 void AboutBox::setup(bool rsvp) {
   // Nothing to do here for now
   dprintln("AboutBox setup called");
@@ -26,10 +28,6 @@ void AboutBox::setup(bool rsvp) {
 
 void AboutBox::showAboutBox() {
 
-  const char *msg = "Press any button";
-  bool blinkOn = false;
-  button_event_t press;
-
   String buf = "Version " + String(GM_VERSION);
   int16_t y = display.height() / 2;
 
@@ -44,23 +42,18 @@ void AboutBox::showAboutBox() {
   display.setCursor(getCenterX(buf.c_str()), y - 10);
   display.print(buf);
   display.display();
-  
-  display.setTextSize(1);
-  int16_t x = getCenterX(msg);
 
-  for (;;) {
+  display.setTextSize(1);
+  msgX = getCenterX(prompt);
+  blinkOn = false;
+}
 
-    // Use the button timeout of 500ms as the blink rate :-)
-    if (xQueueReceive(buttonEvents, &(press), (TickType_t)500)) {
-      if (press.action == btnReleased) return;
-    }
+void AboutBox::blinkMessage() {
 
-    blinkOn = !blinkOn;
-    display.setCursor(x, display.height() - 10);
-    display.setTextColor(blinkOn ? WHITE : BLACK);
-    display.print(msg);
-    display.display();
-  }
+  blinkOn = !blinkOn;
+  display.setCursor(msgX, display.height() - 10);
+  display.setTextColor(blinkOn ? WHITE : BLACK);
+  display.print(prompt);
 }
 
 // rollCredits()
@@ -90,13 +83,28 @@ void AboutBox::showAboutBox() {
  *
  * Puts the program version and credits on the screen.  Basic
  * test of the menu/app interaction.  Waits for any button press
- * to return to the menu.
+ * to return to the menu.  Runs as an activity on the shared COOP
+ * task, since it spends nearly all its time waiting anyway.
  */
-void AboutBox::run() {
+actState AboutBox::step() {
 
-  dprintln("AboutBox: Task starting");
+  ACT_BEGIN();
+
+  dprintln("AboutBox: Activity starting");
 
   showAboutBox();
 
-  dprintln("AboutBox: Task complete");
+  for (;;) {
+
+    // Use the button timeout of 500ms as the blink rate :-)
+    ACT_AWAIT_BUTTON(press, 500);
+    if (gotEvent() && press.action == btnReleased) break;
+
+    blinkMessage();
+    ACT_PRESENT();
+  }
+
+  dprintln("AboutBox: Activity complete");
+
+  ACT_END();
 }
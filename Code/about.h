@@ -2,8 +2,8 @@
  *  about.h - An "about box"
  *
  *  Abstract:
- *      Defines a simple "game" task that hooks into the
- *      menu and task scheduler to show credits/version
+ *      Defines a simple "game" activity that hooks into the
+ *      menu and cooperative runner to show credits/version
  *      info about the console.
  *
  *  Team 14 Project
@@ -14,18 +14,27 @@
 #ifndef _GM_ABOUT_H_
 #define _GM_ABOUT_H_
 
+#include "activity.h"
+
 #define GM_VERSION 0.89
 
-class AboutBox : public GMTask {
+class AboutBox : public Activity {
   public:
     AboutBox();
     void setup(bool rsvp) override;
+    size_t footprint() override { return sizeof(*this); }
 
     static const String appName;
 
   private:
     void showAboutBox();
-    void run() override;
+    void blinkMessage();
+    actState step() override;
+
+    // Everything that has to survive an await
+    button_event_t press;
+    bool blinkOn;
+    int16_t msgX;
 };
 
 #endif
@@ -0,0 +1,308 @@
+/*
+ *  activity.cpp - Cooperative activity runner
+ *
+ *  Abstract:
+ *      Runs any number (well, MAX_ACTIVITIES) of small Activity
+ *      objects on a single FreeRTOS task.  Each one costs only its
+ *      own object (tens of bytes) instead of an 8K stack plus task
+ *      control block, which adds up fast once the menu, widgets and
+ *      little animations all want to run at the same time.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include "GameMan.h"
+#include "activity.h"
+
+/*
+ *  Activity
+ */
+Activity::Activity(const char *name) {
+  _name = name;
+}
+
+Activity::~Activity() {
+}
+
+const char *Activity::getName() {
+  return _name;
+}
+
+bool Activity::isRunning() {
+  return _running;
+}
+
+bool Activity::gotEvent() {
+  return _got;
+}
+
+TickType_t Activity::now() {
+  return xTaskGetTickCount();
+}
+
+/*
+ *  (Internal) Park this activity on something; see the ACT_AWAIT
+ *  macros.  A negative timeout waits forever.
+ */
+void Activity::await(actWait what, int ms, QueueHandle_t q, void *into) {
+  _wait = what;
+  _queue = q;
+  _into = into;
+  _got = false;
+  _timed = (ms >= 0 && what != waitFrame);
+  _wakeAt = xTaskGetTickCount() + pdMS_TO_TICKS(ms > 0 ? ms : 0);
+}
+
+/*
+ *  ActivityRunner
+ */
+ActivityRunner::ActivityRunner()
+  : GMTask("COOP", ACT_STACK_SIZE, 2, APP_CPU_NUM) {
+
+  for (int i = 0; i < MAX_ACTIVITIES; i++) {
+    slots[i] = NULL;
+  }
+}
+
+void ActivityRunner::setup(bool rsvp) {
+  Serial.println("coop: Task initializing");
+}
+
+/*
+ *  Start an activity on the shared task.  Safe to call from any
+ *  task (the menu, usually).  Returns false if all slots are busy.
+ */
+bool ActivityRunner::launch(Activity *act, bool rsvp) {
+  bool ok = false;
+
+  if (act == NULL || act->isRunning()) return false;
+
+  act->setup(rsvp);
+  act->_line = 0;
+  act->_wait = waitNone;
+  act->_cancel = false;
+  act->_running = true;
+
+  portENTER_CRITICAL(&slotLock);
+  for (int i = 0; i < MAX_ACTIVITIES; i++) {
+    if (slots[i] == NULL) {
+      slots[i] = act;
+      ok = true;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&slotLock);
+
+  if (!ok) {
+    Serial.printf("coop: No room to launch %s!\n", act->getName());
+    act->_running = false;
+    return false;
+  }
+
+  dprintf("coop: Launched %s\n", act->getName());
+
+  // Poke the runner in case it's sleeping
+  if (getHandle()) xTaskNotifyGive(getHandle());
+  return true;
+}
+
+/*
+ *  Ask the runner to drop an activity at its next await (which is
+ *  wherever it's parked now, since step() never blocks).  The caller
+ *  can watch isRunning() to see it go.
+ */
+void ActivityRunner::cancel(Activity *act) {
+  if (act == NULL || !act->isRunning()) return;
+
+  act->_cancel = true;
+  if (getHandle()) xTaskNotifyGive(getHandle());
+}
+
+/*
+ *  (Internal) See if whatever the activity is waiting on has
+ *  happened.  Returns true if it should be stepped now.
+ */
+bool ActivityRunner::resolve(Activity *a, TickType_t now) {
+
+  bool expired = a->_timed && (int32_t)(now - a->_wakeAt) >= 0;
+
+  switch (a->_wait) {
+    case waitNone:
+      return true;
+
+    case waitTime:
+      a->_got = expired;
+      return expired;
+
+    case waitButton:
+      if (havePending) {
+        memcpy(a->_into, &pending, sizeof(button_event_t));
+        a->_got = true;
+        return true;
+      }
+      return expired;
+
+    case waitPacket:
+      if (a->_queue && xQueueReceive(a->_queue, a->_into, (TickType_t)0)) {
+        a->_got = true;
+        return true;
+      }
+      return expired;
+
+    case waitFrame:
+      a->_got = (framesShown != a->_frame);
+      return a->_got;
+  }
+
+  return false;
+}
+
+/*
+ *  (Internal) How long can we sleep before somebody needs us?
+ */
+TickType_t ActivityRunner::nextWake(TickType_t now) {
+  TickType_t wait = portMAX_DELAY;
+
+  for (int i = 0; i < MAX_ACTIVITIES; i++) {
+    Activity *a = slots[i];
+    if (a == NULL) continue;
+
+    TickType_t t = portMAX_DELAY;
+
+    if (a->_wait == waitNone) {
+      t = 0;
+    } else if (a->_wait == waitPacket) {
+      t = pdMS_TO_TICKS(ACT_POLL_MS);
+    } else if (a->_wait == waitFrame && framesShown != a->_frame) {
+      t = 0;
+    } else if (a->_wait == waitFrame) {
+      TickType_t due = lastFrame + pdMS_TO_TICKS(ACT_FRAME_MS);
+      t = (int32_t)(due - now) > 0 ? due - now : 0;
+    }
+
+    if (a->_timed) {
+      TickType_t left = (int32_t)(a->_wakeAt - now) > 0 ? a->_wakeAt - now : 0;
+      if (left < t) t = left;
+    }
+
+    if (t < wait) wait = t;
+  }
+
+  return wait;
+}
+
+/*
+ *  Serial report of what the activities are costing us, and what
+ *  the same set would cost as one GMTask apiece.
+ */
+void ActivityRunner::dumpStats() {
+  int count = 0;
+  size_t objects = 0;
+
+  for (int i = 0; i < MAX_ACTIVITIES; i++) {
+    if (slots[i] != NULL) {
+      count++;
+      objects += slots[i]->footprint();
+    }
+  }
+
+  UBaseType_t freeStack = getHandle() ? uxTaskGetStackHighWaterMark(getHandle()) : ACT_STACK_SIZE;
+
+  Serial.printf("coop: %d activities, %u bytes of objects, shared stack %u of %u used\n",
+                count, (unsigned)objects, (unsigned)(ACT_STACK_SIZE - freeStack), ACT_STACK_SIZE);
+
+  if (count > 0) {
+    Serial.printf("coop: ~%u bytes per activity vs. ~%u bytes per task-per-app\n",
+                  (unsigned)(objects / count), (unsigned)(8192 + sizeof(StaticTask_t)));
+  }
+}
+
+/*
+ *  ActivityRunner main loop
+ *
+ *  Step every activity that's ready, flush the display once if any
+ *  of them presented a frame, then sleep until the next deadline.
+ *  If any activity is waiting on a button we block on the button
+ *  queue (so a press wakes us right away); otherwise we block on a
+ *  task notification, which launch() uses to kick us.
+ */
+void ActivityRunner::run() {
+
+  Serial.printf("coop: Task starting up on core %d\n", xPortGetCoreID());
+
+  for (;;) {
+
+    TickType_t now = xTaskGetTickCount();
+    bool wantButtons = false;
+
+    for (int i = 0; i < MAX_ACTIVITIES; i++) {
+      Activity *a = slots[i];
+      if (a == NULL) continue;
+
+      // Cancelled?  Drop it wherever it's parked
+      if (a->_cancel) {
+        dprintf("coop: %s cancelled\n", a->getName());
+        a->abort();
+
+        portENTER_CRITICAL(&slotLock);
+        slots[i] = NULL;
+        portEXIT_CRITICAL(&slotLock);
+
+        a->_running = false;
+        continue;
+      }
+
+      if (!resolve(a, now)) {
+        wantButtons |= (a->_wait == waitButton);
+        continue;
+      }
+
+      a->_wait = waitNone;
+
+      if (a->_line == 0) dprintf("coop: %s starting\n", a->getName());
+
+      if (a->step() == actDone) {
+        dprintf("coop: %s complete\n", a->getName());
+
+        portENTER_CRITICAL(&slotLock);
+        slots[i] = NULL;
+        portEXIT_CRITICAL(&slotLock);
+
+        a->_running = false;
+        continue;
+      }
+
+      // Remember which frame a presenter is waiting to see go out
+      if (a->_wait == waitFrame) {
+        a->_frame = framesShown;
+        dirty = true;
+      }
+
+      wantButtons |= (a->_wait == waitButton);
+    }
+
+    // Everyone waiting on a button has now seen it
+    havePending = false;
+
+    // One flush per frame no matter how many activities drew
+    if (dirty && elapsed(ACT_FRAME_MS, lastFrame)) {
+      display.display();
+      framesShown++;
+      lastFrame = xTaskGetTickCount();
+      dirty = false;
+    }
+
+    TickType_t wait = nextWake(xTaskGetTickCount());
+
+    if (wantButtons) {
+      // launch() can't poke us while we're parked on the button queue,
+      // so don't park there too long
+      if (wait > pdMS_TO_TICKS(ACT_POLL_MS * 10)) wait = pdMS_TO_TICKS(ACT_POLL_MS * 10);
+      havePending = xQueueReceive(buttonEvents, &pending, wait);
+    } else {
+      ulTaskNotifyTake(pdTRUE, wait);
+    }
+  }
+}
@@ -0,0 +1,134 @@
+/*
+ *  activity.h - Lightweight cooperative "activities"
+ *
+ *  Abstract:
+ *      An Activity is a small resumable function (a stackless
+ *      coroutine, protothreads style) that runs on the shared COOP
+ *      task instead of getting a FreeRTOS task and 8K stack of its
+ *      own.  Simple screens, widgets and background animations that
+ *      spend their lives waiting on a button, a packet or a timer
+ *      can all share one stack this way.  Full GMTask apps still
+ *      run on their own tasks alongside it.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_ACTIVITY_H_
+#define _GM_ACTIVITY_H_
+
+#include "task.h"
+#include "button.h"
+#include "network.h"
+
+#define MAX_ACTIVITIES   8      // concurrent activities on the COOP task
+#define ACT_STACK_SIZE   8192   // the one stack they all share
+#define ACT_FRAME_MS     33     // ~30fps cap on ACT_PRESENT() flushes
+#define ACT_POLL_MS      10     // packet queue poll rate while anyone waits
+
+enum actState : byte { actReady, actWaiting, actDone };
+enum actWait : byte { waitNone, waitTime, waitButton, waitPacket, waitFrame };
+
+/*
+ *  The body of an activity is its step() method, bracketed by
+ *  ACT_BEGIN()/ACT_END().  The ACT_AWAIT_* macros save the current
+ *  line and return to the runner, which calls step() again (and
+ *  jumps straight back to that line) once the thing being waited
+ *  for shows up or times out.  Use gotEvent() to tell which.
+ *
+ *  Because step() really returns, local variables do NOT survive
+ *  an await -- keep any state in member variables.  And don't put
+ *  an await inside a switch statement of your own.
+ */
+#define ACT_BEGIN()   switch (_line) { case 0:
+#define ACT_END()     } _line = 0; return actDone
+
+#define ACT_AWAIT(what, ms, q, into) \
+  do { await((what), (ms), (q), (into)); _line = __LINE__; return actWaiting; case __LINE__:; } while (0)
+
+#define ACT_YIELD()                   ACT_AWAIT(waitTime, 0, NULL, NULL)
+#define ACT_DELAY(ms)                 ACT_AWAIT(waitTime, (ms), NULL, NULL)
+#define ACT_AWAIT_BUTTON(ev, ms)      ACT_AWAIT(waitButton, (ms), NULL, &(ev))
+#define ACT_AWAIT_PACKET(q, pkt, ms)  ACT_AWAIT(waitPacket, (ms), (q), &(pkt))
+#define ACT_PRESENT()                 ACT_AWAIT(waitFrame, 0, NULL, NULL)
+
+#define ACT_FOREVER  -1             // no timeout on an await
+
+class Activity {
+public:
+  Activity(const char *name);
+  virtual ~Activity();
+
+  // Called by the menu prior to launch (same contract as GMTask)
+  virtual void setup(bool rsvp) {}
+
+  // Called on the COOP task if the menu cancels us (home button)
+  virtual void abort() {}
+
+  // Memory this activity costs while it runs (for the RAM report)
+  virtual size_t footprint() { return sizeof(*this); }
+
+  const char *getName();
+  bool isRunning();
+
+protected:
+  // Body of the activity: ACT_BEGIN(); ... ACT_END();
+  virtual actState step() = 0;
+
+  bool gotEvent();
+  static TickType_t now();
+
+  // Plumbing for the ACT_ macros
+  void await(actWait what, int ms, QueueHandle_t q, void *into);
+  uint16_t _line = 0;           // where to resume in step()
+
+private:
+  friend class ActivityRunner;
+
+  const char *_name;
+  volatile bool _running = false;
+  volatile bool _cancel = false;  // menu wants us gone
+
+  actWait _wait = waitNone;     // what we're parked on
+  bool _timed = false;          // does _wakeAt apply?
+  bool _got = false;            // did the awaited thing arrive?
+  TickType_t _wakeAt = 0;       // timeout (or delay) deadline
+  QueueHandle_t _queue = NULL;  // for waitPacket
+  void *_into = NULL;           // where to copy the button event/packet
+  uint32_t _frame = 0;          // for waitFrame
+};
+
+/*
+ *  The runner is an ordinary GMTask that owns the shared stack and
+ *  steps every ready activity in turn.  It sleeps until the nearest
+ *  deadline, a button event (if anyone's waiting on one), or a new
+ *  activity is launched.
+ */
+class ActivityRunner : public GMTask {
+public:
+  ActivityRunner();
+  void setup(bool rsvp) override;
+
+  bool launch(Activity *act, bool rsvp);
+  void cancel(Activity *act);
+  void dumpStats();
+
+private:
+  void run() override;
+
+  bool resolve(Activity *a, TickType_t now);
+  TickType_t nextWake(TickType_t now);
+
+  Activity *slots[MAX_ACTIVITIES];
+  portMUX_TYPE slotLock = portMUX_INITIALIZER_UNLOCKED;
+
+  button_event_t pending;       // one button event, offered to all waiters
+  bool havePending = false;
+
+  bool dirty = false;           // someone asked to present a frame
+  uint32_t framesShown = 0;
+  TickType_t lastFrame = 0;
+};
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ *  battery.cpp - Battery monitor
+ *
+ *  Abstract:
+ *      analogReadMilliVolts() applies the ADC calibration burned
+ *      into eFuse at the factory, so (unlike a raw analogRead()
+ *      with a fudge factor) the voltage is good to a few percent
+ *      on any board.  The charge curve is a lookup table, sampled
+ *      from the LiPo discharge polynomial SysInfo used to evaluate
+ *      on every refresh.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include "GameMan.h"
+#include "hardware.h"
+#include "battery.h"
+
+// Percent charge every 50mV from 3.50V to 4.20V (polynomial courtesy
+// of github.com/G6EJD/LiPo_Battery_Capacity, evaluated offline)
+static const uint8_t socTable[BATT_TABLE_LEN] = {
+  0, 2, 10, 21, 35, 49, 61, 71, 79, 84, 87, 89, 90, 93, 100
+};
+
+BatteryTask::BatteryTask()
+  : GMTask("BATTERY", 3072, 1, PRO_CPU_NUM) {
+}
+
+void BatteryTask::setup(bool rsvp) {
+  Serial.println("battery: Task initializing");
+  analogSetPinAttenuation(VBAT_SENSE, ADC_11db);
+}
+
+/*
+ *  Voltage -> state of charge, interpolating between table entries.
+ */
+uint8_t BatteryTask::toPercent(uint16_t mv) {
+
+  if (mv <= BATT_TABLE_MIN) return socTable[0];
+
+  int i = (mv - BATT_TABLE_MIN) / BATT_TABLE_STEP;
+  if (i >= BATT_TABLE_LEN - 1) return socTable[BATT_TABLE_LEN - 1];
+
+  int frac = (mv - BATT_TABLE_MIN) % BATT_TABLE_STEP;
+  return socTable[i] + (socTable[i + 1] - socTable[i]) * frac / BATT_TABLE_STEP;
+}
+
+/*
+ *  (Internal) One averaged reading of the battery, in mV.
+ */
+uint16_t BatteryTask::sample() {
+  uint32_t sum = 0;
+
+  for (int i = 0; i < BATT_OVERSAMPLE; i++) {
+    sum += analogReadMilliVolts(VBAT_SENSE);
+  }
+
+  return sum * BATT_DIVIDER / BATT_OVERSAMPLE;
+}
+
+void BatteryTask::publish(uint16_t mv, uint8_t pct, bool low) {
+  latest = ((uint32_t)mv << 16) | ((uint32_t)pct << 8) | (low ? 1 : 0);
+}
+
+battery_info_t BatteryTask::get() {
+  uint32_t v = latest;    // one read, so the fields all match
+  battery_info_t b;
+
+  b.mv = v >> 16;
+  b.pct = (v >> 8) & 0xff;
+  b.low = v & 1;
+  return b;
+}
+
+uint8_t BatteryTask::percent() {
+  return get().pct;
+}
+
+uint16_t BatteryTask::millivolts() {
+  return get().mv;
+}
+
+bool BatteryTask::isLow() {
+  return get().low;
+}
+
+/*
+ *  BatteryTask main loop
+ *
+ *  Sample, filter, publish, sleep.  The first sample seeds the filter
+ *  so the reading is right from the start.  Crossing BATT_LOW_PCT (and
+ *  back above BATT_OK_PCT, so it doesn't flap) switches the power
+ *  manager's low battery mode.
+ */
+void BatteryTask::run() {
+  bool low = false;
+
+  Serial.printf("battery: Task starting up on core %d\n", xPortGetCoreID());
+
+  filtered = (uint32_t)sample() << 4;
+
+  for (;;) {
+
+    uint16_t mv = filtered >> 4;
+    uint8_t pct = toPercent(mv);
+
+    if (!low && pct < BATT_LOW_PCT) {
+      low = true;
+      Serial.printf("battery: Low! %dmV (%d%%)\n", mv, pct);
+      power.setLowBattery(true);
+      display.dim();
+    } else if (low && pct > BATT_OK_PCT) {
+      low = false;
+      Serial.printf("battery: OK again, %dmV (%d%%)\n", mv, pct);
+      power.setLowBattery(false);
+    }
+
+    publish(mv, pct, low);
+
+    delay(BATT_INTERVAL);
+
+    // Exponential moving average (in 1/16 mV) to knock down ADC noise
+    int32_t diff = ((int32_t)sample() << 4) - (int32_t)filtered;
+    filtered += diff / BATT_FILTER;
+  }
+}
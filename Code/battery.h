@@ -0,0 +1,65 @@
+/*
+ *  battery.h - Battery monitor
+ *
+ *  Abstract:
+ *      A low priority background task that samples the battery
+ *      every so often, smooths the readings, converts them to a
+ *      state of charge and publishes the result where anyone can
+ *      read it for free.  When the charge runs low it puts the
+ *      power manager into low battery mode.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_BATTERY_H_
+#define _GM_BATTERY_H_
+
+#include "task.h"
+
+#define BATT_INTERVAL   10000   // ms between samples
+#define BATT_OVERSAMPLE 16      // ADC reads averaged per sample
+#define BATT_DIVIDER    2       // VBAT_SENSE sits behind a 2:1 divider
+#define BATT_FILTER     4       // EMA weight: each sample moves it 1/4 of the way
+
+#define BATT_LOW_PCT    10      // low battery below this...
+#define BATT_OK_PCT     15      // ...until it's back above this
+
+// State of charge table: percent at BATT_TABLE_MIN mV, then every BATT_TABLE_STEP
+#define BATT_TABLE_MIN  3500
+#define BATT_TABLE_STEP 50
+#define BATT_TABLE_LEN  15
+
+typedef struct battInfo {
+  uint16_t mv;                  // filtered battery voltage
+  uint8_t pct;                  // state of charge, 0..100
+  bool low;                     // below BATT_LOW_PCT (with hysteresis)
+} battery_info_t;
+
+class BatteryTask : public GMTask {
+public:
+  BatteryTask();
+  void setup(bool rsvp) override;
+
+  // Latest published reading; safe (and cheap) from any task
+  battery_info_t get();
+  uint8_t percent();
+  uint16_t millivolts();
+  bool isLow();
+
+  static uint8_t toPercent(uint16_t mv);
+
+private:
+  void run() override;
+  uint16_t sample();
+  void publish(uint16_t mv, uint8_t pct, bool low);
+
+  // mv << 16 | pct << 8 | low, written in one 32-bit store so
+  // readers never see half an update (no lock needed)
+  volatile uint32_t latest = 0;
+
+  uint32_t filtered = 0;        // EMA state, mV << 4 for some fraction bits
+};
+
+#endif
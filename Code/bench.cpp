@@ -0,0 +1,496 @@
+/*
+ *  bench.cpp - Benchmark app
+ *
+ *  Abstract:
+ *      Every test times a loop of the same operation with micros()
+ *      and reports the average, so the numbers include whatever an
+ *      app would pay for the same call (the display mutex, queue
+ *      overhead, and so on).  The whole suite runs under the perf
+ *      lock so the clock doesn't change under it, and the display is
+ *      woken first so flushes aren't skipped.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include "GameMan.h"
+#include "hardware.h"
+#include "graphics.h"
+#include "about.h"
+#include "bench.h"
+
+Bench::Bench()
+  : GMTask("BENCH") {
+}
+
+const String Bench::appName = "Bench";
+
+static const wire_field_t benchFields[] = {
+  WIRE_FIELD(bfType,    wkUint, bench_packet_t, type),
+  WIRE_FIELD(bfUnicast, wkUint, bench_packet_t, unicast),
+  WIRE_FIELD(bfSeq,     wkUint, bench_packet_t, seq),
+  WIRE_FIELD(bfSent,    wkUint, bench_packet_t, sent),
+};
+static const wire_schema_t benchSchema = WIRE_SCHEMA(1, bench_packet_t, benchFields);
+
+// Names and units, in benchTest order
+static const struct {
+  const char *key;
+  const char *label;
+  const char *unit;
+} benchTests[bnTestCount] = {
+  { "flush_full",  "Flush",    "fps" },
+  { "flush_16x16", "Flush 16", "fps" },
+  { "fill_full",   "Fill",     "us" },
+  { "bitmap_16",   "Bitmap",   "ns" },
+  { "text_char",   "Text/ch",  "ns" },
+  { "queue_event", "Q event",  "ns" },
+  { "queue_pkt",   "Q packet", "ns" },
+  { "ctx_switch",  "Switch",   "ns" },
+  { "nvs_write",   "NVS wr",   "us" },
+  { "nvs_read",    "NVS rd",   "us" },
+  { "rtt_bcast",   "RTT bc",   "us" },
+  { "rtt_ucast",   "RTT uc",   "us" },
+  { "rtt_loss",    "RTT loss", "%" },
+};
+
+void Bench::setup(bool rsvp) {
+  for (int i = 0; i < bnTestCount; i++) {
+    results[i].key = benchTests[i].key;
+    results[i].label = benchTests[i].label;
+    results[i].unit = benchTests[i].unit;
+    results[i].value = 0;
+    results[i].valid = false;
+  }
+
+  netId = -1;
+  netQ = 0;
+  pong = NULL;
+}
+
+/*
+ *  Home was held: give back the packet queue and the ping-pong partner
+ *  if it's alive.  (The menu takes back the perf lock.)
+ */
+void Bench::abort() {
+  stopNetwork();
+
+  if (pong) vTaskDelete(pong);
+  pong = NULL;
+}
+
+/*
+ *  Save a result and print it for the regression scripts.
+ */
+void Bench::record(int test, int32_t value) {
+  results[test].value = value;
+  results[test].valid = true;
+  Serial.printf("BENCH,%s,%d,%s\n", results[test].key, (int)value, results[test].unit);
+}
+
+/*
+ *  Title and prompt on top, then one line per test.
+ */
+void Bench::showResults(const char *prompt) {
+  char line[24];
+
+  display.clearDisplay();
+  display.setFont();
+  display.setTextSize(1);
+  display.setTextColor(WHITE);
+  display.setCursor(0, 0);
+  display.print(appName);
+  display.setCursor(display.width() - strlen(prompt) * 6, 0);
+  display.print(prompt);
+
+  for (int i = 0; i < bnTestCount; i++) {
+    if (results[i].valid) {
+      snprintf(line, sizeof(line), "%-9.9s%6d %-5.5s", results[i].label, (int)results[i].value, results[i].unit);
+    } else {
+      snprintf(line, sizeof(line), "%-9.9s%6s", results[i].label, "-");
+    }
+    display.setCursor(0, 10 + i * 9);
+    display.print(line);
+  }
+
+  display.display();
+}
+
+/*
+ *  Flush rate (whole panel and a 16x16 dirty window) and drawing
+ *  throughput into the framebuffer.  Setting two corner pixels is
+ *  enough to make the next flush cover that whole rectangle.
+ */
+void Bench::benchDisplay() {
+  int16_t w = display.width();
+  int16_t h = display.height();
+  uint32_t t;
+
+  display.clearDisplay();
+
+  t = micros();
+  for (int i = 0; i < BENCH_FLUSHES; i++) {
+    display.drawPixel(0, 0, i & 1 ? WHITE : BLACK);
+    display.drawPixel(w - 1, h - 1, i & 1 ? WHITE : BLACK);
+    display.display();
+  }
+  t = micros() - t;
+  record(bnFlushFull, (uint64_t)BENCH_FLUSHES * 1000000 / (t ? t : 1));
+
+  t = micros();
+  for (int i = 0; i < BENCH_PARTIALS; i++) {
+    display.drawPixel(56, 56, i & 1 ? WHITE : BLACK);
+    display.drawPixel(71, 71, i & 1 ? WHITE : BLACK);
+    display.display();
+  }
+  t = micros() - t;
+  record(bnFlushPart, (uint64_t)BENCH_PARTIALS * 1000000 / (t ? t : 1));
+
+  t = micros();
+  for (int i = 0; i < BENCH_DRAWS; i++) {
+    display.fillRect(0, 0, w, h, i & 1 ? HALF_BRIGHT : BLACK);
+  }
+  t = micros() - t;
+  record(bnFill, t / BENCH_DRAWS);
+
+  t = micros();
+  for (int i = 0; i < BENCH_BITMAPS; i++) {
+    display.drawBitmap((i * 16) % (w - 16), (i / 8 * 16) % (h - 16), bench16_bmp, 16, 16, WHITE);
+  }
+  t = micros() - t;
+  record(bnBitmap, (uint64_t)t * 1000 / BENCH_BITMAPS);
+
+  display.setCursor(0, 0);
+  t = micros();
+  for (int i = 0; i < BENCH_TEXT; i++) {
+    display.print((char)('!' + i % 90));
+  }
+  t = micros() - t;
+  record(bnText, (uint64_t)t * 1000 / BENCH_TEXT);
+}
+
+/*
+ *  Send/receive pairs on an otherwise idle queue, at the sizes the
+ *  button and network queues carry.  No task switch is involved.
+ */
+void Bench::benchQueues() {
+  QueueHandle_t q;
+  button_event_t ev;
+  gm_packet_t pkt;
+  uint32_t t;
+
+  memset(&ev, 0, sizeof(ev));
+  memset(&pkt, 0, sizeof(pkt));
+
+  if ((q = xQueueCreate(1, sizeof(button_event_t))) != 0) {
+    t = micros();
+    for (int i = 0; i < BENCH_QUEUE_OPS; i++) {
+      xQueueSend(q, &ev, 0);
+      xQueueReceive(q, &ev, 0);
+    }
+    t = micros() - t;
+    record(bnQueueEvent, (uint64_t)t * 1000 / BENCH_QUEUE_OPS);
+    vQueueDelete(q);
+  }
+
+  if ((q = xQueueCreate(1, sizeof(gm_packet_t))) != 0) {
+    t = micros();
+    for (int i = 0; i < BENCH_QUEUE_OPS; i++) {
+      xQueueSend(q, &pkt, 0);
+      xQueueReceive(q, &pkt, 0);
+    }
+    t = micros() - t;
+    record(bnQueuePacket, (uint64_t)t * 1000 / BENCH_QUEUE_OPS);
+    vQueueDelete(q);
+  }
+}
+
+/*
+ *  (Internal) Ping-pong partner: bounce every notification back.
+ */
+void Bench::pongTask(void *param) {
+  TaskHandle_t back = (TaskHandle_t)param;
+
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    xTaskNotifyGive(back);
+  }
+}
+
+/*
+ *  Context switch cost: bounce a notification off a task at our
+ *  priority on our core.  Each round trip is two switches.
+ */
+void Bench::benchSwitch() {
+  uint32_t t;
+
+  if (xTaskCreatePinnedToCore(pongTask, "PONG", 2048, xTaskGetCurrentTaskHandle(),
+                              uxTaskPriorityGet(NULL), &pong, xPortGetCoreID()) != pdPASS) {
+    Serial.println("bench: Could not create the PONG task");
+    pong = NULL;
+    return;
+  }
+
+  ulTaskNotifyTake(pdTRUE, 0);
+
+  t = micros();
+  for (int i = 0; i < BENCH_SWITCHES; i++) {
+    xTaskNotifyGive(pong);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+  t = micros() - t;
+  record(bnSwitch, (uint64_t)t * 1000 / (BENCH_SWITCHES * 2));
+
+  vTaskDelete(pong);
+  pong = NULL;
+}
+
+/*
+ *  Blob write and read times in a scratch namespace.  Each write
+ *  changes the data, so NVS can't skip it as unchanged.
+ */
+void Bench::benchNVS() {
+  Preferences prefs;
+  uint8_t buf[32];
+  uint32_t t;
+
+  if (!prefs.begin(BENCH_NVM_KEY, false)) {
+    Serial.println("bench: Failed to open preferences!?");
+    return;
+  }
+
+  memset(buf, 0, sizeof(buf));
+
+  t = micros();
+  for (int i = 0; i < BENCH_NVS_OPS; i++) {
+    buf[0] = i;
+    prefs.putBytes("blob", buf, sizeof(buf));
+  }
+  t = micros() - t;
+  record(bnNvsWrite, t / BENCH_NVS_OPS);
+
+  t = micros();
+  for (int i = 0; i < BENCH_NVS_OPS; i++) {
+    prefs.getBytes("blob", buf, sizeof(buf));
+  }
+  t = micros() - t;
+  record(bnNvsRead, t / BENCH_NVS_OPS);
+
+  prefs.clear();
+  prefs.end();
+}
+
+bool Bench::startNetwork() {
+  netId = netTask.createQueue();
+
+  if (netTask.addFilter(netId, GM_BENCH) < 0) {
+    Serial.println("bench: Failed to initialize the network!");
+    stopNetwork();
+    return false;
+  }
+
+  netQ = netTask.getHandle(netId);
+  return netQ != 0;
+}
+
+void Bench::stopNetwork() {
+  if (netId >= 0) netTask.destroyQueue(netId);
+  netId = -1;
+  netQ = 0;
+}
+
+/*
+ *  Send one ping and wait for its echo.  Returns the round trip in
+ *  usec (and who answered), or -1 if it was lost.
+ */
+int Bench::ping(const uint8_t *dst, bool unicast, uint16_t seq, uint8_t *from) {
+  gm_packet_t pkt;
+  bench_packet_t b;
+  uint32_t start;
+
+  // Forget late echoes from earlier pings
+  while (xQueueReceive(netQ, &pkt, 0)) {}
+
+  b.type = BENCH_PING;
+  b.unicast = unicast;
+  b.seq = seq;
+  b.sent = micros();
+
+  pkt.pktType = GM_BENCH;
+  memcpy(pkt.dstAddr, dst, ADDR_LEN);
+  memcpy(pkt.srcAddr, netTask.getPlayer(0)->node, ADDR_LEN);
+  netTask.pack(&pkt, &benchSchema, &b);
+
+  start = micros();
+  if (netTask.sendPkt(&pkt) != ESP_OK) return -1;
+
+  TickType_t until = xTaskGetTickCount() + pdMS_TO_TICKS(BENCH_PING_WAIT);
+
+  for (;;) {
+    int32_t left = (int32_t)(until - xTaskGetTickCount());
+    if (left <= 0 || !xQueueReceive(netQ, &pkt, left)) return -1;
+
+    // Just peek at the two fields that matter
+    WireView echo(pkt.payload, pkt.length);
+    if (echo.getUint(bfType) == BENCH_ECHO && echo.getUint(bfSeq) == seq) {
+      memcpy(from, pkt.srcAddr, ADDR_LEN);
+      return micros() - start;
+    }
+  }
+}
+
+/*
+ *  Round trips to an echo unit: broadcast first (which also finds
+ *  out who's echoing), then unicast to whoever answered.
+ */
+void Bench::benchRadio() {
+  uint8_t from[ADDR_LEN], peer[ADDR_LEN];
+  uint32_t total;
+  uint16_t seq = esp_random();
+  int sent = 0, lost = 0, n, rtt;
+
+  if (!startNetwork()) return;
+
+  total = n = 0;
+  for (int i = 0; i < BENCH_PINGS; i++, sent++) {
+    if ((rtt = ping(netTask.broadcast, false, seq++, from)) < 0) {
+      lost++;
+    } else {
+      memcpy(peer, from, ADDR_LEN);
+      total += rtt;
+      n++;
+    }
+  }
+
+  if (n == 0) {
+    Serial.println("bench: No echo unit answered");
+    stopNetwork();
+    return;
+  }
+  record(bnRttBcast, total / n);
+
+  total = n = 0;
+  for (int i = 0; i < BENCH_PINGS; i++, sent++) {
+    if ((rtt = ping(peer, true, seq++, from)) < 0) {
+      lost++;
+    } else {
+      total += rtt;
+      n++;
+    }
+  }
+
+  if (n > 0) record(bnRttUcast, total / n);
+  record(bnRttLoss, lost * 100 / sent);
+
+  stopNetwork();
+}
+
+/*
+ *  The whole suite, redrawing the results between groups (the
+ *  display tests scribble all over the screen).
+ */
+void Bench::runSuite() {
+  uint32_t start = millis();
+
+  for (int i = 0; i < bnTestCount; i++) results[i].valid = false;
+
+  Serial.printf("BENCH,start,%.2f,%s\n", GM_VERSION, HW_VERSION);
+  Serial.printf("BENCH,cpu_mhz,%u,MHz\n", (unsigned)getCpuFrequencyMhz());
+
+  showResults("running");
+  benchDisplay();
+  showResults("running");
+  benchQueues();
+  benchSwitch();
+  showResults("running");
+  benchNVS();
+  showResults("running");
+  benchRadio();
+
+  Serial.printf("BENCH,end,%u,ms\n", (unsigned)(millis() - start));
+}
+
+/*
+ *  Answer pings until a button is pressed.  The screen is only
+ *  updated once a second, so drawing doesn't pad the round trips.
+ */
+void Bench::echoMode() {
+  button_event_t press;
+  gm_packet_t pkt;
+  bench_packet_t b;
+  int echoed = 0, shown = -1;
+  TickType_t drawn = 0;
+
+  if (!startNetwork()) return;
+
+  display.clearDisplay();
+  display.setCursor(0, 0);
+  display.print(appName);
+  display.setCursor(0, 20);
+  display.println("Echo mode");
+  display.println();
+  display.println("Any button stops");
+  display.display();
+
+  for (;;) {
+    if (xQueueReceive(netQ, &pkt, pdMS_TO_TICKS(50))) {
+      if (netTask.unpack(&pkt, &benchSchema, &b) && b.type == BENCH_PING) {
+        b.type = BENCH_ECHO;
+        memcpy(pkt.dstAddr, b.unicast ? pkt.srcAddr : netTask.broadcast, ADDR_LEN);
+        memcpy(pkt.srcAddr, netTask.getPlayer(0)->node, ADDR_LEN);
+        netTask.pack(&pkt, &benchSchema, &b);
+        netTask.sendPkt(&pkt);
+        echoed++;
+      }
+    }
+
+    if (echoed != shown && elapsed(1000, drawn)) {
+      display.fillRect(0, 60, display.width(), 8, BLACK);
+      display.setCursor(0, 60);
+      display.print("Echoed: " + String(echoed));
+      display.display();
+      shown = echoed;
+      drawn = xTaskGetTickCount();
+    }
+
+    if (xQueueReceive(buttonEvents, &press, 0) && press.action == btnReleased) break;
+  }
+
+  stopNetwork();
+}
+
+/*
+ *  Bench main loop: B runs the suite, A echoes for another unit,
+ *  anything else goes back to the menu.
+ */
+void Bench::run() {
+  button_event_t press;
+
+  dprintln("Bench: Task starting");
+
+  power.perfLock();
+  display.wake();
+
+  showResults("B=run A=echo");
+
+  for (;;) {
+    if (xQueueReceive(buttonEvents, &press, portMAX_DELAY) && press.action == btnReleased) {
+      if (press.id == BTN_B) {
+        runSuite();
+      } else if (press.id == BTN_A) {
+        echoMode();
+      } else {
+        break;
+      }
+      showResults("B=run A=echo");
+    }
+  }
+
+  power.perfUnlock();
+
+  dprintln("Bench: Task complete");
+}
@@ -0,0 +1,104 @@
+/*
+ *  bench.h - Benchmark application class
+ *
+ *  Abstract:
+ *      Runs a fixed suite of timings -- display flushes and drawing,
+ *      FreeRTOS queues and context switches, NVS, and ESP-NOW round
+ *      trips -- so builds and boards can be compared.  Results go on
+ *      the screen and to the serial console as "BENCH,name,value,unit"
+ *      lines that a script can collect.  The radio tests need a
+ *      second unit running Bench in echo mode (press A).
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_BENCH_H_
+#define _GM_BENCH_H_
+
+#include "task.h"
+#include "network.h"
+
+#define BENCH_FLUSHES     10      // full screen flushes
+#define BENCH_PARTIALS    50      // 16x16 dirty window flushes
+#define BENCH_DRAWS       50      // full screen fills
+#define BENCH_BITMAPS     200     // 16x16 bitmaps
+#define BENCH_TEXT        400     // characters
+#define BENCH_QUEUE_OPS   1000    // send/receive pairs per size
+#define BENCH_SWITCHES    500     // ping-pong round trips
+#define BENCH_NVS_OPS     20      // keep the flash wear down
+#define BENCH_PINGS       20      // per radio test
+#define BENCH_PING_WAIT   100     // ms before a ping counts as lost
+
+#define BENCH_NVM_KEY     "gm-bench"    // scratch namespace, cleared after
+
+/*
+ *  Bench network protocol: PING goes out, the echo unit sends the
+ *  same payload straight back as ECHO (broadcast pings are answered
+ *  by broadcast, unicast by unicast).
+ */
+#define BENCH_PING  0x50
+#define BENCH_ECHO  0x45
+
+typedef struct BENCHpkt {
+  uint8_t type;               // PING or ECHO
+  uint8_t unicast;            // answer by unicast?
+  uint16_t seq;               // matches the echo to its ping
+  uint32_t sent;              // sender's micros(), for the sender only
+} bench_packet_t;
+
+// Wire field ids for the above
+enum benchField : uint8_t { bfType = 1, bfUnicast, bfSeq, bfSent };
+
+// One line of results
+typedef struct benchResult {
+  const char *key;            // machine-readable name
+  const char *label;          // what goes on the screen
+  const char *unit;
+  int32_t value;
+  bool valid;                 // false if it couldn't be measured
+} bench_result_t;
+
+enum benchTest : byte {
+  bnFlushFull, bnFlushPart, bnFill, bnBitmap, bnText,
+  bnQueueEvent, bnQueuePacket, bnSwitch,
+  bnNvsWrite, bnNvsRead,
+  bnRttBcast, bnRttUcast, bnRttLoss,
+  bnTestCount
+};
+
+class Bench : public GMTask {
+  public:
+    Bench();
+    void setup(bool rsvp) override;
+    void abort() override;
+
+    static const String appName;
+
+  private:
+    void run() override;
+
+    void showResults(const char *prompt);
+    void record(int test, int32_t value);
+    void runSuite();
+    void echoMode();
+
+    void benchDisplay();
+    void benchQueues();
+    void benchSwitch();
+    void benchNVS();
+    void benchRadio();
+    int ping(const uint8_t *dst, bool unicast, uint16_t seq, uint8_t *from);
+
+    bool startNetwork();
+    void stopNetwork();
+    static void pongTask(void *param);
+
+    bench_result_t results[bnTestCount];
+    int netId = -1;
+    QueueHandle_t netQ = 0;
+    TaskHandle_t pong = NULL;
+};
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ *  boot.cpp - Startup sequencer
+ *
+ *  Abstract:
+ *      Everything here has to be ready before the menu task starts,
+ *      but none of it touches the display, so it can run alongside
+ *      the splash.  Boot milestones are logged as "boot: <phase>"
+ *      lines with the time since reset, so boot time can be tracked
+ *      from the serial log.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include <Preferences.h>
+
+#include "GameMan.h"
+#include "boot.h"
+
+BootTask::BootTask()
+  : GMTask("BOOT", BOOT_STACK_SIZE, 2, PRO_CPU_NUM) {
+}
+
+void BootTask::setup(bool rsvp) {
+  // Nothing to do; it's all in run()
+}
+
+/*
+ *  Print a boot milestone.  millis() starts at reset, so these are
+ *  absolute; the delta from the previous mark shows where time went.
+ *  The boot task and setup() mark from different cores, so the last
+ *  mark is swapped under a spinlock.
+ */
+static portMUX_TYPE markLock = portMUX_INITIALIZER_UNLOCKED;
+
+void bootMark(const char *phase) {
+  static unsigned long lastMark = 0;
+  unsigned long now, last;
+
+  portENTER_CRITICAL(&markLock);
+  now = millis();
+  last = lastMark;
+  lastMark = now;
+  portEXIT_CRITICAL(&markLock);
+
+  Serial.printf("boot: %-12s %5lu ms (+%lu)\n", phase, now, now - last);
+}
+
+bool BootTask::fastBoot() {
+  Preferences prefs;
+  bool on = false;
+
+  if (prefs.begin(GM_NVM_KEY, true)) {
+    on = prefs.getBool(BOOT_NVM_FAST, false);
+    prefs.end();
+  }
+
+  return on;
+}
+
+void BootTask::setFastBoot(bool on) {
+  Preferences prefs;
+
+  if (!prefs.begin(GM_NVM_KEY, false)) {
+    Serial.println("boot: Failed to open preferences!?");
+    return;
+  }
+
+  prefs.putBool(BOOT_NVM_FAST, on);
+  prefs.end();
+}
+
+/*
+ *  Wait for run() to get all the way through, then delete the task.
+ *  Polling isRunning() (rather than waking on a notification) means
+ *  we never delete it while it's still in the middle of a printf.
+ */
+void BootTask::finish() {
+  while (isRunning()) delay(BOOT_POLL_MS);
+  end();
+}
+
+/*
+ *  BootTask main body
+ *
+ *  One pass through the subsystem setup() calls, in the same order
+ *  the old serial boot used, then done.  The display belongs to the
+ *  splash screen meanwhile, so nothing in here may draw.
+ */
+void BootTask::run() {
+
+  Serial.printf("boot: Initializing on core %d\n", xPortGetCoreID());
+
+  // Initialize the button(s)
+  buttonTask.setup(false);
+  bootMark("buttons");
+
+  // Set up the network/player info
+  netTask.setup(false);
+  bootMark("network");
+
+  // Now that the radio is up, settle into the low power policy
+  power.begin();
+  bootMark("power");
+
+  // Build the menu
+  menuTask.setup(false);
+  bootMark("menu setup");
+
+  // Shared task for lightweight activities
+  coopTask.setup(false);
+  bootMark("activities");
+
+  // Battery monitor
+  battery.setup(false);
+  bootMark("battery");
+}
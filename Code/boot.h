@@ -0,0 +1,45 @@
+/*
+ *  boot.h - Startup sequencer
+ *
+ *  Abstract:
+ *      Runs the slow, display-free parts of startup (ESP-NOW
+ *      bring-up, NVRAM reads, building the menu) on their own task
+ *      on the PRO core, so they overlap the splash animation that
+ *      setup() plays on the APP core instead of following it.
+ *      Also owns the "fast boot" setting, which skips the splash
+ *      entirely, and the boot-phase timing log.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_BOOT_H_
+#define _GM_BOOT_H_
+
+#include "task.h"
+
+#define BOOT_STACK_SIZE  8192   // freed once the sequencer finishes
+#define BOOT_POLL_MS     5      // how often setup() checks on it
+#define BOOT_NVM_FAST    "fastboot"   // key in the GM_NVM_KEY namespace
+
+class BootTask : public GMTask {
+public:
+  BootTask();
+  void setup(bool rsvp) override;
+
+  // Block until initialization is complete (and clean up the task)
+  void finish();
+
+  // The skip-the-splash setting, saved in NVRAM
+  static bool fastBoot();
+  static void setFastBoot(bool on);
+
+private:
+  void run() override;
+};
+
+// Log a boot milestone with time since power on (any task, any core)
+extern void bootMark(const char *phase);
+
+#endif
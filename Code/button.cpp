@@ -3,7 +3,9 @@
  *
  *  Abstract:
  *      Runs the button task so clients get a simple and
- *      consistent event-driven interface.
+ *      consistent event-driven interface.  The task sleeps
+ *      until a GPIO edge interrupt (or a repeat timer) wakes
+ *      it, so an idle console costs no CPU here at all.
  *
  *  Team 14 Project
  *  Portland State University
@@ -13,10 +15,74 @@
 #include "GameMan.h"
 #include "button.h"
 
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+
+static_assert(BTN_COUNT + 2 <= MAX_TIMERS, "not enough timers for every button plus home and idle");
+static_assert(DISP_DIM_SECS < DISP_BLANK_SECS && DISP_LOW_DIM_SECS < DISP_LOW_BLANK_SECS, "dim comes before blank");
+static_assert(BTN_LONG_PRESS < BTN_REPEAT_DELAY, "long press has to come before repeats");
+
+/*
+ *  Pin -> status bit mapping, resolved at compile time.  The ESP32
+ *  latches all GPIO inputs into two registers (GPIO_IN for 0-31 and
+ *  GPIO_IN1 for 32-39), so one read of each gives a coherent picture
+ *  of every button, and each button is then just a shift and a mask
+ *  that moves its pin bit onto its BTN_* bit; snapButtons() ORs the
+ *  seven results.  Each button keeps its own shift and mask (the
+ *  compiler may share the work when two shifts come out the same, as
+ *  for N/E/S on 25-27), and the asserts below check that no two land
+ *  on the same bit.
+ */
+constexpr int bitNum(uint32_t id) {
+  return (id <= 1) ? 0 : 1 + bitNum(id >> 1);
+}
+
+constexpr uint32_t shiftBy(uint32_t reg, int n) {
+  return (n >= 0) ? (reg >> n) : (reg << -n);
+}
+
+constexpr uint32_t pinBit(uint8_t pin, uint32_t in0, uint32_t in1, uint8_t id) {
+  return shiftBy(pin < 32 ? in0 : in1, (pin % 32) - bitNum(id)) & id;
+}
+
+// Status word (1 = released, same sense as the pins) from raw registers
+constexpr byte snapButtons(uint32_t in0, uint32_t in1) {
+  return pinBit(IO_BTN_A, in0, in1, BTN_A) | pinBit(IO_BTN_B, in0, in1, BTN_B) |
+         pinBit(IO_BTN_C, in0, in1, BTN_C) | pinBit(IO_BTN_N, in0, in1, BTN_UP) |
+         pinBit(IO_BTN_E, in0, in1, BTN_RT) | pinBit(IO_BTN_S, in0, in1, BTN_DN) |
+         pinBit(IO_BTN_W, in0, in1, BTN_LT);
+}
+
+// Register images with just one pin high, for checking the map
+constexpr uint32_t in0Only(uint8_t pin) { return pin < 32 ? (1UL << pin) : 0; }
+constexpr uint32_t in1Only(uint8_t pin) { return pin < 32 ? 0 : (1UL << (pin - 32)); }
+#define BTN_MAPS(pin, id) (snapButtons(in0Only(pin), in1Only(pin)) == (id))
+
+// If hardware.h moves a button, these make sure it still lands right
+static_assert(IO_BTN_A < 40 && IO_BTN_B < 40 && IO_BTN_C < 40 && IO_BTN_N < 40 &&
+              IO_BTN_E < 40 && IO_BTN_S < 40 && IO_BTN_W < 40, "button on a nonexistent GPIO");
+static_assert(BTN_MAPS(IO_BTN_A, BTN_A), "IO_BTN_A does not map to BTN_A");
+static_assert(BTN_MAPS(IO_BTN_B, BTN_B), "IO_BTN_B does not map to BTN_B");
+static_assert(BTN_MAPS(IO_BTN_C, BTN_C), "IO_BTN_C does not map to BTN_C");
+static_assert(BTN_MAPS(IO_BTN_N, BTN_UP), "IO_BTN_N does not map to BTN_UP");
+static_assert(BTN_MAPS(IO_BTN_E, BTN_RT), "IO_BTN_E does not map to BTN_RT");
+static_assert(BTN_MAPS(IO_BTN_S, BTN_DN), "IO_BTN_S does not map to BTN_DN");
+static_assert(BTN_MAPS(IO_BTN_W, BTN_LT), "IO_BTN_W does not map to BTN_LT");
+static_assert(snapButtons(0, 0) == 0, "stray bits with every pin low");
+static_assert(snapButtons(0xffffffff, 0xff) == (BTN_A | BTN_B | BTN_C | BTN_UP | BTN_RT | BTN_DN | BTN_LT),
+              "buttons overlap or are missing with every pin high");
+
+static inline byte readButtons() {
+  return snapButtons(REG_READ(GPIO_IN_REG), REG_READ(GPIO_IN1_REG));
+}
+
 ButtonTask::ButtonTask()
   : GMTask("BUTTON") {
 }
 
+TaskHandle_t ButtonTask::isrTask = NULL;
+portMUX_TYPE ButtonTask::edgeLock = portMUX_INITIALIZER_UNLOCKED;
+
 void ButtonTask::setup(bool rsvp) {
 
   Serial.println("button: Task initializing");
@@ -35,17 +101,65 @@ void ButtonTask::setup(bool rsvp) {
   pinMode(LED_BUILTIN, OUTPUT);
 }
 
-// Check ALL the buttons and update the flag words
-void ButtonTask::pollButtonState() {
+/*
+ *  GPIO edge interrupt (any button, either direction).  Just note when
+ *  it happened and kick the task; bounces only push lastEdge out, and
+ *  the task reads the pin once things have been quiet for BTN_DEBOUNCE.
+ */
+void IRAM_ATTR ButtonTask::edgeISR(void *arg) {
+  button_state_t *b = (button_state_t *)arg;
+  BaseType_t woken = pdFALSE;
+  int64_t now = esp_timer_get_time();
+
+  portENTER_CRITICAL_ISR(&edgeLock);
+  if (!b->pending) {
+    b->firstEdge = now;
+    b->pending = true;
+  }
+  b->lastEdge = now;
+  portEXIT_CRITICAL_ISR(&edgeLock);
+
+  TRACE(trBtnEdge, b->id, 0);
+
+  if (isrTask) vTaskNotifyGiveFromISR(isrTask, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+
+/*
+ *  Check ALL the buttons and update the flag words.  A button with
+ *  recent edges is left alone until it settles; returns true if any
+ *  are still settling so the caller knows to check back shortly.
+ */
+bool ButtonTask::pollButtonState() {
 
   int now = xTaskGetTickCount();  // Snapshot the current time
+  int64_t nowUs = esp_timer_get_time();
+  int64_t stamps[BTN_COUNT];
+  bool settling = false;
+  byte snap = readButtons();      // every pin at one instant
 
   lastButt = curButt;
   curButt = 0;
 
-  for (int i = 0; i < 8; i++) {
+  for (int i = 0; i < BTN_COUNT; i++) {
+    bool quiet = true;
+
+    portENTER_CRITICAL(&edgeLock);
+    if (buttons[i].pending) {
+      quiet = (nowUs - buttons[i].lastEdge) >= BTN_DEBOUNCE * 1000;
+      if (quiet) buttons[i].pending = false;
+      stamps[i] = buttons[i].firstEdge;
+    } else {
+      stamps[i] = nowUs;  // no edge seen (missed?), so call it now
+    }
+    portEXIT_CRITICAL(&edgeLock);
+
     buttons[i].last = buttons[i].current;
-    buttons[i].current = digitalRead(buttons[i].pin);
+    if (quiet) {
+      buttons[i].current = (snap & buttons[i].id) ? 1 : 0;
+    } else {
+      settling = true;
+    }
 
     // Change in state?
     if (buttons[i].current != buttons[i].last) {
@@ -61,7 +175,8 @@ void ButtonTask::pollButtonState() {
   }
 
   // Now compute/send updates if needed
-  queueButtonEvents();
+  queueButtonEvents(stamps);
+  return settling;
 }
 
 bool ButtonTask::buttonsChanged() {
@@ -70,89 +185,232 @@ bool ButtonTask::buttonsChanged() {
 
 button_state_t ButtonTask::getButtonState(byte button) {
 
-  if (button < 0 || button > 7) return buttons[7];
+  if (button >= BTN_COUNT) {
+    button_state_t none = { 0, 0, 0, 0, 0, 0, 0 };
+    return none;
+  }
 
   return buttons[button];
 }
 
-void ButtonTask::enqueue(buttAction a, byte id) {
+void ButtonTask::enqueue(buttAction a, byte id, int64_t when) {
   button_event_t e;
+
+  if (id & swallowed) return;
+
+  TRACE(trBtnEvent, a, id);
   e.action = a;
   e.id = id;
+  e.when = when;
   xQueueSend(buttonEvents, (void *)&e, (TickType_t)0);
 }
 
 /*
- * Check each button for UP/DOWN transitions and if so queue an event.
- * If a button is held down for a longer period, check to see if a repeat
- * event should be queued.  If the poll rate is fairly long, no separate
- * debouncing processing is needed.  See button.h for tunables.
+ *  (Internal) A button went down.  Completes a chord if other buttons
+ *  went down within BTN_CHORD_WINDOW of it, finishes a double tap if
+ *  it came soon after a tap, otherwise starts timing a long press.
+ */
+void ButtonTask::pressed(int i, int64_t when) {
+  byte chord = buttons[i].id;
+
+  buttons[i].downAt = when;
+  enqueue(btnPressed, buttons[i].id, when);
+
+  for (int j = 0; j < BTN_COUNT; j++) {
+    if (j != i && buttons[j].current == 0 && (when - buttons[j].downAt) <= BTN_CHORD_WINDOW * 1000) {
+      chord |= buttons[j].id;
+    }
+  }
+
+  if (chord != buttons[i].id) {
+    enqueue(btnChord, chord, when);
+
+    // Members of a chord don't also long-press, tap or repeat
+    for (int j = 0; j < BTN_COUNT; j++) {
+      if (chord & buttons[j].id) {
+        buttons[j].gesture = gsChord;
+        timers.cancel(j);
+      }
+    }
+  } else if (buttons[i].gesture == gsTapped) {
+    enqueue(btnDoubleTap, buttons[i].id, when);
+    buttons[i].gesture = gsDown2;
+    timers.start(i, BTN_LONG_PRESS);
+  } else {
+    buttons[i].gesture = gsDown;
+    timers.start(i, BTN_LONG_PRESS);
+  }
+
+  if (buttons[i].id == BTN_HOME) timers.start(tmrHome, BTN_HOME_HOLD);
+}
+
+/*
+ *  (Internal) A button came up.  A short first press opens the double
+ *  tap window; anything else just goes back to idle.
+ */
+void ButtonTask::released(int i, int64_t when) {
+
+  enqueue(btnReleased, buttons[i].id, when);
+
+  if (buttons[i].gesture == gsDown) {
+    buttons[i].gesture = gsTapped;
+    timers.start(i, BTN_DOUBLE_TAP);
+  } else {
+    buttons[i].gesture = gsIdle;
+    timers.cancel(i);
+  }
+
+  if (buttons[i].id == BTN_HOME) timers.cancel(tmrHome);
+}
+
+/*
+ *  (Internal) Timer t is due.  For a button, what that means depends
+ *  on its gesture state: still down after BTN_LONG_PRESS is a long
+ *  press, still held after that it starts repeating, and a tap whose
+ *  double tap window ran out is just done.
+ */
+void ButtonTask::timerFired(int t, int now) {
+
+  if (t == tmrIdle) {
+    // Dim first, then (if still nobody) turn the panel off
+    if (display.getState() == dispOn) {
+      display.dim();
+      timers.start(tmrIdle, display.blankAfter() - display.dimAfter());
+    } else {
+      display.blank();
+    }
+    return;
+  }
+
+  if (t == tmrHome) {
+    Serial.println("button: Home!");
+    enqueue(btnHome, BTN_HOME, esp_timer_get_time());
+    menuTask.homeAbort();
+    return;
+  }
+
+  switch (buttons[t].gesture) {
+    case gsDown:
+    case gsDown2:
+      buttons[t].gesture = gsHeld;
+      enqueue(btnLongPress, buttons[t].id, esp_timer_get_time());
+      timers.start(t, BTN_REPEAT_DELAY - BTN_LONG_PRESS);
+      break;
+
+    case gsHeld:
+      buttons[t].lastEventTime = now;
+      enqueue(btnRepeat, buttons[t].id, esp_timer_get_time());
+
+      // First repeat after the initial delay, then at the repeat rate
+      if (!timers.isActive(t)) timers.start(t, BTN_REPEAT_RATE, true);
+      break;
+
+    case gsTapped:
+      buttons[t].gesture = gsIdle;
+      break;
+
+    default:
+      break;
+  }
+}
+
+/*
+ * Check each button for UP/DOWN transitions and if so queue an event,
+ * then run any gesture/repeat timers that are due.  Debouncing already
+ * happened in pollButtonState(), and each event carries the timestamp
+ * of the edge that caused it.  See button.h for tunables.
  *
  * Currently just drops the latest event if the queue is full...
  */
-void ButtonTask::queueButtonEvents() {
+void ButtonTask::queueButtonEvents(int64_t stamps[]) {
 
   int now = xTaskGetTickCount();  // Snapshot the current time -- or pass it in?
+  int t;
 
   /*
-   * Transition rules:
-   *    up -> down      timeInState reset, generate a pressed event
-   *    down, no change if timeInState < repeat rate, no-op for now
-   *    down, no change if timeInState > initial delay, generate a repeat event
-   *    down, no change while repeating, only send events based on time - initdelay / rate
-   *    down -> up      generate released event
+   * Transition rules (per button, see buttGesture):
+   *    idle/tapped -> down   pressed event (+ chord or double tap), arm long press timer
+   *    down, timer fired     long press event, arm timer for the rest of the repeat delay
+   *    held, timer fired     repeat event, re-arm at the repeat rate
+   *    down -> up            released event; a short press opens the double tap window
+   *    chord                 members sit out long press/repeat until released
    */
-  for (int i = 0; i < 8; i++) {
+  for (int i = 0; i < BTN_COUNT; i++) {
 
     if (buttons[i].current != buttons[i].last) {
-      dprintf("button: %d ", i);
+      buttons[i].lastEventTime = now;
+
+      // Somebody's there: restart the display's idle countdown.  A
+      // press that turns the panel back on is just for that, so the
+      // app never sees it (or its release)
+      timers.start(tmrIdle, display.dimAfter());
 
       if (buttons[i].current == 0) {
-        dprintln("pressed");
-        buttons[i].lastEventTime = now;
-        enqueue(btnPressed, buttons[i].id);
+        if (display.wake()) swallowed |= buttons[i].id;
+        pressed(i, stamps[i]);
       } else {
-        dprintln("released");
-        buttons[i].lastEventTime = now;
-        enqueue(btnReleased, buttons[i].id);
-      }
-    } else {
-      if (buttons[i].current == 0 && buttons[i].timeInState > BTN_REPEAT_DELAY) {
+        released(i, stamps[i]);
 
-        if (elapsed(BTN_REPEAT_RATE, buttons[i].lastEventTime, now)) {
-          dprintf("button: %d repeats (%d ticks)\n", i, now - buttons[i].lastEventTime);
-          buttons[i].lastEventTime = now;
-          enqueue(btnRepeat, buttons[i].id);
+        // ...and it doesn't count as the first half of a double tap
+        if (swallowed & buttons[i].id) {
+          buttons[i].gesture = gsIdle;
+          timers.cancel(i);
+          swallowed &= ~buttons[i].id;
         }
       }
     }
   }
+
+  // Any gestures or repeats due?
+  while ((t = timers.expired(now)) != TMR_NONE) {
+    timerFired(t, now);
+  }
+}
+
+/*
+ *  (Internal) How long to sleep: until the next repeat is due, or just
+ *  past the debounce window if a button is still settling.  Forever if
+ *  nothing is going on -- the next edge interrupt will wake us.
+ */
+TickType_t ButtonTask::nextWake(bool settling) {
+  TickType_t wait = timers.ticksToNext();
+  TickType_t settle = pdMS_TO_TICKS(BTN_DEBOUNCE) + 1;
+
+  return (settling && wait > settle) ? settle : wait;
 }
 
 /*
  *  ButtonTask main loop
  *
  *  Track the hardware state of the buttons and queue up events for the
- *  "foreground app" that consumes them.  This task loops forever, polling
- *  the buttons at the (configurable) BTN_POLL_RATE.  Events are posted to
- *  the global GMEventQueue.
+ *  "foreground app" that consumes them.  This task sleeps until an edge
+ *  interrupt or repeat timer wakes it, then samples the buttons.  Events
+ *  are posted to the global buttonEvents queue.
  */
 void ButtonTask::run() {
 
   Serial.printf("button: Task starting up on core %d\n", xPortGetCoreID());
 
+  // Hook the edge interrupts from this task (so they land on this core)
+  isrTask = xTaskGetCurrentTaskHandle();
+  for (int i = 0; i < BTN_COUNT; i++) {
+    attachInterruptArg(buttons[i].pin, edgeISR, &buttons[i], CHANGE);
+  }
+
+  timers.start(tmrIdle, display.dimAfter());
+
   for (;;) {
 
-    pollButtonState();
+    bool settling = pollButtonState();
 
     if (buttonsChanged()) {
-      dprintf("button: State %s at %d\n", String(curButt, BIN), xTaskGetTickCount());
+      TRACE(trBtnState, curButt, 0);
 
       // debug
       buttLight = !buttLight;
       digitalWrite(LED_BUILTIN, buttLight ? HIGH : LOW);
     }
 
-    delay(BTN_POLL_RATE);
+    ulTaskNotifyTake(pdTRUE, nextWake(settling));
   }
 }
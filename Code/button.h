@@ -3,7 +3,11 @@
  *
  *  Abstract:
  *      Definitions for the button task, which tracks button state and
- *      fires events for presses, repeats, status requests, etc.
+ *      fires events for presses, repeats, status requests, etc.  On
+ *      top of the raw press/release/repeat events it recognizes a
+ *      few gestures (long press, double tap, chords and the "home"
+ *      hold that aborts the running app) so apps don't each have to
+ *      reinvent them.
  *
  *  Team 14 Project
  *  Portland State University
@@ -14,6 +18,8 @@
 #define _GM_BUTTON_H_
 
 #include "hardware.h"
+#include "timer.h"
+#include "screen.h"
 
 // Bit positions in the status word
 #define BTN_A     0x01
@@ -25,12 +31,30 @@
 #define BTN_DN    0x40
 #define BTN_LT    0x80
 
+#define BTN_COUNT   7         // buttons actually wired up
+
 // Timing
-#define BTN_POLL_RATE     10    // Season to taste
+#define BTN_DEBOUNCE      3     // ms of quiet after the last edge before we believe it
 #define BTN_REPEAT_DELAY  1000  // not too touchy...
 #define BTN_REPEAT_RATE   200   // see what feels right
 
-enum buttAction : byte { btnPressed, btnRepeat, btnReleased };
+// Gestures (these bound how late each one can be reported)
+#define BTN_LONG_PRESS    600   // held this long -> btnLongPress
+#define BTN_DOUBLE_TAP    300   // max gap from a tap's release to the next press
+#define BTN_CHORD_WINDOW  60    // presses this close together form a chord
+#define BTN_HOME          BTN_C // the "home"/"abort" button...
+#define BTN_HOME_HOLD     2000  // ...held this long returns to the menu
+
+/*
+ *  Raw events come first and are always sent; gestures are extra
+ *  events layered on top.  For btnChord the id is the mask of all
+ *  the buttons in the chord rather than a single button.
+ */
+enum buttAction : byte { btnPressed, btnRepeat, btnReleased,
+                         btnLongPress, btnDoubleTap, btnChord, btnHome };
+
+// Per-button gesture state (the repeat timer's meaning depends on it)
+enum buttGesture : byte { gsIdle, gsDown, gsHeld, gsTapped, gsDown2, gsChord };
 
 typedef struct buttState {
   byte id;                      // bit id in status word
@@ -40,11 +64,17 @@ typedef struct buttState {
   int pollTime;                 // time we last updated
   int timeInState;              // total millis since last transition
   int lastEventTime;            // to pace our repeats
+  buttGesture gesture;          // where we are in the gesture state machine
+  int64_t downAt;               // usec timestamp of the last press (for chords)
+  volatile bool pending;        // edge(s) seen, waiting to settle
+  volatile int64_t firstEdge;   // usec timestamp of the edge that started it
+  volatile int64_t lastEdge;    // usec timestamp of the latest (bounce) edge
 } button_state_t;
 
 typedef struct buttEvent {
   buttAction action;            // what just happened?
   byte id;                      // to which button?
+  int64_t when;                 // usec timestamp (esp_timer) of the edge
 } button_event_t;
 
 class ButtonTask : public GMTask {
@@ -59,28 +89,45 @@ class ButtonTask : public GMTask {
     // or just use an event queue and pop button events like network packets?
 
   private:
-    button_state_t buttons[8] = {  // state for each button
+    button_state_t buttons[BTN_COUNT] = {  // state for each button
       { BTN_A, IO_BTN_A, 1, 1, 0, 0, 0 },
       { BTN_B, IO_BTN_B, 1, 1, 0, 0, 0 },
       { BTN_C, IO_BTN_C, 1, 1, 0, 0, 0 },
       { BTN_UP, IO_BTN_N, 1, 1, 0, 0, 0 },
       { BTN_RT, IO_BTN_E, 1, 1, 0, 0, 0 },
       { BTN_DN, IO_BTN_S, 1, 1, 0, 0, 0 },
-      { BTN_LT, IO_BTN_W, 1, 1, 0, 0, 0 },
-      { 0, 0, 0, 0, 0, 0, 0 }
+      { BTN_LT, IO_BTN_W, 1, 1, 0, 0, 0 }
     };
 
     byte curButt = 0xff;        // status combined into one flag word
     byte lastButt = 0xff;       // for quick tests ("press any key") :-)
 
+    // Gesture/auto-repeat timers, one per button (id is the button
+    // index), plus the home hold and the display's idle countdown
+    GMTimers timers;
+    static const uint8_t tmrHome = BTN_COUNT;
+    static const uint8_t tmrIdle = BTN_COUNT + 1;
+
+    // Buttons whose events we're eating (they only woke the display)
+    byte swallowed = 0;
+
     // debug
     bool buttLight = false;
 
     void run() override;
 
-    void pollButtonState();
-    void queueButtonEvents();
-    void enqueue(buttAction a, byte id);
+    // Edge interrupts just timestamp and wake the task
+    static void IRAM_ATTR edgeISR(void *arg);
+    static TaskHandle_t isrTask;
+    static portMUX_TYPE edgeLock;
+
+    bool pollButtonState();
+    void queueButtonEvents(int64_t stamps[]);
+    void pressed(int i, int64_t when);
+    void released(int i, int64_t when);
+    void timerFired(int t, int now);
+    void enqueue(buttAction a, byte id, int64_t when);
+    TickType_t nextWake(bool settling);
 };
 
 #endif
@@ -56,6 +56,22 @@ static const uint8_t PROGMEM bship16_bmp[] = {
   0xc0, 0x01, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
 };
 
+// "Bench" menu icon
+static const uint8_t PROGMEM bench16_bmp[] = {
+  0xff, 0xff, 0xfc, 0x3f, 0xfe, 0x7f, 0xf8, 0x1f,
+  0xe7, 0xe7, 0xdf, 0x7b, 0xbf, 0x7d, 0xbf, 0x7d,
+  0xbf, 0x1d, 0xbf, 0xfd, 0xbf, 0xfd, 0xdf, 0xfb,
+  0xe7, 0xe7, 0xf8, 0x1f, 0xff, 0xff, 0xff, 0xff
+};
+
+// "Watch" menu icon
+static const uint8_t PROGMEM watch16_bmp[] = {
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xf8, 0x1f,
+  0xe7, 0xe7, 0xde, 0x7b, 0xbc, 0x3d, 0x78, 0x1e,
+  0x78, 0x1e, 0xbc, 0x3d, 0xde, 0x7b, 0xe7, 0xe7,
+  0xf8, 0x1f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
 // Mazewar mid-size
 static const uint8_t PROGMEM maze32_bmp[] = {
   0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 
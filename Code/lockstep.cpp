@@ -0,0 +1,77 @@
+/*
+ *  lockstep.cpp - Base class for real-time, lockstep multiplayer games
+ *
+ *  Abstract:
+ *      The fixed-timestep loop: take in the others' inputs, add ours,
+ *      run (and re-run) frames, draw, and send.  See lockstep.h.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include "GameMan.h"
+#include "lockstep.h"
+
+LockstepGame::LockstepGame(const char *name, uint8_t type)
+  : GMTask(name) {
+  pktType = type;
+  held = 0;
+}
+
+/*
+ *  Keep track of the buttons held down from the press and release
+ *  events (anything else is left to the gestures).
+ */
+uint8_t LockstepGame::readInput() {
+  button_event_t press;
+
+  while (xQueueReceive(buttonEvents, &press, 0)) {
+    if (press.action == btnPressed) held |= press.id;
+    else if (press.action == btnReleased) held &= ~press.id;
+  }
+  return held;
+}
+
+bool LockstepGame::finished() {
+  return false;
+}
+
+bool LockstepGame::play(int qId, void *state, int size, int players, int me) {
+  QueueHandle_t q = netTask.getHandle(qId);
+  uint8_t inputs[LOCK_MAX_PLAYERS];
+  gm_packet_t pkt;
+  TickType_t wake, heard;
+  lock_stats_t st;
+
+  if (!q || !rollback.begin(pktType, state, size, players, me, netTask.getPlayer(0)->node)) return false;
+
+  held = 0;
+  wake = heard = xTaskGetTickCount();
+
+  while (!finished()) {
+    while (xQueueReceive(q, &pkt, 0)) {
+      if (rollback.receive(&pkt)) heard = xTaskGetTickCount();
+    }
+
+    if (players > 1 && elapsed(LOCK_TIMEOUT, heard)) {
+      dprintf("lock: Nothing from the others in %d ms, giving up at frame %d\n", LOCK_TIMEOUT, rollback.frame());
+      return false;
+    }
+
+    rollback.setLocal(readInput());
+    while (rollback.step(inputs)) simulate(inputs);
+    render();
+
+    while (rollback.next(&pkt)) netTask.sendSession(&pkt);
+
+    // Running ahead of the others only makes them roll back more, so
+    // a unit that's ahead eases off a little until they catch up
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(rollback.ahead() > 0 ? LOCK_FRAME_MS * 5 / 4 : LOCK_FRAME_MS));
+  }
+
+  rollback.getStats(&st);
+  dprintf("lock: %u frames, %u rollbacks (%u frames again, deepest %u), %u stalls, %u desyncs\n",
+          st.frames, st.rollbacks, st.resimulated, st.deepest, st.stalls, st.desyncs);
+  return true;
+}
@@ -0,0 +1,60 @@
+/*
+ *  lockstep.h - Base class for real-time, lockstep multiplayer games
+ *
+ *  Abstract:
+ *      A game derived from LockstepGame keeps everything that matters
+ *      in one plain state struct and supplies simulate(), which moves
+ *      it on one frame given every player's buttons.  play() runs
+ *      the frames at a fixed LOCK_FRAME_MS, sends only our buttons
+ *      over the air and brings in everyone else's, predicting and
+ *      rolling back when they're late (see rollback.h).  simulate()
+ *      may be called several times for the same frame, so it must be
+ *      deterministic - the same on every unit, given the same state
+ *      and inputs - and must not touch anything but the state (no
+ *      drawing, no random(), no millis()).  Zero the struct before
+ *      filling it in, since the desync checksums cover its padding
+ *      too.  render() draws whatever the state is once a frame's work
+ *      is done.
+ *
+ *      The game still sets up its own network queue (with a filter
+ *      for its packet type) and session; rsvp.h gets everyone in,
+ *      and the host being player 0 is a fine way to number them.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_LOCKSTEP_H_
+#define _GM_LOCKSTEP_H_
+
+#include "task.h"
+#include "rollback.h"
+
+#define LOCK_FRAME_MS     33      // fixed timestep (about 30 frames a second)
+#define LOCK_TIMEOUT    3000      // ms without a word from the others: they're gone
+
+class LockstepGame : public GMTask {
+public:
+  LockstepGame(const char *name, uint8_t pktType);
+
+protected:
+  // One frame: inputs[p] is player p's buttons (BTN_* bits)
+  virtual void simulate(const uint8_t *inputs) = 0;
+  virtual void render() = 0;
+
+  // Our input for this frame; by default, the buttons held down
+  virtual uint8_t readInput();
+  virtual bool finished();
+
+  // Run until finished() (true) or the others stop answering (false)
+  bool play(int qId, void *state, int size, int players, int me);
+
+  Rollback rollback;          // stats, frame numbers
+
+private:
+  uint8_t pktType;
+  uint8_t held;
+};
+
+#endif
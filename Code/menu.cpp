@@ -18,14 +18,17 @@
 #include "graphics.h"
 #include "button.h"
 #include "network.h"
+#include "boot.h"
 
 // For each app on the menu
 #include "about.h"
 #include "sysinfo.h"
 #include "tictactoe.h"
+#include "bench.h"
+#include "watch.h"
 
 MenuTask::MenuTask()
-  : GMTask("MENU") {
+  : GMTask("MENU", 8192, MENU_PRIORITY) {
 }
 
 /*
@@ -38,26 +41,36 @@ void MenuTask::setup(bool rsvp) {
   strcpy(currentApp, "MENU");
 
   // Build the array in the order to be displayed
-  items[0].prog = new AboutBox;
+  items[0].prog = NULL;
+  items[0].act = new AboutBox;
   items[0].icon = about16_bmp;
-  strncpy(items[0].progName, AboutBox::appName.c_str(), MENU_MAX_CHARS);
+  snprintf(items[0].progName, MENU_MAX_CHARS, "%s", AboutBox::appName.c_str());
 
   items[1].prog = new SysInfo;
+  items[1].act = NULL;
   items[1].icon = info16_bmp;
-  strncpy(items[1].progName, SysInfo::appName.c_str(), MENU_MAX_CHARS);
+  snprintf(items[1].progName, MENU_MAX_CHARS, "%s", SysInfo::appName.c_str());
 
   items[2].prog = new TicTacToe;
+  items[2].act = NULL;
   items[2].icon = ttt16_bmp;
-  strncpy(items[2].progName, TicTacToe::appName.c_str(), MENU_MAX_CHARS);
+  snprintf(items[2].progName, MENU_MAX_CHARS, "%s", TicTacToe::appName.c_str());
 
   // TBD
   items[3].prog = NULL;
+  items[3].act = NULL;
   items[3].icon = bship16_bmp;
-  strncpy(items[3].progName, "Battleship", MENU_MAX_CHARS);
+  snprintf(items[3].progName, MENU_MAX_CHARS, "%s", "Battleship");
 
-  items[4].prog = NULL;
-  items[4].icon = about16_bmp;
-  strncpy(items[4].progName, "MazeWar!", MENU_MAX_CHARS);
+  items[4].prog = new Bench;
+  items[4].act = NULL;
+  items[4].icon = bench16_bmp;
+  snprintf(items[4].progName, MENU_MAX_CHARS, "%s", Bench::appName.c_str());
+
+  items[5].prog = new Watch;
+  items[5].act = NULL;
+  items[5].icon = watch16_bmp;
+  snprintf(items[5].progName, MENU_MAX_CHARS, "%s", Watch::appName.c_str());
 }
 
 /*
@@ -71,7 +84,7 @@ bool MenuTask::startNetwork() {
   // At system startup, task launch times might not be deterministic
   // so wait for the network to report itself open for business
   while (!netTask.isRunning()) {
-    delay(100);
+    delay(10);
     dprint(".");
   }
   dprintln();
@@ -100,6 +113,7 @@ bool MenuTask::startNetwork() {
  * Clear the screen and paint the menu.
  */
 void MenuTask::redrawMenu() {
+  PROF_SCOPE(pzMenuRedraw);
   int16_t x1, y1;
   uint16_t w, h;
 
@@ -116,7 +130,8 @@ void MenuTask::redrawMenu() {
    *  Each menu selection is rendered in a box at least 18 pixels high
    *  to accommodate the icon and a thin border, and 104 pixels wide.
    *
-   *  TODO: implement scrolling.
+   *  The list starts at entry "top"; small arrows on the right say
+   *  there are more above or below.
    */
 
   display.clearDisplay();
@@ -141,7 +156,9 @@ void MenuTask::redrawMenu() {
   // Skip header + border; leave room above/below for highlight
   y1 = MENU_Y_OFFSET + fontHeight + boxHeight;
 
-  for (int i = 0; i < MENU_MAX_ITEMS; i++) {
+  int i;
+
+  for (i = top; i < MENU_MAX_ITEMS; i++) {
 
     // Save computed Y position to save effort later
     yPos[i] = y1 - 1;
@@ -154,16 +171,25 @@ void MenuTask::redrawMenu() {
       display.drawBitmap(MENU_BORDER, y1 - MENU_ICON_SZ, items[i].icon, MENU_ICON_SZ, MENU_ICON_SZ, WHITE);
 
     // Finally, draw the text
-    if (items[i].progName != NULL) {
+    if (items[i].progName[0] != '\0') {
       display.setCursor(MENU_X_OFFSET, yPos[i]);
       display.print(items[i].progName);
     }
 
     y1 += boxHeight;
   }
+  rows = i - top;
+
+  // More above, more below (right of the highlight, inside the border)
+  for (int j = 0; j < 2; j++) {
+    if (top > 0)
+      display.drawFastHLine(display.width() - 4 - j, MENU_Y_OFFSET + fontHeight + 3 + j, 2 * j + 1, WHITE);
+    if (i < MENU_MAX_ITEMS)
+      display.drawFastHLine(display.width() - 4 - j, display.height() - 5 - j, 2 * j + 1, WHITE);
+  }
 
   // Highlight the first item
-  selected = 0;
+  selected = top;
 
   // Paint it!
   display.display();
@@ -193,10 +219,98 @@ void MenuTask::showSelected(bool on) {
   display.display();
 }
 
+/*
+ *  Scroll the list (if need be) so that item is on the screen.
+ */
+void MenuTask::scrollTo(byte item) {
+
+  if (item < top) {
+    top = item;
+  } else if (item >= top + rows) {
+    top = item - rows + 1;
+  } else {
+    return;
+  }
+
+  redrawMenu();
+  selected = item;
+}
+
 char *MenuTask::getCurrentApp() {
   return currentApp;
 }
 
+/*
+ *  Match an invitation to one of our menu entries.  -1 if we don't
+ *  have that app (or it's just a placeholder).
+ */
+int MenuTask::findApp(const char *name) {
+  for (int i = 0; i < MENU_MAX_ITEMS; i++) {
+    if (items[i].prog == NULL && items[i].act == NULL) continue;
+    if (strncmp(items[i].progName, name, MENU_MAX_CHARS) == 0) return i;
+  }
+  return -1;
+}
+
+/*
+ *  Pop up the invitation over the menu and wait for B (yes) or
+ *  C (no).  Nobody home for MENU_RSVP_WAIT means no.
+ */
+bool MenuTask::answerRSVP(const iff_packet_t *rsvp) {
+  button_event_t press;
+  uint32_t start = millis();
+
+  display.setFont();
+  display.setTextSize(1);
+  display.fillRect(8, 30, display.width() - 16, 64, BLACK);
+  display.drawRect(8, 30, display.width() - 16, 64, WHITE);
+  display.setTextColor(WHITE);
+  display.setCursor(14, 38);
+  display.print(rsvp->who);
+  display.setCursor(14, 50);
+  display.print("wants to play");
+  display.setCursor(14, 62);
+  display.print(rsvp->what);
+  display.setCursor(14, 80);
+  display.print("B: Yes   C: No");
+  display.display();
+
+  // Button presses from before the invite don't count
+  xQueueReset(buttonEvents);
+
+  while (millis() - start < MENU_RSVP_WAIT) {
+    if (xQueueReceive(buttonEvents, &(press), pdMS_TO_TICKS(50))) {
+      if (press.action != btnReleased) continue;
+      if (press.id == BTN_B) return true;
+      if (press.id == BTN_C) return false;
+    }
+  }
+
+  dprintln("menu: RSVP timed out");
+  return false;
+}
+
+/*
+ *  For an app launched as a guest: the invitation it was launched
+ *  for, and when the player said yes.  NULL if there isn't one.
+ */
+const gm_packet_t *MenuTask::getInvite(uint32_t *acceptedAt) {
+  if (inviteAt == 0) return NULL;
+
+  if (acceptedAt) *acceptedAt = inviteAt;
+  return &invite;
+}
+
+/*
+ *  Called by the button task when the home button has been held down.
+ *  We run at a higher priority than any app, so the notification
+ *  wakes us (and we freeze the app) right away rather than whenever
+ *  the app gets around to looking at its button queue.
+ */
+void MenuTask::homeAbort() {
+  if (getHandle()) xTaskNotifyGive(getHandle());
+}
+
 /*
  *  MenuTask main loop
  *
@@ -207,17 +321,17 @@ char *MenuTask::getCurrentApp() {
  *  and allows another program to be chosen.
  *
  *  RSVP requests from other nodes when the menu is active trigger a dialog that
- *  lets the user accept or reject the connection.  If accepted, the menu invokes
- *  the requested program with the "rsvp" flag set so the app can start up in
- *  guest mode and synchronize with the requester.  RSVPs when another app is
- *  running are ignored/rejected (for now).
+ *  lets the user accept or reject the connection.  The answer goes straight
+ *  back to the requester's queue.  If accepted, the menu invokes the requested
+ *  program with the "rsvp" flag set so the app can start up in guest mode and
+ *  join the requester's session (see rsvp.h).  RSVPs when another app is
+ *  running are ignored; the host just keeps asking until it gives up.
  */
 void MenuTask::run() {
 
   bool appRunning = false;
   bool guest = false;
   button_event_t press;
-  TaskHandle_t app;
 
   Serial.printf("menu: Task starting up on core %d\n", xPortGetCoreID());
   delay(10);
@@ -228,6 +342,7 @@ void MenuTask::run() {
 
   redrawMenu();
   showSelected(true);
+  bootMark("menu up");
 
   for (;;) {
 
@@ -257,13 +372,14 @@ void MenuTask::run() {
               // button B is "yes"/doit -- ignore repeats
               if (press.action != btnRepeat) {
                 dprintf("Selected item %d!\n", selected);
-                if (items[selected].prog != NULL)
+                if (items[selected].prog != NULL || items[selected].act != NULL)
                   appRunning = true;
               }
               break;
           }
 
           // Re-draw it even if it didn't change
+          scrollTo(selected);
           showSelected(true);
         }
       }
@@ -278,17 +394,39 @@ void MenuTask::run() {
           Serial.println("menu: Received RSVP packet");
 
           // Sanity check...
-          if (pkt.pktType != GM_RSVP || pkt.length != sizeof(iff_packet_t)) {
-            dprintf("BAD type (%d) or payload length (%d)\n", pkt.pktType, pkt.length);
+          if (pkt.pktType != GM_RSVP || !netTask.unpack(&pkt, &iffSchema, &rsvp)) {
+            dprintf("BAD type (%d) or payload (%d bytes)\n", pkt.pktType, pkt.length);
           } else {
-            // Copy it out
-            memcpy(&rsvp, pkt.payload, pkt.length);
-            dprintf("Invite from %s to play %s\n", rsvp.who, rsvp.what);
-            // run the dialog
-            // for now, just say YES; update the payload and ship it back
-            // assume we have the same programs but a findProg(rsvp.what) to make sure
-            //
-            //netTask.sendTo();
+            int found = findApp(rsvp.what);
+
+            if (rsvp.session != GM_NO_SESSION && rsvp.session == declined) {
+              // Already said no; they'll stop asking eventually
+            } else if (found < 0) {
+              dprintf("menu: Invite from %s to play %s, which we don't have\n", rsvp.who, rsvp.what);
+              netTask.sendReply(&pkt, false);
+            } else {
+              byte was = selected;
+
+              dprintf("menu: Invite from %s to play %s\n", rsvp.who, rsvp.what);
+
+              if (answerRSVP(&rsvp)) {
+                netTask.sendReply(&pkt, true);
+                memcpy(&invite, &pkt, sizeof(gm_packet_t));
+                inviteAt = millis();
+                selected = found;
+                guest = true;
+                appRunning = true;
+              } else {
+                netTask.sendReply(&pkt, false);
+                declined = rsvp.session;
+                redrawMenu();
+                selected = was;
+                showSelected(true);
+              }
+
+              // Repeats of the invite piled up while we were asking
+              xQueueReset(rsvpQ);
+            }
           }
         }
       }
@@ -301,13 +439,26 @@ void MenuTask::run() {
       // todo: some kind of animation to fade the menu or blink the selection
       // a couple of times to start the transition?
       GMTask *app = items[selected].prog;
-      strncpy(currentApp, items[selected].progName, MENU_MAX_CHARS);
+      Activity *act = items[selected].act;
+      snprintf(currentApp, MENU_MAX_CHARS, "%s", items[selected].progName);
+      netTask.announce();
 
-      // Call the setup() method in case the program needs to do any
-      app->setup(guest);
+      // Forget any home holds from while the menu was up
+      ulTaskNotifyTake(pdTRUE, 0);
 
-      // Launch the program in its own task and save the handle
-      app->start();
+      // Anybody may watch it (except another unit's stream)
+      if (strcmp(currentApp, Watch::appName.c_str()) != 0) display.startCast();
+
+      if (app != NULL) {
+        // Call the setup() method in case the program needs to do any
+        app->setup(guest);
+
+        // Launch the program in its own task and save the handle
+        app->start();
+      } else if (!coopTask.launch(act, guest)) {
+        // Activities share the COOP task; launch() calls setup()
+        appRunning = false;
+      }
 
       // Now loop in the background until it completes
       while (appRunning) {
@@ -320,22 +471,58 @@ void MenuTask::run() {
             dprintln("menu: Ignored RSVP (busy)");
           }
         }
+
+        // Keyframes and new watchers, if it's being watched (and come
+        // back soon if a frame is still going out)
+        int wait = display.pollCast() ? DISP_CAST_POLL_MS : MENU_APP_POLL;
         
-        delay(250);                       // reduce frequency to save battery :-)
-        appRunning = app->isRunning();    // there are better ways to do this
+        // Sleep until the next check (reduce frequency to save battery :-)
+        // unless the user holds down home to bail out of the app
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait))) {
+          Serial.printf("menu: Aborting %s\n", currentApp);
+
+          if (app != NULL) {
+            if (app->isRunning()) {
+              // Don't freeze it in the middle of a flush (holding the display),
+              // a send (holding the network's session or peer lock) or a
+              // speed change; then take back any performance locks it had
+              display.lock();
+              netTask.lock();
+              power.lock();
+              app->suspend();
+              power.unlock();
+              netTask.unlock();
+              display.unlock();
+              power.releaseLocks(app->getHandle());
+              app->abort();
+            }
+          } else {
+            coopTask.cancel(act);
+            while (act->isRunning()) delay(ACT_POLL_MS);
+          }
+          break;
+        }
+
+        appRunning = (app != NULL) ? app->isRunning() : act->isRunning();
       }
 
+      appRunning = false;
+
       // Properly close down the (suspended) task
-      app->end();
+      if (app != NULL) app->end();
+      display.stopCast();
 
       // We have control again, so reset and repaint the screen
       strcpy(currentApp, "MENU");
+      netTask.announce();
       guest = false;
+      inviteAt = 0;
       redrawMenu();
       showSelected(true);
 
       // Clear the queue of residual events and start polling the buttons again
       xQueueReset(buttonEvents);
+      if (rsvpQ) xQueueReset(rsvpQ);
     }
   }
 }
@@ -15,8 +15,9 @@
 
 #include "task.h"
 #include "network.h"
+#include "activity.h"
 
-#define MENU_MAX_ITEMS 5    // number of items (for now)
+#define MENU_MAX_ITEMS 6    // number of items (for now)
 #define MENU_MAX_CHARS 15   // room for icon, selection box
 
 #define MENU_NUM_ITEMS (MENU_MAX_ITEMS - 1)
@@ -27,11 +28,16 @@
 #define MENU_X_OFFSET (MENU_BORDER + MENU_ICON_SZ + 1)
 #define MENU_Y_OFFSET (MENU_BORDER * 2)
 
+#define MENU_PRIORITY 3     // one above the apps, so home can preempt them
+#define MENU_APP_POLL 250   // ms between checks on a running app
+#define MENU_RSVP_WAIT 10000  // ms to answer an invitation before it's a no
+
 
 typedef struct menuItem {
   char progName[MENU_MAX_CHARS];  // entry name
   const uint8_t *icon;            // teeny icon
   GMTask *prog;                   // game object
+  Activity *act;                  // ...or a lightweight activity
 } menuItem_t;
 
 
@@ -40,6 +46,8 @@ public:
   MenuTask();
   void setup(bool rsvp) override;
   char *getCurrentApp();
+  void homeAbort();
+  const gm_packet_t *getInvite(uint32_t *acceptedAt);
 
 private:
   void run() override;
@@ -47,8 +55,13 @@ private:
   bool startNetwork();
   void redrawMenu();
   void showSelected(bool on);
+  void scrollTo(byte item);
+  int findApp(const char *name);
+  bool answerRSVP(const iff_packet_t *rsvp);
 
   byte selected = 0;
+  byte top = 0;             // first entry on the screen
+  byte rows = 0;            // ...and how many fit
   int16_t fontHeight = 0;
   int16_t boxHeight = 0;
   char currentApp[MENU_MAX_CHARS];
@@ -58,6 +71,10 @@ private:
 
   int rsvpId;
   QueueHandle_t rsvpQ;
+
+  gm_packet_t invite;       // the RSVP we said yes to, for the guest app
+  uint32_t inviteAt = 0;    // when we said yes
+  uint16_t declined = GM_NO_SESSION;  // don't keep asking about this one
 };
 
 #endif
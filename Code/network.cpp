@@ -25,15 +25,33 @@
 // Quick and dirty check to see that the given qId is in range
 #define VALID(x) (x >= 0 && x < MAX_CLIENTS && clients[x].inUse)
 
+// How IFF and session messages go on the wire
+static const wire_field_t iffFields[] = {
+  WIRE_FIELD(ifType,     wkUint,  iff_packet_t, type),
+  WIRE_FIELD(ifReqId,    wkUint,  iff_packet_t, reqId),
+  WIRE_FIELD(ifSession,  wkUint,  iff_packet_t, session),
+  WIRE_FIELD(ifWho,      wkChars, iff_packet_t, who),
+  WIRE_FIELD(ifWhat,     wkChars, iff_packet_t, what),
+  WIRE_FIELD(ifTimeSent, wkUint,  iff_packet_t, timeSent),
+};
+const wire_schema_t iffSchema = WIRE_SCHEMA(1, iff_packet_t, iffFields);
+
+static const wire_field_t sessionFields[] = {
+  WIRE_FIELD(sfType,    wkUint,  session_packet_t, type),
+  WIRE_FIELD(sfApp,     wkUint,  session_packet_t, app),
+  WIRE_FIELD(sfCount,   wkUint,  session_packet_t, count),
+  WIRE_FIELD(sfMembers, wkBytes, session_packet_t, members),
+};
+const wire_schema_t sessionSchema = WIRE_SCHEMA(1, session_packet_t, sessionFields);
+
 NetworkTask::NetworkTask()
   : GMTask("NET", 8192, 2, PRO_CPU_NUM) {
 
   // Maybe not required, but good practice?
   initialized = false;
-  lastHello = 0;
   numClients = 0;
 
-  for (int i = 0; i <= pktDropped; i++) {
+  for (int i = 0; i <= pktSuppressed; i++) {
     pktStats[i] = 0;
   }
 
@@ -44,10 +62,37 @@ NetworkTask::NetworkTask()
   for (int i = 0; i < MAX_PLAYERS; i++) {
     memset(&players[i], 0, sizeof(gm_player_t));
   }
+  memset(playerTables, -1, sizeof(playerTables));
+  playerIndex = playerTables[0];
+  playersExpired = 0;
+
+  memset(peers, 0, sizeof(peers));
+  peerEvictions = 0;
+
+  memset(&session, 0, sizeof(session));
+
+  helloInterval = IFF_IMIN;
+  helloHeard = 0;
+  helloNeeded = false;
+  helloSuppressed = 0;
+  lastHello = 0;
+  neighborhood = 0;
+  appChanged = false;
+
+  relayMode = false;
+  txSeq = 0;
+  memset(relayCache, 0, sizeof(relayCache));
+  for (int i = 0; i < RELAY_CACHE; i++) relayCache[i].pending = -1;
+  relayNext = 0;
+  memset(relayEntry, -1, sizeof(relayEntry));
+
+  probeEveryone = false;
+  probeNext = 0;
+  memset(sniffFrom, 0, sizeof(sniffFrom));
+  sniffRSSI = 0;
 }
 
-QueueHandle_t NetworkTask::incoming;
-int NetworkTask::pktStats[6];
+NetworkTask *NetworkTask::radio = NULL;
 
 /*
  *  Initialize the ESP NOW network stack.
@@ -72,8 +117,11 @@ void NetworkTask::setup(bool rsvp) {
     initialized = true;
   }
 
-  // Register the broadcast address as a peer
-  addPeer(broadcast);
+  // Register the broadcast address as a peer (permanently; it
+  // doesn't take one of the LRU slots)
+  peerLock = xSemaphoreCreateMutex();
+  sessionLock = xSemaphoreCreateMutex();
+  registerPeer(broadcast);
 
   // Print MAC Address to Serial monitor
   dprint("net: MAC Address: ");
@@ -81,6 +129,8 @@ void NetworkTask::setup(bool rsvp) {
 
   // and save it to our player record
   WiFi.macAddress(players[0].node);
+  indexPlayer(playerIndex, 0);
+  updateNeighborhood();
 
   // Open up our nvram namespace
   if (!prefs.begin(GM_NVM_KEY, false)) {
@@ -91,7 +141,7 @@ void NetworkTask::setup(bool rsvp) {
   if (prefs.getBytes("tag", &name, GM_PLAYER_TAG_LEN) < 1) {
     Serial.println("net: Player tag not found in NVRAM, setting default");
 
-    snprintf(name, GM_PLAYER_TAG_LEN, "Player%d", random(1, 99));
+    snprintf(name, GM_PLAYER_TAG_LEN, "Player%d", (int)random(1, 99));
 
     // Save it to the nvram
     if (!prefs.putBytes("tag", name, GM_PLAYER_TAG_LEN)) {
@@ -101,7 +151,10 @@ void NetworkTask::setup(bool rsvp) {
 
   // Set it in the player table
   setPlayerName(name);
-  dprintf("net: Player tag set: '%s'\n", getPlayerName());
+  dprintf("net: Player tag set: '%s'\n", getPlayerName().c_str());
+
+  relayMode = prefs.getBool("relay", false);
+  if (relayMode) Serial.println("net: Relay mode on");
   prefs.end();
 }
 
@@ -141,7 +194,7 @@ int NetworkTask::createQueue(int maxDepth) {
     if (!clients[i].inUse) {
 
       // Try to create a new queue; if that fails, bail out
-      clients[i].handle = xQueueCreate(maxDepth, maxDepth * sizeof(gm_packet_t));
+      clients[i].handle = xQueueCreate(maxDepth, sizeof(gm_packet_t));
       if (clients[i].handle == 0) {
         Serial.println("net: Failed to create network queue!!");
         return -1;
@@ -225,14 +278,84 @@ int NetworkTask::dropFilter(int qId, uint8_t code) {
 }
 
 /*
- *  Send a network broadcast packet.
+ *  Send a network packet, broadcast or unicast, outside of any session.
  */
 int NetworkTask::sendPkt(gm_packet_t *pkt) {
+  pkt->session = GM_NO_SESSION;
+  return transmit(pkt);
+}
+
+/*
+ *  Payloads are encoded (wire.h), not copied raw; only the encoded
+ *  length goes on the air.
+ */
+bool NetworkTask::pack(gm_packet_t *pkt, const wire_schema_t *schema, const void *msg) {
+  int n = wireEncode(schema, msg, pkt->payload, MAX_PKT_LEN);
+
+  if (n < 0) {
+    Serial.printf("net: Type %d message doesn't fit in a packet!\n", pkt->pktType);
+    pkt->length = 0;
+    return false;
+  }
+  pkt->length = n;
+  return true;
+}
 
-  // Send message via ESP-NOW
-  esp_err_t result = esp_now_send(pkt->dstAddr, (uint8_t *)pkt, sizeof(gm_packet_t));
+bool NetworkTask::unpack(const gm_packet_t *pkt, const wire_schema_t *schema, void *msg) {
+  return wireDecode(schema, pkt->payload, pkt->length, msg);
+}
+
+/*
+ *  Broadcasts everyone is meant to look at are numbered, so that
+ *  listeners can tell how many they missed (and relays can spot
+ *  copies).  Unicasts and other sessions' traffic aren't heard by
+ *  everyone, so they'd only look like losses.
+ */
+static bool sequenced(const gm_packet_t *pkt) {
+  static const uint8_t all[ADDR_LEN] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+  return pkt->ttl > 0 || (pkt->session == GM_NO_SESSION && memcmp(pkt->dstAddr, all, ADDR_LEN) == 0);
+}
+
+/*
+ *  (Internal) Put a packet we made on the air.  In relay mode,
+ *  broadcasts get a TTL, and so do unicasts to anyone we don't hear
+ *  well enough to trust a direct send; those go out as broadcasts
+ *  (still addressed inside) for the relays to carry.
+ */
+int NetworkTask::transmit(gm_packet_t *pkt) {
+  const uint8_t *air = pkt->dstAddr;
+  bool bcast = memcmp(pkt->dstAddr, broadcast, ADDR_LEN) == 0;
 
-  dprintf("net: Sent to %s (type %d)\n", fmtMAC(pkt->dstAddr), pkt->pktType);
+  pkt->ttl = 0;
+  pkt->hops = 0;
+
+  if (relayMode && (bcast || !neighbor(pkt->dstAddr))) {
+    pkt->ttl = (bcast && pkt->pktType == GM_IFF) ? RELAY_HELLO_TTL : RELAY_TTL;
+    air = broadcast;
+  }
+
+  // Any task can get here, and two packets with the same seq would
+  // look like one to relayFresh() and heardFrom()
+  if (sequenced(pkt)) pkt->seq = __atomic_add_fetch(&txSeq, 1, __ATOMIC_RELAXED);
+  else pkt->seq = __atomic_load_n(&txSeq, __ATOMIC_RELAXED);
+
+  return sendFrame(air, pkt);
+}
+
+/*
+ *  (Internal) Hand a frame to ESP-NOW as is.
+ */
+int NetworkTask::sendFrame(const uint8_t *dst, gm_packet_t *pkt) {
+
+  // Unicasts need the destination in the (limited) peer table
+  if (memcmp(dst, broadcast, ADDR_LEN) != 0) addPeer(dst);
+
+  // Send message via ESP-NOW: the header and as much payload as is used
+  if (pkt->length > MAX_PKT_LEN) pkt->length = MAX_PKT_LEN;
+  esp_err_t result = esp_now_send(dst, (uint8_t *)pkt, offsetof(gm_packet_t, payload) + pkt->length);
+
+  TRACE(trNetSend, pkt->pktType | (result << 16), TRACE_MAC(dst));
   sendAccounting(result);
   return result;
 }
@@ -269,15 +392,81 @@ void NetworkTask::sendAccounting(esp_err_t err) {
  *  and inefficient but time is short and we can make it pretty later.
  */
 void NetworkTask::recvCallback(const uint8_t *mac_addr, const uint8_t *data, int data_len) {
+  if (radio) radio->receive(mac_addr, data, data_len);
+}
 
-  gm_packet_t pkt;
+void NetworkTask::sendCallback(const uint8_t *mac_addr, esp_now_send_status_t status) {
+  if (radio) radio->sendDone(mac_addr, status == ESP_NOW_SEND_SUCCESS);
+}
 
-  dprintf("net: Received from %s (%d bytes)\n", fmtMAC(mac_addr), data_len);
+/*
+ *  Promiscuous mode sees every management frame, and ESP-NOW rides in
+ *  vendor-specific action frames, so pick those out and note who sent
+ *  it and how loud.  The ESP-NOW callback for the same frame follows
+ *  on the same (WiFi) task, and picks up the RSSI if the sender matches.
+ */
+void NetworkTask::sniffCallback(void *buf, wifi_promiscuous_pkt_type_t type) {
+  const wifi_promiscuous_pkt_t *p = (const wifi_promiscuous_pkt_t *)buf;
 
-  memcpy(&pkt, data, data_len);
+  if (!radio || type != WIFI_PKT_MGMT || p->rx_ctrl.sig_len < 28) return;
+  if (p->payload[0] != 0xd0 || p->payload[24] != 0x7f) return;   // action, vendor specific
 
-  if (xQueueSend(incoming, (void *)&pkt, (TickType_t)0) != pdTRUE) {
-    Serial.println("net: Incoming queue full, packet dropped!");
+  radio->signal(p->payload + 10, p->rx_ctrl.rssi);                 // addr2 is the sender
+}
+
+void NetworkTask::signal(const uint8_t *mac_addr, int rssi) {
+  memcpy(sniffFrom, mac_addr, ADDR_LEN);
+  sniffRSSI = rssi;
+}
+
+/*
+ *  The radio has finished with a unicast: ACKed, or out of retries.
+ *  This runs on the radio's task, but they're only counts, so a lookup
+ *  that races a change to the directory costs one of them at worst.
+ */
+void NetworkTask::sendDone(const uint8_t *mac_addr, bool acked) {
+  int p = findNode(mac_addr);
+
+  if (p <= 0) return;
+  if (acked) players[p].link.txAcked++;
+  else players[p].link.txFailed++;
+}
+
+void NetworkTask::receive(const uint8_t *mac_addr, const uint8_t *data, int data_len) {
+
+  gm_frame_t frame;
+  uint16_t sid;
+
+  if (!incoming) return;
+
+  TRACE(trNetRecv, data_len, TRACE_MAC(mac_addr));
+
+  // Not even a whole header?  Not ours
+  if (data_len < (int)offsetof(gm_packet_t, payload)) {
+    pktStats[pktForeign]++;
+    return;
+  }
+
+  // Someone else's game?  Don't even copy it (unless we're to relay it)
+  memcpy(&sid, data + offsetof(gm_packet_t, session), sizeof(sid));
+  if (sid != GM_NO_SESSION && sid != session.id && !(relayMode && data[offsetof(gm_packet_t, ttl)] > 0)) {
+    TRACE(trNetDropped, data[offsetof(gm_packet_t, pktType)], 3);
+    pktStats[pktForeign]++;
+    return;
+  }
+
+  if (data_len > (int)sizeof(gm_packet_t)) data_len = sizeof(gm_packet_t);
+  memcpy(frame.from, mac_addr, ADDR_LEN);
+  frame.rssi = memcmp(sniffFrom, mac_addr, ADDR_LEN) == 0 ? sniffRSSI : 0;
+  memcpy(&frame.pkt, data, data_len);
+
+  // Trust what arrived over what the header claims
+  if (frame.pkt.length > data_len - offsetof(gm_packet_t, payload)) {
+    frame.pkt.length = data_len - offsetof(gm_packet_t, payload);
+  }
+
+  if (xQueueSend(incoming, (void *)&frame, (TickType_t)0) != pdTRUE) {
+    TRACE(trNetOverflow, data_len, TRACE_MAC(mac_addr));
     pktStats[pktRecvOverflow]++;
   } else {
     pktStats[pktTotalRecv]++;
@@ -286,40 +475,66 @@ void NetworkTask::recvCallback(const uint8_t *mac_addr, const uint8_t *data, int
 
 /*
  *  Examine the packet type and place it on the appropriate client queue if
- *  anyone is filtering for it.  Otherwise just drop it.
+ *  anyone is filtering for it.  Otherwise just drop it.  Blocks for up to
+ *  wait ticks if nothing has arrived yet.
  */
-void NetworkTask::dispatch() {
+void NetworkTask::dispatch(TickType_t wait) {
 
-  gm_packet_t pkt;
+  gm_frame_t frame;
+  gm_packet_t &pkt = frame.pkt;
+  int p;
+
+  // If our network isn't up, there's nothin' to do (but don't spin)
+  if (!initialized || !incoming) {
+    vTaskDelay(wait);
+    return;
+  }
 
-  // If our network isn't up, there's nothin' to do
-  if (!initialized || !incoming) return;
+  // Got packets?  Wait (block) until one shows up or a timer is due
+  if (!xQueueReceive(incoming, &(frame), wait)) return;
 
-  // Got packets?  Wait (block) up to 10ms...
-  if (!xQueueReceive(incoming, &(pkt), (TickType_t)10)) return;
+  PROF_SCOPE(pzNetDispatch);
 
-  dprintf("net: Dispatch type %d: ", pkt.pktType);
+  if (pkt.hops == 0) heardFrom(pkt.srcAddr, &pkt);
+
+  // The signal strength is the last hop's, whoever that was
+  if (frame.rssi && (p = findNode(frame.from)) > 0) {
+    int8_t &rssi = players[p].link.rssi;
+    rssi = rssi ? rssi + (frame.rssi - rssi) / LINK_RSSI_EWMA : frame.rssi;
+  }
+
+  // Relayed (or relayable): drop copies, maybe pass it on
+  if ((pkt.ttl > 0 || pkt.hops > 0) && !relayFresh(&frame)) {
+    TRACE(trNetDropped, pkt.pktType, 4);
+    pktStats[pktDuplicate]++;
+    return;
+  }
+
+  // Only here to be relayed: someone else's unicast or session
+  if ((memcmp(pkt.dstAddr, broadcast, ADDR_LEN) != 0 && memcmp(pkt.dstAddr, players[0].node, ADDR_LEN) != 0) ||
+      (pkt.session != GM_NO_SESSION && pkt.session != session.id)) {
+    TRACE(trNetDropped, pkt.pktType, 3);
+    pktStats[pktForeign]++;
+    return;
+  }
 
   // See if anyone wants it
   // todo: this is brute force and slow, but sufficient for now?
   for (int q = 0; q < MAX_CLIENTS; q++) {
     if (clients[q].inUse) {
-      // dprintf("\n--> client %d ", q);
       for (int f = 0; f < MAX_FILTERS; f++) {
         if (clients[q].filters[f] == pkt.pktType) {
-          // dprintf("match filter %d! ", f);
           if (clients[q].handle) {
-            // dprintln("handle is good, about to queue:");
             if (xQueueSend(clients[q].handle, (void *)&pkt, (TickType_t)0) == pdTRUE) {
-              dprintf("Sent to client %d\n", q);
+              TRACE(trNetDispatch, pkt.pktType, q);
               pktStats[pktDispatched]++;
               clients[q].numReceived++;
             } else {
-              dprintf("Failed, client %d queue full!\n", q);
+              TRACE(trNetDropped, pkt.pktType, 1);
               pktStats[pktDropped]++;
             }
           } else {
-            dprintf("Failed, client %d queue invalid!\n", q);
+            TRACE(trNetDropped, pkt.pktType, 2);
             pktStats[pktDropped]++;
           }
           // Bug out. For now, it's first come, first served...
@@ -330,7 +545,7 @@ void NetworkTask::dispatch() {
   }
 
   // Nobody's interested
-  dprintln("Dropping unloved packet");
+  TRACE(trNetDropped, pkt.pktType, 0);
   pktStats[pktDropped]++;
 }
 
@@ -344,20 +559,22 @@ void NetworkTask::sendIFF(uint8_t code) {
 
   // Fill in the payload
   hello.type = code;
-  hello.reqId = 0;
+  hello.reqId = (code == IFF_HELLO) ? neighborhood : 0;
+  hello.session = GM_NO_SESSION;
   memcpy(hello.who, players[0].tag, GM_PLAYER_TAG_LEN);
-  strncpy(hello.what, menuTask.getCurrentApp(), IFF_PAYLOAD);
+  strncpy(hello.what, menuTask.getCurrentApp(), IFF_PAYLOAD - 1);
+  hello.what[IFF_PAYLOAD - 1] = '\0';
   hello.timeSent = xTaskGetTickCount();
 
   // Fill in the GM wrapper
   pkt.pktType = GM_IFF;
   memcpy(pkt.dstAddr, broadcast, ADDR_LEN);
   memcpy(pkt.srcAddr, players[0].node, ADDR_LEN);
-  pkt.length = sizeof(iff_packet_t);
-  memcpy(pkt.payload, &hello, pkt.length);
+  pack(&pkt, &iffSchema, &hello);
 
   // Ship it!
   sendPkt(&pkt);
+  if (code == IFF_HELLO) lastHello = xTaskGetTickCount();
 }
 
 /*
@@ -367,41 +584,95 @@ void NetworkTask::sendIFF(uint8_t code) {
  *  field as the queue ID to send responses back to the requester.
  *  Network rendezvous is hard and this is a quick hack.
  */
-void NetworkTask::sendRSVP(const char *appRequest, uint8_t replyTo) {
+void NetworkTask::sendRSVP(const char *appRequest, uint8_t replyTo, uint16_t session) {
   gm_packet_t pkt;
   iff_packet_t rsvp;
 
   // Fill in the payload
   rsvp.type = IFF_RSVP;
   rsvp.reqId = replyTo;
+  rsvp.session = session;
   memcpy(rsvp.who, players[0].tag, GM_PLAYER_TAG_LEN);
-  strncpy(rsvp.what, appRequest, IFF_PAYLOAD);
+  strncpy(rsvp.what, appRequest, IFF_PAYLOAD - 1);
+  rsvp.what[IFF_PAYLOAD - 1] = '\0';
   rsvp.timeSent = xTaskGetTickCount();
 
   // Fill in the GM wrapper
   pkt.pktType = GM_RSVP;
   memcpy(pkt.dstAddr, broadcast, ADDR_LEN);
   memcpy(pkt.srcAddr, players[0].node, ADDR_LEN);
-  pkt.length = sizeof(iff_packet_t);
-  memcpy(pkt.payload, &rsvp, pkt.length);
+  pack(&pkt, &iffSchema, &rsvp);
 
   // Send it
   sendPkt(&pkt);
 }
 
+/*
+ *  Answer an RSVP, straight back to the queue that asked.
+ */
+void NetworkTask::sendReply(const gm_packet_t *rsvp, bool accept) {
+  gm_packet_t pkt;
+  iff_packet_t req, reply;
+
+  if (!unpack(rsvp, &iffSchema, &req)) return;
+
+  reply.type = accept ? IFF_ACCEPT : IFF_REJECT;
+  reply.reqId = req.reqId;
+  reply.session = req.session;
+  memcpy(reply.who, players[0].tag, GM_PLAYER_TAG_LEN);
+  memcpy(reply.what, req.what, IFF_PAYLOAD);
+  reply.timeSent = xTaskGetTickCount();
+
+  pkt.pktType = GM_IFF;
+  memcpy(pkt.dstAddr, rsvp->srcAddr, ADDR_LEN);
+  memcpy(pkt.srcAddr, players[0].node, ADDR_LEN);
+  pack(&pkt, &iffSchema, &reply);
+
+  sendPkt(&pkt);
+}
+
+/*
+ *  The running app changed: say so right away (from the caller's
+ *  task), and have the network task speed up beaconing for a bit.
+ */
+void NetworkTask::announce() {
+  if (!initialized) return;
+
+  sendIFF(IFF_HELLO);
+  appChanged = true;
+}
+
+/*
+ *  Tell everyone we're going away, so they can drop us from their
+ *  player tables now instead of after PLAYER_TIMEOUT.
+ */
+void NetworkTask::sendGoodbye() {
+  sendIFF(IFF_GOODBYE);
+}
+
 /*
  *  Decode and act on incoming IFF packets.
  */
 void NetworkTask::receiveIFF(QueueHandle_t q) {
   gm_packet_t pkt;
   iff_packet_t iff;
+  int p;
 
   if (!xQueueReceive(q, &(pkt), (TickType_t)0)) return;
 
+  // Session housekeeping comes in this way too
+  if (pkt.pktType == GM_SESSION) {
+    receiveSession(&pkt);
+    return;
+  }
+
   dprint("net: Received IFF: ");
 
   // Pull the IFF payload from the GM wrapper and see what to do with it
-  memcpy(&iff, pkt.payload, pkt.length);
+  if (!unpack(&pkt, &iffSchema, &iff)) {
+    dprintln("malformed, dropped");
+    return;
+  }
 
   switch (iff.type) {
     case IFF_HELLO:
@@ -409,14 +680,39 @@ void NetworkTask::receiveIFF(QueueHandle_t q) {
 
       if (strlen(iff.who) > 0) {
 
-        int playerNum = findPlayer(iff.who);
+        int playerNum = findNode(pkt.srcAddr);
         if (playerNum < 0) {
           // A new friend!  Add 'em
           playerNum = addPlayer(iff.who, pkt.srcAddr);
-          addPeer(pkt.srcAddr);
-        } else {
-          // An old friend!  Update 'em
+          if (playerNum > 0) {
+            players[playerNum].digest = iff.reqId;
+            players[playerNum].hops = pkt.hops;
+            if (pkt.hops == 0) heardFrom(pkt.srcAddr, &pkt);
+          }
+        } else if (playerNum > 0) {
+          // An old friend!  Update 'em (and pick up a new tag, if any)
           players[playerNum].lastSeen = xTaskGetTickCount();
+          if (strncmp(players[playerNum].tag, iff.who, GM_PLAYER_TAG_LEN) != 0) {
+            dprintf("net: Player '%s' is now '%s'\n", players[playerNum].tag, iff.who);
+            strncpy(players[playerNum].tag, iff.who, GM_PLAYER_TAG_LEN);
+          }
+
+          players[playerNum].hops = pkt.hops;
+
+          // Same view of the room as ours counts toward suppressing
+          // our next HELLO.  A different one means we should speak up
+          // anyway, and if it just changed, someone's catching up, so
+          // help them along.  (Relayed HELLOs are from another part of
+          // the room, so they don't count either way.)
+          if (pkt.hops == 0) {
+            if (iff.reqId == neighborhood) {
+              helloHeard++;
+            } else {
+              helloNeeded = true;
+              if (iff.reqId != players[playerNum].digest) helloReset();
+            }
+          }
+          players[playerNum].digest = iff.reqId;
         }
       } else {
         dprintln("net: Invalid player (name not set), ignored");
@@ -448,10 +744,29 @@ void NetworkTask::receiveIFF(QueueHandle_t q) {
       break;
 
     case IFF_GOODBYE:
-      dprintf("GOODBYE from %s (unimplemented)\n", iff.who);
-      // use this to delete a player/mac association
-      // if they are changing their name, we want to flush the old
-      // or they are just switching off or have timed out, battery died, ...
+      dprintf("GOODBYE from %s\n", iff.who);
+
+      // Switching off; forget them now rather than waiting them out
+      if (findNode(pkt.srcAddr) > 0) removePlayer(findNode(pkt.srcAddr));
+      break;
+
+    case IFF_PING:
+      dprintf("PING from %s\n", iff.who);
+
+      // Straight back, stamp and all
+      sendProbe(IFF_ECHO, pkt.srcAddr, iff.reqId, iff.timeSent);
+      break;
+
+    case IFF_ECHO:
+      dprintf("ECHO from %s\n", iff.who);
+
+      // Only the latest PING counts; a later echo was already a loss
+      p = findNode(pkt.srcAddr);
+      if (p > 0 && players[p].link.probeOut && iff.reqId == players[p].link.probeSeq) {
+        players[p].link.probeOut = false;
+        players[p].link.probesAnswered++;
+        rttSample(p, (uint32_t)micros() - (uint32_t)iff.timeSent);
+      }
       break;
 
     default:
@@ -461,6 +776,586 @@ void NetworkTask::receiveIFF(QueueHandle_t q) {
   }
 }
 
+/*
+ *  Start a session for an app (identified by its packet type) with us
+ *  as the host, for up to limit members (us included).  Returns the
+ *  session id to hand out to guests.
+ */
+uint16_t NetworkTask::hostSession(uint8_t app, int limit) {
+  uint16_t id = random(1, 65536);
+
+  xSemaphoreTake(sessionLock, portMAX_DELAY);
+  memset(&session, 0, sizeof(session));
+  session.id = id;
+  session.app = app;
+  session.count = 1;
+  session.limit = limit < SESSION_MAX_MEMBERS ? limit : SESSION_MAX_MEMBERS;
+  session.joined = true;
+  memcpy(session.members[0], players[0].node, ADDR_LEN);
+  xSemaphoreGive(sessionLock);
+
+  dprintf("net: Hosting session %04x (type %02x)\n", id, app);
+  return id;
+}
+
+/*
+ *  Ask a host to let us into their session.  We accept that session's
+ *  traffic from now on; sessionJoined() says when the host's roster
+ *  (with us on it) has come back.  The caller retries as it sees fit.
+ */
+bool NetworkTask::joinSession(uint16_t id, uint8_t app, const uint8_t *host) {
+
+  if (id == GM_NO_SESSION) return false;
+
+  xSemaphoreTake(sessionLock, portMAX_DELAY);
+  if (session.id != id) {
+    memset(&session, 0, sizeof(session));
+    session.id = id;
+    session.app = app;
+    session.count = 2;
+    session.limit = SESSION_MAX_MEMBERS;
+    memcpy(session.members[0], host, ADDR_LEN);
+    memcpy(session.members[1], players[0].node, ADDR_LEN);
+  }
+  xSemaphoreGive(sessionLock);
+
+  dprintf("net: Joining session %04x at %s\n", id, fmtMAC(host));
+  sendSessionCtl(SESS_JOIN, host);
+  return true;
+}
+
+/*
+ *  Tell the others we're going and stop taking session traffic.
+ */
+void NetworkTask::leaveSession() {
+
+  if (session.id == GM_NO_SESSION) return;
+
+  sendSessionCtl(SESS_LEAVE, NULL);
+
+  xSemaphoreTake(sessionLock, portMAX_DELAY);
+  dprintf("net: Left session %04x\n", session.id);
+  memset(&session, 0, sizeof(session));
+  xSemaphoreGive(sessionLock);
+}
+
+/*
+ *  Send a packet to the other members of our session.  A few members
+ *  get their own unicasts (acked and retried by the radio, and never
+ *  even seen by anyone else); more than SESSION_UNICAST_MAX share one
+ *  broadcast that outsiders drop on arrival.
+ */
+int NetworkTask::sendSession(gm_packet_t *pkt) {
+  uint8_t members[SESSION_MAX_MEMBERS][ADDR_LEN];
+  int count, result = ESP_OK;
+  bool far = false;
+
+  xSemaphoreTake(sessionLock, portMAX_DELAY);
+  pkt->session = session.id;
+  count = session.count;
+  memcpy(members, session.members, sizeof(members));
+  xSemaphoreGive(sessionLock);
+
+  if (pkt->session == GM_NO_SESSION) return ESP_ERR_ESPNOW_ARG;
+  memcpy(pkt->srcAddr, players[0].node, ADDR_LEN);
+
+  // Anyone who needs a relay to reach gets one relayed broadcast,
+  // rather than a relayed copy per member
+  for (int m = 0; relayMode && m < count; m++) {
+    if (memcmp(members[m], players[0].node, ADDR_LEN) != 0 && !neighbor(members[m])) far = true;
+  }
+
+  if (count - 1 > SESSION_UNICAST_MAX || far) {
+    memcpy(pkt->dstAddr, broadcast, ADDR_LEN);
+    return transmit(pkt);
+  }
+
+  for (int m = 0; m < count; m++) {
+    if (memcmp(members[m], players[0].node, ADDR_LEN) == 0) continue;
+
+    memcpy(pkt->dstAddr, members[m], ADDR_LEN);
+    int err = transmit(pkt);
+    if (err != ESP_OK) result = err;
+  }
+
+  return result;
+}
+
+uint16_t NetworkTask::getSession() {
+  return session.id;
+}
+
+bool NetworkTask::sessionJoined() {
+  return session.id != GM_NO_SESSION && session.joined;
+}
+
+bool NetworkTask::sessionHost() {
+  return session.id != GM_NO_SESSION && memcmp(session.members[0], players[0].node, ADDR_LEN) == 0;
+}
+
+int NetworkTask::sessionMembers() {
+  return session.count;
+}
+
+/*
+ *  Hold (and release) the locks that apps take when they send, so an
+ *  app can be suspended without freezing while it has one.  Nothing
+ *  holds one of them while waiting for the other, so the order only
+ *  has to match between callers of lock().
+ */
+void NetworkTask::lock() {
+  if (sessionLock) xSemaphoreTake(sessionLock, portMAX_DELAY);
+  if (peerLock) xSemaphoreTake(peerLock, portMAX_DELAY);
+}
+
+void NetworkTask::unlock() {
+  if (peerLock) xSemaphoreGive(peerLock);
+  if (sessionLock) xSemaphoreGive(sessionLock);
+}
+
+/*
+ *  Relay mode on or off, remembered across power cycles.
+ */
+void NetworkTask::setRelay(bool on) {
+  Preferences prefs;
+
+  relayMode = on;
+  if (prefs.begin(GM_NVM_KEY, false)) {
+    prefs.putBool("relay", on);
+    prefs.end();
+  }
+  Serial.printf("net: Relay mode %s\n", on ? "on" : "off");
+}
+
+bool NetworkTask::relaying() {
+  return relayMode;
+}
+
+/*
+ *  Round trips to everyone we hear directly, not just our session
+ *  (for the SysInfo network page, while it's up).
+ */
+void NetworkTask::probeAll(bool on) {
+  probeEveryone = on;
+}
+
+/*
+ *  (Internal) Is this unit in our session?
+ */
+bool NetworkTask::inSession(const uint8_t *mac) {
+  bool found = false;
+
+  if (!sessionLock) return false;
+  xSemaphoreTake(sessionLock, portMAX_DELAY);
+  for (int m = 0; m < session.count && !found; m++) {
+    found = memcmp(session.members[m], mac, ADDR_LEN) == 0;
+  }
+  xSemaphoreGive(sessionLock);
+
+  return found;
+}
+
+/*
+ *  (Internal) PING the next player due one, round robin.  A PING that
+ *  hasn't come back by the time the next one goes counts as lost.
+ */
+void NetworkTask::probeDue() {
+
+  for (int i = 1; i <= MAX_PLAYERS; i++) {
+    int p = (probeNext + i) % MAX_PLAYERS;
+    gm_link_t *l = &players[p].link;
+
+    if (p == 0 || !players[p].tag[0]) continue;
+    if (!(probeEveryone && players[p].hops == 0) && !inSession(players[p].node)) continue;
+
+    if (l->probeOut) l->probesLost++;
+    if (l->probesAnswered + l->probesLost > LINK_LOSS_WINDOW) {
+      l->probesAnswered /= 2;
+      l->probesLost /= 2;
+    }
+
+    l->probeOut = true;
+    sendProbe(IFF_PING, players[p].node, ++l->probeSeq, (int)micros());
+    probeNext = p;
+    return;
+  }
+}
+
+/*
+ *  (Internal) Unicast a PING, or the ECHO of one.  The stamp is the
+ *  pinger's micros(), and only means anything to them.
+ */
+void NetworkTask::sendProbe(uint8_t code, const uint8_t *dst, uint8_t seq, int stamp) {
+  gm_packet_t pkt;
+  iff_packet_t probe;
+
+  probe.type = code;
+  probe.reqId = seq;
+  probe.session = GM_NO_SESSION;
+  memcpy(probe.who, players[0].tag, GM_PLAYER_TAG_LEN);
+  probe.what[0] = '\0';
+  probe.timeSent = stamp;
+
+  pkt.pktType = GM_IFF;
+  memcpy(pkt.dstAddr, dst, ADDR_LEN);
+  memcpy(pkt.srcAddr, players[0].node, ADDR_LEN);
+  pack(&pkt, &iffSchema, &probe);
+
+  sendPkt(&pkt);
+}
+
+/*
+ *  (Internal) Fold in a round trip, smoothed as TCP does (RFC 6298),
+ *  and keep it for the percentile.
+ */
+void NetworkTask::rttSample(int p, uint32_t us) {
+  gm_link_t *l = &players[p].link;
+
+  if (l->srtt == 0) {
+    l->srtt = us ? us : 1;
+    l->rttvar = us / 2;
+  } else {
+    uint32_t err = us > l->srtt ? us - l->srtt : l->srtt - us;
+    l->rttvar += (int32_t)(err - l->rttvar) / 4;
+    l->srtt += (int32_t)(us - l->srtt) / 8;
+  }
+
+  l->rtt[l->rttNext] = us;
+  l->rttNext = (l->rttNext + 1) % LINK_RTT_SAMPLES;
+  if (l->rttCount < LINK_RTT_SAMPLES) l->rttCount++;
+}
+
+/*
+ *  How the link to a player is doing, for the SysInfo page or a game
+ *  that wants to adapt (send less, wait longer).  False if there's no
+ *  such player.  The network task keeps updating the numbers, so this
+ *  works from a copy.
+ */
+bool NetworkTask::getLinkStats(int id, gm_link_stats_t *stats) {
+  uint32_t sorted[LINK_RTT_SAMPLES];
+  gm_link_t l;
+  int n, heard, sent;
+
+  if (id <= 0 || id >= MAX_PLAYERS || !players[id].tag[0] || !stats) return false;
+
+  l = players[id].link;
+  n = l.rttCount;
+
+  // Insertion sort; there are only a handful
+  for (int i = 0; i < n; i++) {
+    uint32_t v = l.rtt[i];
+    int j = i;
+
+    for (; j > 0 && sorted[j - 1] > v; j--) sorted[j] = sorted[j - 1];
+    sorted[j] = v;
+  }
+
+  heard = l.seqHeard + l.seqMissed;
+  sent = l.probesAnswered + l.probesLost;
+
+  stats->rtt = l.srtt ? (int)l.srtt : -1;
+  stats->rttVar = l.srtt ? (int)l.rttvar : -1;
+  stats->rttP95 = n ? (int)sorted[(n * 95 + 99) / 100 - 1] : -1;
+  stats->rttSamples = n;
+  stats->loss = heard ? l.seqMissed * 100 / heard : -1;
+  stats->probeLoss = sent ? l.probesLost * 100 / sent : -1;
+  stats->rssi = l.rssi;
+  stats->txAcked = l.txAcked;
+  stats->txFailed = l.txFailed;
+  stats->hops = players[id].hops;
+  return true;
+}
+
+/*
+ *  (Internal) Track how well we hear a unit directly: every numbered
+ *  broadcast of theirs we missed (a gap in seq) pulls linkQ down by
+ *  1/LINK_EWMA, and every one that arrives pulls it back up.
+ */
+void NetworkTask::heardFrom(const uint8_t *mac, const gm_packet_t *pkt) {
+  int p = findNode(mac);
+  gm_player_t *pl;
+  uint16_t gap;
+
+  if (p <= 0 || !sequenced(pkt)) return;
+
+  pl = &players[p];
+  gap = pkt->seq - pl->lastSeq;
+
+  if (pl->lastDirect == 0) {
+    pl->linkQ = 128;    // no idea yet
+  } else if (gap == 0) {
+    return;
+  } else if (gap <= RELAY_SEQ_WINDOW) {
+    for (int i = 1; i < gap; i++) pl->linkQ -= pl->linkQ / LINK_EWMA;
+    pl->linkQ += (255 - pl->linkQ) / LINK_EWMA;
+    pl->link.seqMissed += gap - 1;
+  }
+
+  // (Bigger jumps: they rebooted, or we were away; start from here)
+  if (++pl->link.seqHeard + pl->link.seqMissed > LINK_LOSS_WINDOW) {
+    pl->link.seqHeard /= 2;
+    pl->link.seqMissed /= 2;
+  }
+  pl->lastSeq = pkt->seq;
+  pl->lastDirect = xTaskGetTickCount() | 1;
+}
+
+/*
+ *  (Internal) Can we reach this unit well without a relay?
+ */
+bool NetworkTask::neighbor(const uint8_t *mac) {
+  int p = findNode(mac);
+
+  if (p <= 0 || players[p].lastDirect == 0) return false;
+  if ((int)(xTaskGetTickCount() - players[p].lastDirect) > (int)pdMS_TO_TICKS(2 * IFF_KEEPALIVE)) return false;
+  return players[p].linkQ >= RELAY_GOOD_LINK;
+}
+
+/*
+ *  (Internal) Is this the first copy of a relayable packet we've seen?
+ *  Copies count against our own pending forward of it.  New ones are
+ *  remembered and, in relay mode, scheduled to go on.
+ */
+bool NetworkTask::relayFresh(const gm_frame_t *frame) {
+  const gm_packet_t *pkt = &frame->pkt;
+  int e;
+
+  // One of ours, back from a relay
+  if (memcmp(pkt->srcAddr, players[0].node, ADDR_LEN) == 0) return false;
+
+  for (e = 0; e < RELAY_CACHE; e++) {
+    gm_relay_t *r = &relayCache[e];
+
+    if (r->copies && r->seq == pkt->seq && memcmp(r->src, pkt->srcAddr, ADDR_LEN) == 0) {
+      if (r->copies < 255) r->copies++;
+      if (r->pending >= 0 && r->copies >= RELAY_REDUNDANCY) {
+        relayCancel(e);
+        pktStats[pktSuppressed]++;
+      }
+      return false;
+    }
+  }
+
+  // New one; it takes the oldest entry's place
+  e = relayNext;
+  relayNext = (relayNext + 1) % RELAY_CACHE;
+  relayCancel(e);
+  memcpy(relayCache[e].src, pkt->srcAddr, ADDR_LEN);
+  relayCache[e].seq = pkt->seq;
+  relayCache[e].copies = 1;
+
+  if (relayMode && pkt->ttl > 0 && memcmp(pkt->dstAddr, players[0].node, ADDR_LEN) != 0) relaySchedule(e, frame);
+  return true;
+}
+
+/*
+ *  (Internal) Queue a forward.  The worse we hear whoever we got it
+ *  from, the farther away we probably are, and the more new ground
+ *  our copy covers, so the sooner it goes.  Units close by wait long
+ *  enough to hear that and keep quiet.
+ */
+void NetworkTask::relaySchedule(int entry, const gm_frame_t *frame) {
+  int s, p, q = 128;
+
+  for (s = 0; s < RELAY_PENDING; s++) {
+    if (relayEntry[s] < 0) break;
+  }
+  if (s == RELAY_PENDING) {
+    dprintln("net: Relay backlog full");
+    return;
+  }
+
+  p = findNode(frame->from);
+  if (p > 0 && players[p].lastDirect) q = players[p].linkQ;
+
+  memcpy(&relayOut[s], &frame->pkt, sizeof(gm_packet_t));
+  relayOut[s].ttl--;
+  relayOut[s].hops++;
+  relayDue[s] = xTaskGetTickCount() + pdMS_TO_TICKS(RELAY_DELAY_MIN + q * RELAY_DELAY_SPAN / 256 + random(0, RELAY_JITTER + 1));
+  relayEntry[s] = entry;
+  relayCache[entry].pending = s;
+
+  relayFlush();
+}
+
+void NetworkTask::relayCancel(int entry) {
+  int s = relayCache[entry].pending;
+
+  if (s >= 0) relayEntry[s] = -1;
+  relayCache[entry].pending = -1;
+}
+
+/*
+ *  (Internal) Send the forwards that are due, and set the timer for
+ *  the next one.
+ */
+void NetworkTask::relayFlush() {
+  TickType_t now = xTaskGetTickCount();
+  int next = -1;
+
+  for (int s = 0; s < RELAY_PENDING; s++) {
+    if (relayEntry[s] < 0) continue;
+
+    if ((int)(relayDue[s] - now) <= 0) {
+      sendFrame(broadcast, &relayOut[s]);
+      pktStats[pktRelayed]++;
+      relayCache[relayEntry[s]].pending = -1;
+      relayEntry[s] = -1;
+    } else if (next < 0 || (int)(relayDue[s] - relayDue[next]) < 0) {
+      next = s;
+    }
+  }
+
+  if (next >= 0) {
+    timers.start(tmrRelay, (relayDue[next] - now) * portTICK_PERIOD_MS);
+  } else {
+    timers.cancel(tmrRelay);
+  }
+}
+
+/*
+ *  (Internal) Send a session control packet to one node, or to the
+ *  whole session if dst is NULL.
+ */
+void NetworkTask::sendSessionCtl(uint8_t code, const uint8_t *dst) {
+  gm_packet_t pkt;
+  session_packet_t ctl;
+
+  memset(&ctl, 0, sizeof(ctl));
+  ctl.type = code;
+
+  xSemaphoreTake(sessionLock, portMAX_DELAY);
+  ctl.app = session.app;
+  ctl.count = session.count;
+  memcpy(ctl.members, session.members, sizeof(ctl.members));
+  pkt.session = session.id;
+  xSemaphoreGive(sessionLock);
+
+  pkt.pktType = GM_SESSION;
+  memcpy(pkt.srcAddr, players[0].node, ADDR_LEN);
+  pack(&pkt, &sessionSchema, &ctl);
+
+  if (dst) {
+    memcpy(pkt.dstAddr, dst, ADDR_LEN);
+    transmit(&pkt);
+  } else {
+    sendSession(&pkt);
+  }
+}
+
+/*
+ *  Act on a JOIN, ROSTER or LEAVE for our session (it can't be for
+ *  anyone else's; those never got this far).
+ */
+void NetworkTask::receiveSession(gm_packet_t *pkt) {
+  session_packet_t ctl;
+  bool roster = false;
+
+  if (!unpack(pkt, &sessionSchema, &ctl)) return;
+
+  if (ctl.type == SESS_LEAVE) {
+    dprintf("net: %s left session %04x\n", fmtMAC(pkt->srcAddr), pkt->session);
+    dropMember(pkt->srcAddr);
+    return;
+  }
+
+  xSemaphoreTake(sessionLock, portMAX_DELAY);
+
+  if (pkt->session == GM_NO_SESSION || pkt->session != session.id) {
+    xSemaphoreGive(sessionLock);
+    return;
+  }
+
+  switch (ctl.type) {
+    case SESS_JOIN:
+      // Only the host takes new members; a repeat JOIN just gets the
+      // roster again (the last one must have been lost)
+      if (memcmp(session.members[0], players[0].node, ADDR_LEN) != 0) break;
+
+      roster = true;
+      for (int m = 0; m < session.count; m++) {
+        if (memcmp(session.members[m], pkt->srcAddr, ADDR_LEN) == 0) {
+          roster = false;
+          break;
+        }
+      }
+      if (roster) {
+        if (session.count >= session.limit) {
+          // Full up; they'll give up waiting for a roster
+          dprintf("net: Session %04x full, %s not added\n", session.id, fmtMAC(pkt->srcAddr));
+          roster = false;
+          break;
+        }
+        memcpy(session.members[session.count++], pkt->srcAddr, ADDR_LEN);
+        dprintf("net: %s joined session %04x (%d members)\n", fmtMAC(pkt->srcAddr), session.id, session.count);
+      }
+      roster = true;
+      break;
+
+    case SESS_ROSTER:
+      // Take the host's word for it, as long as we're on it
+      for (int m = 0; m < ctl.count && m < SESSION_MAX_MEMBERS; m++) {
+        if (memcmp(ctl.members[m], players[0].node, ADDR_LEN) == 0) {
+          memcpy(session.members, ctl.members, sizeof(session.members));
+          session.count = ctl.count;
+          session.joined = true;
+          break;
+        }
+      }
+      break;
+  }
+
+  xSemaphoreGive(sessionLock);
+
+  if (roster) sendSessionCtl(SESS_ROSTER, NULL);
+}
+
+/*
+ *  A member is gone.  If it was the host, the lowest remaining address
+ *  takes over; every member works that out the same way, so there's
+ *  nothing to negotiate, and the new host sends out the roster.
+ */
+void NetworkTask::dropMember(const uint8_t *mac) {
+  bool promoted = false;
+  int m;
+
+  if (!sessionLock) return;
+  xSemaphoreTake(sessionLock, portMAX_DELAY);
+
+  for (m = 0; m < session.count; m++) {
+    if (memcmp(session.members[m], mac, ADDR_LEN) == 0) break;
+  }
+
+  if (session.id == GM_NO_SESSION || m == session.count) {
+    xSemaphoreGive(sessionLock);
+    return;
+  }
+
+  memmove(session.members[m], session.members[m + 1], (session.count - m - 1) * ADDR_LEN);
+  session.count--;
+
+  if (m == 0 && session.count > 0) {
+    int lowest = 0;
+
+    for (int i = 1; i < session.count; i++) {
+      if (memcmp(session.members[i], session.members[lowest], ADDR_LEN) < 0) lowest = i;
+    }
+
+    uint8_t host[ADDR_LEN];
+    memcpy(host, session.members[lowest], ADDR_LEN);
+    memcpy(session.members[lowest], session.members[0], ADDR_LEN);
+    memcpy(session.members[0], host, ADDR_LEN);
+
+    promoted = memcmp(host, players[0].node, ADDR_LEN) == 0;
+    if (promoted) session.joined = true;
+    dprintf("net: Session %04x host is now %s\n", session.id, fmtMAC(host));
+  }
+
+  xSemaphoreGive(sessionLock);
+
+  if (promoted) sendSessionCtl(SESS_ROSTER, NULL);
+}
+
 /*
  *  Debugging output to serial port.
  */
@@ -472,7 +1367,26 @@ void NetworkTask::dumpStats() {
     Serial.printf("Wifi stats for %d active clients:\n", numClients);
     Serial.printf("  Sent:  %d success, %d fail\n", pktStats[pktTotalSent], pktStats[pktSendError]);
     Serial.printf("  Recv:  %d total, %d overflow\n", pktStats[pktTotalRecv], pktStats[pktRecvOverflow]);
-    Serial.printf("  Queue: %d dispatched, %d dropped\n", pktStats[pktDispatched], pktStats[pktDropped]);
+    Serial.printf("  Queue: %d dispatched, %d dropped, %d for other sessions\n", pktStats[pktDispatched],
+                  pktStats[pktDropped], pktStats[pktForeign]);
+
+    int known = 0, active = 0;
+    for (int p = 1; p < MAX_PLAYERS; p++) if (players[p].tag[0]) known++;
+    for (int i = 0; i < MAX_PEERS; i++) if (peers[i].inUse) active++;
+    Serial.printf("  Players: %d known, %d expired\n", known, playersExpired);
+    Serial.printf("  Peers: %d of %d, %d evicted\n", active, MAX_PEERS, peerEvictions);
+    Serial.printf("  HELLO: every %d ms, %d suppressed\n", helloInterval, helloSuppressed);
+    Serial.printf("  Relay: %s, %d forwarded, %d suppressed, %d duplicates\n", relayMode ? "on" : "off",
+                  pktStats[pktRelayed], pktStats[pktSuppressed], pktStats[pktDuplicate]);
+
+    // Links we've measured something about
+    for (int p = 1; p < MAX_PLAYERS; p++) {
+      gm_link_stats_t l;
+
+      if (!getLinkStats(p, &l) || (l.rttSamples == 0 && l.rssi == 0 && l.txAcked + l.txFailed == 0)) continue;
+      Serial.printf("  Link %s: rtt %d us (p95 %d), loss %d%%, ping loss %d%%, %d dBm, tx %d ok %d failed\n",
+                    players[p].tag, l.rtt, l.rttP95, l.loss, l.probeLoss, l.rssi, l.txAcked, l.txFailed);
+    }
   }
 }
 
@@ -485,71 +1399,285 @@ String NetworkTask::getPlayerName() {
 
 void NetworkTask::setPlayerName(char *name) {
   dprintf("net: setPlayerName to '%s'\n", name);
-  strncpy(players[0].tag, name, GM_PLAYER_TAG_LEN);
+  strncpy(players[0].tag, name, GM_PLAYER_TAG_LEN - 1);
+  players[0].tag[GM_PLAYER_TAG_LEN - 1] = '\0';
 }
 
 /*
- *  Search for a player and return their player number, -1 if not found.
+ *  Search for a player by tag and return their player number, -1 if
+ *  not found.  This walks the table; the packet path uses findNode().
  */
 int NetworkTask::findPlayer(char *name) {
 
   for (int p = 0; p < MAX_PLAYERS; p++) {
-    if (strncmp(players[p].tag, name, GM_PLAYER_TAG_LEN) == 0) return p;
+    if (players[p].tag[0] && strncmp(players[p].tag, name, GM_PLAYER_TAG_LEN) == 0) return p;
   }
 
   return -1;  // nope
 }
 
+/*
+ *  Directory index: FNV-1a over the MAC, linear probing.  The table is
+ *  twice the size of the directory so probes stay short.
+ */
+static inline uint32_t hashMAC(const uint8_t *mac) {
+  uint32_t h = 2166136261u;
+
+  for (int i = 0; i < ADDR_LEN; i++) {
+    h = (h ^ mac[i]) * 16777619u;
+  }
+  return h;
+}
+
+/*
+ *  Look up a player by node address: player number, or -1.  Called
+ *  from any task (and the send callback) while the NET task may be
+ *  adding or removing players.  Adding only fills an empty bucket, and
+ *  removing builds a new index, so whichever one we look at is whole.
+ */
+int NetworkTask::findNode(const uint8_t *mac) {
+  const int8_t *index = playerIndex;
+
+  for (int i = 0, b = hashMAC(mac) & (PLAYER_HASH - 1); i < PLAYER_HASH; i++, b = (b + 1) & (PLAYER_HASH - 1)) {
+    int p = index[b];
+
+    if (p < 0) break;
+    if (memcmp(players[p].node, mac, ADDR_LEN) == 0) return p;
+  }
+
+  return -1;
+}
+
+void NetworkTask::indexPlayer(int8_t *index, int p) {
+  int b = hashMAC(players[p].node) & (PLAYER_HASH - 1);
+
+  while (index[b] >= 0) b = (b + 1) & (PLAYER_HASH - 1);
+  index[b] = p;
+}
+
+/*
+ *  Deleting from a linear probe table leaves holes in other entries'
+ *  chains, and removals are rare, so just rebuild it: in the spare
+ *  copy, which then takes over in one store.
+ */
+void NetworkTask::reindexPlayers() {
+  int8_t *index = playerIndex == playerTables[0] ? playerTables[1] : playerTables[0];
+
+  memset(index, -1, PLAYER_HASH);
+  for (int p = 0; p < MAX_PLAYERS; p++) {
+    if (p == 0 || players[p].tag[0]) indexPlayer(index, p);
+  }
+  playerIndex = index;
+}
+
 gm_player_t *NetworkTask::getPlayer(int id) {
   if (id >= 0 && id < MAX_PLAYERS) {
     return &players[id];
   }
   return NULL;
 }
+
 /*
- *  Add a new network player if there's room.  Otherwise, flail.
+ *  Add a new network player.  If the table is full, the one we heard
+ *  from longest ago makes room, but only if they've missed a keepalive;
+ *  swapping out live players would just thrash the table (and the
+ *  HELLO rate along with it) in a room with more units than slots.
  */
 int NetworkTask::addPlayer(char *name, uint8_t *node) {
+  int p, oldest = 1;
 
   // Find the first slot where the name is null.  Player 0 is
   // this node, by convention/laziness
+  for (p = 1; p < MAX_PLAYERS; p++) {
+    if (strlen(players[p].tag) == 0) break;
+    if ((int)(players[p].lastSeen - players[oldest].lastSeen) < 0) oldest = p;
+  }
+
+  if (p == MAX_PLAYERS) {
+    if ((int)(xTaskGetTickCount() - players[oldest].lastSeen) <= (int)pdMS_TO_TICKS(IFF_KEEPALIVE)) {
+      dprintf("net: Player table full, '%s' not added\n", name);
+      return -1;
+    }
+    dprintf("net: Player table full, evicting '%s'\n", players[oldest].tag);
+    removePlayer(oldest);
+    p = oldest;
+  }
+
+  dprintf("net: Adding player '%s' (node %s) at id %d\n", name, fmtMAC(node), p);
+  strncpy(players[p].tag, name, GM_PLAYER_TAG_LEN);
+  memcpy(players[p].node, node, ADDR_LEN);
+  players[p].lastSeen = xTaskGetTickCount();
+  indexPlayer(playerIndex, p);
+  updateNeighborhood();
+  helloReset();
+
+  // They become an ESP-NOW peer when someone first sends to them
+  return p;
+}
+
+/*
+ *  Forget a player (they said GOODBYE, went quiet, or got bumped).
+ */
+void NetworkTask::removePlayer(int p) {
+
+  if (p <= 0 || p >= MAX_PLAYERS || !players[p].tag[0]) return;
+
+  dprintf("net: Removing player '%s' (node %s)\n", players[p].tag, fmtMAC(players[p].node));
+  dropPeer(players[p].node);
+  dropMember(players[p].node);
+  memset(&players[p], 0, sizeof(gm_player_t));
+  reindexPlayers();
+  updateNeighborhood();
+  helloReset();
+}
+
+/*
+ *  Drop anyone we haven't had a HELLO from in PLAYER_TIMEOUT.
+ */
+void NetworkTask::agePlayers() {
+  int now = xTaskGetTickCount();
+
   for (int p = 1; p < MAX_PLAYERS; p++) {
-    if (strlen(players[p].tag) == 0) {
-      dprintf("net: Adding player '%s' (node %s) at id %d\n", name, fmtMAC(node), p);
-      strncpy(players[p].tag, name, GM_PLAYER_TAG_LEN);
-      memcpy(players[p].node, node, ADDR_LEN);
-      players[p].lastSeen = xTaskGetTickCount();
-
-      // Add them as a network peer if they aren't there already
-      addPeer(players[p].node);
-      return p;
+    if (players[p].tag[0] && now - players[p].lastSeen > (int)pdMS_TO_TICKS(PLAYER_TIMEOUT)) {
+      removePlayer(p);
+      playersExpired++;
     }
   }
+}
 
-  dprintf("net: Failed to add player '%s', no empty slots!\n", name);
-  return -1;  // fix this if more GM hardware ever gets made :-)
+/*
+ *  An 8-bit, order-independent digest of every node address in the
+ *  directory (us included).  Units that can all hear each other end
+ *  up with the same one, which is what HELLO suppression checks.
+ */
+void NetworkTask::updateNeighborhood() {
+  uint32_t d = 0;
+
+  for (int p = 0; p < MAX_PLAYERS; p++) {
+    if (p == 0 || players[p].tag[0]) d ^= hashMAC(players[p].node);
+  }
+  neighborhood = d ^ (d >> 8) ^ (d >> 16) ^ (d >> 24);
+}
+
+/*
+ *  Trickle: something changed, so go back to beaconing fast (unless
+ *  we already are; resetting again would only add HELLOs).
+ */
+void NetworkTask::helloReset() {
+  if (helloInterval == IFF_IMIN) return;
+
+  helloInterval = IFF_IMIN;
+  helloStart();
 }
 
 /*
- *  Add a node address to the ESP-NOW peer list (so we can send
- *  packets to them directly, not just broadcasts).
+ *  Begin an interval: the HELLO goes out at a random point in its
+ *  second half, so the first half is for listening.
+ */
+void NetworkTask::helloStart() {
+  helloHeard = 0;
+  helloNeeded = false;
+  timers.start(tmrHello, helloInterval / 2 + random(helloInterval / 2));
+  timers.start(tmrInterval, helloInterval);
+}
+
+/*
+ *  Our slot in this interval came up: speak unless enough others
+ *  already said the same thing, or we'd go quiet too long by skipping.
+ */
+void NetworkTask::helloDue() {
+  TickType_t quiet = xTaskGetTickCount() - lastHello;
+
+  if (helloNeeded || helloHeard < IFF_REDUNDANCY || quiet + pdMS_TO_TICKS(IFF_IMAX * 3 / 2) > pdMS_TO_TICKS(IFF_KEEPALIVE)) {
+    sendIFF(IFF_HELLO);
+  } else {
+    helloSuppressed++;
+  }
+}
+
+/*
+ *  Make sure a node address is on the ESP-NOW peer list (so we can
+ *  send packets to them directly, not just broadcasts).  The radio
+ *  only holds so many, so when our slots are full the least recently
+ *  used peer is unregistered; it comes back the next time it's sent
+ *  to.  Called from any task that sends.
  */
 void NetworkTask::addPeer(const uint8_t *mac) {
+  int slot = -1, lru = 0;
+
+  if (!peerLock) return;
+  xSemaphoreTake(peerLock, portMAX_DELAY);
+
+  for (int i = 0; i < MAX_PEERS; i++) {
+    if (peers[i].inUse && memcmp(peers[i].node, mac, ADDR_LEN) == 0) {
+      peers[i].lastUsed = xTaskGetTickCount();
+      xSemaphoreGive(peerLock);
+      return;
+    }
+    if (!peers[i].inUse) {
+      if (slot < 0) slot = i;
+    } else if (peers[lru].inUse && (int)(peers[i].lastUsed - peers[lru].lastUsed) < 0) {
+      lru = i;
+    }
+  }
+
+  if (slot < 0) {
+    dprintf("net: Evicting peer %s\n", fmtMAC(peers[lru].node));
+    esp_now_del_peer(peers[lru].node);
+    peers[lru].inUse = false;
+    peerEvictions++;
+    slot = lru;
+  }
+
+  if (registerPeer(mac)) {
+    memcpy(peers[slot].node, mac, ADDR_LEN);
+    peers[slot].lastUsed = xTaskGetTickCount();
+    peers[slot].inUse = true;
+  }
+
+  xSemaphoreGive(peerLock);
+}
+
+/*
+ *  Unregister a peer now (rather than waiting for it to age out).
+ */
+void NetworkTask::dropPeer(const uint8_t *mac) {
+
+  if (!peerLock) return;
+  xSemaphoreTake(peerLock, portMAX_DELAY);
+
+  for (int i = 0; i < MAX_PEERS; i++) {
+    if (peers[i].inUse && memcmp(peers[i].node, mac, ADDR_LEN) == 0) {
+      esp_now_del_peer(mac);
+      peers[i].inUse = false;
+      dprintf("net: Dropped peer %s\n", fmtMAC(mac));
+      break;
+    }
+  }
+
+  xSemaphoreGive(peerLock);
+}
+
+/*
+ *  Hand an address to ESP-NOW, if it isn't there already.
+ */
+bool NetworkTask::registerPeer(const uint8_t *mac) {
   esp_now_peer_info_t p;
   esp_err_t err;
 
-  if (!esp_now_is_peer_exist(mac)) {
+  if (esp_now_is_peer_exist(mac)) return true;
 
-    memset(&p, 0, sizeof(esp_now_peer_info_t));  // work around bug in esp-now 2.x
-    memcpy(p.peer_addr, mac, ADDR_LEN);
+  memset(&p, 0, sizeof(esp_now_peer_info_t));  // work around bug in esp-now 2.x
+  memcpy(p.peer_addr, mac, ADDR_LEN);
 
-    err = esp_now_add_peer(&p);
-    if (err == ESP_OK) {
-      dprintf("net: Added peer %s\n", fmtMAC(mac));
-    } else {
-      Serial.printf("net: Error %d registering peer!\n", err);
-    }
+  err = esp_now_add_peer(&p);
+  if (err == ESP_OK) {
+    dprintf("net: Added peer %s\n", fmtMAC(mac));
+    return true;
   }
+
+  Serial.printf("net: Error %d registering peer!\n", err);
+  return false;
 }
 
 /*
@@ -564,55 +1692,136 @@ void NetworkTask::addPeer(const uint8_t *mac) {
  */
 void NetworkTask::run() {
 
-  esp_err_t err;
-  int lastHello = xTaskGetTickCount();
-  int lastStats = lastHello;
-
   Serial.printf("net: Task starting up on core %d\n", xPortGetCoreID());
 
+  begin();
+
+  // Main loop: sleep until a packet arrives or a timer is due
+  for (;;) {
+    poll(timers.ticksToNext());
+  }
+}
+
+/*
+ *  Create the packet queues, hook the receive callback and start the
+ *  housekeeping timers.  False if the network isn't usable.
+ */
+bool NetworkTask::begin() {
+
+  esp_err_t err;
+
   // Create the queue for incoming ESP-NOW packets
-  incoming = xQueueCreate(MAX_PENDING, sizeof(gm_packet_t));
+  incoming = xQueueCreate(MAX_PENDING, sizeof(gm_frame_t));
   if (!incoming) {
     Serial.println("net: Failed to create incoming packet queue!");
     initialized = false;
   }
 
   // Set up the global receive callback to actually catch them
+  radio = this;
   err = esp_now_register_recv_cb(recvCallback);
   if (err != ESP_OK) {
     Serial.printf("net: ERROR %d registering network receive callback!\n", err);
     initialized = false;
   }
 
+  // And the radio's word on how our unicasts went
+  err = esp_now_register_send_cb(sendCallback);
+  if (err != ESP_OK) {
+    Serial.printf("net: Error %d registering send callback\n", err);
+  }
+
+#if LINK_RSSI
+  // The ESP-NOW callback doesn't say how loud a frame was, but the
+  // promiscuous one does; ESP-NOW frames are management frames
+  wifi_promiscuous_filter_t sniff = { WIFI_PROMIS_FILTER_MASK_MGMT };
+
+  esp_wifi_set_promiscuous_filter(&sniff);
+  esp_wifi_set_promiscuous_rx_cb(sniffCallback);
+  if (esp_wifi_set_promiscuous(true) != ESP_OK) {
+    Serial.println("net: No promiscuous mode, so no RSSI");
+  }
+#endif
+
   // Set up a queue for IFF packets (handled here)
   int iffQId = createQueue();
 
-  if (addFilter(iffQId, GM_IFF) < 0) {
+  if (addFilter(iffQId, GM_IFF) < 0 || addFilter(iffQId, GM_SESSION) < 0) {
     Serial.println("net: ERROR adding IFF filter!?");
   }
 
   // And grab the actual queue handle
-  QueueHandle_t iffQueue = getHandle(iffQId);
+  iffQueue = getHandle(iffQId);
 
-  // Main loop
-  for (;;) {
+  // Periodic housekeeping
+  timers.start(tmrAge, IFF_AGE_INTERVAL, true);
+  timers.start(tmrStats, NET_STATS_INTERVAL, true);
+  timers.start(tmrProbe, LINK_PROBE_INTERVAL, true);
+  helloStart();
 
-    // Deal with pending packets (with blocking to avoid watchdogs)
-    dispatch();
+  return initialized;
+}
 
-    // Check our queue for local processing
-    receiveIFF(iffQueue);
+/*
+ *  One trip around the main loop.
+ */
+void NetworkTask::poll(TickType_t wait) {
+  int t;
 
-    // n seconds since last hello packet sent?
-    if (elapsed(IFF_INTERVAL, lastHello)) {
-      sendIFF(IFF_HELLO);
-      lastHello = xTaskGetTickCount();
-    }
+  // Deal with pending packets; sleep until one arrives or a timer is due
+  dispatch(wait);
 
-    // Debug: dump stats (less frequently)
-    if (elapsed(30000, lastStats)) {
-      dumpStats();
-      lastStats = xTaskGetTickCount();
+  // Check our queue for local processing
+  receiveIFF(iffQueue);
+
+  if (appChanged) {
+    appChanged = false;
+    helloReset();
+  }
+
+  while ((t = timers.expired()) != TMR_NONE) {
+    switch (t) {
+      case tmrHello:
+        helloDue();
+        break;
+
+      case tmrInterval:
+        // Quiet interval; back off
+        if ((helloInterval *= 2) > IFF_IMAX) helloInterval = IFF_IMAX;
+        helloStart();
+        break;
+
+      case tmrAge:
+        agePlayers();
+        break;
+
+      case tmrStats:
+        // Debug: dump stats (less frequently)
+        dumpStats();
+        break;
+
+      case tmrRelay:
+        relayFlush();
+        break;
+
+      case tmrProbe:
+        probeDue();
+        break;
     }
   }
 }
+
+/*
+ *  Counters (statCount) and the receive backlog, for the curious.
+ */
+int NetworkTask::getStat(int which) {
+  return (which >= 0 && which <= pktSuppressed) ? pktStats[which] : 0;
+}
+
+TickType_t NetworkTask::nextTimer() {
+  return timers.ticksToNext();
+}
+
+int NetworkTask::pending() {
+  return incoming ? uxQueueMessagesWaiting(incoming) : 0;
+}
@@ -17,7 +17,10 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <esp_now.h>
+#include <esp_wifi.h>
 #include "task.h"
+#include "timer.h"
+#include "wire.h"
 
 /*
  *  GM protocol identifiers
@@ -26,6 +29,9 @@
 #define GM_INVALID  0x00    // unknown or uninitialized
 #define GM_IFF      0x01    // network task coordination protocol
 #define GM_RSVP     0x02    // used by the menu to invite players
+#define GM_SESSION  0x03    // session membership (network task)
+#define GM_BENCH    0x0b    // benchmark pings and echoes
+#define GM_CAST     0x0c    // screen streaming to spectators (screencast.h)
 #define GM_TICTAC   0x10    // tic-tac-toe
 #define GM_BTLSHIP  0x42    // battleship game
 #define GM_MAZEWAR  0xa1    // multi-player mayhem
@@ -38,20 +44,83 @@
 #define GM_NVM_KEY  "GMan"        // namespace for saving preferences
 
 #define ADDR_LEN        6         // ESP_NOW_ETH_ALEN - 48-bit Ethernet-type MAC
-#define MAX_PKT_LEN   236         // ESP_NOW_MAX_DATA_LEN is 250, minus some GMpkt overhead
+#define MAX_PKT_LEN   230         // ESP_NOW_MAX_DATA_LEN is 250, minus some GMpkt overhead
+                                  // (only the header and length bytes of payload go on the air)
 #define MAX_PENDING    10         // incoming packet queue, adjust if needed
 #define MAX_CLIENTS     4         // how many network queues can we manage?
 #define MAX_FILTERS     5         // probably only one per app, realistically
-#define MAX_PLAYERS     5         // how many GM units can we talk to? (ESP-NOW limit is ~20)
+#define MAX_PLAYERS    32         // player directory size, including us in slot 0
+#define PLAYER_HASH    64         // directory index buckets (power of 2, > MAX_PLAYERS)
+#define MAX_PEERS      16         // unicast peers at once (ESP-NOW limit is 20, minus broadcast)
 
 typedef struct GMpkt {
-  uint8_t srcAddr[ADDR_LEN];      // MAC of this unit on transmit
+  uint8_t srcAddr[ADDR_LEN];      // MAC of this unit on transmit (the first one, if relayed)
   uint8_t dstAddr[ADDR_LEN];      // destination or all ff's for broadcast
   uint8_t pktType;                // 256 types oughtta be enough
   uint8_t length;                 // size of the payload portion
+  uint16_t session;               // GM_NO_SESSION, or the only session that wants it
+  uint16_t seq;                   // sender's broadcast count (relay duplicates, link quality)
+  uint8_t ttl;                    // relay hops it may still take (0: don't relay)
+  uint8_t hops;                   // relay hops it has taken
   uint8_t payload[MAX_PKT_LEN];   // user/game defined, max 250 bytes!
 } gm_packet_t;
 
+/*
+ *  Relay mode (optional, for spread-out venues): broadcasts, and
+ *  unicasts to anyone we can't hear well, go out with a TTL, and
+ *  units in relay mode repeat what they overhear.  Each relay waits a
+ *  little first - less the worse it hears the unit it got the packet
+ *  from, since a distant relay reaches the most new ground - and
+ *  stays quiet if RELAY_REDUNDANCY copies go by in the meantime.
+ *  Everyone drops copies they've already seen, by source and seq.
+ */
+#define RELAY_TTL          3      // hops a packet may take
+#define RELAY_HELLO_TTL    1      // ...or a HELLO/GOODBYE (enough to see round a wall)
+#define RELAY_REDUNDANCY   2      // copies heard (the first included) that make ours redundant
+#define RELAY_CACHE       48      // recent (source, seq) pairs remembered
+#define RELAY_PENDING      4      // forwards waiting on their delay
+#define RELAY_DELAY_MIN    1      // ms; plus up to RELAY_DELAY_SPAN by link quality
+#define RELAY_DELAY_SPAN   8
+#define RELAY_JITTER       3      // ms of random spread on top
+#define RELAY_GOOD_LINK   96      // linkQ (of 255) worth a direct unicast
+#define RELAY_SEQ_WINDOW  32      // bigger seq jumps restart the link estimate
+
+/*
+ *  Sessions: the units playing one game together.  Packets sent with
+ *  sendSession() carry the session id and go by unicast to each member
+ *  (or, for bigger sessions, one broadcast), and every unit that isn't
+ *  in that session throws them away in the radio callback, before
+ *  they're copied or queued.  Member 0 is the host; if the host leaves,
+ *  the member with the lowest address takes over.
+ */
+#define GM_NO_SESSION         0
+#define SESSION_MAX_MEMBERS   8
+#define SESSION_UNICAST_MAX   3   // more other members than this: broadcast instead
+
+#define SESS_JOIN   0x4a    // guest asks the host to be added
+#define SESS_ROSTER 0x52    // host tells everyone who's in
+#define SESS_LEAVE  0x4c    // member is leaving
+
+typedef struct session {
+  uint16_t id;                      // GM_NO_SESSION when not in one
+  uint8_t app;                      // the game's packet type
+  uint8_t count;                    // members, including us
+  uint8_t limit;                    // host: most members to take
+  bool joined;                      // we're on the host's roster
+  uint8_t members[SESSION_MAX_MEMBERS][ADDR_LEN];
+} gm_session_t;
+
+typedef struct SESSpkt {
+  uint8_t type;                     // SESS_* code above
+  uint8_t app;
+  uint8_t count;
+  uint8_t members[SESSION_MAX_MEMBERS][ADDR_LEN];  // ROSTER only, host first
+} session_packet_t;
+
+// Wire field ids (see wire.h; never reuse one)
+enum sessionField : uint8_t { sfType = 1, sfApp, sfCount, sfMembers };
+extern const wire_schema_t sessionSchema;
+
 /*
  *  Specific protocol id bytes used by the network/menu tasks.
  *  We just use the IFF packet type and codes for RSVPs too, but
@@ -65,25 +134,104 @@ typedef struct GMpkt {
 #define IFF_ACCEPT  0xac    // player responds affirmatively
 #define IFF_REJECT  0x86    // player responds negatively
 #define IFF_GOODBYE 0xbb    // this GM is going offline
+#define IFF_PING    0x50    // round trip probe (network task to network task)
+#define IFF_ECHO    0x45    // ...and its answer
 
 #define IFF_PAYLOAD   32    // context dependent
-#define IFF_INTERVAL  5000  // how often to send HELLO or RSVP broadcasts
+#define IFF_INTERVAL  5000  // how often to send RSVP broadcasts
+
+/*
+ *  HELLOs are paced Trickle-style: fast (every IFF_IMIN or so) when
+ *  the neighborhood changes, doubling up to IFF_IMAX while it's
+ *  stable, and skipped altogether in an interval where we've already
+ *  heard IFF_REDUNDANCY others with the same view of it.  Everyone
+ *  still speaks up at least every IFF_KEEPALIVE so they don't age out.
+ */
+#define IFF_IMIN        250   // ms, shortest beacon interval
+#define IFF_IMAX       4000   // ms, longest
+#define IFF_REDUNDANCY    3   // consistent HELLOs that suppress ours
+#define IFF_KEEPALIVE 20000   // ms, longest we stay quiet (keep well over IFF_IMAX)
+#define IFF_AGE_INTERVAL 1000 // ms between player table sweeps
+
+#define PLAYER_TIMEOUT (2 * IFF_KEEPALIVE + IFF_AGE_INTERVAL)  // forget players we haven't heard from
 
 typedef struct IFFpkt {
   uint8_t type;                 // IFF_* code above
-  uint8_t reqId;                // for RSVPs, who's asking?
+  uint8_t reqId;                // for RSVPs, who's asking? (HELLO: neighborhood digest)
+  uint16_t session;             // RSVP: the session to join
   char who[GM_PLAYER_TAG_LEN];  // tag/name of sender, if set (generated from MAC if not)
   char what[IFF_PAYLOAD];       // string identifying the app, or general
   int timeSent;                 // local time of sender for timing coordination
 } iff_packet_t;
 
+// Wire field ids (see wire.h; never reuse one)
+enum iffField : uint8_t { ifType = 1, ifReqId, ifSession, ifWho, ifWhat, ifTimeSent };
+extern const wire_schema_t iffSchema;
+
+/*
+ *  Link metrics, kept per player.  Round trips come from PINGs the
+ *  network task sends, one every LINK_PROBE_INTERVAL, round robin over
+ *  the other members of our session (and everyone we hear directly
+ *  while probeAll() is on), and the ECHOs that come straight back.
+ *  Loss is from gaps in their numbered broadcasts, RSSI is sniffed off
+ *  the radio in promiscuous mode (LINK_RSSI), and TX failures are the
+ *  radio's verdict on our unicasts to them once its retries run out.
+ */
+#define LINK_EWMA             8     // link quality smoothing (1/n per packet)
+#define LINK_PROBE_INTERVAL 500     // ms between PINGs
+#define LINK_RTT_SAMPLES     20     // round trips kept for the p95
+#define LINK_LOSS_WINDOW     64     // counts are halved past this, so they follow changes
+#define LINK_RSSI_EWMA        4     // RSSI smoothing (1/n per frame)
+#define LINK_RSSI             1     // 0: no promiscuous mode (no RSSI, but less radio work)
+
+typedef struct link {
+  uint32_t srtt;                // us, smoothed round trip (0: none yet)
+  uint32_t rttvar;              // us, its mean deviation
+  uint32_t rtt[LINK_RTT_SAMPLES];  // the last few round trips, us
+  uint8_t rttNext;
+  uint8_t rttCount;
+  uint8_t probeSeq;             // last PING sent them
+  bool probeOut;                // ...and it hasn't come back yet
+  uint16_t probesAnswered;
+  uint16_t probesLost;
+  uint16_t seqHeard;            // their numbered broadcasts we got
+  uint16_t seqMissed;           // ...and the ones we didn't
+  int8_t rssi;                  // dBm, smoothed (0: unknown)
+  uint32_t txAcked;             // our unicasts to them the radio got an ACK for
+  uint32_t txFailed;            // ...or gave up on
+} gm_link_t;
+
+typedef struct link_stats {
+  int rtt;                      // us, smoothed round trip (-1: not measured)
+  int rttVar;                   // us, its mean deviation
+  int rttP95;                   // us, 95th percentile of the last LINK_RTT_SAMPLES
+  int rttSamples;
+  int loss;                     // % of their recent broadcasts we missed (-1: none heard)
+  int probeLoss;                // % of recent PINGs that didn't come back (-1: none sent)
+  int rssi;                     // dBm (0: unknown)
+  int txAcked;
+  int txFailed;
+  int hops;                     // relays in between
+} gm_link_stats_t;
 
 typedef struct player {
   char tag[GM_PLAYER_TAG_LEN];  // who
   uint8_t node[ADDR_LEN];       // where last seen
   int lastSeen;                 // when last seen
+  uint8_t digest;               // their neighborhood, from their last HELLO
+  uint8_t hops;                 // relays between us, last time we heard
+  uint8_t linkQ;                // share of their broadcasts we hear directly, 0-255
+  uint16_t lastSeq;             // their last broadcast we heard directly
+  int lastDirect;               // when (0: never)
+  gm_link_t link;               // how well we're getting through
 } gm_player_t;
 
+typedef struct peer {
+  bool inUse;
+  uint8_t node[ADDR_LEN];       // registered with ESP-NOW
+  TickType_t lastUsed;          // for LRU eviction
+} gm_peer_t;
+
 
 typedef struct queue {
   bool inUse;                       // is this entry valid?
@@ -93,7 +241,25 @@ typedef struct queue {
   int numReceived;                  // total matching packets received (debug)
 } gm_packet_queue_t;
 
-enum statCount : byte { pktTotalSent, pktSendError, pktTotalRecv, pktRecvOverflow, pktDispatched, pktDropped };
+typedef struct frame {
+  uint8_t from[ADDR_LEN];           // who we heard it from (a relay, maybe)
+  int8_t rssi;                      // how loud, dBm (0: unknown)
+  gm_packet_t pkt;
+} gm_frame_t;
+
+typedef struct relay {
+  uint8_t src[ADDR_LEN];            // packet's source and seq
+  uint16_t seq;
+  uint8_t copies;                   // times we've heard it
+  int8_t pending;                   // our forward waiting in relayOut, or -1
+} gm_relay_t;
+
+enum statCount : byte { pktTotalSent, pktSendError, pktTotalRecv, pktRecvOverflow, pktDispatched, pktDropped, pktForeign,
+                        pktDuplicate, pktRelayed, pktSuppressed };
+
+enum netTimer : byte { tmrHello, tmrInterval, tmrAge, tmrStats, tmrRelay, tmrProbe };
+
+#define NET_STATS_INTERVAL 30000  // debug stats dump
 
 class NetworkTask : public GMTask {
   public:
@@ -101,6 +267,24 @@ class NetworkTask : public GMTask {
     void setup(bool rsvp) override;
     bool isRunning();
 
+    // The task body in pieces, so it can also be driven from outside
+    // (the host network simulator runs many instances this way):
+    // bring up the queues and timers, then handle one round of packets
+    // and timers at a time, waiting up to wait ticks for a packet
+    bool begin();
+    void poll(TickType_t wait);
+    TickType_t nextTimer();
+
+    // Take a frame off the air (the ESP-NOW callback lands here), the
+    // radio's verdict on a unicast we sent, and the signal strength of
+    // a frame from mac_addr that's about to arrive
+    void receive(const uint8_t *mac_addr, const uint8_t *data, int data_len);
+    void sendDone(const uint8_t *mac_addr, bool acked);
+    void signal(const uint8_t *mac_addr, int rssi);
+
+    int getStat(int which);
+    int pending();
+
     // Network stuff
     int createQueue(int maxDepth = 8);
     QueueHandle_t getHandle(int qId);
@@ -111,7 +295,33 @@ class NetworkTask : public GMTask {
 
     int sendPkt(gm_packet_t *pkt);
 
-    void sendRSVP(const char *appRequest, uint8_t replyTo);
+    // Encode a message into a packet's payload (and length), or decode
+    // one; false if it won't fit or doesn't parse.  See wire.h.
+    static bool pack(gm_packet_t *pkt, const wire_schema_t *schema, const void *msg);
+    static bool unpack(const gm_packet_t *pkt, const wire_schema_t *schema, void *msg);
+
+    void sendRSVP(const char *appRequest, uint8_t replyTo, uint16_t session = GM_NO_SESSION);
+    void sendReply(const gm_packet_t *rsvp, bool accept);
+    void sendGoodbye();
+    void announce();
+
+    // Session stuff
+    uint16_t hostSession(uint8_t app, int limit = SESSION_MAX_MEMBERS);
+    bool joinSession(uint16_t id, uint8_t app, const uint8_t *host);
+    void leaveSession();
+    int sendSession(gm_packet_t *pkt);
+    uint16_t getSession();
+    bool sessionJoined();
+    bool sessionHost();
+    int sessionMembers();
+
+    // Hold off every sender (the menu, around suspending an app)
+    void lock();
+    void unlock();
+
+    // Relay mode (saved in NVRAM)
+    void setRelay(bool on);
+    bool relaying();
 
     const uint8_t broadcast[ADDR_LEN] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
     static const char *fmtMAC(const uint8_t *mac);
@@ -122,37 +332,112 @@ class NetworkTask : public GMTask {
     String getNodeAddr();
     void setPlayerName(char *name);
     int findPlayer(char *name);
+    int findNode(const uint8_t *mac);
     gm_player_t *getPlayer(int id);
 
+    // Link metrics (see LINK_PROBE_INTERVAL); probeAll() measures round
+    // trips to everyone in range, not just our session
+    bool getLinkStats(int id, gm_link_stats_t *stats);
+    void probeAll(bool on);
+
   private:
     void run() override;
 
     // Callback to catch/filter/distribute incoming packets
     static void recvCallback(const uint8_t *mac_addr, const uint8_t *data, int data_len);
+    static void sendCallback(const uint8_t *mac_addr, esp_now_send_status_t status);
+    static void sniffCallback(void *buf, wifi_promiscuous_pkt_type_t type);
+    static NetworkTask *radio;      // the instance the callback feeds
 
-    static QueueHandle_t incoming;
-    static int pktStats[6];
+    QueueHandle_t incoming = 0;
+    QueueHandle_t iffQueue = 0;
+    int pktStats[pktSuppressed + 1];
 
-    void dispatch();
+    void dispatch(TickType_t wait);
+    int transmit(gm_packet_t *pkt);
+    int sendFrame(const uint8_t *dst, gm_packet_t *pkt);
     void addPeer(const uint8_t *mac);
+    bool registerPeer(const uint8_t *mac);
+    void dropPeer(const uint8_t *mac);
     void sendAccounting(esp_err_t err);
     void dumpStats();
 
     // GM protocol routines
     void sendIFF(uint8_t code);
     void receiveIFF(QueueHandle_t q);
+    void sendSessionCtl(uint8_t code, const uint8_t *dst);
+    void receiveSession(gm_packet_t *pkt);
+    void dropMember(const uint8_t *mac);
     
     bool initialized;
-    int lastHello;
+    GMTimers timers;
 
     // Preallocate a table of connections
     gm_packet_queue_t clients[MAX_CLIENTS];
     int numClients;
 
-    // Player info
+    // Player directory: slots, plus an open-addressed index by MAC (two
+    // copies, so a rebuild never shows a half-built one to a lookup)
     gm_player_t players[MAX_PLAYERS];
+    int8_t playerTables[2][PLAYER_HASH];
+    int8_t * volatile playerIndex;
+    int playersExpired;
 
     int addPlayer(char *name, uint8_t *node);
+    void removePlayer(int p);
+    void indexPlayer(int8_t *index, int p);
+    void reindexPlayers();
+    void agePlayers();
+
+    // HELLO pacing (see IFF_IMIN)
+    int helloInterval;              // current interval, ms
+    int helloHeard;                 // consistent HELLOs heard this interval
+    bool helloNeeded;               // someone sees the room differently
+    int helloSuppressed;
+    TickType_t lastHello;
+    uint8_t neighborhood;           // digest of the node addresses we know
+    volatile bool appChanged;
+
+    void updateNeighborhood();
+    void helloReset();
+    void helloStart();
+    void helloDue();
+
+    // Unicast peers registered with ESP-NOW, least recently used goes first
+    gm_peer_t peers[MAX_PEERS];
+    SemaphoreHandle_t peerLock = NULL;
+    int peerEvictions;
+
+    // Relaying (see RELAY_TTL)
+    bool relayMode;
+    uint16_t txSeq;
+    gm_relay_t relayCache[RELAY_CACHE];
+    int relayNext;
+    gm_packet_t relayOut[RELAY_PENDING];
+    TickType_t relayDue[RELAY_PENDING];
+    int8_t relayEntry[RELAY_PENDING];     // cache entry it belongs to, or -1
+
+    void heardFrom(const uint8_t *mac, const gm_packet_t *pkt);
+    bool neighbor(const uint8_t *mac);
+    bool relayFresh(const gm_frame_t *frame);
+    void relaySchedule(int entry, const gm_frame_t *frame);
+    void relayCancel(int entry);
+    void relayFlush();
+
+    // Link probing (see LINK_PROBE_INTERVAL)
+    volatile bool probeEveryone;
+    int probeNext;
+    uint8_t sniffFrom[ADDR_LEN];    // last frame the radio told us the RSSI of
+    int8_t sniffRSSI;
+
+    void probeDue();
+    bool inSession(const uint8_t *mac);
+    void sendProbe(uint8_t code, const uint8_t *dst, uint8_t seq, int stamp);
+    void rttSample(int p, uint32_t us);
+
+    // The session we're in (apps and the network task both change it)
+    gm_session_t session;
+    SemaphoreHandle_t sessionLock = NULL;
 
 };
 
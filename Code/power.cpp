@@ -0,0 +1,280 @@
+/*
+ *  power.cpp - Power manager
+ *
+ *  Abstract:
+ *      With CONFIG_PM_ENABLE the heavy lifting is done by esp_pm:
+ *      we configure DFS + automatic light sleep once and hold a pair
+ *      of PM locks (max CPU, no light sleep) during performance mode.
+ *      Without it (the stock Arduino core), we set the clock directly
+ *      and light sleep isn't available, so the estimates say so.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include "GameMan.h"
+#include "power.h"
+
+#ifdef CONFIG_PM_ENABLE
+#include "esp_wifi.h"
+#endif
+
+PowerManager::PowerManager() {
+}
+
+/*
+ *  Set up the idle power policy.  Called from the boot sequencer right
+ *  after the network comes up.
+ */
+void PowerManager::begin() {
+
+#ifdef CONFIG_PM_ENABLE
+  esp_pm_config_esp32_t cfg;
+  esp_err_t err;
+
+  cfg.max_freq_mhz = PWR_MAX_MHZ;
+  cfg.min_freq_mhz = PWR_MIN_MHZ;
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+  cfg.light_sleep_enable = true;
+#else
+  cfg.light_sleep_enable = false;
+#endif
+
+  err = esp_pm_configure(&cfg);
+  if (err != ESP_OK) {
+    Serial.printf("power: Error %d configuring power management\n", err);
+  } else {
+    autoSleep = cfg.light_sleep_enable;
+  }
+
+  speedLock = xSemaphoreCreateMutex();
+
+  esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "gm-perf", &cpuLock);
+  esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "gm-awake", &sleepLock);
+
+  setRadioNaps(autoSleep);
+#else
+  speedLock = xSemaphoreCreateMutex();
+  setCpuFrequencyMhz(PWR_MIN_MHZ);
+#endif
+
+  Serial.printf("power: %d-%d MHz, light sleep %s\n", PWR_MIN_MHZ, PWR_MAX_MHZ,
+                autoSleep ? "enabled" : "not available");
+}
+
+/*
+ *  (Internal) Let the radio doze between ESP-NOW wake windows, or
+ *  keep it listening all the time.
+ */
+void PowerManager::setRadioNaps(bool on) {
+
+#ifdef CONFIG_PM_ENABLE
+  if (on) {
+    esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+    esp_wifi_connectionless_module_set_wake_interval(PWR_WAKE_INTERVAL);
+    esp_now_set_wake_window(PWR_WAKE_WINDOW);
+  } else {
+    esp_wifi_set_ps(WIFI_PS_NONE);
+  }
+#endif
+}
+
+/*
+ *  (Internal) Switch between full speed and idling.
+ */
+void PowerManager::setSpeed(bool fast) {
+
+#ifdef CONFIG_PM_ENABLE
+  if (fast) {
+    if (cpuLock) esp_pm_lock_acquire(cpuLock);
+    if (sleepLock) esp_pm_lock_acquire(sleepLock);
+    if (autoSleep) setRadioNaps(false);
+  } else {
+    if (autoSleep) setRadioNaps(true);
+    if (sleepLock) esp_pm_lock_release(sleepLock);
+    if (cpuLock) esp_pm_lock_release(cpuLock);
+  }
+#else
+  setCpuFrequencyMhz(fast ? PWR_MAX_MHZ : PWR_MIN_MHZ);
+#endif
+
+  dprintf("power: Performance mode %s\n", fast ? "on" : "off");
+}
+
+/*
+ *  (Internal) Go to whatever speed the lock count and battery call
+ *  for.  Deciding and switching happen under one mutex, so a perfLock()
+ *  and a perfUnlock() racing on two tasks can't apply their switches in
+ *  the wrong order and leave us slow while the lock is held.
+ */
+void PowerManager::updateSpeed() {
+  bool want;
+
+  if (speedLock) xSemaphoreTake(speedLock, portMAX_DELAY);
+  want = perfCount > 0 && !lowBattery;
+  if (want != fullSpeed) {
+    setSpeed(want);
+    fullSpeed = want;
+  }
+  if (speedLock) xSemaphoreGive(speedLock);
+}
+
+/*
+ *  (Internal, under perfMux) The calling task's entry in the holder
+ *  table, or a free one if add; NULL if neither.
+ */
+pwr_holder_t *PowerManager::holder(TaskHandle_t task, bool add) {
+  pwr_holder_t *free = NULL;
+
+  for (int i = 0; i < PWR_MAX_HOLDERS; i++) {
+    if (holders[i].count && holders[i].task == task) return &holders[i];
+    if (!holders[i].count && !free) free = &holders[i];
+  }
+
+  if (add && free) free->task = task;
+  return add ? free : NULL;
+}
+
+/*
+ *  Take/release the performance lock.  The first taker speeds us up,
+ *  the last one out lets us slow down (and doze) again.  On a low
+ *  battery the lock is still counted but doesn't do anything.  Each
+ *  task's share is counted in the same step, so if the task is killed
+ *  releaseLocks() knows exactly what it held.
+ */
+void PowerManager::perfLock() {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  pwr_holder_t *h;
+
+  portENTER_CRITICAL(&perfMux);
+  h = holder(self, true);
+  if (h) {
+    h->count++;
+    perfCount++;
+  }
+  portEXIT_CRITICAL(&perfMux);
+
+  if (!h) {
+    Serial.println("power: Too many perfLock() holders!");
+    return;
+  }
+
+  updateSpeed();
+}
+
+void PowerManager::perfUnlock() {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  pwr_holder_t *h;
+
+  portENTER_CRITICAL(&perfMux);
+  h = holder(self, false);
+  if (h) {
+    h->count--;
+    perfCount--;
+  }
+  portEXIT_CRITICAL(&perfMux);
+
+  if (!h) {
+    Serial.println("power: Unbalanced perfUnlock()!");
+    return;
+  }
+
+  updateSpeed();
+}
+
+/*
+ *  Drop every performance lock a task holds (the menu, when it kills
+ *  an app that was frozen by the home button).  Returns how many.
+ */
+int PowerManager::releaseLocks(TaskHandle_t task) {
+  pwr_holder_t *h;
+  int n = 0;
+
+  if (!task) return 0;
+
+  portENTER_CRITICAL(&perfMux);
+  h = holder(task, false);
+  if (h) {
+    n = h->count;
+    perfCount -= n;
+    h->count = 0;
+  }
+  portEXIT_CRITICAL(&perfMux);
+
+  if (n) {
+    dprintf("power: Released %d perf lock%s\n", n, n == 1 ? "" : "s");
+    updateSpeed();
+  }
+  return n;
+}
+
+/*
+ *  Hold off speed changes (the menu, around suspending an app), so an
+ *  app is never frozen halfway through one holding speedLock.
+ */
+void PowerManager::lock() {
+  if (speedLock) xSemaphoreTake(speedLock, portMAX_DELAY);
+}
+
+void PowerManager::unlock() {
+  if (speedLock) xSemaphoreGive(speedLock);
+}
+
+/*
+ *  Called by the battery task when the charge crosses the low mark.
+ *  If a game is holding the performance lock, it loses (or gets back)
+ *  the speed boost right away.
+ */
+void PowerManager::setLowBattery(bool low) {
+  if (low == lowBattery) return;
+
+  lowBattery = low;
+  updateSpeed();
+}
+
+bool PowerManager::isLowBattery() {
+  return lowBattery;
+}
+
+bool PowerManager::isPerformance() {
+  return perfCount > 0;
+}
+
+bool PowerManager::canSleep() {
+  return autoSleep;
+}
+
+/*
+ *  Estimated draw (mA) sitting idle on a menu or waiting for a player.
+ *  With light sleep the radio listens for its wake window and the
+ *  chip sleeps the rest; without it the radio is always on and the CPU
+ *  just ticks over at the low clock.
+ */
+float PowerManager::idleCurrent() {
+
+  if (autoSleep) {
+    float duty = (float)PWR_WAKE_WINDOW / PWR_WAKE_INTERVAL;
+    return duty * (PWR_MA_RADIO_RX + PWR_MA_CPU_MIN) + (1.0 - duty) * PWR_MA_LIGHT;
+  }
+
+  return PWR_MA_RADIO_RX + PWR_MA_CPU_MIN;
+}
+
+/*
+ *  How long before a button press is noticed by a blocked task: the
+ *  light sleep exit if we sleep, otherwise next to nothing (clock
+ *  switching is instant as far as a human is concerned).
+ */
+uint32_t PowerManager::wakeLatencyUs() {
+  return autoSleep ? PWR_LIGHT_WAKE_US : 0;
+}
+
+/*
+ *  Longest stretch the radio is deaf between wake windows.  Anything
+ *  sent then is missed unless the sender retries, so periodic traffic
+ *  (HELLOs, RSVPs) should repeat at least this often.
+ */
+uint32_t PowerManager::radioGapMs() {
+  return autoSleep ? PWR_WAKE_INTERVAL - PWR_WAKE_WINDOW : 0;
+}
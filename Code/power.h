@@ -0,0 +1,102 @@
+/*
+ *  power.h - Power manager
+ *
+ *  Abstract:
+ *      Keeps the console as slow and as asleep as it can get away
+ *      with.  Where the ESP-IDF power management layer is built in
+ *      (CONFIG_PM_ENABLE) the CPU scales between PWR_MIN_MHZ and
+ *      PWR_MAX_MHZ on its own and drops into light sleep whenever
+ *      every task is blocked, with the radio waking on a fixed
+ *      schedule so ESP-NOW still works.  Otherwise we just clock
+ *      down to PWR_MIN_MHZ.  Either way, a game in active play
+ *      takes the "performance" lock to get full speed (and a radio
+ *      that never naps) until it lets go.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_POWER_H_
+#define _GM_POWER_H_
+
+#include <Arduino.h>
+
+#ifdef CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+#define PWR_MAX_MHZ       240   // performance lock (and DFS ceiling)
+#define PWR_MIN_MHZ       80    // lowest clock the radio is happy with
+#define PWR_MAX_HOLDERS   4     // tasks holding the performance lock at once
+
+// ESP-NOW wake schedule while light sleeping: the radio listens for
+// PWR_WAKE_WINDOW out of every PWR_WAKE_INTERVAL ms
+#define PWR_WAKE_INTERVAL 200
+#define PWR_WAKE_WINDOW   50
+
+/*
+ *  Rough current draw (mA) of the ESP32 module alone -- no display --
+ *  from the datasheet, for the idle estimate in SysInfo.
+ */
+#define PWR_MA_CPU_MAX    50.0  // CPU busy at 240MHz
+#define PWR_MA_CPU_MIN    20.0  // CPU at 80MHz
+#define PWR_MA_RADIO_RX   95.0  // radio listening
+#define PWR_MA_LIGHT      0.8   // light sleep
+#define PWR_LIGHT_WAKE_US 1000  // light sleep exit, ballpark
+
+// Who holds the performance lock, and how many times over
+typedef struct pwrHolder {
+  TaskHandle_t task;
+  int count;
+} pwr_holder_t;
+
+class PowerManager {
+public:
+  PowerManager();
+
+  // Call once ESP-NOW is up (the wake schedule needs the radio)
+  void begin();
+
+  // Full speed for games in active play; nests, so pair them up
+  void perfLock();
+  void perfUnlock();
+  bool isPerformance();
+
+  // For the menu, when it kills an app: hold off speed changes while
+  // it's frozen, then drop whatever performance locks it had
+  void lock();
+  void unlock();
+  int releaseLocks(TaskHandle_t task);
+
+  // Low battery: no more full speed, and the display gives up sooner
+  void setLowBattery(bool low);
+  bool isLowBattery();
+
+  // For SysInfo: what idling costs us and how long waking takes
+  bool canSleep();
+  float idleCurrent();
+  uint32_t wakeLatencyUs();
+  uint32_t radioGapMs();
+
+private:
+  volatile int perfCount = 0;
+  pwr_holder_t holders[PWR_MAX_HOLDERS] = {};
+  portMUX_TYPE perfMux = portMUX_INITIALIZER_UNLOCKED;
+  bool autoSleep = false;       // light sleep actually configured?
+  volatile bool lowBattery = false;
+  bool fullSpeed = false;       // speed last set (under speedLock)
+  SemaphoreHandle_t speedLock = NULL;
+
+#ifdef CONFIG_PM_ENABLE
+  esp_pm_lock_handle_t cpuLock = NULL;
+  esp_pm_lock_handle_t sleepLock = NULL;
+#endif
+
+  void setRadioNaps(bool on);
+  void setSpeed(bool fast);
+  void updateSpeed();
+  pwr_holder_t *holder(TaskHandle_t task, bool add);
+};
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ *  prof.cpp - Scoped cycle-count profiling
+ *
+ *  Abstract:
+ *      The histogram trades precision for a fixed 128 bytes per zone:
+ *      each bucket is a power of two wide, so p99 is only good to a
+ *      factor of two (it's reported as the top of its bucket, but
+ *      never more than the true max).  That's enough to tell a 2ms
+ *      flush from a 20ms one, which is the question we keep asking.
+ *
+ *      Times are in CPU cycles, not microseconds: with dynamic
+ *      frequency scaling on, the clock a zone ran at isn't known
+ *      afterwards, and cycles are what the work actually cost.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include "GameMan.h"
+#include "prof.h"
+
+prof_zone_t Profiler::zones[pzZoneCount];
+portMUX_TYPE Profiler::profLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Names for the dump and SysInfo, in profZone order
+static const char *zoneNames[] = {
+  "menu",
+  "ttt",
+  "net",
+  "flush",
+};
+
+static_assert(sizeof(zoneNames) / sizeof(zoneNames[0]) == pzZoneCount, "profZone and zoneNames disagree");
+
+void Profiler::record(uint8_t zone, uint32_t cycles) {
+  int b = 31 - __builtin_clz(cycles | 1);
+  prof_zone_t *z = &zones[zone];
+
+  portENTER_CRITICAL(&profLock);
+
+  if (z->count == 0 || cycles < z->min) z->min = cycles;
+  if (cycles > z->max) z->max = cycles;
+  z->total += cycles;
+  z->count++;
+  z->hist[b]++;
+
+  portEXIT_CRITICAL(&profLock);
+}
+
+void Profiler::migrated(uint8_t zone) {
+  portENTER_CRITICAL(&profLock);
+  zones[zone].migrated++;
+  portEXIT_CRITICAL(&profLock);
+}
+
+void Profiler::reset() {
+  portENTER_CRITICAL(&profLock);
+  memset(zones, 0, sizeof(zones));
+  portEXIT_CRITICAL(&profLock);
+}
+
+bool Profiler::summarize(uint8_t zone, prof_summary_t *out) {
+  prof_zone_t z;
+
+  if (zone >= pzZoneCount) return false;
+
+  // Copy it out so the arithmetic isn't done with interrupts off
+  portENTER_CRITICAL(&profLock);
+  z = zones[zone];
+  portEXIT_CRITICAL(&profLock);
+
+  memset(out, 0, sizeof(*out));
+  out->name = zoneNames[zone];
+  out->migrated = z.migrated;
+  if (z.count == 0) return false;
+
+  out->count = z.count;
+  out->min = z.min;
+  out->max = z.max;
+  out->avg = z.total / z.count;
+
+  // Walk up the buckets until 99% of the samples are below us
+  uint32_t want = z.count - z.count / 100;
+  uint32_t seen = 0;
+
+  for (int b = 0; b < PROF_BUCKETS; b++) {
+    seen += z.hist[b];
+    if (seen >= want) {
+      uint32_t top = (b == 31) ? 0xffffffff : (2UL << b) - 1;
+      out->p99 = top < z.max ? top : z.max;
+      break;
+    }
+  }
+
+  return true;
+}
+
+const char *Profiler::format(uint32_t cycles, char *buf, size_t len) {
+  if (cycles < 1000) {
+    snprintf(buf, len, "%u", (unsigned)cycles);
+  } else if (cycles < 1000000) {
+    snprintf(buf, len, "%uk", (unsigned)(cycles / 1000));
+  } else if (cycles < 10000000) {
+    snprintf(buf, len, "%u.%uM", (unsigned)(cycles / 1000000), (unsigned)(cycles / 100000 % 10));
+  } else {
+    snprintf(buf, len, "%uM", (unsigned)(cycles / 1000000));
+  }
+  return buf;
+}
+
+void Profiler::dump() {
+  prof_summary_t s;
+
+  Serial.printf("prof: cycles, CPU now at %u MHz\n", (unsigned)getCpuFrequencyMhz());
+  Serial.println("prof: zone        count        min        avg        p99        max");
+
+  for (int i = 0; i < pzZoneCount; i++) {
+    bool any = summarize(i, &s);
+
+    if (s.migrated) Serial.printf("prof: %-6s %u scopes moved cores (not counted)\n", s.name, (unsigned)s.migrated);
+    if (!any) {
+      Serial.printf("prof: %-6s %10s\n", s.name, "-");
+      continue;
+    }
+
+    Serial.printf("prof: %-6s %10u %10u %10u %10u %10u\n", s.name, (unsigned)s.count,
+                  (unsigned)s.min, (unsigned)s.avg, (unsigned)s.p99, (unsigned)s.max);
+
+    // Histogram, one "2^n:count" per non-empty bucket
+    Serial.printf("prof: %-6s", s.name);
+    for (int b = 0; b < PROF_BUCKETS; b++) {
+      if (zones[i].hist[b]) Serial.printf(" 2^%d:%u", b, (unsigned)zones[i].hist[b]);
+    }
+    Serial.println();
+  }
+}
@@ -0,0 +1,117 @@
+/*
+ *  prof.h - Scoped cycle-count profiling
+ *
+ *  Abstract:
+ *      Times named stretches of code ("zones") with the CPU cycle
+ *      counter.  PROF_SCOPE(zone) at the top of a block reads CCOUNT
+ *      on the way in and again when the block exits, and adds the
+ *      difference to that zone's totals and a log2 histogram, from
+ *      which min/avg/p99/max come out.  Zone ids are an enum, so a
+ *      scope compiles down to two register reads and one short
+ *      critical section; with PROF_ENABLE 0 it compiles to nothing
+ *      and the zones can stay in shipping code.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_PROF_H_
+#define _GM_PROF_H_
+
+#include <Arduino.h>
+
+#define PROF_ENABLE   1       // 0 compiles every PROF_SCOPE() out
+#define PROF_BUCKETS  32      // bucket n counts times in [2^n, 2^(n+1)) cycles
+
+/*
+ *  Zone ids.  Add new ones at the end, with a name in prof.cpp.
+ */
+enum profZone : uint8_t {
+  pzMenuRedraw,       // MenuTask::redrawMenu()
+  pzTttDraw,          // TicTacToe::drawScreen()
+  pzNetDispatch,      // NetworkTask::dispatch(), once a packet is in hand
+  pzDisplayFlush,     // framebuffer push to the panel
+  pzZoneCount
+};
+
+// Running totals for one zone
+typedef struct profZoneData {
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t total;
+  uint32_t migrated;            // scopes that ended on the other core
+  uint32_t hist[PROF_BUCKETS];
+} prof_zone_t;
+
+// What gets reported for a zone (all in cycles)
+typedef struct profSummary {
+  const char *name;
+  uint32_t count;
+  uint32_t min;
+  uint32_t avg;
+  uint32_t p99;                 // upper edge of the bucket holding the 99th
+  uint32_t max;
+  uint32_t migrated;
+} prof_summary_t;
+
+class Profiler {
+public:
+  // Add one timing to a zone (called by ProfScope)
+  static void record(uint8_t zone, uint32_t cycles);
+  static void migrated(uint8_t zone);
+
+  // Reduce a zone to min/avg/p99/max; false if it has no samples
+  bool summarize(uint8_t zone, prof_summary_t *out);
+
+  // Start every zone over
+  void reset();
+
+  // Print all the zones, with histograms, to the serial console
+  void dump();
+
+  // Squeeze a cycle count into 4 characters ("850", "12k", "3.4M")
+  static const char *format(uint32_t cycles, char *buf, size_t len);
+
+private:
+  static prof_zone_t zones[pzZoneCount];
+  static portMUX_TYPE profLock;
+};
+
+/*
+ *  CCOUNT is per core, so a scope that gets switched across cores
+ *  can't be timed; it's counted as migrated instead.  GameMan tasks
+ *  are all pinned, so that should stay at zero.
+ */
+template <uint8_t Zone>
+class ProfScope {
+  static_assert(Zone < pzZoneCount, "unknown profiling zone");
+
+public:
+  inline ProfScope() : core(xPortGetCoreID()), start(ESP.getCycleCount()) {}
+
+  inline ~ProfScope() {
+    uint32_t end = ESP.getCycleCount();
+
+    if (xPortGetCoreID() == core) {
+      Profiler::record(Zone, end - start);
+    } else {
+      Profiler::migrated(Zone);
+    }
+  }
+
+private:
+  BaseType_t core;
+  uint32_t start;
+};
+
+#if PROF_ENABLE
+#define PROF_CAT2(a, b)   a##b
+#define PROF_CAT(a, b)    PROF_CAT2(a, b)
+#define PROF_SCOPE(zone)  ProfScope<zone> PROF_CAT(_profScope, __LINE__)
+#else
+#define PROF_SCOPE(zone)  do { } while (0)
+#endif
+
+#endif
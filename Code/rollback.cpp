@@ -0,0 +1,354 @@
+/*
+ *  rollback.cpp - Input exchange, prediction and rollback for lockstep games
+ *
+ *  Abstract:
+ *      Keeps every player's inputs by frame, what we guessed for the
+ *      ones that hadn't arrived, and the state before each recent
+ *      frame, so a wrong guess can be undone and the frames since run
+ *      again with the real input.  See rollback.h.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include "rollback.h"
+
+static const uint8_t lockBroadcast[ADDR_LEN] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+static const wire_field_t lockFields[] = {
+  WIRE_FIELD(lfType,      wkUint,  lock_packet_t, type),
+  WIRE_FIELD(lfPlayer,    wkUint,  lock_packet_t, player),
+  WIRE_FIELD(lfFirst,     wkInt,   lock_packet_t, first),
+  WIRE_FIELD(lfCount,     wkUint,  lock_packet_t, count),
+  WIRE_FIELD(lfHeard,     wkInt,   lock_packet_t, heard),
+  WIRE_FIELD(lfFrame,     wkInt,   lock_packet_t, frame),
+  WIRE_FIELD(lfSyncFrame, wkInt,   lock_packet_t, syncFrame),
+  WIRE_FIELD(lfSyncCrc,   wkUint,  lock_packet_t, syncCrc),
+  WIRE_FIELD(lfInputs,    wkBytes, lock_packet_t, inputs),
+  WIRE_FIELD(lfLead,      wkInt,   lock_packet_t, lead),
+};
+static const wire_schema_t lockSchema = WIRE_SCHEMA(1, lock_packet_t, lockFields);
+
+Rollback::Rollback() {
+  state = NULL;
+  size = 0;
+  players = 0;
+}
+
+/*
+ *  Every unit calls this with the same (freshly set up) state and
+ *  player count; me is our own player number, 0 to players - 1.
+ */
+bool Rollback::begin(uint8_t type, void *st, int sz, int count, int player, const uint8_t *mac) {
+
+  if (sz <= 0 || sz > LOCK_MAX_STATE || count < 1 || count > LOCK_MAX_PLAYERS || player >= count) {
+    Serial.printf("lock: Can't do %d players (%d bytes of state)!\n", count, sz);
+    return false;
+  }
+
+  pktType = type;
+  state = (uint8_t *)st;
+  size = sz;
+  players = count;
+  me = player;
+  memcpy(self, mac, ADDR_LEN);
+
+  memset(inputFrame, 0xff, sizeof(inputFrame));
+  memset(crcFrame, 0xff, sizeof(crcFrame));
+
+  // Nobody has input for the first frames (that's the delay), so
+  // they're known to be nothing
+  for (int p = 0; p < players; p++) {
+    for (int32_t f = 0; f < LOCK_INPUT_DELAY; f++) {
+      input[p][f % LOCK_RING] = 0;
+      inputFrame[p][f % LOCK_RING] = f;
+    }
+    known[p] = LOCK_INPUT_DELAY;
+    peerHeard[p] = 0;
+    peerFrame[p] = 0;
+    peerLead[p] = 0;
+    peerSyncFrame[p] = -1;
+  }
+  localNext = LOCK_INPUT_DELAY;
+
+  now = 0;
+  replay = 0;
+  rewindTo = -1;
+  stepping = false;
+  nextCheck = 0;
+  sendDue = false;
+
+  memset(&stats, 0, sizeof(stats));
+  stats.firstDesync = -1;
+  return true;
+}
+
+/*
+ *  Our input, sampled now, is for LOCK_INPUT_DELAY frames from now.
+ */
+void Rollback::setLocal(uint8_t in) {
+
+  while (localNext <= now + LOCK_INPUT_DELAY) {
+    store(me, localNext++, in);
+  }
+}
+
+/*
+ *  Call until it returns false, simulating one frame with the given
+ *  inputs (one per player) each time.  It first takes the state back
+ *  and replays, if an input we guessed has turned out different,
+ *  then advances a frame unless we're too far ahead of the others.
+ */
+bool Rollback::step(uint8_t *inputs) {
+  int32_t f;
+
+  if (!state) return false;
+
+  if (!stepping) {
+    stepping = true;
+    advanced = false;
+    replay = now;
+
+    if (rewindTo >= 0) {
+      memcpy(state, saved[rewindTo % LOCK_SAVES], size);
+      stats.rollbacks++;
+      if (now - rewindTo > stats.deepest) stats.deepest = now - rewindTo;
+      replay = rewindTo;
+      rewindTo = -1;
+    }
+  }
+
+  if (replay < now) {
+    f = replay++;
+    stats.resimulated++;
+  } else if (!advanced && now - confirmed() < LOCK_MAX_ROLLBACK) {
+    f = now++;
+    replay = now;
+    advanced = true;
+    stats.frames++;
+  } else {
+    if (!advanced) stats.stalls++;
+    stepping = false;
+    record();
+    sendDue = true;
+    return false;
+  }
+
+  memcpy(saved[f % LOCK_SAVES], state, size);
+
+  for (int p = 0; p < players; p++) {
+    inputs[p] = used[p][f % LOCK_RING] = predict(p, f);
+  }
+  return true;
+}
+
+/*
+ *  Take another player's inputs.  Returns true if it was one of ours.
+ */
+bool Rollback::receive(const gm_packet_t *pkt) {
+  lock_packet_t lp;
+
+  if (!state || pkt->pktType != pktType) return false;
+  if (!wireDecode(&lockSchema, pkt->payload, pkt->length, &lp)) return false;
+  if (lp.type != LOCK_INPUT || lp.player >= players || lp.player == me || lp.count > LOCK_SEND_MAX) return false;
+
+  for (int i = 0; i < lp.count; i++) {
+    store(lp.player, lp.first + i, lp.inputs[i]);
+  }
+
+  if (lp.heard > peerHeard[lp.player]) peerHeard[lp.player] = lp.heard;
+  if (lp.frame > peerFrame[lp.player]) {
+    peerFrame[lp.player] = lp.frame;
+    peerLead[lp.player] = lp.lead;
+  }
+
+  if (lp.syncFrame >= 0) {
+    peerSyncFrame[lp.player] = lp.syncFrame;
+    peerSyncCrc[lp.player] = lp.syncCrc;
+    compare(lp.player);
+  }
+  return true;
+}
+
+/*
+ *  After each round of step()s, one packet for everyone else: our
+ *  inputs from the oldest frame one of them is missing.  Send it to
+ *  the session.
+ */
+bool Rollback::next(gm_packet_t *pkt) {
+  lock_packet_t lp;
+  int32_t from = localNext;
+  int n;
+
+  if (!sendDue || players < 2) return false;
+  sendDue = false;
+
+  for (int p = 0; p < players; p++) {
+    if (p != me && peerHeard[p] < from) from = peerHeard[p];
+  }
+  if (from < localNext - LOCK_RING + 1) from = localNext - LOCK_RING + 1;
+
+  memset(&lp, 0, sizeof(lp));
+  lp.type = LOCK_INPUT;
+  lp.player = me;
+  lp.first = from;
+  lp.count = localNext - from < LOCK_SEND_MAX ? localNext - from : LOCK_SEND_MAX;
+  lp.heard = confirmed();
+  lp.frame = now;
+  lp.lead = constrain(lead(), -127, 127);
+  lp.syncFrame = nextCheck - 1;
+  if (nextCheck > 0) lp.syncCrc = crc[(nextCheck - 1) % LOCK_RING];
+
+  for (int i = 0; i < lp.count; i++) {
+    lp.inputs[i] = input[me][(from + i) % LOCK_RING];
+  }
+
+  if ((n = wireEncode(&lockSchema, &lp, pkt->payload, MAX_PKT_LEN)) < 0) return false;
+
+  pkt->pktType = pktType;
+  pkt->length = n;
+  memcpy(pkt->srcAddr, self, ADDR_LEN);
+  memcpy(pkt->dstAddr, lockBroadcast, ADDR_LEN);
+
+  stats.sent++;
+  stats.bytes += n;
+  return true;
+}
+
+// The next frame to simulate
+int32_t Rollback::frame() {
+  return now;
+}
+
+// The first frame someone's input is still missing for
+int32_t Rollback::confirmed() {
+  int32_t c = known[0];
+
+  for (int p = 1; p < players; p++) {
+    if (known[p] < c) c = known[p];
+  }
+  return c;
+}
+
+/*
+ *  How many frames we're ahead of the slowest player.  What we last
+ *  heard from them is already old, so on its own that overstates it
+ *  by the latency; they see the same of us, so half the difference
+ *  between our lead and theirs is the real thing.
+ */
+int Rollback::ahead() {
+  int worst = 0;
+
+  for (int p = 0; p < players; p++) {
+    int a = (now - peerFrame[p] - peerLead[p]) / 2;
+
+    if (p != me && a > worst) worst = a;
+  }
+  return worst;
+}
+
+// Checksum of the state before frame f, once every input up to it is in
+bool Rollback::checksum(int32_t f, uint32_t *c) {
+
+  if (f < 0 || crcFrame[f % LOCK_RING] != f) return false;
+  *c = crc[f % LOCK_RING];
+  return true;
+}
+
+void Rollback::getStats(lock_stats_t *st) {
+  memcpy(st, &stats, sizeof(lock_stats_t));
+}
+
+// FNV-1a; quick, and plenty to spot two states that differ
+uint32_t Rollback::stateCrc(const void *st, int sz) {
+  const uint8_t *b = (const uint8_t *)st;
+  uint32_t h = 2166136261u;
+
+  for (int i = 0; i < sz; i++) {
+    h = (h ^ b[i]) * 16777619u;
+  }
+  return h;
+}
+
+/*
+ *  (Internal) How far ahead of the slowest player we look from here.
+ */
+int Rollback::lead() {
+  int32_t slowest = now;
+
+  for (int p = 0; p < players; p++) {
+    if (p != me && peerFrame[p] < slowest) slowest = peerFrame[p];
+  }
+  return now - slowest;
+}
+
+/*
+ *  (Internal) File away one input.  If we've already simulated that
+ *  frame with a different guess, we'll have to go back to it.
+ */
+void Rollback::store(int p, int32_t f, uint8_t in) {
+  int slot = f % LOCK_RING;
+
+  // Old news, or so far ahead it would overwrite something we need
+  if (f < known[p] || f >= confirmed() + LOCK_RING - 1 || inputFrame[p][slot] == f) return;
+
+  input[p][slot] = in;
+  inputFrame[p][slot] = f;
+  while (inputFrame[p][known[p] % LOCK_RING] == known[p]) known[p]++;
+
+  if (f < now && used[p][slot] != in && (rewindTo < 0 || f < rewindTo)) rewindTo = f;
+}
+
+/*
+ *  (Internal) The input to use: the real one if it's here, otherwise
+ *  the same as the last one we have in order.
+ */
+uint8_t Rollback::predict(int p, int32_t f) {
+
+  if (inputFrame[p][f % LOCK_RING] == f) return input[p][f % LOCK_RING];
+  return input[p][(known[p] - 1) % LOCK_RING];
+}
+
+/*
+ *  (Internal) Checksum each state that's now final (everything before
+ *  it is in), and compare with what the others said.
+ */
+void Rollback::record() {
+  int32_t c = confirmed();
+
+  while (nextCheck < now && nextCheck <= c) {
+    if (now - nextCheck < LOCK_SAVES) {
+      crc[nextCheck % LOCK_RING] = stateCrc(saved[nextCheck % LOCK_SAVES], size);
+      crcFrame[nextCheck % LOCK_RING] = nextCheck;
+    }
+    nextCheck++;
+  }
+
+  for (int p = 0; p < players; p++) {
+    if (p != me) compare(p);
+  }
+}
+
+/*
+ *  (Internal) Check a peer's checksum against ours, once we have one
+ *  for that frame.
+ */
+void Rollback::compare(int p) {
+  int32_t f = peerSyncFrame[p];
+  uint32_t mine;
+
+  if (f < 0) return;
+
+  if (!checksum(f, &mine)) {
+    if (f < nextCheck - LOCK_RING) peerSyncFrame[p] = -1;   // too old to check
+    return;
+  }
+
+  stats.checked++;
+  if (mine != peerSyncCrc[p]) {
+    if (!stats.desyncs) stats.firstDesync = f;
+    stats.desyncs++;
+  }
+  peerSyncFrame[p] = -1;
+}
@@ -0,0 +1,151 @@
+/*
+ *  rollback.h - Input exchange, prediction and rollback for lockstep games
+ *
+ *  Abstract:
+ *      The bookkeeping behind LockstepGame (lockstep.h), kept apart
+ *      from the task, the radio and the buttons so it can be run and
+ *      checked on its own.  Every player's unit runs the same
+ *      deterministic simulation, one fixed frame at a time, and only
+ *      the inputs (a byte per player per frame) go over the air.  A
+ *      unit's own input is held back LOCK_INPUT_DELAY frames, which
+ *      hides that much network latency outright.  When another player's
+ *      input for a frame hasn't arrived yet, it's predicted (the same
+ *      as their last one) and the frame is simulated anyway; if the
+ *      real input turns out different, the state is put back as it
+ *      was before that frame and the frames since are run again.
+ *      The state is saved before every frame, a plain copy into a
+ *      ring of LOCK_SAVES, so going back is one memcpy.  A unit never
+ *      runs more than LOCK_MAX_ROLLBACK frames past the last one it
+ *      has everyone's input for; it stalls instead.
+ *
+ *      Packets carry the inputs not yet acknowledged (so a lost one
+ *      is covered by the next), how far we've heard from everyone,
+ *      and a checksum of the state at the last frame every input is
+ *      in for.  A checksum that doesn't match our own for that frame
+ *      is a desync, which is counted, not fixed.
+ *
+ *      Like the Replicator, it doesn't do I/O; the caller feeds it
+ *      packets with receive(), sends what next() gives it, and runs
+ *      the frames step() asks for:
+ *
+ *          rb.setLocal(buttons);
+ *          while (rb.step(inputs)) simulate(inputs);
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_ROLLBACK_H_
+#define _GM_ROLLBACK_H_
+
+#include "network.h"
+
+#define LOCK_MAX_PLAYERS    4
+#define LOCK_MAX_STATE    512     // biggest game state, in bytes
+#define LOCK_INPUT_DELAY    2     // frames our own input is held back
+#define LOCK_MAX_ROLLBACK   8     // frames we'll run ahead of the inputs we have
+#define LOCK_SAVES        (LOCK_MAX_ROLLBACK + 2)   // states kept to go back to
+#define LOCK_RING          32     // frames of inputs kept (covers everyone's lead)
+#define LOCK_SEND_MAX      16     // inputs per packet, at most
+
+// The only message, for now (see lockSchema)
+#define LOCK_INPUT       0x49
+
+typedef struct LOCKpkt {
+  uint8_t type;                 // LOCK_INPUT
+  uint8_t player;               // whose inputs
+  int32_t first;                // frame of inputs[0]
+  uint8_t count;
+  int32_t heard;                // we have everyone's inputs before this frame
+  int32_t frame;                // where the sender is
+  int8_t lead;                  // ...and how far ahead it thinks it is
+  int32_t syncFrame;            // a frame with every input in...
+  uint32_t syncCrc;             // ...and its state's checksum
+  uint8_t inputs[LOCK_SEND_MAX];
+} lock_packet_t;
+
+// Wire field ids for the above; never renumber or reuse one
+enum lockField : uint8_t { lfType = 1, lfPlayer, lfFirst, lfCount, lfHeard, lfFrame,
+                           lfSyncFrame, lfSyncCrc, lfInputs, lfLead };
+
+typedef struct lockStats {
+  uint32_t frames;              // frames advanced
+  uint32_t stalls;              // steps we couldn't advance (too far ahead)
+  uint32_t rollbacks;           // mispredictions that sent us back
+  uint32_t resimulated;         // frames run again because of them
+  uint8_t deepest;              // longest rollback, in frames
+  uint32_t sent;                // packets
+  uint32_t bytes;               // payload bytes sent
+  uint32_t checked;             // checksums compared with a peer's
+  uint32_t desyncs;             // ...that didn't match
+  int32_t firstDesync;          // frame of the first one (-1: none)
+} lock_stats_t;
+
+class Rollback {
+  public:
+    Rollback();
+
+    bool begin(uint8_t pktType, void *state, int size, int players, int me, const uint8_t *self);
+
+    void setLocal(uint8_t input);
+    bool step(uint8_t *inputs);
+    bool receive(const gm_packet_t *pkt);
+    bool next(gm_packet_t *pkt);
+
+    int32_t frame();
+    int32_t confirmed();
+    int ahead();
+    bool checksum(int32_t f, uint32_t *crc);
+    void getStats(lock_stats_t *stats);
+
+    static uint32_t stateCrc(const void *state, int size);
+
+  private:
+    void store(int p, int32_t f, uint8_t in);
+    uint8_t predict(int p, int32_t f);
+    void record();
+    void compare(int p);
+    int lead();
+
+    uint8_t pktType;
+    uint8_t *state;
+    int size;
+    int players;
+    int me;
+    uint8_t self[ADDR_LEN];
+
+    // Inputs by player and frame (frame % LOCK_RING); inputFrame says
+    // which frame a slot holds, or -1 if nothing's arrived for it
+    uint8_t input[LOCK_MAX_PLAYERS][LOCK_RING];
+    int32_t inputFrame[LOCK_MAX_PLAYERS][LOCK_RING];
+    uint8_t used[LOCK_MAX_PLAYERS][LOCK_RING];     // what we simulated with
+    int32_t known[LOCK_MAX_PLAYERS];               // first frame we're missing from each
+    int32_t localNext;                             // next frame of ours to fill in
+
+    // State before each recent frame (frame % LOCK_SAVES)
+    uint8_t saved[LOCK_SAVES][LOCK_MAX_STATE];
+
+    int32_t now;                // next frame to simulate
+    int32_t replay;             // next frame to run again, during a rollback
+    int32_t rewindTo;           // earliest mispredicted frame (or -1)
+    bool stepping;              // between the first step() and the last
+    bool advanced;
+
+    // Checksums of the state before frames everyone's input is in for
+    uint32_t crc[LOCK_RING];
+    int32_t crcFrame[LOCK_RING];
+    int32_t nextCheck;
+
+    // What we know of each peer
+    int32_t peerHeard[LOCK_MAX_PLAYERS];
+    int32_t peerFrame[LOCK_MAX_PLAYERS];
+    int8_t peerLead[LOCK_MAX_PLAYERS];
+    int32_t peerSyncFrame[LOCK_MAX_PLAYERS];
+    uint32_t peerSyncCrc[LOCK_MAX_PLAYERS];
+    bool sendDue;
+
+    lock_stats_t stats;
+};
+
+#endif
@@ -0,0 +1,159 @@
+/*
+ *  rsvp.cpp - Game invitations
+ *
+ *  Abstract:
+ *      The host side keeps inviting (every RSVP_INTERVAL, up to
+ *      RSVP_TRIES) until an ACCEPT comes back and that guest's JOIN
+ *      lands in the session.  If the JOIN doesn't follow within
+ *      RSVP_JOIN_WAIT, the ACCEPT is forgotten and the invites go on.
+ *      The guest side repeats its JOIN until the host's roster comes
+ *      back with it on the list.
+ *
+ *      Time-to-start runs from the first invite (host) or from the
+ *      player pressing yes (guest) to the app calling started(), and
+ *      goes to the console as "RSVP,app,role,ms,tries".
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include "GameMan.h"
+#include "rsvp.h"
+
+Rendezvous::Rendezvous(uint8_t app, const char *appName)
+  : app(app), appName(appName) {
+  tag[0] = '\0';
+}
+
+/*
+ *  Home button (C) backs out while we wait.  Anything else pressed
+ *  in the meantime is thrown away.
+ */
+bool Rendezvous::cancelled() {
+  button_event_t press;
+
+  while (xQueueReceive(buttonEvents, &(press), (TickType_t)0)) {
+    if (press.action == btnReleased && press.id == BTN_C) return true;
+  }
+  return false;
+}
+
+int Rendezvous::invite(int qId, int players) {
+  QueueHandle_t q = netTask.getHandle(qId);
+  uint32_t next, acceptAt = 0;
+  bool accepted = false, rejected = false;
+  uint16_t sid;
+
+  if (!q) return rsvpFailed;
+
+  hosting = true;
+  tries = 0;
+  t0 = next = millis();
+  sid = netTask.hostSession(app, players);
+
+  for (;;) {
+    uint32_t now = millis();
+    gm_packet_t pkt;
+
+    if (netTask.sessionMembers() >= players) return rsvpAccepted;
+
+    if (accepted && now - acceptAt > RSVP_JOIN_WAIT) {
+      dprintf("rsvp: %s accepted but never joined\n", tag);
+      accepted = false;
+    }
+
+    if (!accepted && (int32_t)(now - next) >= 0) {
+      if (tries == RSVP_TRIES) break;
+
+      netTask.sendRSVP(appName, qId, sid);
+      tries++;
+      next += RSVP_INTERVAL;
+    }
+
+    if (cancelled()) {
+      netTask.leaveSession();
+      return rsvpCancelled;
+    }
+
+    // Replies come straight to our queue; anything else this early is
+    // from a game that hasn't started, so it can go
+    if (!xQueueReceive(q, &(pkt), pdMS_TO_TICKS(RSVP_POLL))) continue;
+    if (pkt.pktType != GM_IFF) continue;
+
+    // Only a few fields matter, so read them in place
+    WireView iff(pkt.payload, pkt.length);
+    if (!iff.valid() || iff.getUint(ifSession) != sid) continue;
+
+    int n;
+    const uint8_t *who = iff.getBytes(ifWho, &n);
+
+    if (iff.getUint(ifType) == IFF_ACCEPT && !accepted) {
+      snprintf(tag, sizeof(tag), "%.*s", n, who ? (const char *)who : "");
+      dprintf("rsvp: %s accepted\n", tag);
+      accepted = true;
+      acceptAt = millis();
+    } else if (iff.getUint(ifType) == IFF_REJECT) {
+      dprintf("rsvp: %.*s declined\n", n, who ? (const char *)who : "");
+      rejected = true;
+    }
+  }
+
+  netTask.leaveSession();
+  return rejected ? rsvpRejected : rsvpTimeout;
+}
+
+int Rendezvous::join() {
+  uint32_t acceptedAt;
+  const gm_packet_t *pkt = menuTask.getInvite(&acceptedAt);
+  iff_packet_t iff;
+
+  hosting = false;
+  tries = 0;
+  t0 = acceptedAt;
+
+  if (!pkt) return rsvpFailed;
+
+  if (!netTask.unpack(pkt, &iffSchema, &iff)) return rsvpFailed;
+  strncpy(tag, iff.who, GM_PLAYER_TAG_LEN);
+
+  while (tries < RSVP_JOIN_TRIES) {
+    netTask.joinSession(iff.session, app, pkt->srcAddr);
+    tries++;
+
+    for (int t = 0; t < RSVP_JOIN_RETRY; t += RSVP_POLL / 5) {
+      if (netTask.sessionJoined()) return rsvpAccepted;
+      if (cancelled()) {
+        netTask.leaveSession();
+        return rsvpCancelled;
+      }
+      delay(RSVP_POLL / 5);
+    }
+  }
+
+  // Lost, or the game filled up without us
+  netTask.leaveSession();
+  return rsvpTimeout;
+}
+
+void Rendezvous::started() {
+  Serial.printf("RSVP,%s,%s,%u,%d\n", appName, hosting ? "host" : "guest", (unsigned)elapsed(), tries);
+}
+
+const char *Rendezvous::describe(int result) {
+  switch (result) {
+    case rsvpAccepted:  return "Let's play!";
+    case rsvpRejected:  return "No takers";
+    case rsvpTimeout:   return "Nobody answered";
+    case rsvpCancelled: return "Cancelled";
+    default:            return "Network error";
+  }
+}
+
+const char *Rendezvous::peerTag() {
+  return tag;
+}
+
+uint32_t Rendezvous::elapsed() {
+  return millis() - t0;
+}
@@ -0,0 +1,61 @@
+/*
+ *  rsvp.h - Game invitations
+ *
+ *  Abstract:
+ *      The two halves of starting a networked game.  The host's app
+ *      opens a session and broadcasts RSVPs; the menu on each idle
+ *      unit asks its player and answers ACCEPT or REJECT straight
+ *      back to the host's queue.  On a yes it launches the same app
+ *      in guest mode, which joins the session.  Every wait is
+ *      bounded, and both sides time how long it took to get the
+ *      game going.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_RSVP_H_
+#define _GM_RSVP_H_
+
+#include "network.h"
+
+#define RSVP_INTERVAL     1000    // ms between invites
+#define RSVP_TRIES        15      // invites before giving up (people are slow)
+#define RSVP_JOIN_WAIT    2000    // ms for the guest to JOIN after accepting
+#define RSVP_JOIN_RETRY   250     // guest: ms between JOINs
+#define RSVP_JOIN_TRIES   8
+#define RSVP_POLL         50      // ms between looks at the queue and buttons
+
+enum rsvpResult : byte { rsvpAccepted, rsvpRejected, rsvpTimeout, rsvpCancelled, rsvpFailed };
+
+class Rendezvous {
+  public:
+    Rendezvous(uint8_t app, const char *appName);
+
+    // Host: invite until someone's in (players counts us), or give up
+    int invite(int qId, int players = 2);
+
+    // Guest: join the session from the invitation the menu accepted
+    int join();
+
+    // The app's own start handshake is done; log the time it took
+    void started();
+
+    static const char *describe(int result);
+
+    const char *peerTag();
+    uint32_t elapsed();
+
+  private:
+    bool cancelled();
+
+    uint8_t app;
+    const char *appName;
+    bool hosting = false;
+    uint32_t t0 = 0;
+    int tries = 0;
+    char tag[GM_PLAYER_TAG_LEN];
+};
+
+#endif
@@ -0,0 +1,212 @@
+/*
+ *  screen.cpp - The GameMan display
+ *
+ *  Abstract:
+ *      Apps keep calling display.display() as before; the dimming
+ *      policy itself is driven by the button task, which knows when
+ *      somebody is actually using the thing.  Casting goes on even
+ *      with the panel off; the watchers' screens aren't ours.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include "GameMan.h"
+#include "screen.h"
+
+GMDisplay::GMDisplay(uint16_t w, uint16_t h, int8_t mosi, int8_t sclk, int8_t dc, int8_t rst, int8_t cs)
+  : Adafruit_SSD1327(w, h, mosi, sclk, dc, rst, cs) {
+}
+
+bool GMDisplay::begin(uint8_t addr, bool reset) {
+  if (mutex == NULL) mutex = xSemaphoreCreateMutex();
+  return Adafruit_SSD1327::begin(addr, reset);
+}
+
+void GMDisplay::lock() {
+  if (mutex) xSemaphoreTake(mutex, portMAX_DELAY);
+}
+
+void GMDisplay::unlock() {
+  if (mutex) xSemaphoreGive(mutex);
+}
+
+/*
+ *  Push the framebuffer to the panel -- unless it's off, in which
+ *  case wake() will push it later.
+ */
+void GMDisplay::display() {
+  lock();
+
+  if (state == dispBlank) {
+    stale = true;
+    skipped++;
+  } else {
+    PROF_SCOPE(pzDisplayFlush);
+    Adafruit_SSD1327::display();
+    flushes++;
+  }
+
+  if (casting) serviceCast(true);
+
+  unlock();
+}
+
+void GMDisplay::dim() {
+  lock();
+
+  if (state == dispOn) {
+    setContrast(DISP_DIM_CONTRAST);
+    state = dispDim;
+    dprintln("display: Dimmed");
+  }
+
+  unlock();
+}
+
+void GMDisplay::blank() {
+  lock();
+
+  if (state != dispBlank) {
+    oled_command(SSD1327_DISPLAYOFF);   // panel sleep, RAM is retained
+    state = dispBlank;
+    stale = false;
+    dprintln("display: Off");
+  }
+
+  unlock();
+}
+
+/*
+ *  Back to full brightness.  The panel kept its RAM while asleep, so
+ *  it only needs a flush if somebody drew in the meantime.
+ */
+bool GMDisplay::wake() {
+  bool wasBlank;
+
+  lock();
+
+  wasBlank = (state == dispBlank);
+
+  if (state != dispOn) {
+    setContrast(DISP_CONTRAST);
+    if (wasBlank) {
+      if (stale) {
+        Adafruit_SSD1327::display();
+        flushes++;
+      }
+      oled_command(SSD1327_DISPLAYON);
+    }
+    state = dispOn;
+    stale = false;
+    dprintln("display: On");
+  }
+
+  unlock();
+  return wasBlank;
+}
+
+dispState GMDisplay::getState() {
+  return state;
+}
+
+int GMDisplay::dimAfter() {
+  return (power.isLowBattery() ? DISP_LOW_DIM_SECS : DISP_DIM_SECS) * 1000;
+}
+
+int GMDisplay::blankAfter() {
+  return (power.isLowBattery() ? DISP_LOW_BLANK_SECS : DISP_BLANK_SECS) * 1000;
+}
+
+/*
+ *  Start publishing flushes.  Costs a copy of each one (and 16K for
+ *  the two screens) until somebody watches, then the packets.
+ */
+bool GMDisplay::startCast() {
+
+  if (casting) return true;
+
+  castId = netTask.createQueue(4);
+  if (castId < 0 || netTask.addFilter(castId, GM_CAST) < 0) {
+    Serial.println("display: No network queue, not casting");
+    if (castId >= 0) netTask.destroyQueue(castId);
+    castId = -1;
+    return false;
+  }
+  castQ = netTask.getHandle(castId);
+
+  lock();
+  casting = cast.begin(netTask.getPlayer(0)->node);
+  if (casting) cast.update(getBuffer(), millis());
+  unlock();
+
+  if (!casting) {
+    netTask.destroyQueue(castId);
+    castId = -1;
+  }
+  return casting;
+}
+
+void GMDisplay::stopCast() {
+  cast_stats_t st;
+
+  if (!casting) return;
+
+  lock();
+  cast.getStats(&st);
+  cast.end();
+  casting = false;
+  unlock();
+
+  netTask.destroyQueue(castId);
+  castId = -1;
+  castQ = 0;
+
+  if (st.frames) {
+    dprintf("display: Cast %u frames (%u keys, %u folded), %u packets, %u kB; latency %u ms avg, %u max\n",
+            st.frames, st.keys, st.folded, st.packets, st.bytes / 1024,
+            st.samples ? st.latency / st.samples : 0, st.latencyMax);
+  }
+}
+
+/*
+ *  Between flushes: new watchers, keyframes, flushes that were folded
+ *  waiting for CAST_MIN_MS, and the rest of a frame that didn't fit in
+ *  one burst.  True if there's still some of it to send.
+ */
+bool GMDisplay::pollCast() {
+  bool more;
+
+  if (!casting) return false;
+
+  lock();
+  more = serviceCast(false);
+  unlock();
+
+  return more;
+}
+
+/*
+ *  (Internal) With the lock held: take in WATCHes, hand over the
+ *  framebuffer if it was just flushed, and send what's ready, at most
+ *  DISP_CAST_BURST packets so a keyframe doesn't stall the app's flush
+ *  (or overrun ESP-NOW's queue).  True if there's more to send.
+ */
+bool GMDisplay::serviceCast(bool flushed) {
+  gm_packet_t pkt;
+  uint32_t now = millis();
+  int sent = 0;
+
+  while (xQueueReceive(castQ, &pkt, 0)) cast.receive(&pkt, now);
+
+  if (flushed) cast.update(getBuffer(), now);
+  else cast.poll(now);
+
+  while (sent < DISP_CAST_BURST && cast.next(&pkt)) {
+    netTask.sendPkt(&pkt);
+    sent++;
+  }
+
+  return cast.sending();
+}
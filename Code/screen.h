@@ -0,0 +1,86 @@
+/*
+ *  screen.h - The GameMan display
+ *
+ *  Abstract:
+ *      Wraps the Adafruit SSD1327 driver to add panel power
+ *      management.  After a stretch with no button activity the
+ *      panel is dimmed, then switched off; while it's off, flushes
+ *      just mark the (retained) framebuffer stale instead of
+ *      clocking 8K out over the SPI pins, and the next press turns
+ *      it back on and pushes the current frame in one go.  It also
+ *      serializes flushes, since several tasks draw, and while casting
+ *      hands each one to the ScreenCast for anyone watching.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_SCREEN_H_
+#define _GM_SCREEN_H_
+
+#include <Adafruit_SSD1327.h>
+
+#include "screencast.h"
+
+#define DISP_DIM_SECS     30    // no buttons this long -> dim
+#define DISP_BLANK_SECS   120   // ...and this long -> panel off
+#define DISP_LOW_DIM_SECS   10  // same, on a low battery
+#define DISP_LOW_BLANK_SECS 30
+#define DISP_CONTRAST     0x80  // normal brightness (driver default)
+#define DISP_DIM_CONTRAST 0x08  // just enough to see it's alive
+
+// Casting: packets handed to the radio per flush or poll (ESP-NOW only
+// queues a few), and how often to poll while a frame is still going out
+#define DISP_CAST_BURST   6
+#define DISP_CAST_POLL_MS 10
+
+enum dispState : byte { dispOn, dispDim, dispBlank };
+
+class GMDisplay : public Adafruit_SSD1327 {
+public:
+  GMDisplay(uint16_t w, uint16_t h, int8_t mosi, int8_t sclk, int8_t dc, int8_t rst, int8_t cs);
+
+  bool begin(uint8_t addr = 0x3D, bool reset = true);
+
+  // Hides the driver's flush: skipped (but remembered) while blank
+  void display();
+
+  // Panel power; wake() returns true if the panel had been off
+  void dim();
+  void blank();
+  bool wake();
+  dispState getState();
+
+  // Inactivity timeouts (ms), shorter on a low battery
+  int dimAfter();
+  int blankAfter();
+
+  // Hold off flushes (e.g., while freezing the task that draws)
+  void lock();
+  void unlock();
+
+  // Let other units watch (screencast.h); the menu casts whatever app
+  // is running, and polls a few times a second for the timers, or
+  // every DISP_CAST_POLL_MS while pollCast() says a frame is going out
+  bool startCast();
+  void stopCast();
+  bool pollCast();
+
+  uint32_t flushes = 0;         // frames sent to the panel
+  uint32_t skipped = 0;         // ...and not sent, since it was off
+
+private:
+  SemaphoreHandle_t mutex = NULL;
+  volatile dispState state = dispOn;
+  bool stale = false;           // framebuffer changed while blank
+
+  ScreenCast cast;
+  bool casting = false;
+  int castId = -1;
+  QueueHandle_t castQ = 0;
+
+  bool serviceCast(bool flushed);
+};
+
+#endif
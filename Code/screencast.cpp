@@ -0,0 +1,639 @@
+/*
+ *  screencast.cpp - Streaming a unit's screen to spectators
+ *
+ *  Abstract:
+ *      The caster compares each flush with the last frame it sent, a
+ *      tile at a time, and packs the tiles that changed into as few
+ *      packets as it can; the watcher paints them straight into its
+ *      framebuffer and keeps track of what it may have missed.  See
+ *      screencast.h.
+ *
+ *      A tile entry is its index, then (for a run of identical tiles
+ *      in a row) 0xc0 + the run length - 1, then the tile's 32 bytes
+ *      RLE'd: a control byte under 0x80 is followed by that many + 1
+ *      bytes as they are, and 0x80 + n means the next byte n + 2
+ *      times.  A tile never needs a control byte of 0xc0 or more, so
+ *      the two can't be confused.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include "screencast.h"
+
+static const uint8_t castBroadcast[ADDR_LEN] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+#define CAST_RUN_MIN    3       // shorter repeats are cheaper as literals
+#define CAST_TILE_RUN   0xc0    // entry prefix: a run of identical tiles
+#define CAST_ENTRY_MAX  (2 + CAST_TILE_BYTES + 1)   // index, run, worst case RLE
+
+// Byte offset of a tile's top row in the framebuffer
+static int tileOffset(int tile) {
+  return (tile / CAST_COLS) * CAST_TILE * (CAST_WIDTH / 2) + (tile % CAST_COLS) * CAST_TILE_ROW;
+}
+
+static bool sameTile(const uint8_t *a, const uint8_t *b, int ta, int tb) {
+  const uint8_t *pa = a + tileOffset(ta);
+  const uint8_t *pb = b + tileOffset(tb);
+
+  for (int r = 0; r < CAST_TILE; r++) {
+    if (memcmp(pa + r * (CAST_WIDTH / 2), pb + r * (CAST_WIDTH / 2), CAST_TILE_ROW) != 0) return false;
+  }
+  return true;
+}
+
+static void copyTile(uint8_t *fb, int from, int to) {
+  const uint8_t *src = fb + tileOffset(from);
+  uint8_t *dst = fb + tileOffset(to);
+
+  for (int r = 0; r < CAST_TILE; r++) {
+    memcpy(dst + r * (CAST_WIDTH / 2), src + r * (CAST_WIDTH / 2), CAST_TILE_ROW);
+  }
+}
+
+static bool tileBit(const uint8_t *bits, int t) {
+  return bits[t >> 3] & (1 << (t & 7));
+}
+
+static void putShort(uint8_t *p, uint16_t v) {
+  p[0] = v & 0xff;
+  p[1] = v >> 8;
+}
+
+static uint16_t getShort(const uint8_t *p) {
+  return p[0] | (p[1] << 8);
+}
+
+ScreenCast::ScreenCast() {
+
+  casting = false;
+  viewing = false;
+  held = NULL;
+  sent = NULL;
+  screen = NULL;
+  numWatchers = 0;
+  cursor = CAST_TILES;
+  copies = 0;
+  leaveDue = false;
+  watchDue = false;
+  memset(&stats, 0, sizeof(stats));
+}
+
+/*
+ *  Caster: start keeping track of the screen.  Nothing goes out
+ *  until somebody asks to watch.
+ */
+bool ScreenCast::begin(const uint8_t *me) {
+
+  end();
+
+  held = (uint8_t *)calloc(CAST_FRAME_BYTES, 1);
+  sent = (uint8_t *)calloc(CAST_FRAME_BYTES, 1);
+  if (!held || !sent) {
+    Serial.println("cast: No memory for the screen copies!");
+    end();
+    return false;
+  }
+
+  memcpy(self, me, ADDR_LEN);
+  casting = true;
+  numWatchers = 0;
+  seq = 0;
+  dirty = false;
+  keyDue = true;
+  lastFrame = lastKey = 0;
+  flushedAt = 0;
+  cursor = CAST_TILES;
+  copies = 0;
+  memset(&stats, 0, sizeof(stats));
+  return true;
+}
+
+/*
+ *  Caster: the screen was just flushed.  It goes out now, or folded
+ *  into the next frame if the last one was under CAST_MIN_MS ago.
+ */
+void ScreenCast::update(const uint8_t *fb, uint32_t now) {
+
+  if (!casting) return;
+
+  if (dirty && numWatchers) stats.folded++;
+  memcpy(held, fb, CAST_FRAME_BYTES);
+  dirty = true;
+  flushedAt = now;
+
+  poll(now);
+}
+
+int ScreenCast::watchers() {
+  return numWatchers;
+}
+
+// The last frame started (0: none yet)
+uint16_t ScreenCast::sequence() {
+  return seq;
+}
+
+// Parts of a frame still to hand out from next()
+bool ScreenCast::sending() {
+  return casting && numWatchers && (cursor < CAST_TILES || copies);
+}
+
+/*
+ *  Watcher: draw what from (or the first caster we hear) is showing
+ *  into fb, which is kept as it was until then.  A caster we were
+ *  given is waited for as long as it takes; one we picked up is given
+ *  up on after CAST_TIMEOUT without a frame, for whoever's next.
+ */
+bool ScreenCast::watch(const uint8_t *me, uint8_t *fb, const uint8_t *from) {
+
+  end();
+
+  memcpy(self, me, ADDR_LEN);
+  screen = fb;
+  viewing = true;
+  haveSource = pinned = from != NULL;
+  if (from) memcpy(source, from, ADDR_LEN);
+  anyFrame = false;
+  damaged = true;
+  curDone = true;
+  shownAt = 0;
+  lastHeard = lastWatch = 0;
+  watchDue = true;
+  clock = 0;
+  memset(&stats, 0, sizeof(stats));
+  return true;
+}
+
+// Watcher: the caster we're locked on to, if any
+bool ScreenCast::watching(uint8_t *from) {
+
+  if (!viewing || !haveSource) return false;
+  if (from) memcpy(from, source, ADDR_LEN);
+  return true;
+}
+
+/*
+ *  Watcher: true if every part of every frame since the last whole
+ *  keyframe has arrived, so the screen is exactly the caster's.
+ */
+bool ScreenCast::intact() {
+  return viewing && anyFrame && !damaged;
+}
+
+/*
+ *  Call every so often (a few times a second is plenty) for the
+ *  timers: keyframes and stale watchers for the caster, check-ins and
+ *  a caster that's gone quiet for the watcher.
+ */
+void ScreenCast::poll(uint32_t now) {
+
+  clock = now;
+
+  if (viewing) {
+    // (The timeout starts with the first frame, not at watch())
+    if (haveSource && anyFrame && now - lastHeard > CAST_TIMEOUT) {
+      Serial.println("cast: Nothing from the caster, looking again");
+      haveSource = pinned;
+      anyFrame = false;
+      damaged = true;
+    }
+    if (now - lastWatch >= CAST_WATCH_MS) watchDue = true;
+    return;
+  }
+
+  if (!casting) return;
+
+  for (int w = 0; w < numWatchers; w++) {
+    if (now - watcher[w].heard > CAST_TIMEOUT) watcher[w--] = watcher[--numWatchers];
+  }
+
+  // Nobody left: stop halfway through a frame if need be
+  if (!numWatchers) {
+    cursor = CAST_TILES;
+    copies = 0;
+    return;
+  }
+
+  if (now - lastKey >= CAST_KEY_MS) keyDue = true;
+
+  if (cursor >= CAST_TILES && !copies && (dirty || keyDue) && now - lastFrame >= CAST_MIN_MS) {
+    startFrame(now);
+  }
+}
+
+/*
+ *  Caster: take a WATCH or LEAVE.  Watcher: take part of a frame;
+ *  true if the screen should be flushed.
+ */
+bool ScreenCast::receive(const gm_packet_t *pkt, uint32_t now) {
+  uint8_t kind;
+
+  if (pkt->pktType != GM_CAST || pkt->length < 1 || (pkt->payload[0] >> 4) != CAST_VERSION) return false;
+
+  clock = now;
+  kind = pkt->payload[0] & 0x0f;
+
+  if (casting && (kind == castWatch || kind == castLeave)) {
+    heardWatch(pkt, now);
+  } else if (viewing && (kind == castKey || kind == castDelta)) {
+    return heardFrame(pkt, now);
+  }
+  return false;
+}
+
+/*
+ *  Packets to send: frame parts from the caster (once per watcher, or
+ *  once for all of them), check-ins and goodbyes from the watcher.
+ */
+bool ScreenCast::next(gm_packet_t *pkt) {
+
+  if (leaveDue) {
+    pkt->payload[0] = (CAST_VERSION << 4) | castLeave;
+    pkt->length = 1;
+    pkt->pktType = GM_CAST;
+    memcpy(pkt->srcAddr, self, ADDR_LEN);
+    memcpy(pkt->dstAddr, leaveTo, ADDR_LEN);
+    leaveDue = false;
+    return true;
+  }
+
+  if (viewing) {
+    if (!watchDue) return false;
+
+    uint32_t since = anyFrame ? clock - shownAt : 0;
+    uint8_t *p = pkt->payload;
+
+    p[0] = (CAST_VERSION << 4) | castWatch;
+    putShort(p + 1, shownSeq);
+    p[3] = (damaged ? CAST_WANT_KEY : 0) | (shownAt ? CAST_SHOWN : 0);
+    putShort(p + 4, shownStamp);
+    putShort(p + 6, since > 0xffff ? 0xffff : since);
+    pkt->length = 8;
+    pkt->pktType = GM_CAST;
+    memcpy(pkt->srcAddr, self, ADDR_LEN);
+    memcpy(pkt->dstAddr, haveSource ? source : castBroadcast, ADDR_LEN);
+
+    lastWatch = clock;
+    watchDue = false;
+    return true;
+  }
+
+  if (!casting) return false;
+
+  if (copies > numWatchers) copies = numWatchers;     // one left halfway through
+  if (!copies) {
+    if (cursor >= CAST_TILES || !numWatchers || !fillPart()) return false;
+    copies = numWatchers > SESSION_UNICAST_MAX ? 1 : numWatchers;
+  }
+
+  memcpy(pkt, &out, offsetof(gm_packet_t, payload) + out.length);
+  if (numWatchers > SESSION_UNICAST_MAX) memcpy(pkt->dstAddr, castBroadcast, ADDR_LEN);
+  else memcpy(pkt->dstAddr, watcher[numWatchers - copies].node, ADDR_LEN);
+  copies--;
+
+  stats.packets++;
+  stats.bytes += pkt->length;
+  return true;
+}
+
+/*
+ *  Stop either job and give back the screen copies.  A watcher says
+ *  goodbye on the next next().
+ */
+void ScreenCast::end() {
+
+  if (viewing && haveSource) {
+    memcpy(leaveTo, source, ADDR_LEN);
+    leaveDue = true;
+  }
+
+  free(held);
+  free(sent);
+  held = sent = NULL;
+  screen = NULL;
+  casting = viewing = false;
+  numWatchers = 0;
+  cursor = CAST_TILES;
+  copies = 0;
+}
+
+void ScreenCast::getStats(cast_stats_t *st) {
+  memcpy(st, &stats, sizeof(cast_stats_t));
+}
+
+/*
+ *  RLE one tile of fb into out.  Returns the bytes used, or -1 if
+ *  room isn't enough (CAST_TILE_BYTES + 1 always is).
+ */
+int ScreenCast::encodeTile(const uint8_t *fb, int tile, uint8_t *out, int room) {
+  uint8_t b[CAST_TILE_BYTES];
+  int i = 0, n = 0;
+
+  for (int r = 0; r < CAST_TILE; r++) {
+    memcpy(b + r * CAST_TILE_ROW, fb + tileOffset(tile) + r * (CAST_WIDTH / 2), CAST_TILE_ROW);
+  }
+
+  while (i < CAST_TILE_BYTES) {
+    int run = 1;
+
+    while (i + run < CAST_TILE_BYTES && b[i + run] == b[i]) run++;
+
+    if (run >= CAST_RUN_MIN) {
+      if (n + 2 > room) return -1;
+      out[n++] = 0x80 + run - 2;
+      out[n++] = b[i];
+      i += run;
+      continue;
+    }
+
+    // Literals, up to the next run worth taking
+    int start = i;
+
+    while (i < CAST_TILE_BYTES) {
+      if (i + CAST_RUN_MIN <= CAST_TILE_BYTES && b[i] == b[i + 1] && b[i] == b[i + 2]) break;
+      i++;
+    }
+    if (n + 1 + i - start > room) return -1;
+    out[n++] = i - start - 1;
+    memcpy(out + n, b + start, i - start);
+    n += i - start;
+  }
+  return n;
+}
+
+/*
+ *  Unpack one tile into fb.  Returns the bytes read, or -1 if in
+ *  runs out or doesn't add up to exactly one tile.
+ */
+int ScreenCast::decodeTile(const uint8_t *in, int len, uint8_t *fb, int tile) {
+  uint8_t b[CAST_TILE_BYTES];
+  int i = 0, n = 0;
+
+  while (i < CAST_TILE_BYTES) {
+    int c, count;
+
+    if (n >= len) return -1;
+    c = in[n++];
+
+    if (c >= CAST_TILE_RUN) return -1;
+
+    if (c & 0x80) {
+      count = (c & 0x7f) + 2;
+      if (n >= len || i + count > CAST_TILE_BYTES) return -1;
+      memset(b + i, in[n++], count);
+    } else {
+      count = c + 1;
+      if (n + count > len || i + count > CAST_TILE_BYTES) return -1;
+      memcpy(b + i, in + n, count);
+      n += count;
+    }
+    i += count;
+  }
+
+  for (int r = 0; r < CAST_TILE; r++) {
+    memcpy(fb + tileOffset(tile) + r * (CAST_WIDTH / 2), b + r * CAST_TILE_ROW, CAST_TILE_ROW);
+  }
+  return n;
+}
+
+/*
+ *  (Internal) Caster: pick the tiles for a new frame (all of them
+ *  for a keyframe) and make the held flush what's been sent.
+ */
+void ScreenCast::startFrame(uint32_t now) {
+  bool key = keyDue;
+  int count = 0;
+
+  memset(pending, 0, sizeof(pending));
+  for (int t = 0; t < CAST_TILES; t++) {
+    if (key || !sameTile(held, sent, t, t)) {
+      pending[t >> 3] |= 1 << (t & 7);
+      count++;
+    }
+  }
+
+  memcpy(sent, held, CAST_FRAME_BYTES);
+  stamp = dirty ? flushedAt : now;
+  dirty = false;
+  if (!count) return;           // flushed, but nothing changed
+
+  seq++;
+  part = 0;
+  cursor = 0;
+  pendingKey = key;
+  lastFrame = now;
+  if (key) {
+    keyDue = false;
+    lastKey = now;
+    stats.keys++;
+  }
+  stats.frames++;
+}
+
+/*
+ *  (Internal) Caster: the next part of the frame going out, as many
+ *  tiles as fit.  False if there's nothing left of it.
+ */
+bool ScreenCast::fillPart() {
+  uint8_t *p = out.payload;
+  uint8_t entry[CAST_ENTRY_MAX];
+  int n = CAST_HEADER;
+
+  while (cursor < CAST_TILES && !tileBit(pending, cursor)) cursor++;
+  if (cursor >= CAST_TILES) return false;
+
+  p[0] = (CAST_VERSION << 4) | (pendingKey ? castKey : castDelta);
+  putShort(p + 1, seq);
+  p[3] = part;
+  putShort(p + 4, stamp);
+
+  while (cursor < CAST_TILES) {
+    int run = 1, k = 0, m;
+
+    if (!tileBit(pending, cursor)) {
+      cursor++;
+      continue;
+    }
+
+    while (cursor + run < CAST_TILES && run < CAST_TILE_RUN / 3 && tileBit(pending, cursor + run) &&
+           sameTile(sent, sent, cursor, cursor + run)) {
+      run++;
+    }
+
+    entry[k++] = cursor;
+    if (run > 1) entry[k++] = CAST_TILE_RUN | (run - 1);
+    if ((m = encodeTile(sent, cursor, entry + k, sizeof(entry) - k)) < 0) return false;
+    k += m;
+
+    if (n + k > MAX_PKT_LEN) break;
+    memcpy(p + n, entry, k);
+    n += k;
+    cursor += run;
+    stats.tiles += run;
+  }
+
+  while (cursor < CAST_TILES && !tileBit(pending, cursor)) cursor++;
+  if (cursor >= CAST_TILES) p[3] |= CAST_LAST_PART;
+  part++;
+
+  out.pktType = GM_CAST;
+  out.length = n;
+  memcpy(out.srcAddr, self, ADDR_LEN);
+  return true;
+}
+
+/*
+ *  (Internal) Caster: a watcher checking in (or leaving).  A new one
+ *  needs a keyframe, and so does one that says it lost something.
+ */
+void ScreenCast::heardWatch(const gm_packet_t *pkt, uint32_t now) {
+  const uint8_t *p = pkt->payload;
+  int w;
+
+  for (w = 0; w < numWatchers; w++) {
+    if (memcmp(watcher[w].node, pkt->srcAddr, ADDR_LEN) == 0) break;
+  }
+
+  if ((p[0] & 0x0f) == castLeave) {
+    if (w < numWatchers) watcher[w] = watcher[--numWatchers];
+    return;
+  }
+  if (pkt->length < 8) return;
+
+  if (w == numWatchers) {
+    if (numWatchers == CAST_MAX_WATCHERS) return;
+    memcpy(watcher[w].node, pkt->srcAddr, ADDR_LEN);
+    watcher[w].sampled = getShort(p + 1) + 1;
+    numWatchers++;
+    keyDue = true;
+  }
+  watcher[w].heard = now;
+
+  if ((p[3] & CAST_WANT_KEY) && now - lastKey >= CAST_KEY_HOLDOFF) keyDue = true;
+
+  // When it showed a frame we stamped, less how long it's been on
+  // the screen: the delay from our flush to theirs, plus this trip
+  if ((p[3] & CAST_SHOWN) && getShort(p + 1) != watcher[w].sampled) {
+    uint16_t lat = (uint16_t)((uint16_t)now - getShort(p + 4)) - getShort(p + 6);
+
+    if (lat < CAST_TIMEOUT) {
+      stats.latency += lat;
+      if (lat > stats.latencyMax) stats.latencyMax = lat;
+      stats.samples++;
+    }
+    watcher[w].sampled = getShort(p + 1);
+  }
+
+  if (cursor >= CAST_TILES && !copies) poll(now);
+}
+
+/*
+ *  (Internal) Watcher: paint in one part of a frame.  A frame is
+ *  shown when its last part arrives, or when the next one starts
+ *  without it.
+ */
+bool ScreenCast::heardFrame(const gm_packet_t *pkt, uint32_t now) {
+  const uint8_t *p = pkt->payload;
+  int len = pkt->length, n = CAST_HEADER;
+  uint16_t s;
+  int pt;
+  bool show = false;
+
+  if (len < CAST_HEADER) return false;
+
+  if (!haveSource) {
+    memcpy(source, pkt->srcAddr, ADDR_LEN);
+    haveSource = true;
+    anyFrame = false;
+    damaged = true;
+  } else if (memcmp(pkt->srcAddr, source, ADDR_LEN) != 0) {
+    memcpy(leaveTo, pkt->srcAddr, ADDR_LEN);
+    leaveDue = true;
+    return false;
+  }
+  lastHeard = now;
+
+  s = getShort(p + 1);
+  pt = p[3] & ~CAST_LAST_PART;
+  if (pt >= CAST_MAX_PARTS) return false;
+
+  if (!anyFrame || s != curSeq) {
+    if (anyFrame && (int16_t)(s - curSeq) < 0) return false;    // late part of an old frame
+
+    if (!curDone) show = endFrame(now);
+    if (anyFrame && s != (uint16_t)(curSeq + 1)) {
+      stats.missed += (uint16_t)(s - curSeq - 1);
+      lostSomething(now);
+    }
+    if (!anyFrame && (p[0] & 0x0f) != castKey) lostSomething(now);
+
+    curSeq = s;
+    curKey = (p[0] & 0x0f) == castKey;
+    curStamp = getShort(p + 4);
+    curDone = false;
+    partsSeen = 0;
+    lastPart = -1;
+    anyFrame = true;
+  }
+
+  while (n < len) {
+    int t = p[n++], run = 1, m;
+
+    if (n < len && p[n] >= CAST_TILE_RUN) run = (p[n++] & ~CAST_TILE_RUN) + 1;
+    if (t + run > CAST_TILES || (m = decodeTile(p + n, len - n, screen, t)) < 0) {
+      Serial.printf("cast: Bad tile %d in frame %u\n", t, s);
+      lostSomething(now);
+      break;
+    }
+    n += m;
+    for (int k = 1; k < run; k++) copyTile(screen, t, t + k);
+    stats.tiles += run;
+  }
+
+  partsSeen |= (uint64_t)1 << pt;
+  stats.packets++;
+  stats.bytes += len;
+
+  if (p[3] & CAST_LAST_PART) lastPart = pt;
+
+  // A straggler for a frame already up just gets it redrawn
+  if (curDone) return true;
+  if (lastPart >= 0) show = endFrame(now);
+  return show;
+}
+
+/*
+ *  (Internal) Watcher: the frame is as done as it's going to get.
+ */
+bool ScreenCast::endFrame(uint32_t now) {
+  uint64_t all = lastPart >= 63 ? ~(uint64_t)0 : ((uint64_t)1 << (lastPart + 1)) - 1;
+
+  curDone = true;
+
+  if (lastPart < 0 || partsSeen != all) {
+    stats.damaged++;
+    lostSomething(now);
+  } else if (curKey) {
+    damaged = false;
+  }
+
+  stats.frames++;
+  if (curKey) stats.keys++;
+
+  shownSeq = curSeq;
+  shownStamp = curStamp;
+  shownAt = now ? now : 1;
+  return true;
+}
+
+/*
+ *  (Internal) Watcher: part of the screen may be out of date.  Ask
+ *  for a keyframe now rather than at the next check-in.
+ */
+void ScreenCast::lostSomething(uint32_t now) {
+
+  damaged = true;
+  if (now - lastWatch >= CAST_KEY_HOLDOFF) watchDue = true;
+}
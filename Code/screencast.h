@@ -0,0 +1,181 @@
+/*
+ *  screencast.h - Streaming a unit's screen to spectators
+ *
+ *  Abstract:
+ *      Lets other units watch what's on our display without running
+ *      the game.  The 128x128 4bpp framebuffer is cut into 8x8 tiles
+ *      (32 bytes each, 256 of them).  Each time the caster's screen
+ *      is flushed, only the tiles that differ from the last frame it
+ *      sent go out, each one RLE-compressed; a run of identical tiles
+ *      in a row is sent once.  Frames are numbered and split into
+ *      numbered parts, one packet each.  Every CAST_KEY_MS (and when
+ *      a watcher joins or says it lost something) the whole screen
+ *      goes out instead, as a keyframe.
+ *
+ *      Tiles are sent as they are, not as a difference, so a lost
+ *      packet only leaves those tiles out of date until they change
+ *      again or the next keyframe; the watcher keeps showing frames
+ *      and asks for a keyframe early.  Nothing is sent while nobody
+ *      is watching.  Watchers say so with a WATCH every CAST_WATCH_MS
+ *      (the first one broadcast, to find a caster) and are dropped
+ *      after CAST_TIMEOUT without one.  Up to SESSION_UNICAST_MAX
+ *      watchers get their own (retried) unicast copy; more than that
+ *      share a broadcast.
+ *
+ *      Like the Replicator, it doesn't do I/O and doesn't read the
+ *      clock; the caller hands it the time in ms, feeds it packets
+ *      with receive() and sends what next() gives it:
+ *
+ *          cast.update(display.getBuffer(), millis());
+ *          while (cast.next(&pkt)) netTask.sendPkt(&pkt);
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_SCREENCAST_H_
+#define _GM_SCREENCAST_H_
+
+#include "network.h"
+
+#define CAST_VERSION        1
+#define CAST_HEADER         6     // version/kind, seq, part, stamp
+#define CAST_WIDTH        128     // pixels
+#define CAST_HEIGHT       128
+#define CAST_TILE           8     // pixels square
+#define CAST_COLS         (CAST_WIDTH / CAST_TILE)
+#define CAST_TILES        (CAST_COLS * (CAST_HEIGHT / CAST_TILE))
+#define CAST_TILE_ROW     (CAST_TILE / 2)           // bytes (two pixels each)
+#define CAST_TILE_BYTES   (CAST_TILE_ROW * CAST_TILE)
+#define CAST_FRAME_BYTES  (CAST_WIDTH * CAST_HEIGHT / 2)
+#define CAST_MAX_PARTS     64     // packets in one frame (a keyframe of noise takes ~40)
+#define CAST_MAX_WATCHERS   4
+
+#define CAST_MIN_MS        50     // at most 20 frames a second; faster flushes are folded
+#define CAST_KEY_MS      3000     // keyframe at least this often
+#define CAST_KEY_HOLDOFF  250     // ...and asked-for ones no more often than this
+#define CAST_WATCH_MS    1000     // watchers check in this often
+#define CAST_TIMEOUT     3500     // either side gives up on the other after this
+
+// Low nibble of the first payload byte (CAST_VERSION is the high one)
+enum castKind : uint8_t {
+  castKey = 1,          // seq, part, stamp, then every tile
+  castDelta,            // seq, part, stamp, then the tiles that changed
+  castWatch,            // seq and stamp last shown, flags, ms since
+  castLeave             // stop sending to me
+};
+
+#define CAST_LAST_PART   0x80     // in the part byte
+#define CAST_WANT_KEY    0x01     // WATCH flags: we're missing something
+#define CAST_SHOWN       0x02     // ...we've shown the frame it names
+
+typedef struct castStats {
+  uint32_t frames;      // sent (caster) or shown (watcher)
+  uint32_t keys;        // ...of them keyframes
+  uint32_t packets;     // sent, every copy (caster) or received (watcher)
+  uint32_t bytes;       // ...their payload bytes
+  uint32_t tiles;       // tiles in them
+  uint32_t folded;      // caster: flushes merged into a later frame
+  uint32_t damaged;     // watcher: frames shown with parts missing
+  uint32_t missed;      // watcher: frames never heard at all
+  uint32_t latency;     // caster: flush to a watcher's screen, ms total...
+  uint32_t latencyMax;
+  uint32_t samples;     // ...over this many WATCHes
+} cast_stats_t;
+
+class ScreenCast {
+  public:
+    ScreenCast();
+
+    // Caster: keeps two copies of the screen (malloc'd here, freed by end())
+    bool begin(const uint8_t *self);
+    void update(const uint8_t *fb, uint32_t now);
+    int watchers();
+    uint16_t sequence();
+    bool sending();
+
+    // Watcher: frames are drawn straight into fb; from is the caster
+    // to watch, or NULL for the first one heard
+    bool watch(const uint8_t *self, uint8_t *fb, const uint8_t *from = NULL);
+    bool watching(uint8_t *from);
+    bool intact();
+
+    // Both sides
+    void poll(uint32_t now);
+    bool receive(const gm_packet_t *pkt, uint32_t now);
+    bool next(gm_packet_t *pkt);
+    void end();
+    void getStats(cast_stats_t *stats);
+
+    // One tile, RLE'd: bytes written (-1 if it won't fit), and read back
+    static int encodeTile(const uint8_t *fb, int tile, uint8_t *out, int room);
+    static int decodeTile(const uint8_t *in, int len, uint8_t *fb, int tile);
+
+  private:
+    typedef struct castWatcher {
+      uint8_t node[ADDR_LEN];
+      uint32_t heard;       // last WATCH, ms
+      uint16_t sampled;     // frame it last told us the latency of
+    } cast_watcher_t;
+
+    void startFrame(uint32_t now);
+    bool fillPart();
+    void heardWatch(const gm_packet_t *pkt, uint32_t now);
+    bool heardFrame(const gm_packet_t *pkt, uint32_t now);
+    bool endFrame(uint32_t now);
+    void lostSomething(uint32_t now);
+
+    uint8_t self[ADDR_LEN];
+    bool casting;
+    bool viewing;
+    uint32_t clock;         // the latest now we were given
+
+    // Caster: the latest flush, and the last frame sent (what watchers have)
+    uint8_t *held;
+    uint8_t *sent;
+    cast_watcher_t watcher[CAST_MAX_WATCHERS];
+    int numWatchers;
+    uint16_t seq;
+    bool dirty;             // held has a flush sent hasn't
+    bool keyDue;
+    uint32_t flushedAt;
+    uint32_t lastFrame;
+    uint32_t lastKey;
+
+    // ...the frame going out: its tiles, where we're up to, and the
+    // packet being handed out once per unicast watcher
+    uint8_t pending[CAST_TILES / 8];
+    bool pendingKey;
+    int cursor;
+    uint8_t part;
+    uint16_t stamp;
+    gm_packet_t out;
+    int copies;             // copies of out still to hand out
+
+    // Watcher
+    uint8_t *screen;
+    uint8_t source[ADDR_LEN];
+    bool haveSource;
+    bool pinned;            // source was given to watch(); don't switch
+    bool anyFrame;
+    uint16_t curSeq;
+    uint16_t curStamp;
+    bool curKey;
+    bool curDone;           // shown already
+    uint64_t partsSeen;
+    int lastPart;           // -1 until the last part arrives
+    bool damaged;           // something's out of date until a whole keyframe
+    uint16_t shownSeq;
+    uint16_t shownStamp;
+    uint32_t shownAt;
+    uint32_t lastHeard;
+    uint32_t lastWatch;
+    bool watchDue;
+    uint8_t leaveTo[ADDR_LEN];
+    bool leaveDue;
+
+    cast_stats_t stats;
+};
+
+#endif
@@ -0,0 +1,418 @@
+/*
+ *  snapshot.cpp - Delta-compressed state replication for real-time games
+ *
+ *  Abstract:
+ *      Keeps the last SNAP_HISTORY snapshots of an app's state and,
+ *      per peer, which of them it has ACKed, so each update can go out
+ *      as a bit-packed XOR diff against something the peer is known to
+ *      have.  See snapshot.h.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include "snapshot.h"
+
+static const uint8_t snapBroadcast[ADDR_LEN] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+/*
+ *  (Internal) Bits go in and out least significant first.
+ */
+typedef struct bitStream {
+  uint8_t *buf;
+  const uint8_t *in;
+  int room;             // bytes
+  int bit;              // next bit
+  bool over;
+} bit_stream_t;
+
+static void putBits(bit_stream_t *w, uint32_t v, int n) {
+
+  for (int i = 0; i < n; i++, w->bit++) {
+    if ((w->bit >> 3) >= w->room) {
+      w->over = true;
+      return;
+    }
+    if ((w->bit & 7) == 0) w->buf[w->bit >> 3] = 0;
+    if (v & (1 << i)) w->buf[w->bit >> 3] |= 1 << (w->bit & 7);
+  }
+}
+
+static bool getBits(bit_stream_t *r, int n, uint32_t *v) {
+
+  *v = 0;
+  for (int i = 0; i < n; i++, r->bit++) {
+    if ((r->bit >> 3) >= r->room) return false;
+    if (r->in[r->bit >> 3] & (1 << (r->bit & 7))) *v |= 1 << i;
+  }
+  return true;
+}
+
+// The last block may be short
+static int blockEnd(int b, int size) {
+  int end = (b + 1) * SNAP_BLOCK;
+
+  return end < size ? end : size;
+}
+
+Replicator::Replicator() {
+
+  state = NULL;
+  size = 0;
+  numPeers = 0;
+  seq = 0;
+  started = false;
+  ackDue = false;
+  cachedLen = 0;
+  memset(historyValid, 0, sizeof(historyValid));
+  memset(&stats, 0, sizeof(stats));
+}
+
+/*
+ *  Replicate this struct as packets of the given type.  Both sides
+ *  call it with the same struct; self is this unit's MAC.
+ */
+bool Replicator::begin(uint8_t type, void *st, int sz, const uint8_t *me) {
+
+  if (sz <= 0 || sz > SNAP_MAX_STATE) {
+    Serial.printf("snap: State of %d bytes won't fit in a packet!\n", sz);
+    return false;
+  }
+
+  pktType = type;
+  state = (uint8_t *)st;
+  size = sz;
+  memcpy(self, me, ADDR_LEN);
+
+  numPeers = 0;
+  seq = 0;
+  started = false;
+  ackDue = false;
+  cachedLen = 0;
+  memset(historyValid, 0, sizeof(historyValid));
+  memset(&stats, 0, sizeof(stats));
+  return true;
+}
+
+/*
+ *  Owner: send updates to this unit too.  It starts with a full
+ *  snapshot, until it ACKs one.
+ */
+bool Replicator::addPeer(const uint8_t *mac) {
+
+  for (int p = 0; p < numPeers; p++) {
+    if (memcmp(peer[p].node, mac, ADDR_LEN) == 0) return true;
+  }
+  if (numPeers == SNAP_MAX_PEERS) return false;
+
+  memcpy(peer[numPeers].node, mac, ADDR_LEN);
+  peer[numPeers].hasAck = false;
+  peer[numPeers].due = false;
+  numPeers++;
+  return true;
+}
+
+void Replicator::dropPeer(const uint8_t *mac) {
+
+  for (int p = 0; p < numPeers; p++) {
+    if (memcmp(peer[p].node, mac, ADDR_LEN) == 0) {
+      peer[p] = peer[--numPeers];
+      return;
+    }
+  }
+}
+
+int Replicator::peers() {
+  return numPeers;
+}
+
+/*
+ *  Owner: take a snapshot of the state as it is now, and queue it for
+ *  each peer.  Returns its sequence number.
+ */
+uint16_t Replicator::update() {
+
+  if (!state) return 0;
+
+  seq = started ? seq + 1 : 1;
+  started = true;
+
+  memcpy(slot(seq), state, size);
+  historySeq[seq % SNAP_HISTORY] = seq;
+  historyValid[seq % SNAP_HISTORY] = true;
+
+  for (int p = 0; p < numPeers; p++) peer[p].due = true;
+  cachedLen = 0;
+
+  stats.updates++;
+  return seq;
+}
+
+/*
+ *  Owner: take an ACK.  Everyone else: apply a snapshot or diff if
+ *  it's newer than what we have, and owe the sender an ACK.  Returns
+ *  true if the state changed.
+ */
+bool Replicator::receive(const gm_packet_t *pkt) {
+  const uint8_t *p = pkt->payload;
+  uint16_t s, base;
+  uint8_t *to;
+
+  if (!state || pkt->pktType != pktType || pkt->length < SNAP_HEADER) return false;
+  if ((p[0] >> 4) != SNAP_VERSION) return false;
+
+  s = p[1] | (p[2] << 8);
+
+  switch (p[0] & 0x0f) {
+    case snapAck:
+      for (int i = 0; i < numPeers; i++) {
+        if (memcmp(peer[i].node, pkt->srcAddr, ADDR_LEN) != 0) continue;
+
+        // Only ever forward, and never past what we've sent
+        if (started && (int16_t)(s - seq) <= 0 && (!peer[i].hasAck || (int16_t)(s - peer[i].acked) > 0)) {
+          peer[i].acked = s;
+          peer[i].hasAck = true;
+        }
+        stats.acks++;
+      }
+      return false;
+
+    case snapFull:
+      if (pkt->length != SNAP_HEADER + size) return false;
+      if (started && (int16_t)(s - seq) <= 0) {
+        stats.stale++;
+        return false;
+      }
+      to = slot(s);
+      memcpy(to, p + SNAP_HEADER, size);
+      break;
+
+    case snapDelta:
+      if (pkt->length < SNAP_HEADER + 2) return false;
+      if (started && (int16_t)(s - seq) <= 0) {
+        stats.stale++;
+        return false;
+      }
+
+      // The baseline has to be one we still have, in a different slot
+      base = p[3] | (p[4] << 8);
+      if (!haveSnapshot(base) || (uint16_t)(s - base) >= SNAP_HISTORY || s == base) {
+        stats.unusable++;
+        return false;
+      }
+
+      to = slot(s);
+      historyValid[s % SNAP_HISTORY] = false;
+      if (!applyDelta(slot(base), p + SNAP_HEADER + 2, pkt->length - SNAP_HEADER - 2, size, to)) {
+        stats.unusable++;
+        return false;
+      }
+      break;
+
+    default:
+      return false;
+  }
+
+  historySeq[s % SNAP_HISTORY] = s;
+  historyValid[s % SNAP_HISTORY] = true;
+  memcpy(state, to, size);
+  seq = s;
+  started = true;
+  stats.applied++;
+
+  memcpy(ackTo, pkt->srcAddr, ADDR_LEN);
+  ackDue = true;
+  return true;
+}
+
+/*
+ *  The next packet to send, if there is one.  toAll says it's for
+ *  every peer (send it to the session); otherwise it's addressed.
+ */
+bool Replicator::next(gm_packet_t *pkt, bool *toAll) {
+
+  pkt->pktType = pktType;
+  memcpy(pkt->srcAddr, self, ADDR_LEN);
+  *toAll = false;
+
+  if (ackDue) {
+    pkt->payload[0] = (SNAP_VERSION << 4) | snapAck;
+    pkt->payload[1] = seq & 0xff;
+    pkt->payload[2] = seq >> 8;
+    pkt->length = SNAP_HEADER;
+    memcpy(pkt->dstAddr, ackTo, ADDR_LEN);
+
+    ackDue = false;
+    stats.acks++;
+    stats.bytes += pkt->length;
+    return true;
+  }
+
+  for (int p = 0; p < numPeers; p++) {
+    if (!peer[p].due) continue;
+
+    int base = baseline(p);
+    if (cachedLen == 0 || base != cachedBase) {
+      cachedLen = encode(base, cached);
+      cachedBase = base;
+    }
+
+    // Everyone on the same baseline?  Then they can share it
+    *toAll = numPeers > 1;
+    for (int q = 0; q < numPeers; q++) {
+      if (!peer[q].due || baseline(q) != base) *toAll = false;
+    }
+
+    if (*toAll) {
+      for (int q = 0; q < numPeers; q++) peer[q].due = false;
+      memcpy(pkt->dstAddr, snapBroadcast, ADDR_LEN);
+    } else {
+      peer[p].due = false;
+      memcpy(pkt->dstAddr, peer[p].node, ADDR_LEN);
+    }
+
+    memcpy(pkt->payload, cached, cachedLen);
+    pkt->length = cachedLen;
+
+    if ((cached[0] & 0x0f) == snapFull) stats.fulls++;
+    else stats.deltas++;
+    stats.bytes += cachedLen;
+    return true;
+  }
+
+  return false;
+}
+
+uint16_t Replicator::sequence() {
+  return seq;
+}
+
+void Replicator::getStats(snap_stats_t *st) {
+  memcpy(st, &stats, sizeof(snap_stats_t));
+}
+
+/*
+ *  Diff cur against base: a bit per block saying whether it changed,
+ *  then for each one that did, a bit per byte, the width of the
+ *  widest XOR (3 bits, less one), and the changed bytes' XORs at
+ *  that width.  Small moves (a coordinate off by one or two) come to
+ *  a couple of bits a byte.
+ */
+int Replicator::encodeDelta(const uint8_t *base, const uint8_t *cur, int size, uint8_t *out, int room) {
+  bit_stream_t w = { out, NULL, room, 0, false };
+  int blocks = (size + SNAP_BLOCK - 1) / SNAP_BLOCK;
+
+  for (int b = 0; b < blocks; b++) {
+    int end = blockEnd(b, size);
+    bool dirty = false;
+
+    for (int i = b * SNAP_BLOCK; i < end; i++) {
+      if (base[i] != cur[i]) dirty = true;
+    }
+    putBits(&w, dirty, 1);
+  }
+
+  for (int b = 0; b < blocks; b++) {
+    int start = b * SNAP_BLOCK, end = blockEnd(b, size);
+    uint32_t mask = 0;
+    uint8_t widest = 0;
+    int width = 1;
+
+    for (int i = start; i < end; i++) {
+      uint8_t x = base[i] ^ cur[i];
+
+      if (x) mask |= 1 << (i - start);
+      widest |= x;
+    }
+    if (!mask) continue;
+
+    while (widest >> width) width++;
+
+    putBits(&w, mask, end - start);
+    putBits(&w, width - 1, 3);
+    for (int i = start; i < end; i++) {
+      if (mask & (1 << (i - start))) putBits(&w, base[i] ^ cur[i], width);
+    }
+  }
+
+  return w.over ? -1 : (w.bit + 7) / 8;
+}
+
+bool Replicator::applyDelta(const uint8_t *base, const uint8_t *in, int len, int size, uint8_t *out) {
+  bit_stream_t r = { NULL, in, len, 0, false };
+  int blocks = (size + SNAP_BLOCK - 1) / SNAP_BLOCK;
+  uint32_t dirty[(SNAP_MAX_STATE + SNAP_BLOCK - 1) / SNAP_BLOCK];
+
+  if (size > SNAP_MAX_STATE) return false;
+
+  memcpy(out, base, size);
+
+  for (int b = 0; b < blocks; b++) {
+    if (!getBits(&r, 1, &dirty[b])) return false;
+  }
+
+  for (int b = 0; b < blocks; b++) {
+    int start = b * SNAP_BLOCK, end = blockEnd(b, size);
+    uint32_t mask, width, x;
+
+    if (!dirty[b]) continue;
+    if (!getBits(&r, end - start, &mask) || !getBits(&r, 3, &width)) return false;
+
+    for (int i = start; i < end; i++) {
+      if (!(mask & (1 << (i - start)))) continue;
+      if (!getBits(&r, width + 1, &x)) return false;
+      out[i] ^= x;
+    }
+  }
+
+  return true;
+}
+
+/*
+ *  (Internal) Where a snapshot lives in the history ring.
+ */
+uint8_t *Replicator::slot(uint16_t s) {
+  return history[s % SNAP_HISTORY];
+}
+
+bool Replicator::haveSnapshot(uint16_t s) {
+  return historyValid[s % SNAP_HISTORY] && historySeq[s % SNAP_HISTORY] == s;
+}
+
+/*
+ *  (Internal) What a peer's next update can be a diff against: the
+ *  last one it ACKed, if we still have it, or -1 for a full snapshot.
+ */
+int Replicator::baseline(int p) {
+
+  if (!peer[p].hasAck) return -1;
+  if ((uint16_t)(seq - peer[p].acked) >= SNAP_HISTORY || !haveSnapshot(peer[p].acked)) return -1;
+  return peer[p].acked;
+}
+
+/*
+ *  (Internal) The current snapshot, as a diff against base, or whole
+ *  if there is no base or the diff comes out bigger.
+ */
+int Replicator::encode(int base, uint8_t *out) {
+  int n = -1;
+
+  out[1] = seq & 0xff;
+  out[2] = seq >> 8;
+
+  if (base >= 0) {
+    out[3] = base & 0xff;
+    out[4] = base >> 8;
+    n = encodeDelta(slot(base), slot(seq), size, out + SNAP_HEADER + 2, MAX_PKT_LEN - SNAP_HEADER - 2);
+  }
+
+  if (n >= 0 && n + 2 < size) {
+    out[0] = (SNAP_VERSION << 4) | snapDelta;
+    return SNAP_HEADER + 2 + n;
+  }
+
+  out[0] = (SNAP_VERSION << 4) | snapFull;
+  memcpy(out + SNAP_HEADER, slot(seq), size);
+  return SNAP_HEADER + size;
+}
@@ -0,0 +1,126 @@
+/*
+ *  snapshot.h - Delta-compressed state replication for real-time games
+ *
+ *  Abstract:
+ *      A game whose shared state changes every tick hands a Replicator
+ *      its state struct.  The unit that owns the state (usually the
+ *      session host) calls update() once a tick; everyone else feeds
+ *      the packets to receive() and their copy is kept current.  Each
+ *      update goes to each peer as a diff against the last snapshot
+ *      that peer ACKed: the two are XORed, and only the 8-byte blocks
+ *      that differ are sent, as a bitmap of blocks, then for each one
+ *      a mask of the bytes that changed and their XORs, bit-packed to
+ *      the width of the widest.  Peers on the same baseline share a
+ *      packet.  A peer with no usable baseline (new, or more than
+ *      SNAP_HISTORY updates behind) gets the whole state instead.  A
+ *      lost update or ACK just makes the next diff a little bigger,
+ *      since a baseline only moves when its ACK comes back.
+ *
+ *      The Replicator doesn't send anything itself; next() hands out
+ *      what's ready, so the owner's loop does
+ *
+ *          snap.update();
+ *          while (snap.next(&pkt, &all)) {
+ *            all ? netTask.sendSession(&pkt) : netTask.sendPkt(&pkt);
+ *          }
+ *
+ *      and the others do the same after receive(), to send their ACK.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_SNAPSHOT_H_
+#define _GM_SNAPSHOT_H_
+
+#include "network.h"
+
+#define SNAP_VERSION        1
+#define SNAP_HEADER         3     // version/kind, seq
+#define SNAP_MAX_STATE    224     // biggest state struct (a full snapshot must fit in a packet)
+#define SNAP_HISTORY       16     // snapshots kept as possible baselines
+#define SNAP_BLOCK          8     // bytes per block in a diff
+#define SNAP_MAX_PEERS    (SESSION_MAX_MEMBERS - 1)
+
+// Low nibble of the first payload byte (SNAP_VERSION is the high one)
+enum snapKind : uint8_t {
+  snapFull = 1,         // seq, then the whole state
+  snapDelta,            // seq, baseline seq, then the diff
+  snapAck               // seq received and applied
+};
+
+typedef struct snapStats {
+  uint32_t updates;     // update() calls
+  uint32_t fulls;       // full snapshots sent (per packet)
+  uint32_t deltas;      // diffs sent (per packet)
+  uint32_t bytes;       // payload bytes sent, ACKs included
+  uint32_t acks;        // ACKs heard (owner) or sent (the rest)
+  uint32_t applied;     // snapshots received and applied
+  uint32_t stale;       // received, but not newer than what we have
+  uint32_t unusable;    // diffs against a baseline we don't have
+} snap_stats_t;
+
+class Replicator {
+  public:
+    Replicator();
+
+    bool begin(uint8_t pktType, void *state, int size, const uint8_t *self);
+
+    // Owner side: who gets updates, and taking one
+    bool addPeer(const uint8_t *mac);
+    void dropPeer(const uint8_t *mac);
+    int peers();
+    uint16_t update();
+
+    // Both sides
+    bool receive(const gm_packet_t *pkt);
+    bool next(gm_packet_t *pkt, bool *toAll);
+    uint16_t sequence();
+    void getStats(snap_stats_t *stats);
+
+    // The diff itself: bytes written (-1 if it won't fit), and applied
+    static int encodeDelta(const uint8_t *base, const uint8_t *cur, int size, uint8_t *out, int room);
+    static bool applyDelta(const uint8_t *base, const uint8_t *in, int len, int size, uint8_t *out);
+
+  private:
+    typedef struct snapPeer {
+      uint8_t node[ADDR_LEN];
+      uint16_t acked;       // newest snapshot it has ACKed
+      bool hasAck;
+      bool due;             // owes a packet for the current update
+    } snap_peer_t;
+
+    uint8_t *slot(uint16_t seq);
+    bool haveSnapshot(uint16_t seq);
+    int baseline(int p);
+    int encode(int base, uint8_t *out);
+
+    uint8_t pktType;
+    uint8_t *state;
+    int size;
+    uint8_t self[ADDR_LEN];
+
+    // The last SNAP_HISTORY snapshots taken (owner) or received
+    uint8_t history[SNAP_HISTORY][SNAP_MAX_STATE];
+    uint16_t historySeq[SNAP_HISTORY];
+    bool historyValid[SNAP_HISTORY];
+    uint16_t seq;           // newest taken or applied
+    bool started;
+
+    snap_peer_t peer[SNAP_MAX_PEERS];
+    int numPeers;
+
+    // Encoded once per baseline per update
+    uint8_t cached[MAX_PKT_LEN];
+    int cachedLen;
+    int cachedBase;
+
+    // An ACK owed to the owner
+    uint8_t ackTo[ADDR_LEN];
+    bool ackDue;
+
+    snap_stats_t stats;
+};
+
+#endif
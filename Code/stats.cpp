@@ -0,0 +1,235 @@
+/*
+ *  stats.cpp - Per-task CPU and scheduler statistics
+ *
+ *  Abstract:
+ *      Tick sampling is statistical: a task that always blocks just
+ *      before the tick is undercounted, and switches that happen and
+ *      undo themselves between ticks aren't seen.  At a 1ms tick and
+ *      over a few seconds it's plenty to tell which task is eating the
+ *      CPU, and it works on the stock Arduino core, which doesn't
+ *      build FreeRTOS with run time stats.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include "esp_freertos_hooks.h"
+
+#include "GameMan.h"
+#include "stats.h"
+
+task_counters_t RunStats::counters[STATS_MAX_TASKS];
+uint32_t RunStats::lastCount[portNUM_PROCESSORS];
+bool RunStats::primed[portNUM_PROCESSORS];
+TaskHandle_t RunStats::lastTask[portNUM_PROCESSORS];
+uint64_t RunStats::coreCycles[portNUM_PROCESSORS];
+portMUX_TYPE RunStats::statLock = portMUX_INITIALIZER_UNLOCKED;
+
+RunStats::RunStats() {
+  memset(lastCoreCycles, 0, sizeof(lastCoreCycles));
+}
+
+void RunStats::begin() {
+  if (hooked) return;
+
+  // Each core's cycle counter is its own, so each tick hook reads its
+  // starting point the first time it runs
+  for (int c = 0; c < portNUM_PROCESSORS; c++) primed[c] = false;
+
+  if (esp_register_freertos_tick_hook_for_cpu(tick0, PRO_CPU_NUM) != ESP_OK ||
+      esp_register_freertos_tick_hook_for_cpu(tick1, APP_CPU_NUM) != ESP_OK) {
+    Serial.println("stats: Could not hook the tick interrupts!");
+    return;
+  }
+
+  hooked = true;
+}
+
+void IRAM_ATTR RunStats::tick0() {
+  charge(PRO_CPU_NUM);
+}
+
+void IRAM_ATTR RunStats::tick1() {
+  charge(APP_CPU_NUM);
+}
+
+/*
+ *  (Internal, tick interrupt) Charge the cycles since this core's last
+ *  tick to whichever task the tick interrupted.  A full table just
+ *  drops the sample; dead tasks' slots are recycled by snapshot().
+ *  The first tick on each core only notes where its counter is.
+ */
+void IRAM_ATTR RunStats::charge(int core) {
+  TaskHandle_t t = xTaskGetCurrentTaskHandleForCPU(core);
+  uint32_t now = ESP.getCycleCount();
+  uint32_t delta = now - lastCount[core];
+  int free = -1;
+
+  lastCount[core] = now;
+  if (!primed[core]) {
+    primed[core] = true;
+    lastTask[core] = t;
+    return;
+  }
+
+  portENTER_CRITICAL_ISR(&statLock);
+
+  coreCycles[core] += delta;
+
+  for (int i = 0; i < STATS_MAX_TASKS; i++) {
+    if (counters[i].handle == t) {
+      counters[i].cycles += delta;
+      if (lastTask[core] != t) counters[i].switches++;
+      free = -2;
+      break;
+    }
+    if (counters[i].handle == NULL && free == -1) free = i;
+  }
+
+  if (free >= 0) {
+    counters[free].handle = t;
+    counters[free].cycles = delta;
+    counters[free].switches = 1;
+    counters[free].lastCycles = 0;
+    counters[free].lastSwitches = 0;
+    counters[free].lastRunTime = 0;
+  }
+
+  lastTask[core] = t;
+  portEXIT_CRITICAL_ISR(&statLock);
+}
+
+/*
+ *  Compute the numbers for the window since the last snapshot.  The
+ *  live task list comes from FreeRTOS (so names and stacks are never
+ *  read from a deleted task), and our counters are matched up to it.
+ */
+int RunStats::snapshot(task_stat_t *rows, int max, uint16_t corePct10[portNUM_PROCESSORS]) {
+  TaskStatus_t status[STATS_MAX_TASKS];
+  uint32_t totalRunTime = 0;
+  uint64_t window[portNUM_PROCESSORS];
+  uint64_t idle[portNUM_PROCESSORS];
+  int count, n = 0;
+
+  count = uxTaskGetSystemState(status, STATS_MAX_TASKS, &totalRunTime);
+
+  // FreeRTOS fills in nothing if the list doesn't fit.  Leave every
+  // counter and window start alone rather than take that as "all the
+  // tasks are gone" and wipe their history.
+  if (count == 0) {
+    if (!overflowed) Serial.printf("stats: More than %d tasks, not reporting!\n", STATS_MAX_TASKS);
+    overflowed = true;
+    for (int c = 0; c < portNUM_PROCESSORS; c++) corePct10[c] = 0;
+    return 0;
+  }
+  overflowed = false;
+
+  portENTER_CRITICAL(&statLock);
+
+  for (int c = 0; c < portNUM_PROCESSORS; c++) {
+    window[c] = coreCycles[c] - lastCoreCycles[c];
+    lastCoreCycles[c] = coreCycles[c];
+    idle[c] = 0;
+  }
+
+  // Forget tasks that have gone away
+  for (int i = 0; i < STATS_MAX_TASKS; i++) {
+    bool alive = false;
+    for (int j = 0; j < count && !alive; j++) alive = (status[j].xHandle == counters[i].handle);
+    if (!alive) counters[i].handle = NULL;
+  }
+
+  for (int j = 0; j < count && n < max; j++) {
+    task_counters_t *tc = NULL;
+    uint64_t cycles = 0;
+    uint32_t switches = 0;
+
+    for (int i = 0; i < STATS_MAX_TASKS; i++) {
+      if (counters[i].handle == status[j].xHandle) {
+        tc = &counters[i];
+        break;
+      }
+    }
+
+    if (tc) {
+      cycles = tc->cycles - tc->lastCycles;
+      switches = tc->switches - tc->lastSwitches;
+      tc->lastCycles = tc->cycles;
+      tc->lastSwitches = tc->switches;
+    }
+
+    rows[n].name = status[j].pcTaskName;
+#if configTASKLIST_INCLUDE_COREID
+    rows[n].core = (status[j].xCoreID < portNUM_PROCESSORS) ? status[j].xCoreID : -1;
+#else
+    rows[n].core = -1;
+#endif
+    rows[n].prio = status[j].uxCurrentPriority;
+    rows[n].switches = switches;
+    rows[n].stackFree = status[j].usStackHighWaterMark;   // bytes on ESP-IDF
+
+#if configGENERATE_RUN_TIME_STATS
+    // Exact run time: share of one core's worth of the elapsed time
+    uint32_t ran = tc ? status[j].ulRunTimeCounter - tc->lastRunTime : 0;
+    uint32_t elapsed = totalRunTime - lastTotalRunTime;
+    if (tc) tc->lastRunTime = status[j].ulRunTimeCounter;
+    rows[n].pct10 = elapsed ? (uint64_t)ran * 1000 / elapsed : 0;
+#else
+    // Sampled cycles: share of its core (core 0's, for floaters)
+    uint64_t span = window[rows[n].core >= 0 ? rows[n].core : PRO_CPU_NUM];
+    rows[n].pct10 = span ? cycles * 1000 / span : 0;
+#endif
+    if (rows[n].pct10 > 1000) rows[n].pct10 = 1000;
+
+    // The idle tasks tell us how busy each core is
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+      if (status[j].xHandle == xTaskGetIdleTaskHandleForCPU(c)) idle[c] = rows[n].pct10;
+    }
+
+    n++;
+  }
+
+  portEXIT_CRITICAL(&statLock);
+  lastTotalRunTime = totalRunTime;
+
+  for (int c = 0; c < portNUM_PROCESSORS; c++) {
+    corePct10[c] = (window[c] || configGENERATE_RUN_TIME_STATS) ? 1000 - idle[c] : 0;
+  }
+
+  // Busiest first (insertion sort; there are only a couple dozen)
+  for (int i = 1; i < n; i++) {
+    task_stat_t r = rows[i];
+    int k = i - 1;
+    while (k >= 0 && rows[k].pct10 < r.pct10) {
+      rows[k + 1] = rows[k];
+      k--;
+    }
+    rows[k + 1] = r;
+  }
+
+  return n;
+}
+
+/*
+ *  Serial dump of everything (the vTaskList() we never had).
+ */
+void RunStats::dump() {
+  task_stat_t rows[STATS_MAX_TASKS];
+  uint16_t core[portNUM_PROCESSORS];
+  int n = snapshot(rows, STATS_MAX_TASKS, core);
+
+  if (n == 0) return;   // too many tasks, already said so
+
+  Serial.printf("stats: CPU0 %d.%d%%  CPU1 %d.%d%%  (%s)\n",
+                core[0] / 10, core[0] % 10, core[1] / 10, core[1] % 10,
+                configGENERATE_RUN_TIME_STATS ? "run time counters" : "tick sampled");
+  Serial.println("stats: task             core prio   cpu%  switches  stack free");
+
+  for (int i = 0; i < n; i++) {
+    Serial.printf("stats: %-16s %4s %4d %4d.%d %9u %11u\n", rows[i].name,
+                  rows[i].core < 0 ? "any" : (rows[i].core ? "1" : "0"), rows[i].prio,
+                  rows[i].pct10 / 10, rows[i].pct10 % 10,
+                  (unsigned)rows[i].switches, (unsigned)rows[i].stackFree);
+  }
+}
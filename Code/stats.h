@@ -0,0 +1,82 @@
+/*
+ *  stats.h - Per-task CPU and scheduler statistics
+ *
+ *  Abstract:
+ *      Answers "what is each task actually costing us?"  A FreeRTOS
+ *      tick hook on each core notes which task was running when the
+ *      tick fired and charges it the CPU cycles (CCOUNT) since the
+ *      previous tick, and counts a context switch whenever that task
+ *      differs from last time.  If the core was built with
+ *      configGENERATE_RUN_TIME_STATS the exact FreeRTOS run time
+ *      counters are used for the CPU figures instead.  Either way,
+ *      snapshot() reports each task's share of a core, each core's
+ *      load, switches and stack high-water marks since the last
+ *      snapshot, for SysInfo and the serial dump.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_STATS_H_
+#define _GM_STATS_H_
+
+#include <Arduino.h>
+
+#define STATS_MAX_TASKS  32     // the Arduino core alone runs about a dozen, we add ~8
+
+// One task's numbers for a snapshot window
+typedef struct taskStat {
+  const char *name;
+  int8_t core;                  // pinned core, or -1 if it floats
+  uint8_t prio;
+  uint16_t pct10;               // CPU in tenths of a percent of one core
+  uint32_t switches;            // times it was seen to be switched in
+  uint32_t stackFree;           // stack high-water mark (bytes never used)
+} task_stat_t;
+
+// Running totals the tick hooks keep for each task
+typedef struct taskCounters {
+  TaskHandle_t handle;
+  uint64_t cycles;              // CCOUNT cycles charged to it
+  uint32_t switches;
+  uint64_t lastCycles;          // ...as of the previous snapshot
+  uint32_t lastSwitches;
+  uint32_t lastRunTime;         // FreeRTOS counter, if we have it
+} task_counters_t;
+
+class RunStats {
+public:
+  RunStats();
+
+  // Hook the tick interrupts on both cores
+  void begin();
+
+  // Fill rows (busiest first) for the window since the last call;
+  // returns how many.  corePct10 gets each core's load.  0 means there
+  // are more tasks than STATS_MAX_TASKS: nothing is reported (or
+  // forgotten), and the next good snapshot covers the whole gap.
+  int snapshot(task_stat_t *rows, int max, uint16_t corePct10[portNUM_PROCESSORS]);
+
+  // Print a snapshot to the serial console
+  void dump();
+
+private:
+  static void IRAM_ATTR tick0();
+  static void IRAM_ATTR tick1();
+  static void IRAM_ATTR charge(int core);
+
+  static task_counters_t counters[STATS_MAX_TASKS];
+  static uint32_t lastCount[portNUM_PROCESSORS];
+  static bool primed[portNUM_PROCESSORS];     // lastCount read on that core yet
+  static TaskHandle_t lastTask[portNUM_PROCESSORS];
+  static uint64_t coreCycles[portNUM_PROCESSORS];
+  static portMUX_TYPE statLock;
+
+  uint64_t lastCoreCycles[portNUM_PROCESSORS];
+  uint32_t lastTotalRunTime = 0;
+  bool hooked = false;
+  bool overflowed = false;      // last snapshot found too many tasks
+};
+
+#endif
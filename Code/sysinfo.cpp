@@ -17,6 +17,7 @@
 #include "hardware.h"
 #include "graphics.h"
 #include "sysinfo.h"
+#include "boot.h"
 
 SysInfo::SysInfo()
   : GMTask("SYSINFO") {
@@ -30,23 +31,12 @@ void SysInfo::setup(bool rsvp) {
 }
 
 /*
- *  Compute approximately how much battery life is available.
- *  Prints to the console for debugging; returns the pct from 0..100.
+ *  Battery charge as published by the battery task (no ADC reads here).
  */
-uint8_t SysInfo::getBatteryAvail() {
-  uint8_t pct = 100;
-  float voltage = analogRead(VBAT_SENSE) / 4096.0 * 7.23;  // ESP32-WROOM-32E with voltage divider
+String SysInfo::batteryStatus() {
+  battery_info_t b = battery.get();
 
-  Serial.println("Battery sense: " + String(voltage));
-
-  // Polynomial courtesy of github.com/G6EJD/LiPo_Battery_Capacity
-  pct = 2808.3808 * pow(voltage, 4) - 43560.9157 * pow(voltage, 3) + 252848.5888 * pow(voltage, 2) - 650767.4615 * voltage + 626532.5703;
-
-  if (voltage > 4.19) pct = 100;
-  else if (voltage <= 3.50) pct = 0;
-
-  Serial.println("Battery avail: " + String(pct) + "%");
-  return pct;
+  return String(b.pct) + "% " + String(b.mv / 1000.0, 2) + "V" + (b.low ? "!" : "");
 }
 
 /*
@@ -72,7 +62,7 @@ int SysInfo::showHWInfo() {
   button_event_t press;
   uint16_t upX, upY;
   uint16_t pctX, pctY;
-  TickType_t lastBatt = xTaskGetTickCount();
+  int t;
 
   showHeader();
   display.println("Address:");
@@ -83,61 +73,83 @@ int SysInfo::showHWInfo() {
   display.print("Battery:  ");
   pctX = display.getCursorX();
   pctY = display.getCursorY();
-  display.println(String(getBatteryAvail()) + "%");
+  display.println(batteryStatus());
   display.println();
   display.print("Uptime:   ");
   upX = display.getCursorX();
   upY = display.getCursorY();
-  display.print(uptime());
+  display.println(uptime());
+  display.println("Idle:     ~" + String(power.idleCurrent(), 1) + "mA");
+  display.println("Wake:     " + String(power.wakeLatencyUs()) + "us/" + String(power.radioGapMs()) + "ms");
   display.setCursor(0, display.height() - 10);
   display.print("                -->");
   display.display();
 
+  // Update the uptime every second, the battery as often as it's sampled
+  timers.start(tmrUptime, 1000, true);
+  timers.start(tmrBattery, BATT_INTERVAL, true);
+
   for (;;) {
 
-    // Update the uptime while waiting for a button press to exit
-    if (xQueueReceive(buttonEvents, &(press), (TickType_t)1000)) {
+    // Sleep until a button press or the next refresh is due
+    if (xQueueReceive(buttonEvents, &(press), timers.ticksToNext())) {
       if (press.action == btnReleased) {
         switch (press.id) {
-          case BTN_RT:  return 2;   // next page
-          case BTN_LT:  break;      // ignore
-          default:      return 0;   // exit
+          case BTN_RT:  timers.clear(); return 2;   // next page
+          case BTN_LT:  break;                      // ignore
+          default:      timers.clear(); return 0;   // exit
         }
       }
     }
 
-    display.setCursor(upX, upY);
-    display.fillRect(upX, upY, display.width() - upX, 10, BLACK);
-    display.print(uptime());
-    display.display();
-
-    // Update the battery charge less frequently
-    if (elapsed(60000, lastBatt)) {
-      display.setCursor(pctX, pctY);
-      display.fillRect(pctX, pctY, display.width() - pctX, 10, BLACK);
-      display.print(String(getBatteryAvail()) + "%");
+    while ((t = timers.expired()) != TMR_NONE) {
+      if (t == tmrUptime) {
+        display.setCursor(upX, upY);
+        display.fillRect(upX, upY, display.width() - upX, 8, BLACK);   // don't clip the next line
+        display.print(uptime());
+      } else if (t == tmrBattery) {
+        display.setCursor(pctX, pctY);
+        display.fillRect(pctX, pctY, display.width() - pctX, 10, BLACK);
+        display.print(batteryStatus());
+      }
       display.display();
-      lastBatt = xTaskGetTickCount();
     }
   }
 }
 
 int SysInfo::showPlayerInfo() {
   button_event_t press;
+  uint16_t fastX, fastY;
+  bool fast = BootTask::fastBoot();
 
   showHeader();
   display.println("Player info/edit");
   display.println("goes here (TBD)");
+  display.println();
+  display.print("Fast boot (A): ");
+  fastX = display.getCursorX();
+  fastY = display.getCursorY();
+  display.print(fast ? "on" : "off");
   display.setCursor(0, display.height() - 10);
   display.print("<--             -->");
   display.display();
 
   for (;;) {
 
-    // Update the uptime while waiting for a button press to exit
-    if (xQueueReceive(buttonEvents, &(press), (TickType_t)1000)) {
+    // Nothing to refresh, so just sleep until a button press
+    if (xQueueReceive(buttonEvents, &(press), portMAX_DELAY)) {
       if (press.action == btnReleased) {
         switch (press.id) {
+          case BTN_A:
+            // Toggle skipping the splash screen at power on
+            fast = !fast;
+            BootTask::setFastBoot(fast);
+            display.fillRect(fastX, fastY, display.width() - fastX, 10, BLACK);
+            display.setCursor(fastX, fastY);
+            display.print(fast ? "on" : "off");
+            display.display();
+            break;
+
           case BTN_RT:  return 3;   // next page
           case BTN_LT:  return 1;   // prev page
           default:      return 0;   // exit
@@ -148,28 +160,218 @@ int SysInfo::showPlayerInfo() {
 }
 
 
+/*
+ *  A round trip in ms, in three characters or less.
+ */
+static const char *fmtRTT(int us, char *buf, size_t len) {
+  if (us < 0) snprintf(buf, len, "-");
+  else if (us < 10000) snprintf(buf, len, "%.1f", us / 1000.0);
+  else if (us < 1000000) snprintf(buf, len, "%d", us / 1000);
+  else snprintf(buf, len, ">1s");
+  return buf;
+}
+
+/*
+ *  (Re)draw the link table: two lines per player, tag then numbers.
+ */
+void SysInfo::drawLinks(int16_t top) {
+  gm_link_stats_t l;
+  char line[48], rtt[8], p95[8], loss[12], rssi[12], fail[12];
+  int shown = 0;
+
+  display.fillRect(0, top, display.width(), display.height() - 10 - top, BLACK);
+  display.setCursor(0, top);
+  display.println("rtt/p95ms loss dBm tx");
+
+  for (int p = 1; p < MAX_PLAYERS && shown < SYS_LINK_ROWS; p++) {
+    if (!netTask.getLinkStats(p, &l)) continue;
+
+    if (l.loss < 0) snprintf(loss, sizeof(loss), "-");
+    else snprintf(loss, sizeof(loss), "%d", l.loss);
+    if (l.rssi == 0) snprintf(rssi, sizeof(rssi), "-");
+    else snprintf(rssi, sizeof(rssi), "%d", l.rssi);
+    snprintf(fail, sizeof(fail), l.txFailed > 99 ? "99+" : "%d", l.txFailed);
+
+    snprintf(line, sizeof(line), "%.11s%s", netTask.getPlayer(p)->tag, l.hops ? " (relayed)" : "");
+    display.println(line);
+    snprintf(line, sizeof(line), "%3s/%-5s%4s%%%4s%3s", fmtRTT(l.rtt, rtt, sizeof(rtt)),
+             fmtRTT(l.rttP95, p95, sizeof(p95)), loss, rssi, fail);
+    display.println(line);
+    shown++;
+  }
+
+  if (!shown) display.println("(nobody around)");
+}
+
 int SysInfo::showNetInfo() {
   button_event_t press;
+  uint16_t relayX, relayY;
+  int16_t top;
+  bool relay = netTask.relaying();
 
   showHeader();
-  display.println("Network info");
-  display.println("goes here (TBD)");
+  display.print("Relay (A): ");
+  relayX = display.getCursorX();
+  relayY = display.getCursorY();
+  display.println(relay ? "on" : "off");
+  top = display.getCursorY();
+  drawLinks(top);
+  display.setCursor(0, display.height() - 10);
+  display.print("<--             -->");
+  display.display();
+
+  // Measure round trips to everyone while we're looking
+  netTask.probeAll(true);
+  timers.start(tmrLinks, SYS_LINK_REFRESH, true);
+
+  for (;;) {
+
+    // Sleep until a button press or it's time to refresh
+    if (xQueueReceive(buttonEvents, &(press), timers.ticksToNext())) {
+      if (press.action == btnReleased) {
+        switch (press.id) {
+          case BTN_A:
+            // Toggle forwarding other units' traffic
+            relay = !relay;
+            netTask.setRelay(relay);
+            display.fillRect(relayX, relayY, display.width() - relayX, 8, BLACK);
+            display.setCursor(relayX, relayY);
+            display.print(relay ? "on" : "off");
+            display.display();
+            break;
+
+          case BTN_RT:  netTask.probeAll(false); timers.clear(); return 4;   // next page
+          case BTN_LT:  netTask.probeAll(false); timers.clear(); return 2;   // prev page
+          default:      netTask.probeAll(false); timers.clear(); return 0;   // exit
+        }
+      }
+    }
+
+    if (timers.expired() == tmrLinks) {
+      drawLinks(top);
+      display.display();
+    }
+  }
+}
+
+/*
+ *  (Re)draw the task table: core loads, then the busiest tasks.
+ */
+void SysInfo::drawTaskStats(int16_t top) {
+  task_stat_t rows[STATS_MAX_TASKS];
+  uint16_t core[portNUM_PROCESSORS];
+  char line[24];
+  int n = runStats.snapshot(rows, STATS_MAX_TASKS, core);
+
+  display.fillRect(0, top, display.width(), display.height() - 10 - top, BLACK);
+  display.setCursor(0, top);
+
+  snprintf(line, sizeof(line), "CPU0 %3d%%  CPU1 %3d%%", core[0] / 10, core[1] / 10);
+  display.println(line);
+  display.println("task     c cpu  stack");
+  if (n == 0) display.println("(too many tasks)");
+
+  for (int i = 0; i < n && i < SYS_TASK_ROWS; i++) {
+    snprintf(line, sizeof(line), "%-8.8s %c %3d%% %5u", rows[i].name,
+             rows[i].core < 0 ? '-' : '0' + rows[i].core, rows[i].pct10 / 10, (unsigned)rows[i].stackFree);
+    display.println(line);
+  }
+}
+
+int SysInfo::showTaskInfo() {
+  button_event_t press;
+  int16_t top;
+
+  showHeader();
+  top = display.getCursorY();
+  drawTaskStats(top);
+  display.setCursor(0, display.height() - 10);
+  display.print("<--             -->");
+  display.display();
+
+  timers.start(tmrTasks, SYS_TASK_REFRESH, true);
+
+  for (;;) {
+
+    // Sleep until a button press or it's time to refresh
+    if (xQueueReceive(buttonEvents, &(press), timers.ticksToNext())) {
+      if (press.action == btnReleased) {
+        switch (press.id) {
+          case BTN_RT:  timers.clear(); return 5;   // next page
+          case BTN_LT:  timers.clear(); return 3;   // prev page
+          default:      timers.clear(); return 0;   // exit
+        }
+      }
+    }
+
+    if (timers.expired() == tmrTasks) {
+      drawTaskStats(top);
+      display.display();
+    }
+  }
+}
+
+/*
+ *  (Re)draw the profiling zones, in CPU cycles.
+ */
+void SysInfo::drawProfile(int16_t top) {
+  prof_summary_t s;
+  char line[24], avg[8], p99[8], max[8];
+
+  display.fillRect(0, top, display.width(), display.height() - 10 - top, BLACK);
+  display.setCursor(0, top);
+  display.println("zone   avg  p99  max");
+
+  for (int i = 0; i < pzZoneCount; i++) {
+    if (profiler.summarize(i, &s)) {
+      snprintf(line, sizeof(line), "%-5.5s%5s%5s%5s", s.name, Profiler::format(s.avg, avg, sizeof(avg)),
+               Profiler::format(s.p99, p99, sizeof(p99)), Profiler::format(s.max, max, sizeof(max)));
+    } else {
+      snprintf(line, sizeof(line), "%-5.5s    -", s.name);
+    }
+    display.println(line);
+  }
+
+  display.println();
+  display.println("cycles; A resets");
+}
+
+int SysInfo::showProfile() {
+  button_event_t press;
+  int16_t top;
+
+  showHeader();
+  top = display.getCursorY();
+  drawProfile(top);
   display.setCursor(0, display.height() - 10);
   display.print("<--");
   display.display();
 
+  timers.start(tmrTasks, SYS_TASK_REFRESH, true);
+
   for (;;) {
 
-    // Update the uptime while waiting for a button press to exit
-    if (xQueueReceive(buttonEvents, &(press), (TickType_t)1000)) {
+    // Sleep until a button press or it's time to refresh
+    if (xQueueReceive(buttonEvents, &(press), timers.ticksToNext())) {
       if (press.action == btnReleased) {
         switch (press.id) {
-          case BTN_RT:  break;      // no next page
-          case BTN_LT:  return 2;   // prev page
-          default:      return 0;   // exit
+          case BTN_A:
+            profiler.reset();
+            drawProfile(top);
+            display.display();
+            break;
+
+          case BTN_RT:  break;                      // no next page
+          case BTN_LT:  timers.clear(); return 4;   // prev page
+          default:      timers.clear(); return 0;   // exit
         }
       }
     }
+
+    if (timers.expired() == tmrTasks) {
+      drawProfile(top);
+      display.display();
+    }
   }
 }
 
@@ -180,6 +382,8 @@ void SysInfo::showSystemInfo() {
     if (page == 1)      page = showHWInfo();
     else if (page == 2) page = showPlayerInfo();
     else if (page == 3) page = showNetInfo();
+    else if (page == 4) page = showTaskInfo();
+    else if (page == 5) page = showProfile();
   } 
 }
 
@@ -14,21 +14,37 @@
 #ifndef _GM_SYSINFO_H_
 #define _GM_SYSINFO_H_
 
+#include "timer.h"
+
+#define SYS_TASK_REFRESH  2000  // ms between task table updates
+#define SYS_TASK_ROWS     7     // as many as fit under the header
+#define SYS_LINK_REFRESH  1000  // ms between link table updates
+#define SYS_LINK_ROWS     4     // players, two lines each
+
+enum infoTimer : byte { tmrUptime, tmrBattery, tmrTasks, tmrLinks };
+
 class SysInfo : public GMTask {
   public:
     SysInfo();
     void setup(bool rsvp) override;
-    uint8_t getBatteryAvail();
 
     static const String appName;
 
   private:
     void run() override;
     void showHeader();
+    String batteryStatus();
     void showSystemInfo();
     int showHWInfo();
     int showPlayerInfo();
     int showNetInfo();
+    void drawLinks(int16_t top);
+    int showTaskInfo();
+    void drawTaskStats(int16_t top);
+    int showProfile();
+    void drawProfile(int16_t top);
+
+    GMTimers timers;
 };
 
 #endif
\ No newline at end of file
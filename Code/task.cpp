@@ -50,15 +50,20 @@ void GMTask::stop() {
 }
 
 void GMTask::delay(int ms) {
-  vTaskDelay(ms / portTICK_PERIOD_MS);
+  vTaskDelay(pdMS_TO_TICKS(ms));
 }
 
+/*
+ *  True if at least ms milliseconds have passed since the given tick
+ *  count.  Compare in ticks (converted properly, whatever the tick
+ *  rate) so a wrapped tick counter still does the right thing.
+ */
 bool GMTask::elapsed(int ms, TickType_t since) {
-  return ((xTaskGetTickCount() - since) / portTICK_PERIOD_MS) >= ms;
+  return (TickType_t)(xTaskGetTickCount() - since) >= pdMS_TO_TICKS(ms);
 }
 
 bool GMTask::elapsed(int ms, TickType_t since, TickType_t now) {
-  return ((now - since) / portTICK_PERIOD_MS) >= ms;
+  return (TickType_t)(now - since) >= pdMS_TO_TICKS(ms);
 }
 
 void GMTask::suspend() {
@@ -106,6 +111,6 @@ String GMTask::uptime() {
   minutes %= 60;
   hours %= 24;
 
-  snprintf(buf, 10, "%0d:%02d:%02d", hours, minutes, seconds);
+  snprintf(buf, 10, "%lu:%02lu:%02lu", hours, minutes, seconds);
   return String(buf);
 }
@@ -25,6 +25,11 @@ public:
   // Called by the menu to launch the task
   void start();
 
+  // Called by the menu (with the task already suspended) when the
+  // user bails out with the home button; release anything that
+  // run() would have cleaned up on its way out
+  virtual void abort() {}
+
   void suspend();
   void resume();
   void stop();
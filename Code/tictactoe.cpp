@@ -19,9 +19,18 @@
 #include "button.h"
 #include "tictactoe.h"
 
+static const wire_field_t tttFields[] = {
+  WIRE_FIELD(tfType,     wkUint,  ttt_packet_t, type),
+  WIRE_FIELD(tfSequence, wkInt,   ttt_packet_t, sequence),
+  WIRE_FIELD(tfWho,      wkChars, ttt_packet_t, who),
+  WIRE_FIELD(tfWhich,    wkUint,  ttt_packet_t, which),
+  WIRE_FIELD(tfX,        wkUint,  ttt_packet_t, x),
+  WIRE_FIELD(tfY,        wkUint,  ttt_packet_t, y),
+};
+static const wire_schema_t tttSchema = WIRE_SCHEMA(1, ttt_packet_t, tttFields);
 
 TicTacToe::TicTacToe()
-  : GMTask("TICTACTOE") {
+  : GMTask("TICTACTOE"), rendezvous(GM_TICTAC, "TicTacToe") {
 }
 
 const String TicTacToe::appName = "TicTacToe";
@@ -35,6 +44,12 @@ void TicTacToe::setup(bool rsvp) {
   hosting = !rsvp;   // if launched by RSVP, we're the guest
   myTurn = hosting;  // player X goes first
   seqNum = 0;        // unsynchronized
+  netId = -1;        // no packet queue yet
+
+  // Nobody to play with until the rendezvous finds them
+  memset(&opponent, 0, sizeof(opponent));
+  memcpy(opponent.node, netTask.broadcast, ADDR_LEN);
+  them = &opponent;
 
   // Clear the board and precompute the text offsets
   for (int x = 0; x < 3; x++) {
@@ -85,6 +100,21 @@ bool TicTacToe::startNetwork() {
   return true;
 }
 
+/*
+ *  User held down home: we've been frozen wherever we were, so just
+ *  tell the other player and give back the packet queue.  This runs
+ *  on the menu task; the menu suspends us only while it holds the
+ *  network's locks (netTask.lock()), so we can't have been frozen
+ *  holding one and the sends here won't block.  (Stats from the game
+ *  in progress are lost, which seems fair for a rage quit.)
+ */
+void TicTacToe::abort() {
+  if (netTask.sessionMembers() > 1) sendTTT(them->node, TTT_QUIT, seqNum);
+  netTask.leaveSession();
+  netTask.destroyQueue(netId);
+  netId = -1;
+}
+
 /*
  *  Display a simple greeting screen.  Make it fancy someday.
  */
@@ -149,35 +179,69 @@ void TicTacToe::showSignOff() {
 }
 
 /*
- *  On startup, ask the user if they want to host a new game or
- *  find an existing one to join.  Run after the network is up.
- *  Returns false if no other player connects or the user quits.
+ *  On startup, find someone to play with.  Picked from the menu, we
+ *  host and invite whoever's around; launched by an RSVP, we join the
+ *  game we were invited to.  Run after the network is up.  Returns
+ *  false if no other player connects or the user quits.
  */
 bool TicTacToe::hostOrJoin() {
+  int result;
+
+  if (hosting) {
+    display.println("Inviting players...");
+    display.println();
+    display.println("Press C to cancel");
+    display.display();
+    result = rendezvous.invite(netId);
+  } else {
+    display.println("Joining game...");
+    display.display();
+    result = rendezvous.join();
+  }
+
+  if (result != rsvpAccepted) {
+    Serial.printf("ttt: No game: %s\n", Rendezvous::describe(result));
+    display.println();
+    display.println(Rendezvous::describe(result));
+    display.display();
+    delay(2000);
+    return false;
+  }
+
+  strncpy(opponent.tag, rendezvous.peerTag(), GM_PLAYER_TAG_LEN - 1);
+  opponent.tag[GM_PLAYER_TAG_LEN - 1] = '\0';
+  return true;
+}
+
+/*
+ *  Shake hands before each game: X sends SYNCs until O echoes one
+ *  back, so both boards start together.  Either side gives up after
+ *  TTT_SYNC_TRIES * TTT_SYNC_WAIT, or when the player presses C.
+ */
+bool TicTacToe::syncUp() {
   button_event_t press;
+  Condition c;
 
-  // A hack until RSVP works :-(
-  display.println("Press A to host");
-  display.println("Press B to join");
-  display.println("Press C for menu");
-  display.display();
+  if (hosting) seqNum++;
+  drawMessage(Status, hosting ? "Sending SYNC" : "Wait for SYNC");
 
-  for (;;) {
+  for (int tries = 0; tries < TTT_SYNC_TRIES; tries++) {
+    if (hosting) sendTTT(them->node, TTT_SYNC, seqNum);
 
-    if (xQueueReceive(buttonEvents, &(press), (TickType_t)1000)) {
-      if (press.action == btnReleased) {
-        if (press.id == BTN_A) {
-          hosting = true;
-          return true;
-        } else if (press.id == BTN_B) {
-          hosting = false;
-          return true;
-        } else if (press.id == BTN_C) {
-          return false;
-        }
+    for (int t = 0; t < TTT_SYNC_WAIT; t += 25) {
+      c = recvUpdate();
+      if (c == Undecided) return true;
+      if (c == Quit) return false;
+
+      if (xQueueReceive(buttonEvents, &(press), pdMS_TO_TICKS(25))) {
+        if (press.action == btnReleased && press.id == BTN_C) return false;
       }
     }
   }
+
+  drawMessage(Status, "No SYNC, giving up");
+  delay(1000);
+  return false;
 }
 
 /*
@@ -204,6 +268,7 @@ void TicTacToe::resetBoard() {
  *  Redraw the screen and playing field.
  */
 void TicTacToe::drawScreen() {
+  PROF_SCOPE(pzTttDraw);
 
   /*
     The screen is arranged with an info area at the top,
@@ -356,7 +421,7 @@ Condition TicTacToe::updateCondition() {
       display.drawFastHLine(GRID_LEFT, GRID_TOP + (r * GRID_SPACING) + (GRID_SPACING / 2) + r, GRID_SIZE, HALF_BRIGHT);
       display.display();
 
-      return (board[0][r].mark == 'x' && hosting || board[0][r].mark == 'o' && !hosting) ? Win : Lose;
+      return ((board[0][r].mark == 'x' && hosting) || (board[0][r].mark == 'o' && !hosting)) ? Win : Lose;
     }
   }
 
@@ -369,7 +434,7 @@ Condition TicTacToe::updateCondition() {
       display.drawFastVLine(GRID_LEFT + (c * GRID_SPACING) + (GRID_SPACING / 2) + c, GRID_TOP, GRID_SIZE, HALF_BRIGHT);
       display.display();
 
-      return (board[c][0].mark == 'x' && hosting || board[c][0].mark == 'o' && !hosting) ? Win : Lose;
+      return ((board[c][0].mark == 'x' && hosting) || (board[c][0].mark == 'o' && !hosting)) ? Win : Lose;
     }
   }
 
@@ -380,7 +445,7 @@ Condition TicTacToe::updateCondition() {
     display.drawLine(GRID_LEFT, GRID_TOP, GRID_LEFT + GRID_SIZE, GRID_TOP + GRID_SIZE, HALF_BRIGHT);
     display.display();
 
-    return (board[1][1].mark == 'x' && hosting || board[1][1].mark == 'o' && !hosting) ? Win : Lose;
+    return ((board[1][1].mark == 'x' && hosting) || (board[1][1].mark == 'o' && !hosting)) ? Win : Lose;
   }
 
   // BotLeft->TopRight diagonal?
@@ -390,7 +455,7 @@ Condition TicTacToe::updateCondition() {
     display.drawLine(GRID_LEFT, GRID_TOP + GRID_SIZE, GRID_LEFT + GRID_SIZE, GRID_TOP, HALF_BRIGHT);
     display.display();
 
-    return (board[1][1].mark == 'x' && hosting || board[1][1].mark == 'o' && !hosting) ? Win : Lose;
+    return ((board[1][1].mark == 'x' && hosting) || (board[1][1].mark == 'o' && !hosting)) ? Win : Lose;
   }
 
   // See if the board is full
@@ -436,11 +501,15 @@ void TicTacToe::sendTTT(const uint8_t *mac, uint8_t code, uint8_t seq) {
   pkt.pktType = GM_TICTAC;
   memcpy(pkt.dstAddr, mac, ADDR_LEN);
   memcpy(pkt.srcAddr, me->node, ADDR_LEN);
-  pkt.length = sizeof(ttt_packet_t);
-  memcpy(pkt.payload, &ttt, pkt.length);
+  netTask.pack(&pkt, &tttSchema, &ttt);
 
-  // Ship it!
-  netTask.sendPkt(&pkt);
+  // Ship it!  Once the other player has joined our session, only they
+  // get it; until then it goes out to whoever's listening
+  if (netTask.sessionMembers() > 1) {
+    netTask.sendSession(&pkt);
+  } else {
+    netTask.sendPkt(&pkt);
+  }
 }
 
 /*
@@ -457,25 +526,7 @@ void TicTacToe::sendUpdate() {
   switch (state) {
 
     case Reset:
-      /*
-       *  If unsynchronized and we're the host, send a Sync with seq #1
-       *  and set up to be player X.  Tells the other to assume player O.
-       *  Wait for their ack to begin.  There should be a timeout/retry
-       *  here in case they miss the initial packet...
-       */
-      if (seqNum == 0) {
-        if (hosting) {
-          drawMessage(Status, "Sending SYNC", WHITE);
-          seqNum = 1;
-          sendTTT(netTask.broadcast, TTT_SYNC, seqNum);
-        } else {
-          drawMessage(Status, "Wait for SYNC", WHITE);
-        }
-      } else if (seqNum == 1) {
-        // ready to transition to game mode
-        drawMessage(Status, "Ready!");
-        state = Undecided;
-      }
+      // syncUp() does the handshake
       break;
 
     case Undecided:
@@ -513,30 +564,36 @@ Condition TicTacToe::recvUpdate() {
 
   // Look for a GM_TICTAC and ignore any IFF stuff for now :-(
   if (xQueueReceive(netQ, &(pkt), (TickType_t)0)) {
-    if (pkt.pktType == GM_TICTAC && pkt.length == sizeof(ttt_packet_t)) {
+    if (pkt.pktType == GM_TICTAC && netTask.unpack(&pkt, &tttSchema, &ttt)) {
 
-      memcpy(&ttt, pkt.payload, pkt.length);
       dprintf("ttt: Received a %c (seq %d) from %s\n", ttt.type, ttt.sequence, ttt.who);
 
       switch (ttt.type) {
 
         case TTT_SYNC:
-          if (ttt.sequence == 1 && ttt.which == 'x') {
+          if (ttt.which == 'x' && !hosting) {
             /*
-             *  If this ARRIVES with seq #1, the other side is the host;
-             *  we respond with a 1 and set which to 'o' to let 'em know we
-             *  are resetting and they go first.  We also record them as
-             *  player 2 and transition to Undecided to await their first play.
+             *  The other side is X; we echo it back with which set to
+             *  'o' to let 'em know we are resetting and they go first.
+             *  (Repeats mean our echo got lost, so echo those too.)
+             *  We also record them as player 2 and transition to
+             *  Undecided to await their first play.
              */
             drawMessage(Status, "SYNC received");
-            hosting = myTurn = false;
-            seqNum = 1;
-            strncpy(them->tag, ttt.who, GM_PLAYER_TAG_LEN);
-            p2label = String(hosting ? "O : " : "X : ") + String(them != NULL ? them->tag : "[Player 2]");
-            drawMessage(Player2, p2label);
-            return Undecided;
+            seqNum = ttt.sequence;
+            sendTTT(pkt.srcAddr, TTT_SYNC, seqNum);
+          } else if (ttt.which == 'o' && hosting && ttt.sequence == seqNum) {
+            // Our SYNC came back; O is ready
+            drawMessage(Status, "Ready!");
+          } else {
+            break;
           }
-          break;
+
+          strncpy(them->tag, ttt.who, GM_PLAYER_TAG_LEN);
+          memcpy(them->node, pkt.srcAddr, ADDR_LEN);
+          p2label = String(hosting ? "O : " : "X : ") + String(them->tag);
+          drawMessage(Player2, p2label);
+          return Undecided;
 
         case TTT_PLAY:
           // their move
@@ -561,7 +618,7 @@ Condition TicTacToe::recvUpdate() {
 /*
  *  Tic Tac Toe main loop
  *
- *  Starts by posting the Host/Join screen to find another player
+ *  Starts by inviting (or, launched by an RSVP, joining) another player
  *  to play against.  (There's no solo/computer player at this time).
  *  Once the other player joins, the game alternates moves until a
  *  win or stalemate; then the sides switch and the board is reset.
@@ -574,6 +631,7 @@ void TicTacToe::run() {
   dprintln("TicTacToe: Task starting");
 
   bool running = true;
+  bool first = true;
   state = Reset;
   seqNum = 0;
 
@@ -583,7 +641,6 @@ void TicTacToe::run() {
   // Got net? Find someone to play with!
   if (running) {
     me = netTask.getPlayer(0);  // get our player rec
-    them = NULL;                // until someone joins
     running = hostOrJoin();
   }
 
@@ -595,34 +652,40 @@ void TicTacToe::run() {
       resetBoard();
       drawScreen();
 
-/*
-    [ networking broken / disabled ]
-    
       // Start the network dance
-      sendUpdate();
-
-      while (state == Reset) {
-
-        delay(25);
-
-        if (xQueueReceive(buttonEvents, &(press), (TickType_t)0)) {
-          if (press.action == btnReleased && press.id == BTN_C)
-            state = Quit;
-        }
+      if (!syncUp()) {
+        state = Quit;
+        running = false;
+        continue;
+      }
 
-        recvUpdate();
+      if (first) {
+        rendezvous.started();
+        first = false;
       }
-*/
+
       curOn = true;
       drawHighlight(curX, curY, curOn);
 
+      // Full speed (and a wide awake radio) while the game is on
+      power.perfLock();
+
       state = Undecided;
-      myTurn = true;      // hosting;   [networking broken/disabled]
+      myTurn = true;      // hosting;   [moves aren't sent yet]
       // And fall straight into the main loop
     }
 
     while (state == Undecided) {
 
+      // Echo late SYNCs, and notice if the other side leaves
+      if (recvUpdate() == Quit) {
+        drawMessage(Status, "Other player quit");
+        delay(2000);
+        state = Quit;
+        running = false;
+        break;
+      }
+
       if (xQueueReceive(buttonEvents, &(press), (TickType_t)25)) {
         if (press.action == btnReleased || press.action == btnRepeat) {
 
@@ -663,6 +726,9 @@ void TicTacToe::run() {
     curOn = false;
     drawHighlight(curX, curY, curOn);
 
+    // Back to idling while we talk it over
+    power.perfUnlock();
+
     // If they quit bail out now
     if (!running) continue;
 
@@ -682,6 +748,9 @@ void TicTacToe::run() {
         drawMessage(Status, "It's a draw.");
         stats[2]++;
         break;
+
+      default:
+        break;
     }
 
     // Go again?
@@ -696,8 +765,11 @@ void TicTacToe::run() {
     }
   }
 
-  // Free up the network connection
+  // Let the other side know, then free up the network connection
+  if (netTask.sessionMembers() > 1) sendTTT(them->node, TTT_QUIT, seqNum);
+  netTask.leaveSession();
   netTask.destroyQueue(netId);
+  netId = -1;
 
   // Save stats and exit gracefully
   showSignOff();
@@ -12,6 +12,7 @@
 #include "task.h"
 #include "network.h"
 #include "graphics.h"
+#include "rsvp.h"
 
 #define TTT_VERSION 0.1
 
@@ -25,6 +26,9 @@
 #define MSG_OFFSET  112
 #define MSG_SIZE    14
 
+#define TTT_SYNC_WAIT   250   // ms between SYNCs before each game
+#define TTT_SYNC_TRIES  12    // then assume the other side is gone
+
 //  Preferences key for storing stats in NVRAM
 #define TTT_NVM_KEY "ttt-stats"
 
@@ -34,7 +38,7 @@
  *      PLAY  - current player places an X or O at [x, y]
  *      DRAW  - sender offers a draw (not implemented)
  *      QUIT  - sender is done, no response expected
- *      SYNC  - start a game/play again?
+ *      SYNC  - start a game/play again?  X sends it, O echoes it
  */
 #define TTT_SYNC 0x53
 #define TTT_PLAY 0x50
@@ -50,6 +54,9 @@ typedef struct TTTpkt {
   uint8_t y;                    // y position of this play
 } ttt_packet_t;
 
+// Wire field ids for the above; never renumber or reuse one
+enum tttField : uint8_t { tfType = 1, tfSequence, tfWho, tfWhich, tfX, tfY };
+
 typedef struct position {
   char mark;        // literally ' ', 'X' or 'O' :-)
   int16_t xOffset;  // precomputed x coord for text placement
@@ -63,6 +70,7 @@ class TicTacToe : public GMTask {
 public:
   TicTacToe();
   void setup(bool rsvp) override;
+  void abort() override;
 
   static const String appName;
 
@@ -71,7 +79,8 @@ private:
 
   void showGreeting();
   bool startNetwork();
-  bool hostOrJoin();  // move to menuTask?
+  bool hostOrJoin();
+  bool syncUp();
   void resetBoard();
   void drawScreen();
   void drawMessage(MsgLine which, String msg, uint8_t color = WHITE);
@@ -88,11 +97,13 @@ private:
   // Connection to the network
   int netId;
   QueueHandle_t netQ;
+  Rendezvous rendezvous;
 
   // Player X is the host, player O is the guest
   bool hosting;
   gm_player_t *me;
   gm_player_t *them;
+  gm_player_t opponent;
   String p1label;
   String p2label;
   String statusMsg;
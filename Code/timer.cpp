@@ -0,0 +1,148 @@
+/*
+ *  timer.cpp - Min-heap software timers
+ *
+ *  Abstract:
+ *      Deadlines are kept in FreeRTOS ticks and compared with
+ *      signed differences, so tick counter wraparound is harmless.
+ *      Millisecond arguments go through pdMS_TO_TICKS() so nothing
+ *      quietly depends on a 1ms tick.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include "timer.h"
+
+GMTimers::GMTimers() {
+  count = 0;
+}
+
+/*
+ *  (Internal) Heap ordering: earlier deadline wins.
+ */
+bool GMTimers::before(int a, int b) {
+  return (int32_t)(heap[a].due - heap[b].due) < 0;
+}
+
+void GMTimers::siftUp(int i) {
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (!before(i, parent)) break;
+
+    gm_timer_t t = heap[i];
+    heap[i] = heap[parent];
+    heap[parent] = t;
+    i = parent;
+  }
+}
+
+void GMTimers::siftDown(int i) {
+  for (;;) {
+    int least = i;
+    int l = 2 * i + 1;
+    int r = l + 1;
+
+    if (l < count && before(l, least)) least = l;
+    if (r < count && before(r, least)) least = r;
+    if (least == i) break;
+
+    gm_timer_t t = heap[i];
+    heap[i] = heap[least];
+    heap[least] = t;
+    i = least;
+  }
+}
+
+int GMTimers::find(uint8_t id) {
+  for (int i = 0; i < count; i++) {
+    if (heap[i].id == id) return i;
+  }
+  return -1;
+}
+
+void GMTimers::removeAt(int i) {
+  count--;
+  if (i == count) return;
+
+  heap[i] = heap[count];
+  siftUp(i);
+  siftDown(i);
+}
+
+/*
+ *  Arm a timer to fire in ms milliseconds (and every ms after that
+ *  if periodic).  Re-arming an active id just moves its deadline.
+ *  Returns false if the table is full.
+ */
+bool GMTimers::start(uint8_t id, int ms, bool periodic) {
+  TickType_t ticks = pdMS_TO_TICKS(ms);
+  int i = find(id);
+
+  if (i >= 0) {
+    removeAt(i);
+  } else if (count >= MAX_TIMERS) {
+    return false;
+  }
+
+  i = count++;
+  heap[i].id = id;
+  heap[i].due = xTaskGetTickCount() + ticks;
+  heap[i].period = periodic ? (ticks > 0 ? ticks : 1) : 0;
+  siftUp(i);
+  return true;
+}
+
+void GMTimers::cancel(uint8_t id) {
+  int i = find(id);
+  if (i >= 0) removeAt(i);
+}
+
+void GMTimers::clear() {
+  count = 0;
+}
+
+bool GMTimers::isActive(uint8_t id) {
+  return find(id) >= 0;
+}
+
+/*
+ *  Ticks until the earliest deadline: 0 if one is already due, or
+ *  portMAX_DELAY if no timers are running (i.e., block forever).
+ */
+TickType_t GMTimers::ticksToNext() {
+  return ticksToNext(xTaskGetTickCount());
+}
+
+TickType_t GMTimers::ticksToNext(TickType_t now) {
+  if (count == 0) return portMAX_DELAY;
+
+  int32_t left = (int32_t)(heap[0].due - now);
+  return left > 0 ? (TickType_t)left : 0;
+}
+
+/*
+ *  Return the id of the earliest timer that's due (re-arming it if
+ *  periodic), or TMR_NONE.  Call in a loop to drain them all.
+ */
+int GMTimers::expired() {
+  return expired(xTaskGetTickCount());
+}
+
+int GMTimers::expired(TickType_t now) {
+  if (count == 0 || (int32_t)(now - heap[0].due) < 0) return TMR_NONE;
+
+  uint8_t id = heap[0].id;
+
+  if (heap[0].period == 0) {
+    removeAt(0);
+  } else {
+    // Stay on the original cadence, unless we've fallen a whole
+    // period behind (stalled), in which case skip the backlog
+    heap[0].due += heap[0].period;
+    if ((int32_t)(now - heap[0].due) >= 0) heap[0].due = now + heap[0].period;
+    siftDown(0);
+  }
+
+  return id;
+}
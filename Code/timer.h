@@ -0,0 +1,61 @@
+/*
+ *  timer.h - Software timers for apps and tasks
+ *
+ *  Abstract:
+ *      A small per-task timer service.  Each task owns a GMTimers
+ *      object holding up to MAX_TIMERS one-shot or periodic timers,
+ *      kept in a min-heap ordered by deadline.  Instead of waking
+ *      up every so often to poll elapsed(), a task blocks on its
+ *      queue (or notification) for ticksToNext() and then collects
+ *      the timer events that fired with expired().
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_TIMER_H_
+#define _GM_TIMER_H_
+
+#include <Arduino.h>
+
+#define MAX_TIMERS  10      // per owner; the button task uses the most
+
+#define TMR_NONE   -1       // expired() result when nothing is due
+
+typedef struct gmTimer {
+  TickType_t due;           // tick count when it fires next
+  TickType_t period;        // reload interval, 0 for one-shot
+  uint8_t id;               // owner-defined event id
+} gm_timer_t;
+
+class GMTimers {
+public:
+  GMTimers();
+
+  // Arm (or re-arm) a timer; the id is the event delivered
+  bool start(uint8_t id, int ms, bool periodic = false);
+  void cancel(uint8_t id);
+  void clear();
+  bool isActive(uint8_t id);
+
+  // How long the owner may block before the next timer is due
+  TickType_t ticksToNext();
+  TickType_t ticksToNext(TickType_t now);
+
+  // Pop the next timer event that's due, or TMR_NONE
+  int expired();
+  int expired(TickType_t now);
+
+private:
+  gm_timer_t heap[MAX_TIMERS];
+  uint8_t count;
+
+  int find(uint8_t id);
+  void removeAt(int i);
+  void siftUp(int i);
+  void siftDown(int i);
+  bool before(int a, int b);
+};
+
+#endif
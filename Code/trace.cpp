@@ -0,0 +1,168 @@
+/*
+ *  trace.cpp - Binary event tracing
+ *
+ *  Abstract:
+ *      Readers never block writers: if a writer laps the TRACE task
+ *      the oldest records are simply lost (and counted).  Each record
+ *      is checked against its commit mark before and after it's
+ *      copied out, so one that's mid-write or was overwritten while
+ *      we copied it is never decoded as garbage.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include "GameMan.h"
+#include "trace.h"
+
+trace_ring_t traceRings[portNUM_PROCESSORS];
+
+// How to show each event (a, b are the two args)
+static const char *traceFormats[trEventCount] = {
+  "none",
+  "mark %u %u",
+  "net send type %u (result %u) to ..%08x",
+  "net recv %u bytes from ..%08x",
+  "net OVERFLOW, %u bytes from ..%08x dropped",
+  "net dispatch type %u to client %u",
+  "net drop type %u (reason %u)",
+  "btn edge %02x",
+  "btn state %02x",
+  "btn action %u id %02x",
+};
+
+static_assert((TRACE_RING & (TRACE_RING - 1)) == 0, "TRACE_RING must be a power of 2");
+static_assert(TRACE_RING < 65536, "seq is only 16 bits");
+static_assert(sizeof(trace_rec_t) == 16, "trace records should stay 16 bytes");
+
+TraceTask::TraceTask()
+  : GMTask("TRACE", 4096, 1, PRO_CPU_NUM) {
+}
+
+void TraceTask::setup(bool rsvp) {
+  if (drainLock == NULL) drainLock = xSemaphoreCreateMutex();
+  echo = DEBUG;
+}
+
+void TraceTask::setEcho(bool on) {
+  echo = on;
+}
+
+/*
+ *  (Internal) Copy up to max committed records out of one core's ring.
+ */
+int TraceTask::pull(int core, trace_rec_t *out, int max) {
+  trace_ring_t *r = &traceRings[core];
+  int n = 0;
+
+  while (n < max) {
+    uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    if (r->tail == head) break;
+
+    // Fell a whole lap behind?  Skip to the oldest record still there
+    if (head - r->tail > TRACE_RING) {
+      r->lost += head - TRACE_RING - r->tail;
+      r->tail = head - TRACE_RING;
+    }
+
+    trace_rec_t *rec = &r->buf[r->tail % TRACE_RING];
+    uint16_t expect = (uint16_t)(r->tail + 1);
+
+    if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != expect) {
+      // Not finished yet (stop here), or being overwritten by the next lap
+      if (head - r->tail < TRACE_RING) break;
+      r->lost++;
+      r->tail++;
+      continue;
+    }
+
+    out[n] = *rec;
+
+    // Overwritten while we copied it?
+    if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != expect) {
+      r->lost++;
+      r->tail++;
+      continue;
+    }
+
+    r->tail++;
+    n++;
+  }
+
+  return n;
+}
+
+void TraceTask::print(trace_rec_t *rec) {
+  char line[80];
+  const char *fmt = (rec->event < trEventCount) ? traceFormats[rec->event] : "event %u %u";
+
+  if (rec->event == trNetSend) {
+    snprintf(line, sizeof(line), fmt, rec->a & 0xffff, rec->a >> 16, rec->b);
+  } else {
+    snprintf(line, sizeof(line), fmt, rec->a, rec->b);
+  }
+
+  Serial.printf("trace: %10u %d %s\n", rec->stamp, rec->core, line);
+}
+
+/*
+ *  Empty both rings, printing the records merged in time order.
+ */
+void TraceTask::flush() {
+  trace_rec_t recs[portNUM_PROCESSORS][TRACE_BATCH];
+  int count[portNUM_PROCESSORS];
+  int next[portNUM_PROCESSORS];
+  bool more = true;
+
+  // Only one reader at a time (the TRACE task, or someone flushing)
+  if (drainLock) xSemaphoreTake(drainLock, portMAX_DELAY);
+
+  while (more) {
+    more = false;
+
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+      count[c] = pull(c, recs[c], TRACE_BATCH);
+      next[c] = 0;
+      more |= (count[c] == TRACE_BATCH);
+    }
+
+    // Two way merge on the (wrapping) timestamps
+    for (;;) {
+      int pick = -1;
+
+      for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        if (next[c] >= count[c]) continue;
+        if (pick < 0 || (int32_t)(recs[c][next[c]].stamp - recs[pick][next[pick]].stamp) < 0) pick = c;
+      }
+
+      if (pick < 0) break;
+      print(&recs[pick][next[pick]++]);
+    }
+  }
+
+  for (int c = 0; c < portNUM_PROCESSORS; c++) {
+    if (traceRings[c].lost) {
+      Serial.printf("trace: core %d lost %u records\n", c, traceRings[c].lost);
+      traceRings[c].lost = 0;
+    }
+  }
+
+  if (drainLock) xSemaphoreGive(drainLock);
+}
+
+/*
+ *  TraceTask main loop
+ *
+ *  Wake up every so often and decode whatever has piled up (or, with
+ *  echo off, do nothing and let the rings roll over).
+ */
+void TraceTask::run() {
+
+  Serial.printf("trace: Task starting up on core %d\n", xPortGetCoreID());
+
+  for (;;) {
+    delay(TRACE_DRAIN_MS);
+    if (echo) flush();
+  }
+}
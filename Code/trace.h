@@ -0,0 +1,116 @@
+/*
+ *  trace.h - Binary event tracing
+ *
+ *  Abstract:
+ *      A replacement for dprintf() in the places that run all the
+ *      time (the ESP-NOW receive callback, packet dispatch, button
+ *      handling).  TRACE(event, a, b) stores a 16 byte record --
+ *      timestamp, core, event id and two arguments -- in a ring
+ *      for the current core and returns; no formatting, no locks,
+ *      no serial port.  The TRACE task drains the rings at low
+ *      priority and decodes them to the console when echo is on,
+ *      so tracing can be left compiled in for real use.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_TRACE_H_
+#define _GM_TRACE_H_
+
+#include <Arduino.h>
+#include "esp_timer.h"
+#include "task.h"
+
+#define TRACE_ENABLE    1       // 0 compiles every TRACE() out entirely
+#define TRACE_RING      256     // records per core (power of 2)
+#define TRACE_DRAIN_MS  100     // how often the TRACE task empties the rings
+#define TRACE_BATCH     32      // records pulled from each ring per pass
+
+/*
+ *  Event ids.  Add new ones at the end, with a matching line in the
+ *  decode table in trace.cpp.
+ */
+enum traceEvent : uint8_t {
+  trNone,
+  trMark,             // a = anything, b = anything (ad hoc debugging)
+  trNetSend,          // a = packet type, b = tail of dest MAC, result in a's high half
+  trNetRecv,          // a = length, b = tail of source MAC
+  trNetOverflow,      // a = length, b = tail of source MAC
+  trNetDispatch,      // a = packet type, b = client queue
+  trNetDropped,       // a = packet type, b = why (0 unloved, 1 queue full, 2 bad queue, 3 not ours, 4 duplicate)
+  trBtnEdge,          // a = button id (from the ISR)
+  trBtnState,         // a = status byte
+  trBtnEvent,         // a = buttAction, b = button id (or chord mask)
+  trEventCount
+};
+
+typedef struct traceRec {
+  uint32_t stamp;               // esp_timer usec (wraps every ~71 minutes)
+  uint16_t seq;                 // commit mark: (slot number + 1), written last
+  uint8_t event;                // traceEvent
+  uint8_t core;                 // where it happened
+  uint32_t a;
+  uint32_t b;
+} trace_rec_t;
+
+typedef struct traceRing {
+  volatile uint32_t head;       // next slot to hand out (only ever grows)
+  uint32_t tail;                // next slot to read (TRACE task only)
+  uint32_t lost;                // records overwritten before they were read
+  trace_rec_t buf[TRACE_RING];
+} trace_ring_t;
+
+extern trace_ring_t traceRings[portNUM_PROCESSORS];
+
+/*
+ *  Record an event.  Safe from any task or ISR on either core: the
+ *  slot is claimed with one atomic add, so writers never wait on each
+ *  other, and the record only counts once its seq is stored.
+ */
+static inline void IRAM_ATTR gmTrace(uint8_t event, uint32_t a, uint32_t b) {
+  uint8_t core = xPortGetCoreID();
+  trace_ring_t *r = &traceRings[core];
+  uint32_t pos = __atomic_fetch_add(&r->head, 1, __ATOMIC_RELAXED);
+  trace_rec_t *rec = &r->buf[pos % TRACE_RING];
+
+  __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+  rec->stamp = (uint32_t)esp_timer_get_time();
+  rec->event = event;
+  rec->core = core;
+  rec->a = a;
+  rec->b = b;
+  __atomic_store_n(&rec->seq, (uint16_t)(pos + 1), __ATOMIC_RELEASE);
+}
+
+#if TRACE_ENABLE
+#define TRACE(ev, a, b)  gmTrace((ev), (uint32_t)(a), (uint32_t)(b))
+#else
+#define TRACE(ev, a, b)  do { } while (0)
+#endif
+
+// Last four bytes of a MAC as one argument
+#define TRACE_MAC(m)  (((uint32_t)(m)[2] << 24) | ((uint32_t)(m)[3] << 16) | ((uint32_t)(m)[4] << 8) | (m)[5])
+
+class TraceTask : public GMTask {
+public:
+  TraceTask();
+  void setup(bool rsvp) override;
+
+  // Decode records to the console as they're drained?
+  void setEcho(bool on);
+
+  // Drain and print whatever's in the rings right now
+  void flush();
+
+private:
+  void run() override;
+  int pull(int core, trace_rec_t *out, int max);
+  void print(trace_rec_t *rec);
+
+  volatile bool echo = false;
+  SemaphoreHandle_t drainLock = NULL;
+};
+
+#endif
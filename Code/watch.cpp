@@ -0,0 +1,123 @@
+/*
+ *  watch.cpp - Spectator app
+ *
+ *  Abstract:
+ *      Frames are painted straight into the display's framebuffer as
+ *      they arrive and flushed once each is in; everything else is
+ *      the ScreenCast's business.  See watch.h.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include "GameMan.h"
+#include "graphics.h"
+#include "watch.h"
+
+Watch::Watch()
+  : GMTask("WATCH") {
+}
+
+const String Watch::appName = "Watch";
+
+void Watch::setup(bool rsvp) {
+  netId = -1;
+  netQ = 0;
+}
+
+/*
+ *  Home was held: say goodbye to the caster (so it stops sending
+ *  right away) and give back the queue.
+ */
+void Watch::abort() {
+  stopNetwork();
+}
+
+void Watch::stopNetwork() {
+  gm_packet_t pkt;
+
+  cast.end();
+  while (cast.next(&pkt)) netTask.sendPkt(&pkt);
+
+  if (netId >= 0) netTask.destroyQueue(netId);
+  netId = -1;
+  netQ = 0;
+}
+
+/*
+ *  Until somebody's screen shows up.
+ */
+void Watch::showLooking() {
+
+  display.clearDisplay();
+  display.setFont();
+  display.setTextSize(2);
+  display.setTextColor(WHITE);
+  display.setCursor(getCenterX("Watch"), 10);
+  display.print("Watch");
+  display.setTextSize(1);
+  display.setTextColor(HALF_BRIGHT);
+  display.setCursor(getCenterX("Looking for a game"), 56);
+  display.print("Looking for a game");
+  display.setCursor(getCenterX("to watch..."), 68);
+  display.print("to watch...");
+  display.setCursor(getCenterX("C: Back"), display.height() - 12);
+  display.print("C: Back");
+  display.display();
+}
+
+/*
+ *  Watch main loop: take frames, check in now and then, and go back
+ *  to looking if the caster goes quiet.
+ */
+void Watch::run() {
+  button_event_t press;
+  gm_packet_t pkt;
+  cast_stats_t st;
+  uint8_t from[ADDR_LEN];
+  uint32_t start = millis();
+  bool locked = false;
+
+  dprintln("Watch: Task starting");
+
+  showLooking();
+
+  netId = netTask.createQueue(MAX_PENDING);
+  if (netId < 0 || netTask.addFilter(netId, GM_CAST) < 0) {
+    Serial.println("Watch: Failed to initialize the network!");
+    stopNetwork();
+    delay(2000);
+    return;
+  }
+  netQ = netTask.getHandle(netId);
+
+  cast.watch(netTask.getPlayer(0)->node, display.getBuffer());
+
+  for (;;) {
+    if (xQueueReceive(netQ, &pkt, pdMS_TO_TICKS(WATCH_POLL))) {
+      if (cast.receive(&pkt, millis())) display.display();
+    }
+
+    cast.poll(millis());
+    while (cast.next(&pkt)) netTask.sendPkt(&pkt);
+
+    if (cast.watching(from) != locked) {
+      locked = !locked;
+      if (locked) {
+        dprintf("Watch: Watching %s\n", NetworkTask::fmtMAC(from));
+      } else {
+        showLooking();
+      }
+    }
+
+    if (xQueueReceive(buttonEvents, &press, 0) && press.action == btnReleased && press.id == BTN_C) break;
+  }
+
+  cast.getStats(&st);
+  stopNetwork();
+
+  uint32_t secs = (millis() - start) / 1000;
+  dprintf("Watch: %u frames (%u keys, %u with parts missing, %u never heard), %u kB, %u kbps\n",
+          st.frames, st.keys, st.damaged, st.missed, st.bytes / 1024, secs ? st.bytes * 8 / 1000 / secs : 0);
+}
@@ -0,0 +1,44 @@
+/*
+ *  watch.h - Spectator app
+ *
+ *  Abstract:
+ *      Shows what another unit's screen is showing, as it streams it
+ *      (see screencast.h), without running the game.  Whatever app
+ *      the other unit is running is cast while somebody watches.
+ *      The first caster heard is the one shown; C goes back to the
+ *      menu.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_WATCH_H_
+#define _GM_WATCH_H_
+
+#include "task.h"
+#include "network.h"
+#include "screencast.h"
+
+#define WATCH_POLL    20      // ms between looks at the queue (and the buttons)
+
+class Watch : public GMTask {
+  public:
+    Watch();
+    void setup(bool rsvp) override;
+    void abort() override;
+
+    static const String appName;
+
+  private:
+    void run() override;
+
+    void showLooking();
+    void stopNetwork();
+
+    int netId = -1;
+    QueueHandle_t netQ = 0;
+    ScreenCast cast;
+};
+
+#endif
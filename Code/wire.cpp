@@ -0,0 +1,264 @@
+/*
+ *  wire.cpp - Compact, versioned encoding for packet payloads
+ *
+ *  Abstract:
+ *      Schema-driven encoder and decoder, and the in-place reader.
+ *      See wire.h for the format.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include "wire.h"
+
+/*
+ *  Varints: 7 bits a byte, low bits first, top bit set on all but the
+ *  last.  A uint32_t takes at most 5.
+ */
+static int putVarint(uint8_t *buf, int pos, int room, uint32_t v) {
+  do {
+    if (pos >= room) return -1;
+    buf[pos++] = (v & 0x7f) | (v > 0x7f ? 0x80 : 0);
+    v >>= 7;
+  } while (v);
+
+  return pos;
+}
+
+static int getVarint(const uint8_t *buf, int pos, int len, uint32_t *v) {
+  *v = 0;
+
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (pos >= len) return -1;
+    *v |= (uint32_t)(buf[pos] & 0x7f) << shift;
+    if (!(buf[pos++] & 0x80)) return pos;
+  }
+
+  return -1;    // too long
+}
+
+static inline uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+/*
+ *  Struct members by size; memcpy, since nothing here is aligned.
+ */
+static uint32_t loadUint(const uint8_t *p, int size) {
+  uint8_t u8;
+  uint16_t u16;
+  uint32_t u32;
+
+  switch (size) {
+    case 1: memcpy(&u8, p, 1); return u8;
+    case 2: memcpy(&u16, p, 2); return u16;
+    case 4: memcpy(&u32, p, 4); return u32;
+  }
+  return 0;
+}
+
+static int32_t loadInt(const uint8_t *p, int size) {
+  int8_t i8;
+  int16_t i16;
+  int32_t i32;
+
+  switch (size) {
+    case 1: memcpy(&i8, p, 1); return i8;
+    case 2: memcpy(&i16, p, 2); return i16;
+    case 4: memcpy(&i32, p, 4); return i32;
+  }
+  return 0;
+}
+
+static void storeUint(uint8_t *p, int size, uint32_t v) {
+  uint8_t u8 = v;
+  uint16_t u16 = v;
+
+  switch (size) {
+    case 1: memcpy(p, &u8, 1); break;
+    case 2: memcpy(p, &u16, 2); break;
+    case 4: memcpy(p, &v, 4); break;
+  }
+}
+
+/*
+ *  Only what's set goes out: zeros, empty strings and the zero tail
+ *  of a byte array are left for the decoder to fill back in.
+ */
+int wireEncode(const wire_schema_t *schema, const void *msg, uint8_t *buf, int room) {
+  const uint8_t *m = (const uint8_t *)msg;
+  int pos = 0;
+
+  if (room < 1) return -1;
+  buf[pos++] = schema->version;
+
+  for (int i = 0; i < schema->count; i++) {
+    const wire_field_t *f = &schema->fields[i];
+    const uint8_t *p = m + f->offset;
+    uint32_t v = 0;
+    int n = 0;
+
+    switch (f->kind) {
+      case wkUint: v = loadUint(p, f->size); break;
+      case wkInt:  v = zigzag(loadInt(p, f->size)); break;
+      case wkChars:
+        while (n < f->size && p[n]) n++;
+        break;
+      case wkBytes:
+        for (n = f->size; n > 0 && p[n - 1] == 0; n--) ;
+        break;
+    }
+
+    if (f->kind == wkUint || f->kind == wkInt) {
+      if (v == 0) continue;
+      if ((pos = putVarint(buf, pos, room, f->id << 1 | wtVarint)) < 0) return -1;
+      if ((pos = putVarint(buf, pos, room, v)) < 0) return -1;
+    } else {
+      if (n == 0) continue;
+      if ((pos = putVarint(buf, pos, room, f->id << 1 | wtBytes)) < 0) return -1;
+      if ((pos = putVarint(buf, pos, room, n)) < 0) return -1;
+      if (pos + n > room) return -1;
+      memcpy(buf + pos, p, n);
+      pos += n;
+    }
+  }
+
+  return pos;
+}
+
+/*
+ *  Fields we don't know (a newer sender) are skipped, and so are ones
+ *  whose wire type doesn't match what we expect.  Strings are always
+ *  terminated; anything too long for its member is cut short.
+ */
+bool wireDecode(const wire_schema_t *schema, const uint8_t *buf, int len, void *msg) {
+  uint8_t *m = (uint8_t *)msg;
+  int pos = 1;
+
+  memset(msg, 0, schema->size);
+  if (len < 1) return false;
+
+  while (pos < len) {
+    uint32_t tag, v;
+    const wire_field_t *f = NULL;
+
+    if ((pos = getVarint(buf, pos, len, &tag)) < 0) return false;
+    if ((pos = getVarint(buf, pos, len, &v)) < 0) return false;
+    if ((tag & 1) == wtBytes && v > (uint32_t)(len - pos)) return false;
+
+    for (int i = 0; i < schema->count; i++) {
+      if (schema->fields[i].id == tag >> 1) f = &schema->fields[i];
+    }
+
+    if (f && (tag & 1) == wtVarint) {
+      if (f->kind == wkUint) storeUint(m + f->offset, f->size, v);
+      else if (f->kind == wkInt) storeUint(m + f->offset, f->size, (uint32_t)unzigzag(v));
+    } else if (f && (tag & 1) == wtBytes) {
+      int room = f->kind == wkChars ? f->size - 1 : f->size;
+
+      if (f->kind == wkChars || f->kind == wkBytes) memcpy(m + f->offset, buf + pos, v < (uint32_t)room ? v : room);
+    }
+
+    if ((tag & 1) == wtBytes) pos += v;
+  }
+
+  return true;
+}
+
+/*
+ *  The view checks the framing once, up front.
+ */
+WireView::WireView(const uint8_t *buf, int len)
+  : buf(buf), len(len), ok(len >= 1) {
+
+  for (int pos = 1; ok && pos < len; ) {
+    uint32_t tag, v;
+
+    if ((pos = getVarint(buf, pos, len, &tag)) < 0 || (pos = getVarint(buf, pos, len, &v)) < 0) {
+      ok = false;
+    } else if ((tag & 1) == wtBytes) {
+      if (v > (uint32_t)(len - pos)) ok = false;
+      else pos += v;
+    }
+  }
+}
+
+bool WireView::valid() const {
+  return ok;
+}
+
+uint8_t WireView::version() const {
+  return ok ? buf[0] : 0;
+}
+
+/*
+ *  (Internal) Find a field of the given wire type: its varint value,
+ *  or its length and where the bytes start.
+ */
+bool WireView::find(uint8_t id, uint8_t type, uint32_t *value, const uint8_t **bytes) const {
+  int pos = 1;
+
+  if (!ok) return false;
+
+  while (pos < len) {
+    uint32_t tag, v;
+
+    pos = getVarint(buf, pos, len, &tag);
+    pos = getVarint(buf, pos, len, &v);
+
+    if (tag >> 1 == id && (tag & 1) == type) {
+      *value = v;
+      if (bytes) *bytes = buf + pos;
+      return true;
+    }
+    if ((tag & 1) == wtBytes) pos += v;
+  }
+
+  return false;
+}
+
+bool WireView::has(uint8_t id) const {
+  uint32_t v;
+
+  return find(id, wtVarint, &v, NULL) || find(id, wtBytes, &v, NULL);
+}
+
+uint32_t WireView::getUint(uint8_t id, uint32_t dflt) const {
+  uint32_t v;
+
+  return find(id, wtVarint, &v, NULL) ? v : dflt;
+}
+
+int32_t WireView::getInt(uint8_t id, int32_t dflt) const {
+  uint32_t v;
+
+  return find(id, wtVarint, &v, NULL) ? unzigzag(v) : dflt;
+}
+
+const uint8_t *WireView::getBytes(uint8_t id, int *len) const {
+  const uint8_t *p;
+  uint32_t v;
+
+  if (!find(id, wtBytes, &v, &p)) {
+    *len = 0;
+    return NULL;
+  }
+  *len = v;
+  return p;
+}
+
+/*
+ *  Compare a string field with a C string, without copying it out.
+ *  A missing field matches "".
+ */
+bool WireView::equals(uint8_t id, const char *str) const {
+  int n;
+  const uint8_t *p = getBytes(id, &n);
+
+  return (int)strlen(str) == n && memcmp(p ? (const void *)p : (const void *)"", str, n) == 0;
+}
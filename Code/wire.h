@@ -0,0 +1,96 @@
+/*
+ *  wire.h - Compact, versioned encoding for packet payloads
+ *
+ *  Abstract:
+ *      A protocol describes its message struct once, as a table of
+ *      fields (WIRE_FIELD), and wireEncode()/wireDecode() turn the
+ *      struct into bytes and back.  On the wire a message is a
+ *      version byte, then for each field that isn't zero or empty,
+ *      a tag (field id and wire type) and the value: integers as
+ *      varints (signed ones zigzagged, so small negatives stay
+ *      small), strings and byte arrays as a length and the bytes,
+ *      minus trailing NULs/zeros.  Nothing depends on the struct's
+ *      layout or padding, fields can be added (with new ids) without
+ *      breaking older units, which skip ids they don't know, and
+ *      fields a sender didn't know come out as zero.  WireView reads
+ *      fields straight out of a received payload without decoding
+ *      the whole thing.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_WIRE_H_
+#define _GM_WIRE_H_
+
+#include <Arduino.h>
+#include <stddef.h>
+
+#define WIRE_MAX_ID   63      // field ids 1-63 (tag fits in one byte)
+
+// How a struct member is stored (and so how it's encoded)
+enum wireKind : uint8_t {
+  wkUint,             // unsigned integer (or bool, or a single char), 1, 2 or 4 bytes
+  wkInt,              // signed integer, 1, 2 or 4 bytes
+  wkChars,            // char array, NUL-terminated (or full)
+  wkBytes             // byte array, any shape
+};
+
+// Wire types in the tag's low bit
+enum wireType : uint8_t { wtVarint, wtBytes };
+
+typedef struct wireField {
+  uint8_t id;         // 1-WIRE_MAX_ID; never reuse one once it's shipped
+  uint8_t kind;       // wireKind
+  uint16_t offset;    // where it lives in the struct
+  uint16_t size;      // and how big it is
+} wire_field_t;
+
+typedef struct wireSchema {
+  uint8_t version;    // bump when fields are added
+  uint8_t count;
+  uint16_t size;      // sizeof the struct
+  const wire_field_t *fields;
+} wire_schema_t;
+
+#define WIRE_FIELD(id, kind, type, member) \
+  { id, kind, (uint16_t)offsetof(type, member), (uint16_t)sizeof(((type *)0)->member) }
+
+#define WIRE_SCHEMA(version, type, fields) \
+  { version, (uint8_t)(sizeof(fields) / sizeof(fields[0])), (uint16_t)sizeof(type), fields }
+
+// Bytes written (at most room), or -1 if it doesn't fit
+int wireEncode(const wire_schema_t *schema, const void *msg, uint8_t *buf, int room);
+
+// Fill in msg (zeroed first); false if the bytes are malformed
+bool wireDecode(const wire_schema_t *schema, const uint8_t *buf, int len, void *msg);
+
+/*
+ *  Read-only view of an encoded message, in place.  Lookups scan the
+ *  fields, which is cheap for the handful a packet carries.  Strings
+ *  and byte arrays come back as pointers into the buffer (not NUL
+ *  terminated), so the buffer has to outlive the view.
+ */
+class WireView {
+  public:
+    WireView(const uint8_t *buf, int len);
+
+    bool valid() const;
+    uint8_t version() const;
+    bool has(uint8_t id) const;
+
+    uint32_t getUint(uint8_t id, uint32_t dflt = 0) const;
+    int32_t getInt(uint8_t id, int32_t dflt = 0) const;
+    const uint8_t *getBytes(uint8_t id, int *len) const;
+    bool equals(uint8_t id, const char *str) const;
+
+  private:
+    bool find(uint8_t id, uint8_t type, uint32_t *value, const uint8_t **bytes) const;
+
+    const uint8_t *buf;
+    int len;
+    bool ok;
+};
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ *  Adafruit_SSD1327.h - Host stand-in for the SSD1327 OLED driver
+ *
+ *  Abstract:
+ *      A 128x128 4bpp framebuffer with the handful of Adafruit_GFX
+ *      drawing calls GameMan uses.  display() counts flushes and,
+ *      if GM_HOST_FRAMES names a directory, writes each frame out
+ *      as a PGM image.  Text uses a blocky placeholder glyph of the
+ *      right size rather than the real fonts, which is enough to
+ *      check layout and to give the framebuffer code something to
+ *      chew on.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_HOST_SSD1327_H_
+#define _GM_HOST_SSD1327_H_
+
+#include <Arduino.h>
+
+#define SSD1327_BLACK 0x0
+#define SSD1327_WHITE 0xF
+#define SSD1327_DISPLAYOFF 0xAE
+#define SSD1327_DISPLAYON 0xAF
+#define SSD1327_SETCONTRAST 0x81
+
+typedef struct {
+  uint16_t bitmapOffset;
+  uint8_t width, height;
+  uint8_t xAdvance;
+  int8_t xOffset, yOffset;
+} GFXglyph;
+
+typedef struct {
+  uint8_t *bitmap;
+  GFXglyph *glyph;
+  uint16_t first, last;
+  uint8_t yAdvance;
+} GFXfont;
+
+class Adafruit_SSD1327 : public Print {
+public:
+  Adafruit_SSD1327(uint16_t w, uint16_t h, int8_t mosi, int8_t sclk, int8_t dc, int8_t rst, int8_t cs);
+  virtual ~Adafruit_SSD1327();
+
+  bool begin(uint8_t i2caddr = 0x3D, bool reset = true);
+  void display();
+  void clearDisplay();
+  void setContrast(uint8_t level);
+  void oled_command(uint8_t c);
+  uint8_t *getBuffer() { return buffer; }
+
+  int16_t width() const { return _width; }
+  int16_t height() const { return _height; }
+
+  void drawPixel(int16_t x, int16_t y, uint16_t color);
+  uint8_t getPixel(int16_t x, int16_t y);
+  void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+  void drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+  void fillScreen(uint16_t color) { fillRect(0, 0, _width, _height, color); }
+  void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color);
+  void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color);
+  void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color);
+  void drawBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint16_t color);
+  void drawBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint16_t color, uint16_t bg);
+
+  void setCursor(int16_t x, int16_t y) { cursor_x = x; cursor_y = y; }
+  int16_t getCursorX() const { return cursor_x; }
+  int16_t getCursorY() const { return cursor_y; }
+  void setTextSize(uint8_t s) { textsize = s ? s : 1; }
+  void setTextColor(uint16_t c) { textcolor = c; textbgcolor = c; }
+  void setTextColor(uint16_t c, uint16_t bg) { textcolor = c; textbgcolor = bg; }
+  void setTextWrap(bool w) { wrap = w; }
+  void setFont(const GFXfont *f = NULL);
+  void getTextBounds(const char *s, int16_t x, int16_t y, int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h);
+  void getTextBounds(const String &s, int16_t x, int16_t y, int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h) {
+    getTextBounds(s.c_str(), x, y, x1, y1, w, h);
+  }
+
+  size_t write(uint8_t c) override;
+
+  // Host only: number of display() flushes so far
+  uint32_t frames() const { return _frames; }
+
+protected:
+  int16_t _width, _height;
+  uint8_t *buffer;
+  int16_t cursor_x = 0, cursor_y = 0;
+  uint8_t textsize = 1;
+  uint16_t textcolor = SSD1327_WHITE, textbgcolor = SSD1327_WHITE;
+  bool wrap = true;
+  const GFXfont *gfxFont = NULL;
+  uint32_t _frames = 0;
+  uint8_t _contrast = 0x7f;
+  bool _on = true;
+
+  void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t size);
+};
+
+#endif
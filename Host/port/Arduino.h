@@ -0,0 +1,180 @@
+/*
+ *  Arduino.h - Host stand-in for the Arduino-ESP32 core
+ *
+ *  Abstract:
+ *      The subset of the Arduino API the GameMan framework uses:
+ *      String, Print/Serial, timing, GPIO and analog reads.  GPIO
+ *      levels come from the scripted button source in host.h and
+ *      Serial goes to stdout.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_HOST_ARDUINO_H_
+#define _GM_HOST_ARDUINO_H_
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "esp_idf.h"
+#include "host.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW  0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+#define LED_BUILTIN 13
+
+#define BIN 2
+#define OCT 8
+#define DEC 10
+#define HEX 16
+
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+
+#define digitalPinToInterrupt(p) (p)
+
+class String {
+public:
+  String(const char *s = "") : _s(s ? s : "") {}
+  String(const std::string &s) : _s(s) {}
+  String(char c) : _s(1, c) {}
+  String(int v, unsigned char base = DEC) : _s(fmt((long long)v, base)) {}
+  String(unsigned int v, unsigned char base = DEC) : _s(fmt((long long)v, base)) {}
+  String(long v, unsigned char base = DEC) : _s(fmt((long long)v, base)) {}
+  String(unsigned long v, unsigned char base = DEC) : _s(fmt((long long)v, base)) {}
+  String(unsigned char v, unsigned char base = DEC) : _s(fmt((long long)v, base)) {}
+  String(double v, unsigned int places = 2) {
+    char buf[40];
+    snprintf(buf, sizeof(buf), "%.*f", places, v);
+    _s = buf;
+  }
+
+  const char *c_str() const { return _s.c_str(); }
+  unsigned int length() const { return _s.length(); }
+  char operator[](unsigned int i) const { return _s[i]; }
+  bool operator==(const String &o) const { return _s == o._s; }
+  bool operator!=(const String &o) const { return _s != o._s; }
+  String &operator+=(const String &o) { _s += o._s; return *this; }
+  String &operator+=(const char *o) { _s += o; return *this; }
+  String &operator+=(char c) { _s += c; return *this; }
+  int toInt() const { return atoi(_s.c_str()); }
+
+  friend String operator+(const String &a, const String &b) { return String(a._s + b._s); }
+  friend String operator+(const String &a, const char *b) { return String(a._s + b); }
+  friend String operator+(const char *a, const String &b) { return String(a + b._s); }
+
+private:
+  std::string _s;
+
+  static std::string fmt(long long v, unsigned char base) {
+    if (base == DEC) return std::to_string(v);
+
+    std::string out;
+    unsigned long long u = (unsigned long long)v;
+    do {
+      out.insert(out.begin(), "0123456789abcdef"[u % base]);
+      u /= base;
+    } while (u);
+    return out;
+  }
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t n) {
+    for (size_t i = 0; i < n; i++) write(buf[i]);
+    return n;
+  }
+
+  size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+  size_t print(const String &s) { return print(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v, int base = DEC) { return print(String(v, base)); }
+  size_t print(unsigned int v, int base = DEC) { return print(String(v, base)); }
+  size_t print(long v, int base = DEC) { return print(String(v, base)); }
+  size_t print(unsigned long v, int base = DEC) { return print(String(v, base)); }
+  size_t print(double v, int places = 2) { return print(String(v, places)); }
+
+  size_t println() { return print("\n"); }
+  template<typename T> size_t println(T v) { size_t n = print(v); return n + println(); }
+  template<typename T> size_t println(T v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+
+  size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long baud) {}
+  int available();
+  int read();
+  void flush() {}
+  operator bool() const { return true; }
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buf, size_t n) override;
+};
+
+extern HardwareSerial Serial;
+
+class EspClass {
+public:
+  uint32_t getFreeHeap();
+  uint32_t getHeapSize();
+  uint32_t getMinFreeHeap();
+  uint32_t getCpuFreqMHz() { return 240; }
+  uint32_t getCycleCount();
+  void restart() { exit(0); }
+};
+
+extern EspClass ESP;
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t level);
+uint16_t analogRead(uint8_t pin);
+uint32_t analogReadMilliVolts(uint8_t pin);
+enum adc_attenuation_t { ADC_0db, ADC_2_5db, ADC_6db, ADC_11db };
+void analogSetPinAttenuation(uint8_t pin, int atten);
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void attachInterruptArg(uint8_t pin, void (*isr)(void *), void *arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+bool setCpuFrequencyMhz(uint32_t mhz);
+uint32_t getCpuFrequencyMhz();
+
+#define constrain(x, lo, hi) ((x) < (lo) ? (lo) : ((x) > (hi) ? (hi) : (x)))
+
+#endif
@@ -0,0 +1,18 @@
+/*
+ *  Fonts/FreeSans9pt7b.h - Host placeholder for the Adafruit font
+ *
+ *  Only the metrics matter off-device; glyphs are drawn as blocks.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_HOST_FREESANS9_H_
+#define _GM_HOST_FREESANS9_H_
+
+#include <Adafruit_SSD1327.h>
+
+static const GFXfont FreeSans9pt7b = { NULL, NULL, 0x20, 0x7e, 22 };
+
+#endif
@@ -0,0 +1,42 @@
+/*
+ *  Preferences.h - Host stand-in for the NVS-backed Preferences class
+ *
+ *  Abstract:
+ *      Keeps namespaces in memory for the life of the process.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_HOST_PREFS_H_
+#define _GM_HOST_PREFS_H_
+
+#include <Arduino.h>
+
+class Preferences {
+public:
+  bool begin(const char *name, bool readOnly = false);
+  void end();
+  bool clear();
+  bool remove(const char *key);
+  bool isKey(const char *key);
+
+  size_t putBytes(const char *key, const void *value, size_t len);
+  size_t getBytes(const char *key, void *buf, size_t maxLen);
+  size_t putUShort(const char *key, uint16_t value);
+  uint16_t getUShort(const char *key, uint16_t defaultValue = 0);
+  size_t putUInt(const char *key, uint32_t value);
+  uint32_t getUInt(const char *key, uint32_t defaultValue = 0);
+  size_t putBool(const char *key, bool value);
+  bool getBool(const char *key, bool defaultValue = false);
+  size_t putUChar(const char *key, uint8_t value);
+  uint8_t getUChar(const char *key, uint8_t defaultValue = 0);
+
+private:
+  String _ns;
+  bool _open = false;
+  bool _readOnly = false;
+};
+
+#endif
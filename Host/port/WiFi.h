@@ -0,0 +1,25 @@
+/*
+ *  WiFi.h - Host stand-in for the Arduino-ESP32 WiFi object
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_HOST_WIFI_H_
+#define _GM_HOST_WIFI_H_
+
+#include <Arduino.h>
+
+typedef enum { WIFI_MODE_NULL, WIFI_MODE_STA, WIFI_MODE_AP, WIFI_MODE_APSTA } wifi_mode_t;
+
+class WiFiClass {
+public:
+  bool mode(wifi_mode_t m) { return true; }
+  String macAddress();
+  uint8_t *macAddress(uint8_t *mac);
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,366 @@
+/*
+ *  arduino.cpp - Host implementation of the Arduino core subset
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+
+/*
+ *  Clock
+ */
+static const auto epoch = std::chrono::steady_clock::now();
+static std::atomic<bool> virtualClock(false);
+static std::atomic<uint64_t> virtualNow(0);
+
+uint64_t hostMicros() {
+  if (virtualClock) return virtualNow;
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+bool hostVirtualClock() {
+  return virtualClock;
+}
+
+void hostUseVirtualClock(bool on) {
+  virtualNow = hostMicros();
+  virtualClock = on;
+}
+
+void hostAdvanceClock(uint64_t us) {
+  virtualNow += us;
+  hostKick();
+}
+
+unsigned long millis() {
+  return hostMicros() / 1000;
+}
+
+unsigned long micros() {
+  return hostMicros();
+}
+
+void delay(uint32_t ms) {
+  vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+void delayMicroseconds(uint32_t us) {
+  if (!virtualClock) usleep(us);
+}
+
+void yield() {
+  vTaskDelay(1);
+}
+
+int64_t esp_timer_get_time() {
+  return hostMicros();
+}
+
+/*
+ *  Random numbers: seeded so runs are repeatable, but differently on
+ *  each node so they don't all pick the same player tag
+ */
+static std::mt19937 &generator() {
+  static std::mt19937 rng(411 + hostNodeMAC()[5]);
+  return rng;
+}
+
+uint32_t esp_random() {
+  return generator()();
+}
+
+long random(long max) {
+  return max > 0 ? generator()() % max : 0;
+}
+
+long random(long min, long max) {
+  return max > min ? min + random(max - min) : min;
+}
+
+void randomSeed(unsigned long seed) {
+  generator().seed(seed);
+}
+
+/*
+ *  GPIO: all pins idle high (buttons are active low with pullups)
+ */
+static std::mutex pinLock;
+static std::map<uint8_t, int> pins;
+static std::map<uint8_t, uint32_t> analog;
+
+struct pinISR {
+  void (*fn)(void *);
+  void *arg;
+  int mode;
+};
+static std::map<uint8_t, pinISR> isrs;
+
+static void callPlain(void *arg) {
+  ((void (*)(void))arg)();
+}
+
+/*
+ *  Change a pin level, firing its edge interrupt (from the caller's
+ *  thread, which plays the part of interrupt context).
+ */
+void hostSetPin(uint8_t pin, int level) {
+  pinISR isr = { nullptr, nullptr, 0 };
+  bool edge;
+
+  {
+    std::lock_guard<std::mutex> lk(pinLock);
+    auto it = pins.find(pin);
+    int was = it == pins.end() ? HIGH : it->second;
+    pins[pin] = level;
+
+    edge = (was != level);
+    if (isrs.count(pin)) isr = isrs[pin];
+  }
+
+  if (edge && isr.fn) {
+    if (isr.mode == CHANGE || (isr.mode == RISING && level) || (isr.mode == FALLING && !level)) {
+      isr.fn(isr.arg);
+    }
+  }
+}
+
+int hostGetPin(uint8_t pin) {
+  std::lock_guard<std::mutex> lk(pinLock);
+  auto it = pins.find(pin);
+  return it == pins.end() ? HIGH : it->second;
+}
+
+/*
+ *  GPIO_IN / GPIO_IN1: unset pins read high, like the pulled-up buttons
+ */
+uint32_t hostReadReg(uint32_t addr) {
+  uint8_t base = (addr == GPIO_IN1_REG) ? 32 : 0;
+  uint32_t v = (addr == GPIO_IN1_REG) ? 0xff : 0xffffffff;
+
+  std::lock_guard<std::mutex> lk(pinLock);
+  for (auto &p : pins) {
+    if (p.first >= base && p.first < base + 32 && !p.second) v &= ~(1UL << (p.first - base));
+  }
+  return v;
+}
+
+void hostSetAnalog(uint8_t pin, uint32_t mv) {
+  std::lock_guard<std::mutex> lk(pinLock);
+  analog[pin] = mv;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+int digitalRead(uint8_t pin) {
+  return hostGetPin(pin);
+}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+  hostSetPin(pin, level);
+}
+
+uint32_t analogReadMilliVolts(uint8_t pin) {
+  std::lock_guard<std::mutex> lk(pinLock);
+  auto it = analog.find(pin);
+  return it == analog.end() ? 1950 : it->second;   // ~3.9V behind a 2:1 divider
+}
+
+uint16_t analogRead(uint8_t pin) {
+  return analogReadMilliVolts(pin) * 4095 / 3300;
+}
+
+void analogSetPinAttenuation(uint8_t pin, int atten) {
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode) {
+  attachInterruptArg(pin, callPlain, (void *)isr, mode);
+}
+
+void attachInterruptArg(uint8_t pin, void (*isr)(void *), void *arg, int mode) {
+  std::lock_guard<std::mutex> lk(pinLock);
+  isrs[pin] = { isr, arg, mode };
+}
+
+void detachInterrupt(uint8_t pin) {
+  std::lock_guard<std::mutex> lk(pinLock);
+  isrs.erase(pin);
+}
+
+static uint32_t cpuMhz = 240;
+
+bool setCpuFrequencyMhz(uint32_t mhz) {
+  cpuMhz = mhz;
+  return true;
+}
+
+uint32_t getCpuFrequencyMhz() {
+  return cpuMhz;
+}
+
+/*
+ *  Serial
+ */
+static std::atomic<bool> serialQuiet(false);
+
+void hostSerialQuiet(bool on) {
+  serialQuiet = on;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return serialQuiet ? 1 : fwrite(&c, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t n) {
+  return serialQuiet ? n : fwrite(buf, 1, n, stdout);
+}
+
+int HardwareSerial::available() {
+  return 0;
+}
+
+int HardwareSerial::read() {
+  return -1;
+}
+
+size_t Print::printf(const char *fmt, ...) {
+  char buf[256];
+  va_list ap;
+
+  va_start(ap, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+
+  if (n < 0) return 0;
+  if ((size_t)n >= sizeof(buf)) n = sizeof(buf) - 1;
+  return write((const uint8_t *)buf, n);
+}
+
+/*
+ *  ESP
+ */
+uint32_t EspClass::getFreeHeap() {
+  return 200 * 1024;
+}
+
+uint32_t EspClass::getHeapSize() {
+  return 320 * 1024;
+}
+
+uint32_t EspClass::getCycleCount() {
+  return (uint32_t)(hostMicros() * cpuMhz);
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+  return 180 * 1024;
+}
+
+/*
+ *  Preferences: node -> namespace -> key -> bytes, kept for the process
+ *  lifetime.  Each node (MAC) gets its own flash, which matters when a
+ *  simulator runs several in one process.
+ */
+static std::mutex prefsLock;
+static std::map<std::string, std::map<std::string, std::map<std::string, std::vector<uint8_t>>>> flash;
+
+static std::map<std::string, std::map<std::string, std::vector<uint8_t>>> &nodeFlash() {
+  return flash[std::string((const char *)hostNodeMAC(), 6)];
+}
+
+bool Preferences::begin(const char *name, bool readOnly) {
+  _ns = name;
+  _open = true;
+  _readOnly = readOnly;
+  return true;
+}
+
+void Preferences::end() {
+  _open = false;
+}
+
+bool Preferences::clear() {
+  std::lock_guard<std::mutex> lk(prefsLock);
+  nodeFlash()[_ns.c_str()].clear();
+  return true;
+}
+
+bool Preferences::remove(const char *key) {
+  std::lock_guard<std::mutex> lk(prefsLock);
+  return nodeFlash()[_ns.c_str()].erase(key) > 0;
+}
+
+bool Preferences::isKey(const char *key) {
+  std::lock_guard<std::mutex> lk(prefsLock);
+  return nodeFlash()[_ns.c_str()].count(key) > 0;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len) {
+  if (!_open || _readOnly) return 0;
+
+  std::lock_guard<std::mutex> lk(prefsLock);
+  const uint8_t *p = (const uint8_t *)value;
+  nodeFlash()[_ns.c_str()][key] = std::vector<uint8_t>(p, p + len);
+  return len;
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen) {
+  if (!_open) return 0;
+
+  std::lock_guard<std::mutex> lk(prefsLock);
+  auto &space = nodeFlash()[_ns.c_str()];
+  auto it = space.find(key);
+  if (it == space.end() || it->second.size() > maxLen) return 0;
+
+  memcpy(buf, it->second.data(), it->second.size());
+  return it->second.size();
+}
+
+#define PREF_SCALAR(name, type)                                       \
+  size_t Preferences::put##name(const char *key, type value) {        \
+    return putBytes(key, &value, sizeof(value));                      \
+  }                                                                   \
+  type Preferences::get##name(const char *key, type defaultValue) {   \
+    type v;                                                           \
+    return getBytes(key, &v, sizeof(v)) == sizeof(v) ? v : defaultValue; \
+  }
+
+PREF_SCALAR(UShort, uint16_t)
+PREF_SCALAR(UInt, uint32_t)
+PREF_SCALAR(Bool, bool)
+PREF_SCALAR(UChar, uint8_t)
+
+/*
+ *  WiFi: the MAC comes from the radio's notion of "this node"
+ */
+uint8_t *WiFiClass::macAddress(uint8_t *mac) {
+  memcpy(mac, hostNodeMAC(), 6);
+  return mac;
+}
+
+String WiFiClass::macAddress() {
+  char buf[18];
+  const uint8_t *m = hostNodeMAC();
+
+  snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", m[0], m[1], m[2], m[3], m[4], m[5]);
+  return String(buf);
+}
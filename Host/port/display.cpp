@@ -0,0 +1,184 @@
+/*
+ *  display.cpp - Framebuffer-backed SSD1327 stand-in
+ *
+ *  Abstract:
+ *      Same 4bpp packed layout as the real driver (two pixels per
+ *      byte, high nibble first) so code that pokes at getBuffer()
+ *      sees what it would on the device.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include <stdlib.h>
+
+#include <Adafruit_SSD1327.h>
+
+Adafruit_SSD1327::Adafruit_SSD1327(uint16_t w, uint16_t h, int8_t mosi, int8_t sclk, int8_t dc, int8_t rst, int8_t cs)
+  : _width(w), _height(h) {
+  buffer = (uint8_t *)calloc(w * h / 2, 1);
+}
+
+Adafruit_SSD1327::~Adafruit_SSD1327() {
+  free(buffer);
+}
+
+bool Adafruit_SSD1327::begin(uint8_t i2caddr, bool reset) {
+  return buffer != NULL;
+}
+
+/*
+ *  "Flush" the framebuffer.  Dumps a PGM per frame if asked to.
+ */
+void Adafruit_SSD1327::display() {
+  const char *dir = getenv("GM_HOST_FRAMES");
+
+  _frames++;
+  if (!dir || !_on) return;
+
+  char path[256];
+  snprintf(path, sizeof(path), "%s/frame%05u.pgm", dir, (unsigned)_frames);
+
+  FILE *f = fopen(path, "wb");
+  if (!f) return;
+
+  fprintf(f, "P5\n%d %d\n15\n", _width, _height);
+  for (int y = 0; y < _height; y++) {
+    for (int x = 0; x < _width; x++) {
+      fputc(getPixel(x, y), f);
+    }
+  }
+  fclose(f);
+}
+
+void Adafruit_SSD1327::clearDisplay() {
+  memset(buffer, 0, _width * _height / 2);
+}
+
+void Adafruit_SSD1327::setContrast(uint8_t level) {
+  _contrast = level;
+}
+
+void Adafruit_SSD1327::oled_command(uint8_t c) {
+  if (c == SSD1327_DISPLAYOFF) _on = false;
+  if (c == SSD1327_DISPLAYON) _on = true;
+}
+
+void Adafruit_SSD1327::drawPixel(int16_t x, int16_t y, uint16_t color) {
+  if (x < 0 || y < 0 || x >= _width || y >= _height) return;
+
+  uint8_t *p = &buffer[(y * _width + x) / 2];
+  if (x & 1) *p = (*p & 0xf0) | (color & 0x0f);
+  else *p = (*p & 0x0f) | ((color & 0x0f) << 4);
+}
+
+uint8_t Adafruit_SSD1327::getPixel(int16_t x, int16_t y) {
+  if (x < 0 || y < 0 || x >= _width || y >= _height) return 0;
+
+  uint8_t b = buffer[(y * _width + x) / 2];
+  return (x & 1) ? (b & 0x0f) : (b >> 4);
+}
+
+void Adafruit_SSD1327::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  for (int16_t j = y; j < y + h; j++)
+    for (int16_t i = x; i < x + w; i++)
+      drawPixel(i, j, color);
+}
+
+void Adafruit_SSD1327::drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  drawFastHLine(x, y, w, color);
+  drawFastHLine(x, y + h - 1, w, color);
+  drawFastVLine(x, y, h, color);
+  drawFastVLine(x + w - 1, y, h, color);
+}
+
+void Adafruit_SSD1327::drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) {
+  fillRect(x, y, w, 1, color);
+}
+
+void Adafruit_SSD1327::drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) {
+  fillRect(x, y, 1, h, color);
+}
+
+void Adafruit_SSD1327::drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+  int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+  int dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+  int err = dx + dy;
+
+  for (;;) {
+    drawPixel(x0, y0, color);
+    if (x0 == x1 && y0 == y1) break;
+    int e2 = 2 * err;
+    if (e2 >= dy) { err += dy; x0 += sx; }
+    if (e2 <= dx) { err += dx; y0 += sy; }
+  }
+}
+
+void Adafruit_SSD1327::drawBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint16_t color) {
+  int16_t stride = (w + 7) / 8;
+
+  for (int16_t j = 0; j < h; j++)
+    for (int16_t i = 0; i < w; i++)
+      if (bitmap[j * stride + i / 8] & (0x80 >> (i & 7)))
+        drawPixel(x + i, y + j, color);
+}
+
+void Adafruit_SSD1327::drawBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint16_t color, uint16_t bg) {
+  int16_t stride = (w + 7) / 8;
+
+  for (int16_t j = 0; j < h; j++)
+    for (int16_t i = 0; i < w; i++)
+      drawPixel(x + i, y + j, (bitmap[j * stride + i / 8] & (0x80 >> (i & 7))) ? color : bg);
+}
+
+void Adafruit_SSD1327::setFont(const GFXfont *f) {
+  // Same cursor fixup as Adafruit_GFX when switching font styles
+  if (f && !gfxFont) cursor_y += 6;
+  else if (!f && gfxFont) cursor_y -= 6;
+  gfxFont = f;
+}
+
+/*
+ *  Placeholder glyph: a 5x7 block with a pattern derived from the
+ *  character code, so different strings look different.
+ */
+void Adafruit_SSD1327::drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t size) {
+  for (int8_t i = 0; i < 5; i++) {
+    uint8_t col = (uint8_t)(c * (i + 3)) | 0x41;
+    for (int8_t j = 0; j < 7; j++) {
+      if (col & (1 << j)) fillRect(x + i * size, y + j * size, size, size, color);
+      else if (bg != color) fillRect(x + i * size, y + j * size, size, size, bg);
+    }
+  }
+}
+
+size_t Adafruit_SSD1327::write(uint8_t c) {
+  int16_t adv = gfxFont ? 10 * textsize : 6 * textsize;
+  int16_t line = gfxFont ? gfxFont->yAdvance * textsize : 8 * textsize;
+
+  if (c == '\n') {
+    cursor_x = 0;
+    cursor_y += line;
+  } else if (c != '\r') {
+    if (wrap && cursor_x + adv > _width) {
+      cursor_x = 0;
+      cursor_y += line;
+    }
+    if (c != ' ') {
+      drawChar(cursor_x, gfxFont ? cursor_y - 12 * textsize : cursor_y, c, textcolor, textbgcolor, textsize);
+    }
+    cursor_x += adv;
+  }
+  return 1;
+}
+
+void Adafruit_SSD1327::getTextBounds(const char *s, int16_t x, int16_t y, int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h) {
+  int16_t adv = gfxFont ? 10 * textsize : 6 * textsize;
+  int16_t tall = gfxFont ? 13 * textsize : 8 * textsize;
+
+  *x1 = x;
+  *y1 = gfxFont ? y - tall : y;
+  *w = strlen(s) * adv;
+  *h = tall;
+}
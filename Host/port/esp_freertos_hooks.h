@@ -0,0 +1,28 @@
+/*
+ *  esp_freertos_hooks.h - Host stand-in for the ESP-IDF FreeRTOS hooks
+ *
+ *  Abstract:
+ *      There's no tick interrupt on the host, so registering a tick
+ *      hook succeeds but the hook is never called.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_HOST_FREERTOS_HOOKS_H_
+#define _GM_HOST_FREERTOS_HOOKS_H_
+
+#include "esp_idf.h"
+#include "freertos/FreeRTOS.h"
+
+typedef void (*esp_freertos_tick_cb_t)(void);
+
+static inline esp_err_t esp_register_freertos_tick_hook_for_cpu(esp_freertos_tick_cb_t cb, UBaseType_t cpu) {
+  return ESP_OK;
+}
+
+static inline void esp_deregister_freertos_tick_hook_for_cpu(esp_freertos_tick_cb_t cb, UBaseType_t cpu) {
+}
+
+#endif
@@ -0,0 +1,27 @@
+/*
+ *  esp_idf.h - Host stand-ins for assorted ESP-IDF system calls
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_HOST_ESP_IDF_H_
+#define _GM_HOST_ESP_IDF_H_
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                  0
+#define ESP_FAIL               -1
+#define ESP_ERR_NO_MEM          0x101
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_INVALID_STATE   0x103
+#define ESP_ERR_NOT_SUPPORTED   0x106
+#define ESP_ERR_TIMEOUT         0x107
+
+int64_t esp_timer_get_time();
+uint32_t esp_random();
+
+#endif
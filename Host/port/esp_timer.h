@@ -0,0 +1,14 @@
+/*
+ *  esp_timer.h - Host stand-in for the ESP-IDF high resolution timer
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_HOST_ESP_TIMER_H_
+#define _GM_HOST_ESP_TIMER_H_
+
+#include "esp_idf.h"
+
+#endif
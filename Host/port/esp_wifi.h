@@ -0,0 +1,53 @@
+/*
+ *  esp_wifi.h - Host stand-in for the bits of the ESP-IDF WiFi API
+ *
+ *  Abstract:
+ *      Just promiscuous mode, which the network task uses to learn
+ *      the signal strength of ESP-NOW frames.  The radio stand-ins
+ *      (radio.cpp, sim/netsim.cpp) implement it.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_HOST_ESP_WIFI_H_
+#define _GM_HOST_ESP_WIFI_H_
+
+#include <stdint.h>
+#include "esp_idf.h"
+
+typedef enum { WIFI_PKT_MGMT, WIFI_PKT_CTRL, WIFI_PKT_DATA, WIFI_PKT_MISC } wifi_promiscuous_pkt_type_t;
+
+#define WIFI_PROMIS_FILTER_MASK_ALL   0xffffffff
+#define WIFI_PROMIS_FILTER_MASK_MGMT  (1)
+
+typedef struct {
+  signed rssi : 8;              // dBm
+  unsigned rate : 5;
+  unsigned : 1;
+  unsigned sig_mode : 2;
+  unsigned : 16;
+  unsigned channel : 4;
+  unsigned : 12;
+  unsigned sig_len : 12;        // frame length, FCS included
+  unsigned : 12;
+  unsigned rx_state : 8;
+} wifi_pkt_rx_ctrl_t;
+
+typedef struct {
+  wifi_pkt_rx_ctrl_t rx_ctrl;
+  uint8_t payload[0];           // 802.11 frame, header first
+} wifi_promiscuous_pkt_t;
+
+typedef struct {
+  uint32_t filter_mask;
+} wifi_promiscuous_filter_t;
+
+typedef void (*wifi_promiscuous_cb_t)(void *buf, wifi_promiscuous_pkt_type_t type);
+
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t cb);
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t *filter);
+esp_err_t esp_wifi_set_promiscuous(bool en);
+
+#endif
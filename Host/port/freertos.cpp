@@ -0,0 +1,506 @@
+/*
+ *  freertos.cpp - Host implementation of the FreeRTOS stand-in
+ *
+ *  Abstract:
+ *      Maps tasks onto std::thread and queues onto a mutex +
+ *      condition variable protected ring.  Every blocking call
+ *      is also a "checkpoint" where a task notices that another
+ *      task suspended or deleted it, which is how GameMan's
+ *      menu shuts down apps.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "host.h"
+
+namespace {
+
+// Thrown through a task's stack when it has been deleted
+struct TaskDeleted {};
+
+std::recursive_mutex bigLock;   // guards task list and critical sections
+std::mutex stateLock;           // guards every queue/task wait
+std::condition_variable_any stateChanged;
+
+}  // namespace
+
+struct hostTask {
+  const char *name;
+  UBaseType_t prio;
+  BaseType_t core;
+  uint32_t stack;
+  TaskFunction_t fn;
+  void *param;
+  std::thread thread;
+  bool suspended = false;
+  bool deleted = false;
+  bool finished = false;
+  uint32_t notifyValue = 0;
+  bool notifyPending = false;
+};
+
+struct hostQueue {
+  UBaseType_t length;
+  UBaseType_t itemSize;
+  std::deque<std::vector<uint8_t>> items;
+  bool isMutex = false;
+};
+
+struct hostEvents {
+  EventBits_t bits = 0;
+};
+
+namespace {
+
+std::vector<hostTask *> tasks;
+thread_local hostTask *self = nullptr;
+hostTask mainTask = { "loopTask", 1, APP_CPU_NUM, 8192, nullptr, nullptr };
+
+hostTask *current() {
+  return self ? self : &mainTask;
+}
+
+// Called with stateLock held; blocks while suspended, throws if deleted
+void checkpoint(std::unique_lock<std::mutex> &lk) {
+  hostTask *t = current();
+  while (t->suspended && !t->deleted) {
+    stateChanged.wait(lk);
+  }
+  if (t->deleted && t != &mainTask) {
+    throw TaskDeleted();
+  }
+}
+
+// Wait on the shared condition until pred() or the timeout passes.
+template<typename Pred>
+bool waitFor(std::unique_lock<std::mutex> &lk, TickType_t wait, Pred pred) {
+  checkpoint(lk);
+  if (pred()) return true;
+  if (wait == 0) return false;
+
+  TickType_t start = xTaskGetTickCount();
+  for (;;) {
+    if (hostVirtualClock()) {
+      // Simulated time only moves when the simulator says so
+      stateChanged.wait_for(lk, std::chrono::milliseconds(1));
+    } else if (wait == portMAX_DELAY) {
+      stateChanged.wait(lk);
+    } else {
+      TickType_t gone = xTaskGetTickCount() - start;
+      if (gone >= wait) return pred();
+      stateChanged.wait_for(lk, std::chrono::milliseconds(wait - gone));
+    }
+    checkpoint(lk);
+    if (pred()) return true;
+    if (wait != portMAX_DELAY && xTaskGetTickCount() - start >= wait) return pred();
+  }
+}
+
+void trampoline(hostTask *t) {
+  self = t;
+  try {
+    {
+      std::unique_lock<std::mutex> lk(stateLock);
+      checkpoint(lk);
+    }
+    t->fn(t->param);
+  } catch (TaskDeleted &) {
+    // normal exit path for vTaskDelete()
+  }
+  std::lock_guard<std::mutex> lk(stateLock);
+  t->finished = true;
+  stateChanged.notify_all();
+}
+
+}  // namespace
+
+void hostEnterCritical(portMUX_TYPE *mux) {
+  bigLock.lock();
+}
+
+void hostExitCritical(portMUX_TYPE *mux) {
+  bigLock.unlock();
+}
+
+/*
+ *  Tasks
+ */
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack,
+                                   void *param, UBaseType_t prio, TaskHandle_t *handle, BaseType_t core) {
+  hostTask *t = new hostTask;
+  t->name = name;
+  t->prio = prio;
+  t->core = core;
+  t->stack = stack;
+  t->fn = fn;
+  t->param = param;
+
+  {
+    std::lock_guard<std::recursive_mutex> lk(bigLock);
+    tasks.push_back(t);
+  }
+  if (handle) *handle = t;
+
+  t->thread = std::thread(trampoline, t);
+  t->thread.detach();
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack,
+                       void *param, UBaseType_t prio, TaskHandle_t *handle) {
+  return xTaskCreatePinnedToCore(fn, name, stack, param, prio, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t t) {
+  hostTask *target = t ? t : current();
+
+  {
+    std::lock_guard<std::mutex> lk(stateLock);
+    target->deleted = true;
+    stateChanged.notify_all();
+  }
+  {
+    std::lock_guard<std::recursive_mutex> lk(bigLock);
+    for (size_t i = 0; i < tasks.size(); i++) {
+      if (tasks[i] == target) {
+        tasks.erase(tasks.begin() + i);
+        break;
+      }
+    }
+  }
+
+  // Deleting ourselves never returns
+  if (target == current() && target != &mainTask) throw TaskDeleted();
+}
+
+void vTaskSuspend(TaskHandle_t t) {
+  std::unique_lock<std::mutex> lk(stateLock);
+  hostTask *target = t ? t : current();
+
+  target->suspended = true;
+  stateChanged.notify_all();
+  if (target == current()) checkpoint(lk);
+}
+
+void vTaskResume(TaskHandle_t t) {
+  std::lock_guard<std::mutex> lk(stateLock);
+  if (t) t->suspended = false;
+  stateChanged.notify_all();
+}
+
+void vTaskDelay(TickType_t ticks) {
+  std::unique_lock<std::mutex> lk(stateLock);
+  waitFor(lk, ticks, [] { return false; });
+}
+
+void vTaskDelayUntil(TickType_t *prev, TickType_t inc) {
+  TickType_t now = xTaskGetTickCount();
+  TickType_t wake = *prev + inc;
+
+  if ((int32_t)(wake - now) > 0) vTaskDelay(wake - now);
+  *prev = wake;
+}
+
+TickType_t xTaskGetTickCount() {
+  return (TickType_t)(hostMicros() / 1000);
+}
+
+TickType_t xTaskGetTickCountFromISR() {
+  return xTaskGetTickCount();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return current();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandleForCPU(BaseType_t core) {
+  // No real notion of "running on a core" here; report the loop task
+  return &mainTask;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t core) {
+  return nullptr;
+}
+
+const char *pcTaskGetName(TaskHandle_t t) {
+  return (t ? t : current())->name;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks() {
+  std::lock_guard<std::recursive_mutex> lk(bigLock);
+  return tasks.size() + 1;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t t) {
+  // Stacks are host-sized, so just report the requested depth
+  return (t ? t : current())->stack;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t max, uint32_t *total) {
+  std::lock_guard<std::recursive_mutex> lk(bigLock);
+  UBaseType_t n = 0;
+
+  for (size_t i = 0; i < tasks.size() && n < max; i++, n++) {
+    memset(&status[n], 0, sizeof(TaskStatus_t));
+    status[n].xHandle = tasks[i];
+    status[n].pcTaskName = tasks[i]->name;
+    status[n].xTaskNumber = i + 1;
+    status[n].eCurrentState = tasks[i]->suspended ? eSuspended : eBlocked;
+    status[n].uxCurrentPriority = tasks[i]->prio;
+    status[n].uxBasePriority = tasks[i]->prio;
+    status[n].usStackHighWaterMark = tasks[i]->stack;
+    status[n].xCoreID = tasks[i]->core;
+  }
+  if (total) *total = 0;
+  return n;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t t) {
+  return (t ? t : current())->prio;
+}
+
+BaseType_t xPortGetCoreID() {
+  BaseType_t core = current()->core;
+  return core == tskNO_AFFINITY ? 0 : core;
+}
+
+eTaskState eTaskGetState(TaskHandle_t t) {
+  std::lock_guard<std::mutex> lk(stateLock);
+  if (t->deleted || t->finished) return eDeleted;
+  if (t->suspended) return eSuspended;
+  return t == current() ? eRunning : eBlocked;
+}
+
+/*
+ *  Notifications
+ */
+BaseType_t xTaskNotify(TaskHandle_t t, uint32_t value, eNotifyAction action) {
+  std::lock_guard<std::mutex> lk(stateLock);
+
+  if (!t) return pdFAIL;
+  switch (action) {
+    case eSetBits: t->notifyValue |= value; break;
+    case eIncrement: t->notifyValue++; break;
+    case eSetValueWithOverwrite: t->notifyValue = value; break;
+    case eSetValueWithoutOverwrite:
+      if (t->notifyPending) return pdFAIL;
+      t->notifyValue = value;
+      break;
+    default: break;
+  }
+  t->notifyPending = true;
+  stateChanged.notify_all();
+  return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t t, uint32_t value, eNotifyAction action, BaseType_t *woken) {
+  if (woken) *woken = pdFALSE;
+  return xTaskNotify(t, value, action);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t t, BaseType_t *woken) {
+  xTaskNotifyFromISR(t, 0, eIncrement, woken);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t *value, TickType_t wait) {
+  std::unique_lock<std::mutex> lk(stateLock);
+  hostTask *t = current();
+
+  if (!t->notifyPending) t->notifyValue &= ~clearOnEntry;
+  if (!waitFor(lk, wait, [t] { return t->notifyPending; })) return pdFALSE;
+
+  if (value) *value = t->notifyValue;
+  t->notifyValue &= ~clearOnExit;
+  t->notifyPending = false;
+  return pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait) {
+  std::unique_lock<std::mutex> lk(stateLock);
+  hostTask *t = current();
+
+  if (!waitFor(lk, wait, [t] { return t->notifyValue != 0; })) return 0;
+
+  uint32_t v = t->notifyValue;
+  t->notifyValue = clear ? 0 : v - 1;
+  t->notifyPending = t->notifyValue != 0;
+  return v;
+}
+
+/*
+ *  Queues
+ */
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  hostQueue *q = new hostQueue;
+  q->length = length;
+  q->itemSize = itemSize;
+  return q;
+}
+
+void vQueueDelete(QueueHandle_t q) {
+  std::lock_guard<std::mutex> lk(stateLock);
+  delete q;
+}
+
+static BaseType_t queueSend(QueueHandle_t q, const void *item, TickType_t wait, bool front) {
+  std::unique_lock<std::mutex> lk(stateLock);
+
+  if (!q) return pdFAIL;
+  if (!waitFor(lk, wait, [q] { return q->items.size() < q->length; })) return errQUEUE_FULL;
+
+  const uint8_t *p = (const uint8_t *)item;
+  std::vector<uint8_t> v(p, p + q->itemSize);
+  if (front) q->items.push_front(v);
+  else q->items.push_back(v);
+  stateChanged.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait) {
+  return queueSend(q, item, wait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void *item, TickType_t wait) {
+  return queueSend(q, item, wait, true);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t q, const void *item) {
+  {
+    std::lock_guard<std::mutex> lk(stateLock);
+    q->items.clear();
+  }
+  return queueSend(q, item, 0, false);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t q, const void *item, BaseType_t *woken) {
+  if (woken) *woken = pdFALSE;
+  return queueSend(q, item, 0, false);
+}
+
+static BaseType_t queueReceive(QueueHandle_t q, void *item, TickType_t wait, bool peek) {
+  std::unique_lock<std::mutex> lk(stateLock);
+
+  if (!q) return pdFALSE;
+  if (!waitFor(lk, wait, [q] { return !q->items.empty(); })) return pdFALSE;
+
+  if (item) memcpy(item, q->items.front().data(), q->itemSize);
+  if (!peek) q->items.pop_front();
+  stateChanged.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait) {
+  return queueReceive(q, item, wait, false);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t q, void *item, TickType_t wait) {
+  return queueReceive(q, item, wait, true);
+}
+
+BaseType_t xQueueReceiveFromISR(QueueHandle_t q, void *item, BaseType_t *woken) {
+  if (woken) *woken = pdFALSE;
+  return queueReceive(q, item, 0, false);
+}
+
+BaseType_t xQueueReset(QueueHandle_t q) {
+  std::lock_guard<std::mutex> lk(stateLock);
+  q->items.clear();
+  stateChanged.notify_all();
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+  std::lock_guard<std::mutex> lk(stateLock);
+  return q->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q) {
+  std::lock_guard<std::mutex> lk(stateLock);
+  return q->length - q->items.size();
+}
+
+/*
+ *  Semaphores
+ */
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  SemaphoreHandle_t s = xQueueCreate(1, 0);
+  s->isMutex = true;
+  xQueueSend(s, nullptr, 0);
+  return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return xQueueCreate(1, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t wait) {
+  return xQueueReceive(s, nullptr, wait);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s) {
+  return xQueueSend(s, nullptr, 0);
+}
+
+/*
+ *  Event groups
+ */
+EventGroupHandle_t xEventGroupCreate() {
+  return new hostEvents;
+}
+
+void vEventGroupDelete(EventGroupHandle_t g) {
+  delete g;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t g, EventBits_t bits) {
+  std::lock_guard<std::mutex> lk(stateLock);
+  g->bits |= bits;
+  stateChanged.notify_all();
+  return g->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t g, EventBits_t bits) {
+  std::lock_guard<std::mutex> lk(stateLock);
+  EventBits_t was = g->bits;
+  g->bits &= ~bits;
+  return was;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t g) {
+  std::lock_guard<std::mutex> lk(stateLock);
+  return g->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t g, EventBits_t bits, BaseType_t clear,
+                                BaseType_t all, TickType_t wait) {
+  std::unique_lock<std::mutex> lk(stateLock);
+
+  waitFor(lk, wait, [g, bits, all] {
+    return all ? (g->bits & bits) == bits : (g->bits & bits) != 0;
+  });
+
+  EventBits_t got = g->bits;
+  bool met = all ? (got & bits) == bits : (got & bits) != 0;
+  if (met && clear) g->bits &= ~bits;
+  return got;
+}
+
+/*
+ *  Wake anything blocked on the shared condition (used when the
+ *  simulated clock advances).
+ */
+void hostKick() {
+  std::lock_guard<std::mutex> lk(stateLock);
+  stateChanged.notify_all();
+}
@@ -0,0 +1,148 @@
+/*
+ *  freertos/FreeRTOS.h - Host stand-in for the ESP-IDF FreeRTOS API
+ *
+ *  Abstract:
+ *      Just enough of the FreeRTOS task, queue, notification and
+ *      event group API to run the GameMan framework on a desktop.
+ *      Tasks are std::threads, queues are a lock-protected ring,
+ *      and one tick is one millisecond.  Suspend and delete of
+ *      *other* tasks is cooperative: the target notices at its
+ *      next blocking call (which is where GameMan tasks live).
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_HOST_FREERTOS_H_
+#define _GM_HOST_FREERTOS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t EventBits_t;
+typedef uint32_t StackType_t;
+
+typedef struct hostTask *TaskHandle_t;
+typedef struct hostQueue *QueueHandle_t;
+typedef struct hostQueue *SemaphoreHandle_t;
+typedef struct hostEvents *EventGroupHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef struct { uint8_t opaque[344]; } StaticTask_t;
+
+#define pdTRUE    1
+#define pdFALSE   0
+#define pdPASS    1
+#define pdFAIL    0
+#define errQUEUE_FULL 0
+
+#define portTICK_PERIOD_MS  1
+#define configTICK_RATE_HZ  1000
+#define portMAX_DELAY       ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define pdTICKS_TO_MS(t)    ((uint32_t)(((uint64_t)(t) * 1000) / configTICK_RATE_HZ))
+#define tskNO_AFFINITY      0x7fffffff
+#define tskIDLE_PRIORITY    0
+#define configMAX_PRIORITIES 25
+#define configGENERATE_RUN_TIME_STATS 0
+#define configUSE_TRACE_FACILITY 1
+#define configTASKLIST_INCLUDE_COREID 1
+
+#define PRO_CPU_NUM 0
+#define APP_CPU_NUM 1
+#define portNUM_PROCESSORS 2
+
+typedef enum { eNoAction, eSetBits, eIncrement, eSetValueWithOverwrite, eSetValueWithoutOverwrite } eNotifyAction;
+typedef enum { eRunning, eReady, eBlocked, eSuspended, eDeleted, eInvalid } eTaskState;
+
+typedef struct {
+  TaskHandle_t xHandle;
+  const char *pcTaskName;
+  UBaseType_t xTaskNumber;
+  eTaskState eCurrentState;
+  UBaseType_t uxCurrentPriority;
+  UBaseType_t uxBasePriority;
+  uint32_t ulRunTimeCounter;
+  StackType_t *pxStackBase;
+  uint32_t usStackHighWaterMark;
+  BaseType_t xCoreID;
+} TaskStatus_t;
+
+// Critical sections become one big process-wide lock
+typedef struct { int unused; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+void hostEnterCritical(portMUX_TYPE *mux);
+void hostExitCritical(portMUX_TYPE *mux);
+#define portENTER_CRITICAL(m)      hostEnterCritical(m)
+#define portEXIT_CRITICAL(m)       hostExitCritical(m)
+#define portENTER_CRITICAL_ISR(m)  hostEnterCritical(m)
+#define portEXIT_CRITICAL_ISR(m)   hostExitCritical(m)
+#define portYIELD_FROM_ISR(...)    do { } while (0)
+#define IRAM_ATTR
+
+// Tasks
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack,
+                                   void *param, UBaseType_t prio, TaskHandle_t *handle, BaseType_t core);
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack,
+                       void *param, UBaseType_t prio, TaskHandle_t *handle);
+void vTaskDelete(TaskHandle_t t);
+void vTaskSuspend(TaskHandle_t t);
+void vTaskResume(TaskHandle_t t);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *prev, TickType_t inc);
+TickType_t xTaskGetTickCount();
+TickType_t xTaskGetTickCountFromISR();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+TaskHandle_t xTaskGetCurrentTaskHandleForCPU(BaseType_t core);
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t core);
+const char *pcTaskGetName(TaskHandle_t t);
+UBaseType_t uxTaskGetNumberOfTasks();
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t t);
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t max, uint32_t *total);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t t);
+BaseType_t xPortGetCoreID();
+eTaskState eTaskGetState(TaskHandle_t t);
+
+// Direct-to-task notifications
+BaseType_t xTaskNotify(TaskHandle_t t, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyFromISR(TaskHandle_t t, uint32_t value, eNotifyAction action, BaseType_t *woken);
+BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t *value, TickType_t wait);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+#define xTaskNotifyGive(t) xTaskNotify((t), 0, eIncrement)
+void vTaskNotifyGiveFromISR(TaskHandle_t t, BaseType_t *woken);
+
+// Queues
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+void vQueueDelete(QueueHandle_t q);
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait);
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void *item, TickType_t wait);
+BaseType_t xQueueOverwrite(QueueHandle_t q, const void *item);
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait);
+BaseType_t xQueuePeek(QueueHandle_t q, void *item, TickType_t wait);
+BaseType_t xQueueReset(QueueHandle_t q);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q);
+BaseType_t xQueueSendFromISR(QueueHandle_t q, const void *item, BaseType_t *woken);
+BaseType_t xQueueReceiveFromISR(QueueHandle_t q, void *item, BaseType_t *woken);
+#define xQueueSendToBack xQueueSend
+
+// Mutexes are just queues of one
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateBinary();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s);
+#define vSemaphoreDelete(s) vQueueDelete(s)
+
+// Event groups
+EventGroupHandle_t xEventGroupCreate();
+void vEventGroupDelete(EventGroupHandle_t g);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t g, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t g, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t g);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t g, EventBits_t bits, BaseType_t clear,
+                                BaseType_t all, TickType_t wait);
+
+#endif
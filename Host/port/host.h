@@ -0,0 +1,40 @@
+/*
+ *  host.h - Knobs for the host (desktop) build
+ *
+ *  Abstract:
+ *      Hooks that only exist off the ESP32: the clock source,
+ *      the scripted button source, and the loopback "radio"
+ *      used in place of the ESP-NOW hardware.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_HOST_H_
+#define _GM_HOST_H_
+
+#include <stdint.h>
+
+// Clock: real time by default, or a simulated clock that only
+// moves when hostAdvanceClock() is called
+uint64_t hostMicros();
+bool hostVirtualClock();
+void hostUseVirtualClock(bool on);
+void hostAdvanceClock(uint64_t us);
+void hostKick();
+
+// Buttons: pin levels as seen by digitalRead() (1 == released)
+void hostSetPin(uint8_t pin, int level);
+int hostGetPin(uint8_t pin);
+
+// Analog inputs, in millivolts at the pin
+void hostSetAnalog(uint8_t pin, uint32_t mv);
+
+// Radio: this process's MAC (from GM_HOST_NODE)
+const uint8_t *hostNodeMAC();
+
+// Serial: throw console output away (for simulations)
+void hostSerialQuiet(bool on);
+
+#endif
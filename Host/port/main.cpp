@@ -0,0 +1,72 @@
+/*
+ *  main.cpp - Host entry point: the Arduino loopTask
+ *
+ *  Abstract:
+ *      Runs setup() and then loop() forever, just like the ESP32
+ *      core does.  Two environment variables make it scriptable:
+ *
+ *        GM_HOST_RUN_MS    stop after this many milliseconds
+ *        GM_HOST_BUTTONS   "ms:pin:level,..." button script, e.g.
+ *                          "7000:33:0,7100:33:1" taps B at 7 s
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <Arduino.h>
+
+extern void setup();
+extern void loop();
+
+struct scriptStep {
+  unsigned long ms;
+  int pin;
+  int level;
+};
+
+static void playButtons(std::vector<scriptStep> steps) {
+  for (auto &s : steps) {
+    while (millis() < s.ms) usleep(1000);
+    hostSetPin(s.pin, s.level);
+  }
+}
+
+int main(int argc, char **argv) {
+  setbuf(stdout, NULL);
+
+  const char *script = getenv("GM_HOST_BUTTONS");
+  if (script) {
+    std::vector<scriptStep> steps;
+    scriptStep s;
+    int used;
+
+    while (sscanf(script, "%lu:%d:%d%n", &s.ms, &s.pin, &s.level, &used) == 3) {
+      steps.push_back(s);
+      script += used;
+      if (*script == ',') script++;
+    }
+    std::thread(playButtons, steps).detach();
+  }
+
+  setup();
+
+  // GM_HOST_RUN_MS bounds the run (handy for scripted/CI use)
+  const char *env = getenv("GM_HOST_RUN_MS");
+  unsigned long limit = env ? strtoul(env, NULL, 10) : 0;
+
+  for (;;) {
+    loop();
+    yield();
+    if (limit && millis() > limit) break;
+  }
+
+  // Tasks are still running, so skip static destructors
+  fflush(stdout);
+  _exit(0);
+}
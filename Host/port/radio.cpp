@@ -0,0 +1,188 @@
+/*
+ *  radio.cpp - ESP-NOW over UDP loopback
+ *
+ *  Abstract:
+ *      Each host GameMan process is one "node".  Its MAC is
+ *      02:47:4d:00:00:NN where NN comes from GM_HOST_NODE (default
+ *      1), and it listens on UDP port GM_HOST_PORT + NN on the
+ *      loopback interface.  A send goes to every node port in
+ *      the range (the receivers filter on destination just like
+ *      the real radio), so a handful of processes on one box see
+ *      each other's broadcasts and unicasts.  Promiscuous mode sees
+ *      the same frames dressed up as 802.11 action frames, all at a
+ *      healthy GM_HOST_RSSI.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <Arduino.h>
+#include <esp_now.h>
+#include <esp_wifi.h>
+
+#define GM_HOST_PORT    41100
+#define GM_HOST_NODES   16
+#define GM_HOST_RSSI    -40
+
+static uint8_t nodeMAC[6] = { 0x02, 0x47, 0x4d, 0x00, 0x00, 0x01 };
+static bool nodeSet = false;
+static int sock = -1;
+static esp_now_recv_cb_t recvCb = nullptr;
+static esp_now_send_cb_t sendCb = nullptr;
+static wifi_promiscuous_cb_t sniffCb = nullptr;
+static bool sniffing = false;
+static std::mutex peerLock;
+static std::set<std::string> peers;
+
+static const uint8_t bcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+static int nodeNumber() {
+  const char *env = getenv("GM_HOST_NODE");
+  int n = env ? atoi(env) : 1;
+  return (n < 1 || n > GM_HOST_NODES) ? 1 : n;
+}
+
+const uint8_t *hostNodeMAC() {
+  if (!nodeSet) {
+    nodeMAC[5] = nodeNumber();
+    nodeSet = true;
+  }
+  return nodeMAC;
+}
+
+/*
+ *  Show promiscuous mode the header of the action frame ESP-NOW would
+ *  have sent: action, addr2 = source, vendor specific category.
+ */
+static void sniff(const uint8_t *src) {
+  uint8_t buf[sizeof(wifi_pkt_rx_ctrl_t) + 28];
+  wifi_pkt_rx_ctrl_t *rx = (wifi_pkt_rx_ctrl_t *)buf;
+  uint8_t *hdr = buf + sizeof(wifi_pkt_rx_ctrl_t);
+
+  memset(buf, 0, sizeof(buf));
+  rx->rssi = GM_HOST_RSSI;
+  rx->sig_len = 28;
+  hdr[0] = 0xd0;
+  memcpy(hdr + 10, src, 6);
+  hdr[24] = 0x7f;
+  sniffCb(buf, WIFI_PKT_MGMT);
+}
+
+static void listener() {
+  uint8_t buf[6 + ESP_NOW_MAX_DATA_LEN];
+
+  for (;;) {
+    ssize_t n = recv(sock, buf, sizeof(buf), 0);
+    if (n < 6) continue;
+
+    // Frame is [source MAC][payload]; we hear our own broadcasts too
+    if (memcmp(buf, hostNodeMAC(), 6) == 0) continue;
+    if (sniffing && sniffCb) sniff(buf);
+    if (recvCb) recvCb(buf, buf + 6, n - 6);
+  }
+}
+
+esp_err_t esp_now_init() {
+  struct sockaddr_in addr;
+
+  sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sock < 0) return ESP_FAIL;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(GM_HOST_PORT + nodeNumber());
+
+  if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(sock);
+    sock = -1;
+    return ESP_FAIL;
+  }
+
+  std::thread(listener).detach();
+  return ESP_OK;
+}
+
+esp_err_t esp_now_deinit() {
+  return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb) {
+  recvCb = cb;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb) {
+  sendCb = cb;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len) {
+  uint8_t buf[6 + ESP_NOW_MAX_DATA_LEN];
+  struct sockaddr_in addr;
+
+  if (sock < 0) return ESP_ERR_ESPNOW_NOT_INIT;
+  if (len > ESP_NOW_MAX_DATA_LEN) return ESP_ERR_ESPNOW_ARG;
+  if (!esp_now_is_peer_exist(peer_addr)) return ESP_ERR_ESPNOW_NOT_FOUND;
+
+  memcpy(buf, hostNodeMAC(), 6);
+  memcpy(buf + 6, data, len);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  for (int n = 1; n <= GM_HOST_NODES; n++) {
+    // Unicasts only go to the addressed node
+    if (memcmp(peer_addr, bcast, 6) != 0 && peer_addr[5] != n) continue;
+
+    addr.sin_port = htons(GM_HOST_PORT + n);
+    sendto(sock, buf, len + 6, 0, (struct sockaddr *)&addr, sizeof(addr));
+  }
+
+  if (sendCb) sendCb(peer_addr, ESP_NOW_SEND_SUCCESS);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t cb) {
+  sniffCb = cb;
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t *filter) {
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous(bool en) {
+  sniffing = en;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer) {
+  std::lock_guard<std::mutex> lk(peerLock);
+
+  if (peers.size() >= ESP_NOW_MAX_TOTAL_PEER_NUM) return ESP_ERR_ESPNOW_FULL;
+  if (!peers.insert(std::string((const char *)peer->peer_addr, 6)).second) return ESP_ERR_ESPNOW_EXIST;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr) {
+  std::lock_guard<std::mutex> lk(peerLock);
+  return peers.erase(std::string((const char *)peer_addr, 6)) ? ESP_OK : ESP_ERR_ESPNOW_NOT_FOUND;
+}
+
+bool esp_now_is_peer_exist(const uint8_t *peer_addr) {
+  std::lock_guard<std::mutex> lk(peerLock);
+  return peers.count(std::string((const char *)peer_addr, 6)) > 0;
+}
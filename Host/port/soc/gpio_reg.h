@@ -0,0 +1,15 @@
+/*
+ *  soc/gpio_reg.h - Host stand-in for the ESP32 GPIO input registers
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_HOST_GPIO_REG_H_
+#define _GM_HOST_GPIO_REG_H_
+
+#define GPIO_IN_REG   0x3FF4403C    // GPIO 0-31
+#define GPIO_IN1_REG  0x3FF44040    // GPIO 32-39
+
+#endif
@@ -0,0 +1,18 @@
+/*
+ *  soc/soc.h - Host stand-in for the ESP32 register access macros
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#ifndef _GM_HOST_SOC_H_
+#define _GM_HOST_SOC_H_
+
+#include <stdint.h>
+
+// Registers are synthesized from the simulated pins
+uint32_t hostReadReg(uint32_t addr);
+#define REG_READ(addr) hostReadReg(addr)
+
+#endif
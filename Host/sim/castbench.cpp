@@ -0,0 +1,384 @@
+/*
+ *  castbench.cpp - Bytes per frame for screen casting
+ *
+ *  Abstract:
+ *      Replays a recorded session (the PGM frames the host build
+ *      writes to GM_HOST_FRAMES) through the real ScreenCast
+ *      (Code/screencast.cpp): one caster gets the frames at a fixed
+ *      rate and streams them to watchers over a shared channel that
+ *      loses packets at random.  Each run reports what went on the
+ *      air per frame, keyframes and deltas apart, against sending
+ *      the raw framebuffer, how long the encoding took, how late
+ *      frames reached the watchers' screens, and whether any screen
+ *      that should have matched the caster's didn't (it mustn't).
+ *
+ *        castbench [--fps N] [--loss LIST] [--watchers N] [--latency MS]
+ *                  [--rate MBPS] [--retries N] [--poll MS] [--skip N]
+ *                  [--seed N] DIR
+ *
+ *      Runs are deterministic for a given --seed, apart from the
+ *      encode times.  sim/castrec.sh records a session to try.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include <dirent.h>
+#include <getopt.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+
+#include "screencast.h"
+
+#define BENCH_HEADER    ((int)offsetof(gm_packet_t, payload))
+#define BENCH_MAC_BYTES 43        // 802.11 framing around an ESP-NOW payload
+#define BENCH_PREAMBLE  192       // us
+#define BENCH_MAX_WATCH CAST_MAX_WATCHERS
+#define BENCH_BURST       6       // as DISP_CAST_BURST (screen.h)
+#define BENCH_BURST_POLL 10       // ...and DISP_CAST_POLL_MS
+
+typedef struct benchConfig {
+  int fps = 20;
+  std::vector<double> loss = { 0, 0.05, 0.2 };
+  int watchers = 1;
+  int latency = 2;              // ms, each way, on top of the airtime
+  double rate = 1.0;            // Mbps
+  int retries = 3;              // unicast retries after the first try
+  int poll = 250;               // ms between the menu's pollCast()s
+  int skip = 0;                 // frames to leave out at the start
+  uint32_t seed = 1;
+} bench_config_t;
+
+struct InFlight {
+  int64_t due;                  // us it arrives
+  int to;                       // 0 is the caster, 1.. the watchers
+  gm_packet_t pkt;
+};
+
+static bench_config_t cfg;
+static std::mt19937 rng;
+static std::vector<std::vector<uint8_t>> frames;
+
+static bool chance(double p) {
+  return std::uniform_real_distribution<double>(0, 1)(rng) < p;
+}
+
+static void nodeMAC(int n, uint8_t *mac) {
+  uint8_t m[ADDR_LEN] = { 0x02, 0x47, 0x4d, 0x43, 0x42, (uint8_t)(n + 1) };
+
+  memcpy(mac, m, ADDR_LEN);
+}
+
+static int macNode(const uint8_t *mac) {
+  return mac[ADDR_LEN - 1] - 1;
+}
+
+// The port layer wants one; nothing here uses the radio
+const uint8_t *hostNodeMAC() {
+  static uint8_t mac[ADDR_LEN];
+
+  nodeMAC(0, mac);
+  return mac;
+}
+
+/*
+ *  One frame dump: "P5 128 128 15", then a byte per pixel.  Packed
+ *  two to a byte, high nibble first, as the driver keeps them.
+ */
+static bool loadPGM(const std::string &path, std::vector<uint8_t> &fb) {
+  FILE *f = fopen(path.c_str(), "rb");
+  int w, h, max;
+
+  if (!f) return false;
+  if (fscanf(f, "P5 %d %d %d", &w, &h, &max) != 3 || w != CAST_WIDTH || h != CAST_HEIGHT) {
+    fclose(f);
+    return false;
+  }
+  fgetc(f);
+
+  fb.assign(CAST_FRAME_BYTES, 0);
+  for (int i = 0; i < w * h; i++) {
+    int c = fgetc(f);
+
+    if (c == EOF) {
+      fclose(f);
+      return false;
+    }
+    fb[i / 2] |= (i & 1) ? (c & 0x0f) : (c & 0x0f) << 4;
+  }
+  fclose(f);
+  return true;
+}
+
+static bool loadDir(const char *dir) {
+  std::vector<std::string> names;
+  DIR *d = opendir(dir);
+  struct dirent *e;
+
+  if (!d) return false;
+  while ((e = readdir(d)) != nullptr) {
+    std::string n = e->d_name;
+
+    if (n.size() > 4 && n.compare(n.size() - 4, 4, ".pgm") == 0) names.push_back(n);
+  }
+  closedir(d);
+  std::sort(names.begin(), names.end());
+  names.erase(names.begin(), names.begin() + std::min(names.size(), (size_t)cfg.skip));
+
+  for (auto &n : names) {
+    std::vector<uint8_t> fb;
+
+    if (!loadPGM(std::string(dir) + "/" + n, fb)) {
+      fprintf(stderr, "castbench: %s/%s isn't a 128x128 frame dump\n", dir, n.c_str());
+      return false;
+    }
+    frames.push_back(fb);
+  }
+  return !frames.empty();
+}
+
+/*
+ *  One channel everybody shares: a packet waits for it to go quiet,
+ *  then takes its airtime.  A broadcast goes once and each watcher
+ *  hears it or doesn't; a unicast is retried until it gets through.
+ */
+static int64_t chanFree;
+static int64_t busy;
+
+static void transmit(std::vector<InFlight> &air, const gm_packet_t *pkt, int64_t now, double loss) {
+  int64_t t = std::max(now, chanFree);
+  int64_t airtime = BENCH_PREAMBLE + (int64_t)((BENCH_MAC_BYTES + BENCH_HEADER + pkt->length) * 8 / cfg.rate);
+  int from = macNode(pkt->srcAddr);
+
+  if (pkt->dstAddr[0] == 0xff) {
+    t += airtime;
+    busy += airtime;
+    for (int to = 0; to <= cfg.watchers; to++) {
+      if (to != from && !chance(loss)) air.push_back({ t + cfg.latency * 1000, to, *pkt });
+    }
+  } else {
+    for (int i = 0; i <= cfg.retries; i++) {
+      t += airtime;
+      busy += airtime;
+      if (!chance(loss)) {
+        air.push_back({ t + cfg.latency * 1000, macNode(pkt->dstAddr), *pkt });
+        break;
+      }
+    }
+  }
+  chanFree = t;
+}
+
+static uint16_t seqOf(const gm_packet_t *pkt) {
+  return pkt->payload[1] | (pkt->payload[2] << 8);
+}
+
+static bool runOnce(double loss) {
+  ScreenCast caster, watcher[BENCH_MAX_WATCH];
+  std::vector<std::vector<uint8_t>> screen(cfg.watchers + 1, std::vector<uint8_t>(CAST_FRAME_BYTES, 0));
+  std::vector<std::vector<uint8_t>> truth(1 << 16);
+  std::vector<int64_t> flushed(1 << 16, 0);
+  std::vector<InFlight> air;
+  uint8_t mac[ADDR_LEN];
+  int64_t frameUs = 1000000 / cfg.fps, end = frames.size() * frameUs + 1000000;
+  int64_t nextPoll = 0, lateSum = 0, lateMax = 0, late = 0;
+  long keyBytes = 0, deltaBytes = 0, pkts = 0, checked = 0, wrong = 0;
+  double encodeUs = 0;
+  uint16_t lastSeq = 0;
+  size_t next = 0, shown = 0;
+  int64_t shownAt = 0;
+  bool fresh = false;
+
+  rng.seed(cfg.seed);
+  chanFree = busy = 0;
+
+  nodeMAC(0, mac);
+  caster.begin(mac);
+  for (int w = 1; w <= cfg.watchers; w++) {
+    nodeMAC(w, mac);
+    watcher[w - 1].watch(mac, screen[w].data());
+  }
+
+  for (int64_t now = 0; now < end; now += 1000) {
+    gm_packet_t pkt;
+    uint32_t ms = now / 1000;
+    bool flush = next < frames.size() && now >= (int64_t)next * frameUs;
+
+    // The caster: a flush (timed, as it would slow the app down), or
+    // the menu's poll, each sending a burst of what it has, as GMDisplay
+    // does; the menu polls sooner while a frame is still going out
+    auto t0 = std::chrono::steady_clock::now();
+    bool service = flush || now >= nextPoll;
+    if (flush) {
+      caster.update(frames[next].data(), ms);
+      shown = next++;
+      shownAt = now;
+      fresh = true;
+    }
+    if (now >= nextPoll) caster.poll(ms);
+
+    // A new sequence number carries the latest flush, however late (or
+    // if it's a keyframe of nothing new, just now)
+    if (caster.sequence() != lastSeq) {
+      lastSeq = caster.sequence();
+      truth[lastSeq] = frames[shown];
+      flushed[lastSeq] = fresh ? shownAt : now;
+      fresh = false;
+    }
+
+    for (int n = 0; service && n < BENCH_BURST && caster.next(&pkt); n++) {
+      if ((pkt.payload[0] & 0x0f) == castKey) keyBytes += BENCH_HEADER + pkt.length;
+      else deltaBytes += BENCH_HEADER + pkt.length;
+      pkts++;
+      transmit(air, &pkt, now, loss);
+    }
+    if (now >= nextPoll || (service && caster.sending())) {
+      nextPoll = now + (caster.sending() ? BENCH_BURST_POLL : cfg.poll) * 1000;
+    }
+    encodeUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+
+    // The watchers: check in, and take whatever has arrived
+    for (int w = 1; w <= cfg.watchers; w++) {
+      watcher[w - 1].poll(ms);
+      while (watcher[w - 1].next(&pkt)) transmit(air, &pkt, now, loss);
+    }
+
+    std::stable_sort(air.begin(), air.end(), [](const InFlight &a, const InFlight &b) { return a.due < b.due; });
+    while (!air.empty() && air.front().due <= now) {
+      InFlight f = air.front();
+      air.erase(air.begin());
+
+      if (f.to == 0) {
+        caster.receive(&f.pkt, ms);
+        continue;
+      }
+
+      ScreenCast &w = watcher[f.to - 1];
+      uint16_t s = seqOf(&f.pkt);
+
+      if (!w.receive(&f.pkt, ms) || !(f.pkt.payload[3] & CAST_LAST_PART)) continue;
+
+      lateSum += now - flushed[s];
+      lateMax = std::max(lateMax, now - flushed[s]);
+      late++;
+
+      if (w.intact()) {
+        checked++;
+        if (truth[s] != screen[f.to]) wrong++;
+      }
+    }
+  }
+
+  cast_stats_t cs, ws;
+  caster.getStats(&cs);
+  watcher[0].getStats(&ws);
+  caster.end();
+
+  int n = frames.size();
+  long keyFrames = cs.keys, deltaFrames = cs.frames - cs.keys;
+  long total = keyBytes + deltaBytes;
+  double raw = (double)n * (CAST_FRAME_BYTES + ((CAST_FRAME_BYTES + MAX_PKT_LEN - 1) / MAX_PKT_LEN) * BENCH_HEADER);
+
+  printf("%5.0f%%  %7.1f  %5.2f  %5.1f%%  %4ld %6.0f  %5ld %6.0f  %6.1f  %5.1f  %6.1f %5ld  %4.0f%%  %4u %4u  %6ld %s\n",
+         loss * 100, (double)total / n, (double)pkts / n, 100.0 * total / raw,
+         keyFrames, keyFrames ? (double)keyBytes / keyFrames : 0.0,
+         deltaFrames, deltaFrames ? (double)deltaBytes / deltaFrames : 0.0,
+         total * 8.0 / 1000 / ((double)n / cfg.fps), encodeUs / n,
+         late ? (double)lateSum / late / 1000 : 0.0, lateMax / 1000,
+         100.0 * busy / end, ws.damaged, ws.missed, checked, wrong ? "CORRUPT" : "ok");
+  if (wrong) printf("       %ld screens differed from the caster's\n", wrong);
+  if (cs.samples) {
+    printf("       (the caster's own estimate from WATCHes: %u ms avg, %u max)\n",
+           cs.latency / cs.samples, cs.latencyMax);
+  }
+  return !wrong;
+}
+
+static void usage() {
+  fprintf(stderr,
+    "usage: castbench [options] DIR\n"
+    "  DIR             frame dumps (frame00001.pgm ...) from GM_HOST_FRAMES\n"
+    "  --fps N         rate the frames were flushed at (20)\n"
+    "  --loss LIST     packet loss rates to run, e.g. 0,0.05,0.2 (default)\n"
+    "  --watchers N    units watching, 1 to %d (1)\n"
+    "  --latency MS    delay on top of the airtime (2)\n"
+    "  --rate MBPS     channel bit rate (1)\n"
+    "  --retries N     unicast retries (3)\n"
+    "  --poll MS       time between the caster's polls (250)\n"
+    "  --skip N        leave out the first N frames, e.g. the boot screens (0)\n"
+    "  --seed N        random seed (1)\n", BENCH_MAX_WATCH);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  static const struct option opts[] = {
+    { "fps",      required_argument, nullptr, 'f' },
+    { "loss",     required_argument, nullptr, 'l' },
+    { "watchers", required_argument, nullptr, 'w' },
+    { "latency",  required_argument, nullptr, 'a' },
+    { "rate",     required_argument, nullptr, 'r' },
+    { "retries",  required_argument, nullptr, 't' },
+    { "poll",     required_argument, nullptr, 'p' },
+    { "skip",     required_argument, nullptr, 'k' },
+    { "seed",     required_argument, nullptr, 's' },
+    { "help",     no_argument,       nullptr, 'h' },
+    { nullptr, 0, nullptr, 0 }
+  };
+  int c;
+
+  while ((c = getopt_long(argc, argv, "", opts, nullptr)) != -1) {
+    switch (c) {
+      case 'f': cfg.fps = atoi(optarg); break;
+      case 'w': cfg.watchers = atoi(optarg); break;
+      case 'a': cfg.latency = std::max(0, atoi(optarg)); break;
+      case 'r': cfg.rate = atof(optarg); break;
+      case 't': cfg.retries = std::max(0, atoi(optarg)); break;
+      case 'p': cfg.poll = std::max(1, atoi(optarg)); break;
+      case 'k': cfg.skip = std::max(0, atoi(optarg)); break;
+      case 's': cfg.seed = strtoul(optarg, nullptr, 0); break;
+      case 'l': {
+        std::string list = optarg;
+        cfg.loss.clear();
+        for (size_t pos = 0; pos != std::string::npos; ) {
+          size_t comma = list.find(',', pos);
+          cfg.loss.push_back(atof(list.substr(pos, comma - pos).c_str()));
+          pos = comma == std::string::npos ? comma : comma + 1;
+        }
+        break;
+      }
+      default: usage();
+    }
+  }
+  if (optind != argc - 1 || cfg.fps <= 0 || cfg.rate <= 0 || cfg.watchers < 1 || cfg.watchers > BENCH_MAX_WATCH) usage();
+
+  if (!loadDir(argv[optind])) {
+    fprintf(stderr, "castbench: no frames in %s\n", argv[optind]);
+    return 2;
+  }
+
+  printf("castbench: %zu frames at %d fps, %d watcher%s, %.0f Mbps + %d ms, %d retries, poll %d ms, seed %u\n\n",
+         frames.size(), cfg.fps, cfg.watchers, cfg.watchers == 1 ? "" : "s", cfg.rate, cfg.latency, cfg.retries,
+         cfg.poll, cfg.seed);
+  printf(" loss  B/frame  pkts   %%raw  keys  B/key  delta  B/dlt    kbps  enc us  lat ms   max   air  dmg miss  checks\n");
+
+  bool ok = true;
+  for (double loss : cfg.loss) ok = runOnce(loss) && ok;
+
+  printf("\nB/frame is everything the caster sent (packet headers included) over\n"
+         "the number of frames replayed, whether or not they changed anything;\n"
+         "%%raw compares with sending the whole %d byte framebuffer each time.\n"
+         "Each unicast watcher gets its own copy.  enc us is the host's time to\n"
+         "encode a frame.  lat is from the caster's flush to a watcher's, air\n"
+         "how busy the channel was, dmg the frames a watcher showed with parts\n"
+         "missing and miss the ones it never heard.  checks counts the screens\n"
+         "compared with the caster's, whenever the watcher thought it had it all.\n",
+         CAST_FRAME_BYTES);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,40 @@
+#!/bin/sh
+#
+#  Record a session for castbench
+#
+#  Node 1 picks TicTacToe from the menu and invites, node 2 accepts,
+#  and node 1 moves its cursor about and claims a few squares before
+#  quitting back to the menu.  Every frame node 1 flushes is dumped to
+#  the given directory (see GM_HOST_FRAMES in README.md).
+#
+#    Host/sim/castrec.sh DIR [build dir]
+#    build/castbench DIR
+#
+
+DIR=$1
+BUILD=${2:-build}
+GM=$BUILD/gameman
+
+if [ -z "$DIR" ]; then
+  echo "usage: castrec.sh DIR [build dir]" >&2
+  exit 2
+fi
+if [ ! -x "$GM" ]; then
+  echo "castrec: no $GM (build first)" >&2
+  exit 2
+fi
+mkdir -p "$DIR" || exit 2
+
+# Menu is up about 5s after start: down, down, B; node 2 says yes at 8s
+PICK="5500:27:0,5580:27:1,5800:27:0,5880:27:1,6100:33:0,6180:33:1"
+
+# Then, once the board is up: right, A, down, A, left, A, down, A, C
+PLAY="10000:26:0,10080:26:1,10600:32:0,10680:32:1,11200:27:0,11280:27:1,11800:32:0,11880:32:1"
+PLAY="$PLAY,12400:14:0,12480:14:1,13000:32:0,13080:32:1,13600:27:0,13680:27:1,14200:32:0,14280:32:1"
+PLAY="$PLAY,16000:4:0,16080:4:1"
+
+GM_HOST_NODE=2 GM_HOST_RUN_MS=18000 GM_HOST_BUTTONS="8000:33:0,8080:33:1" $GM > /dev/null 2>&1 &
+GM_HOST_NODE=1 GM_HOST_RUN_MS=18000 GM_HOST_BUTTONS="$PICK,$PLAY" GM_HOST_FRAMES="$DIR" $GM > /dev/null 2>&1
+wait
+
+echo "castrec: $(ls "$DIR" | grep -c '\.pgm$') frames in $DIR"
@@ -0,0 +1,408 @@
+/*
+ *  locksim.cpp - Lockstep/rollback peers over a lossy link
+ *
+ *  Abstract:
+ *      Runs two (or up to four) peers of a small deterministic space
+ *      game through the real Rollback (Code/rollback.cpp) on a virtual
+ *      clock.  Each peer ticks every LOCK_FRAME_MS, easing off when
+ *      it's ahead the way LockstepGame::play() does, and starts up to
+ *      --skew ms after the first.  Every packet between them is lost
+ *      with probability --loss, or arrives --latency ms later plus up
+ *      to --jitter.  The players' buttons come from a script (random
+ *      presses held for a few frames).
+ *
+ *      Alongside, the same game runs once more with nothing but the
+ *      script, to give the right answer.  Every state checksum a peer
+ *      settles on must match it, and the peers' own cross-checks must
+ *      find no desyncs.  --break makes one peer's simulation go wrong
+ *      at one frame, to show that it's caught.
+ *
+ *        locksim [--frames N] [--players N] [--loss LIST]
+ *                [--latency MS] [--jitter MS] [--skew MS]
+ *                [--break F] [--seed N]
+ *
+ *      Runs are deterministic for a given --seed.  Exits non-zero if
+ *      any run desyncs.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+
+#include "lockstep.h"
+#include "button.h"
+
+#define SIM_SHOTS    12
+#define SIM_ARENA    128
+
+// The game: ships that thrust and shoot, in a wrap-around arena
+typedef struct simWorld {
+  uint32_t frame;
+  uint32_t seed;              // the game's own dice, part of the state
+  struct {
+    int16_t x, y;
+    int8_t vx, vy;
+    uint8_t hp;
+    uint8_t cooldown;
+    uint16_t score;
+  } ship[LOCK_MAX_PLAYERS];
+  struct {
+    int16_t x, y;
+    int8_t vx, vy;
+    uint8_t owner;
+    uint8_t ttl;
+  } shot[SIM_SHOTS];
+} sim_world_t;
+
+typedef struct simConfig {
+  int frames = 3000;
+  int players = 2;
+  std::vector<double> loss = { 0, 0.05, 0.2 };
+  int latencyMs = 10;
+  int jitterMs = 20;
+  int skewMs = 100;
+  int breakAt = -1;           // frame to break one peer at
+  uint32_t seed = 1;
+} sim_config_t;
+
+struct Delivery {
+  int64_t at;
+  uint64_t order;
+  int to;
+  gm_packet_t pkt;
+
+  bool operator>(const Delivery &o) const {
+    return at != o.at ? at > o.at : order > o.order;
+  }
+};
+
+static sim_config_t cfg;
+static std::mt19937 rng;
+
+static int wrap(int v) {
+  return (v + SIM_ARENA) % SIM_ARENA;
+}
+
+/*
+ *  One frame.  Only the state and the inputs go in, so every peer
+ *  (and the reference) gets the same answer.
+ */
+static void simulate(sim_world_t *w, const uint8_t *inputs, int players) {
+
+  w->frame++;
+
+  for (int p = 0; p < players; p++) {
+    auto &s = w->ship[p];
+    uint8_t in = inputs[p];
+
+    if (in & BTN_LT) s.vx = constrain(s.vx - 1, -4, 4);
+    if (in & BTN_RT) s.vx = constrain(s.vx + 1, -4, 4);
+    if (in & BTN_UP) s.vy = constrain(s.vy - 1, -4, 4);
+    if (in & BTN_DN) s.vy = constrain(s.vy + 1, -4, 4);
+    if (in & BTN_B) s.vx = s.vy = 0;
+
+    s.x = wrap(s.x + s.vx);
+    s.y = wrap(s.y + s.vy);
+
+    if (s.cooldown) s.cooldown--;
+    if ((in & BTN_A) && !s.cooldown && (s.vx || s.vy)) {
+      for (int i = 0; i < SIM_SHOTS; i++) {
+        if (w->shot[i].ttl) continue;
+        w->shot[i] = { s.x, s.y, (int8_t)(s.vx * 2), (int8_t)(s.vy * 2), (uint8_t)p, 30 };
+        s.cooldown = 8;
+        break;
+      }
+    }
+  }
+
+  for (int i = 0; i < SIM_SHOTS; i++) {
+    auto &sh = w->shot[i];
+
+    if (!sh.ttl) continue;
+    sh.x = wrap(sh.x + sh.vx);
+    sh.y = wrap(sh.y + sh.vy);
+    sh.ttl--;
+
+    for (int p = 0; p < players; p++) {
+      auto &s = w->ship[p];
+
+      if (p == sh.owner || abs(s.x - sh.x) > 3 || abs(s.y - sh.y) > 3) continue;
+      w->ship[sh.owner].score++;
+      sh.ttl = 0;
+
+      // Out of hit points: back in somewhere random (by the game's dice)
+      if (--s.hp == 0) {
+        w->seed = w->seed * 1103515245 + 12345;
+        s.x = (w->seed >> 8) % SIM_ARENA;
+        s.y = (w->seed >> 16) % SIM_ARENA;
+        s.vx = s.vy = 0;
+        s.hp = 5;
+      }
+      break;
+    }
+    if (!sh.ttl) sh = {};
+  }
+}
+
+static void newWorld(sim_world_t *w, int players) {
+
+  memset(w, 0, sizeof(sim_world_t));
+  w->seed = 411;
+  for (int p = 0; p < players; p++) {
+    w->ship[p].x = 20 + p * 30;
+    w->ship[p].y = 64;
+    w->ship[p].hp = 5;
+  }
+}
+
+/*
+ *  Everyone's buttons, by frame: a few held at a time, for a few
+ *  frames at a time, much as people play.
+ */
+static std::vector<std::vector<uint8_t>> makeScript(int frames, int players) {
+  static const uint8_t pick[] = { BTN_LT, BTN_RT, BTN_UP, BTN_DN, BTN_A, BTN_A, BTN_B };
+  std::vector<std::vector<uint8_t>> script(players, std::vector<uint8_t>(frames + LOCK_INPUT_DELAY + 1));
+
+  for (int p = 0; p < players; p++) {
+    uint8_t held = 0;
+    int left = 0;
+
+    for (int f = LOCK_INPUT_DELAY; f < (int)script[p].size(); f++) {
+      if (left-- <= 0) {
+        held = 0;
+        for (int b = std::uniform_int_distribution<int>(0, 2)(rng); b > 0; b--) {
+          held |= pick[std::uniform_int_distribution<int>(0, sizeof(pick) - 1)(rng)];
+        }
+        left = std::uniform_int_distribution<int>(2, 15)(rng);
+      }
+      script[p][f] = held;
+    }
+  }
+  return script;
+}
+
+// Nothing pressed once the script runs out
+static uint8_t scriptAt(const std::vector<std::vector<uint8_t>> &script, int p, int32_t f) {
+  return f < (int32_t)script[p].size() ? script[p][f] : 0;
+}
+
+static void nodeMAC(int n, uint8_t *mac) {
+  uint8_t m[ADDR_LEN] = { 0x02, 0x47, 0x4d, 0x4c, 0x4b, (uint8_t)(n + 1) };
+
+  memcpy(mac, m, ADDR_LEN);
+}
+
+// The port layer wants one; nothing here uses the radio
+const uint8_t *hostNodeMAC() {
+  static uint8_t mac[ADDR_LEN];
+
+  nodeMAC(0, mac);
+  return mac;
+}
+
+static bool runOnce(double loss) {
+  int players = cfg.players;
+  std::vector<sim_world_t> world(players);
+  std::vector<Rollback> peer(players);
+  std::vector<int64_t> tickAt(players);
+  std::vector<int32_t> checked(players, 0);
+  std::vector<uint32_t> truth;
+  std::priority_queue<Delivery, std::vector<Delivery>, std::greater<Delivery>> air;
+  uint64_t order = 0;
+  long wrong = 0, sent = 0, lost = 0;
+  int32_t firstWrong = -1;
+  int64_t clock = 0;
+
+  rng.seed(cfg.seed);
+  auto script = makeScript(cfg.frames, players);
+
+  // The right answer: checksum of the state before each frame
+  sim_world_t ref;
+  uint8_t in[LOCK_MAX_PLAYERS];
+  newWorld(&ref, players);
+  for (int f = 0; f <= cfg.frames + LOCK_RING; f++) {
+    truth.push_back(Rollback::stateCrc(&ref, sizeof(ref)));
+    for (int p = 0; p < players; p++) in[p] = scriptAt(script, p, f);
+    simulate(&ref, in, players);
+  }
+
+  for (int p = 0; p < players; p++) {
+    uint8_t mac[ADDR_LEN];
+
+    nodeMAC(p, mac);
+    newWorld(&world[p], players);
+    peer[p].begin(GM_MAZEWAR, &world[p], sizeof(sim_world_t), players, p, mac);
+    tickAt[p] = p ? std::uniform_int_distribution<int>(0, cfg.skewMs)(rng) : 0;
+  }
+
+  // Run whichever peer's tick comes next until everyone's done (the
+  // first to finish keeps going, so the others still hear from it)
+  for (;;) {
+    int p = 0, done = 0;
+
+    for (int q = 0; q < players; q++) {
+      if (peer[q].frame() >= cfg.frames) done++;
+      if (tickAt[q] < tickAt[p]) p = q;
+    }
+    if (done == players) break;
+
+    clock = tickAt[p];
+    if (clock > (int64_t)cfg.frames * LOCK_FRAME_MS * 10) {
+      printf("%5.0f%%  STUCK at %.1fs: frames", loss * 100, clock / 1000.0);
+      for (int q = 0; q < players; q++) printf(" %d", peer[q].frame());
+      printf("\n");
+      return false;
+    }
+
+    // What's arrived by now, for anyone
+    while (!air.empty() && air.top().at <= clock) {
+      Delivery d = air.top();
+      air.pop();
+      peer[d.to].receive(&d.pkt);
+    }
+
+    int32_t f = peer[p].frame();
+    uint8_t inputs[LOCK_MAX_PLAYERS];
+    gm_packet_t pkt;
+
+    peer[p].setLocal(scriptAt(script, p, f + LOCK_INPUT_DELAY));
+    while (peer[p].step(inputs)) {
+      simulate(&world[p], inputs, players);
+      if (p == 1 && (int32_t)world[p].frame == cfg.breakAt) world[p].ship[0].score += 100;
+    }
+
+    while (peer[p].next(&pkt)) {
+      sent++;
+      for (int q = 0; q < players; q++) {
+        if (q == p) continue;
+        if (std::uniform_real_distribution<double>(0, 1)(rng) < loss) {
+          lost++;
+          continue;
+        }
+        int64_t at = clock + cfg.latencyMs + std::uniform_int_distribution<int>(0, cfg.jitterMs)(rng);
+        air.push({ at, order++, q, pkt });
+      }
+    }
+
+    // Everything this peer has settled on must be the right answer
+    uint32_t crc;
+    while (checked[p] < (int32_t)truth.size() && peer[p].checksum(checked[p], &crc)) {
+      if (crc != truth[checked[p]]) {
+        if (firstWrong < 0) firstWrong = checked[p];
+        wrong++;
+      }
+      checked[p]++;
+    }
+
+    tickAt[p] += peer[p].ahead() > 0 ? LOCK_FRAME_MS * 5 / 4 : LOCK_FRAME_MS;
+  }
+
+  lock_stats_t st, total = {};
+  int32_t settled = cfg.frames;
+  int desyncs = 0;
+
+  for (int p = 0; p < players; p++) {
+    peer[p].getStats(&st);
+    total.frames += st.frames;
+    total.stalls += st.stalls;
+    total.rollbacks += st.rollbacks;
+    total.resimulated += st.resimulated;
+    total.deepest = std::max(total.deepest, st.deepest);
+    total.bytes += st.bytes;
+    total.checked += st.checked;
+    desyncs += st.desyncs;
+    settled = std::min(settled, checked[p]);
+  }
+
+  double seconds = clock / 1000.0;
+  bool ok = !wrong && !desyncs;
+  printf("%5.0f%%  %6.1f  %7.1f  %6.2f  %5u  %6.1f  %6.1f  %5.1f  %6d  %6u  %7d  %s\n",
+         loss * 100, seconds, total.rollbacks / seconds / players,
+         total.rollbacks ? (double)total.resimulated / total.rollbacks : 0.0, total.deepest,
+         100.0 * total.stalls / (total.frames + total.stalls), (double)total.bytes / total.frames,
+         total.bytes * 8 / seconds / players / 1000, settled, total.checked, desyncs,
+         ok ? "ok" : "DESYNC");
+  if (wrong) printf("       %ld settled states differed from the reference, the first at frame %d\n", wrong, firstWrong);
+  if (desyncs) printf("       the peers' own checksums disagreed %d times\n", desyncs);
+  return ok;
+}
+
+static void usage() {
+  fprintf(stderr,
+    "usage: locksim [options]\n"
+    "  --frames N      frames each peer runs (3000)\n"
+    "  --players N     2 to %d (2)\n"
+    "  --loss LIST     packet loss rates to run, e.g. 0,0.05,0.2 (default)\n"
+    "  --latency MS    one-way delay (10)\n"
+    "  --jitter MS     plus up to this much (20)\n"
+    "  --skew MS       later peers start up to this much later (100)\n"
+    "  --break F       make peer 2 go wrong at frame F\n"
+    "  --seed N        random seed (1)\n", LOCK_MAX_PLAYERS);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  static const struct option opts[] = {
+    { "frames",  required_argument, nullptr, 'f' },
+    { "players", required_argument, nullptr, 'p' },
+    { "loss",    required_argument, nullptr, 'l' },
+    { "latency", required_argument, nullptr, 'a' },
+    { "jitter",  required_argument, nullptr, 'j' },
+    { "skew",    required_argument, nullptr, 'k' },
+    { "break",   required_argument, nullptr, 'b' },
+    { "seed",    required_argument, nullptr, 's' },
+    { "help",    no_argument,       nullptr, 'h' },
+    { nullptr, 0, nullptr, 0 }
+  };
+  bool ok = true;
+  int c;
+
+  while ((c = getopt_long(argc, argv, "", opts, nullptr)) != -1) {
+    switch (c) {
+      case 'f': cfg.frames = atoi(optarg); break;
+      case 'p': cfg.players = atoi(optarg); break;
+      case 'a': cfg.latencyMs = atoi(optarg); break;
+      case 'j': cfg.jitterMs = atoi(optarg); break;
+      case 'k': cfg.skewMs = atoi(optarg); break;
+      case 'b': cfg.breakAt = atoi(optarg); break;
+      case 's': cfg.seed = strtoul(optarg, nullptr, 0); break;
+      case 'l': {
+        std::string list = optarg;
+        cfg.loss.clear();
+        for (size_t pos = 0; pos != std::string::npos; ) {
+          size_t comma = list.find(',', pos);
+          cfg.loss.push_back(atof(list.substr(pos, comma - pos).c_str()));
+          pos = comma == std::string::npos ? comma : comma + 1;
+        }
+        break;
+      }
+      default: usage();
+    }
+  }
+  if (cfg.frames <= 0 || cfg.players < 2 || cfg.players > LOCK_MAX_PLAYERS) usage();
+
+  printf("locksim: %d players, %zu byte state, %d frames at %dms, delay %d, rollback up to %d, "
+         "latency %d+%dms, seed %u\n\n",
+         cfg.players, sizeof(sim_world_t), cfg.frames, LOCK_FRAME_MS, LOCK_INPUT_DELAY, LOCK_MAX_ROLLBACK,
+         cfg.latencyMs, cfg.jitterMs, cfg.seed);
+  printf(" loss    secs  rb/sec  frames  deep  stall%%  B/frm  kbps  settled  checks  desyncs\n");
+
+  for (double loss : cfg.loss) ok = runOnce(loss) && ok;
+
+  printf("\nrb/sec is rollbacks a second per peer, frames how many each re-ran on\n"
+         "average and deep the most; stall%% is ticks spent waiting for inputs.\n"
+         "B/frm and kbps are what each peer sent.  settled is the last frame every\n"
+         "peer's state was checked against the reference at, and checks how many\n"
+         "times the peers compared checksums with each other.\n");
+  return ok ? 0 : 1;
+}
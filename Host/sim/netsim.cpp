@@ -0,0 +1,1055 @@
+/*
+ *  netsim.cpp - Discrete-event simulator for the GameMan network stack
+ *
+ *  Abstract:
+ *      Runs N copies of the real NetworkTask (Code/network.cpp) in
+ *      one thread on the host's virtual clock, against a simulated
+ *      shared channel instead of the ESP-NOW radio.  Every node is
+ *      driven through begin()/poll()/receive(), so HELLO timers,
+ *      the incoming queue (MAX_PENDING), dispatch and the player
+ *      table all behave as they do on the device.  Only the air and
+ *      the CPU are modeled:
+ *
+ *        - by default one collision domain; with --topology, nodes
+ *          on a line, a grid or at random, each hearing only those
+ *          within --range, and losing more the farther off they are
+ *        - airtime from the PHY rate and frame size; a frame is lost
+ *          at a receiver that hears another one overlapping it (or
+ *          is sending itself)
+ *        - carrier sense (of the frames a node can hear) with a
+ *          one-slot blind spot and random backoff (or pure ALOHA
+ *          with --aloha)
+ *        - independent per-receiver loss, fixed latency plus jitter
+ *        - MAC-level retries for unicasts, none for broadcasts
+ *        - a fixed CPU cost per packet the NET task handles, so a
+ *          burst can overflow the incoming queue
+ *        - optionally, some nodes leave halfway through (half of them
+ *          say GOODBYE, the rest just go quiet)
+ *        - optionally, the first few nodes play a game: they form a
+ *          session and send packets at a fixed rate, so the cost to
+ *          the bystanders can be measured (or compared with plain
+ *          broadcasts), and the host can walk away mid-game
+ *        - with --relay, each run is done twice, relay mode off and
+ *          on, to show what relaying gains (and costs) per hop
+ *        - RSSI falling off with distance, fed to the network task's
+ *          link metrics along with the unicast ACKs, which the game
+ *          host's view of the other players then shows
+ *
+ *      Runs are deterministic for a given --seed.  For each node
+ *      count it reports delivery rate, queue overflow, airtime use,
+ *      dispatch latency, how long nodes take to discover each other
+ *      (bounded by MAX_PLAYERS), and how long the rest take to forget
+ *      the ones that left.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include <getopt.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <queue>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+#include <esp_now.h>
+
+#include "GameMan.h"
+#include "network.h"
+
+// 802.11b DSSS timing, which is what ESP-NOW uses by default
+#define SIM_PREAMBLE_US   192     // long preamble + PLCP header
+#define SIM_MAC_BYTES     43      // MAC header, FCS, vendor action header
+#define SIM_SLOT_US       20
+#define SIM_DIFS_US       50
+#define SIM_CW            31      // backoff window, in slots
+#define SIM_HOPS          (RELAY_TTL + 1)
+
+enum simTopology { topoFull, topoLine, topoGrid, topoRandom };
+
+typedef struct simConfig {
+  std::vector<int> nodes;       // node counts to sweep
+  uint32_t seconds = 60;        // simulated time per run
+  double loss = 0.02;           // per-receiver frame loss
+  uint32_t latencyUs = 200;     // end of frame to receive callback
+  uint32_t jitterUs = 300;      // plus up to this much
+  uint32_t rateKbps = 1000;     // PHY rate
+  uint32_t procUs = 400;        // NET task time per packet handled
+  uint32_t spreadMs = 2000;     // power-on times spread over this
+  bool csma = true;
+  int retries = 3;              // unicast retransmissions
+  double leave = 0;             // fraction of nodes that leave halfway
+  uint32_t gameHz = 0;          // game packets per second per player
+  int players = 2;              // how many play
+  bool gameBcast = false;       // old style: no session, broadcast it all
+  bool hostLeaves = false;      // game host leaves halfway
+  simTopology topology = topoFull;
+  double range = 1.5;           // radio range, in node spacings
+  bool relay = false;           // compare relay mode off and on
+  uint32_t seed = 1;
+  bool verbose = false;
+} sim_config_t;
+
+struct Frame {
+  int src;
+  uint8_t dst[ADDR_LEN];
+  std::vector<uint8_t> data;
+  int64_t start = 0;
+  int64_t end = 0;
+  bool collided = false;
+  std::vector<int> overlaps;  // senders of frames that overlapped this one
+  int tries = 0;
+  int refs = 0;               // deliveries still to happen
+};
+
+struct SimNode {
+  NetworkTask *net = nullptr;
+  uint8_t mac[ADDR_LEN];
+  int64_t bootAt = 0;
+  bool up = false;
+  bool gone = false;              // left; sends out what's queued, nothing more
+
+  // Radio
+  std::deque<Frame *> txq;
+  bool txPending = false;
+  std::set<std::string> peers;
+  int sent = 0;
+  int peerFull = 0;
+
+  // CPU: the NET task is either idle or handling a packet
+  int64_t busyUntil = 0;
+  int64_t serviceAt = -1;
+  uint64_t serviceGen = 0;
+  std::deque<int64_t> arrivals;   // air times of what's in incoming
+
+  // Results
+  int expected = 0;
+  int heard = 0;
+  int collided = 0;
+  int lost = 0;
+  int64_t latSum = 0;
+  int64_t latMax = 0;
+  int latN = 0;
+  int64_t discovered = -1;        // ms after boot
+  int64_t forgot = -1;            // ms after the others left
+
+  // Game traffic
+  bool player = false;
+  QueueHandle_t gameQ = 0;
+  int gameSent = 0;
+  int gameHeard = 0;              // as a player, after duplicates are gone
+  int hopHeard[SIM_HOPS] = {};    // ...by relays it took
+  int64_t hopLat[SIM_HOPS] = {};  // send to dispatch, us
+  int gameQueued = 0;             // as a bystander: copied and queued
+  int gameDropped = 0;            // as a bystander: dropped in the callback
+};
+
+enum simEvent { evBoot, evService, evTxAttempt, evTxEnd, evDeliver, evLeave, evSession, evGame };
+
+struct Event {
+  int64_t t;
+  uint64_t seq;
+  simEvent type;
+  int node;
+  Frame *frame;
+  uint64_t gen;
+
+  bool operator>(const Event &o) const {
+    return t != o.t ? t > o.t : seq > o.seq;
+  }
+};
+
+/*
+ *  Simulation state (one run at a time)
+ */
+static sim_config_t cfg;
+static std::vector<SimNode> nodes;
+static std::vector<std::vector<double>> linkLoss;   // [from][to], 1 = out of range
+static std::vector<std::vector<int>> linkRSSI;      // [from][to], dBm
+static std::vector<int> playerIds;
+static bool relayRun = false;
+static std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+static std::vector<Frame *> onAir;
+static std::mt19937 rng;
+static SimNode *cur = nullptr;
+static uint64_t seqNo = 0;
+static int64_t base = 0;          // host clock at t = 0
+static int64_t now = 0;           // usec since t = 0
+static int64_t leaveAt = -1;
+static int64_t gameStart = -1;
+static int64_t airBusyEnd = 0;
+static int64_t airBusy = 0;
+static int collisions = 0;
+static int frames = 0;
+
+static const uint8_t bcastMAC[ADDR_LEN] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+static void post(int64_t t, simEvent type, int node, Frame *f = nullptr, uint64_t gen = 0) {
+  events.push(Event { t, seqNo++, type, node, f, gen });
+}
+
+static uint32_t randUpTo(uint32_t n) {
+  return n ? std::uniform_int_distribution<uint32_t>(0, n)(rng) : 0;
+}
+
+static int64_t airtime(size_t bytes) {
+  return SIM_PREAMBLE_US + (int64_t)(bytes + SIM_MAC_BYTES) * 8 * 1000 / cfg.rateKbps;
+}
+
+static void setClock(int64_t t) {
+  int64_t host = base + t;
+  if (host > (int64_t)hostMicros()) hostAdvanceClock(host - hostMicros());
+  now = t;
+}
+
+/*
+ *  Make sure node n's NET task gets to run by time t.
+ */
+static void wake(int n, int64_t t) {
+  SimNode &s = nodes[n];
+
+  t = std::max(t, s.busyUntil);
+  if (s.serviceAt >= 0 && s.serviceAt <= t) return;
+
+  s.serviceAt = t;
+  post(t, evService, n, nullptr, ++s.serviceGen);
+}
+
+/*
+ *  Lay the nodes out and work out who hears whom.  Spacing is 1; in
+ *  range, loss climbs from --loss to half again by the edge.
+ */
+static void placeNodes(int count) {
+  std::vector<double> x(count), y(count);
+  int w = (int)ceil(sqrt((double)count));
+
+  for (int i = 0; i < count; i++) {
+    switch (cfg.topology) {
+      case topoFull:   x[i] = y[i] = 0; break;
+      case topoLine:   x[i] = i; y[i] = 0; break;
+      case topoGrid:   x[i] = i % w; y[i] = i / w; break;
+      case topoRandom:
+        x[i] = std::uniform_real_distribution<double>(0, sqrt((double)count))(rng);
+        y[i] = std::uniform_real_distribution<double>(0, sqrt((double)count))(rng);
+        break;
+    }
+  }
+
+  // Signal from -45 dBm next door down to -90 at the edge of range
+  linkLoss.assign(count, std::vector<double>(count, 1.0));
+  linkRSSI.assign(count, std::vector<int>(count, -50));
+  for (int a = 0; a < count; a++) {
+    for (int b = 0; b < count; b++) {
+      double d = hypot(x[a] - x[b], y[a] - y[b]) / cfg.range;
+
+      if (cfg.topology == topoFull) linkLoss[a][b] = cfg.loss;
+      else if (d <= 1.0) linkLoss[a][b] = cfg.loss + (1 - cfg.loss) * 0.5 * pow(d, 4);
+      if (cfg.topology != topoFull) linkRSSI[a][b] = (int)lround(-45 - 45 * std::min(d, 1.0));
+    }
+  }
+}
+
+static bool hears(int rx, int tx) {
+  return rx == tx || linkLoss[tx][rx] < 1.0;
+}
+
+/*
+ *  Discovery is done once the player table holds everyone it can.
+ */
+static void checkDiscovery(int n) {
+  SimNode &s = nodes[n];
+  int want = std::min((int)nodes.size() - 1, MAX_PLAYERS - 1);
+  int known = 0;
+
+  if (s.discovered >= 0) return;
+
+  for (int p = 1; p < MAX_PLAYERS; p++) {
+    if (s.net->getPlayer(p)->tag[0]) known++;
+  }
+  if (known >= want) s.discovered = (now - s.bootAt) / 1000;
+}
+
+/*
+ *  After the leavers go, note when a survivor has dropped them all.
+ */
+static void checkForgotten(int n) {
+  SimNode &s = nodes[n];
+
+  if (leaveAt < 0 || now < leaveAt || s.forgot >= 0) return;
+
+  for (SimNode &o : nodes) {
+    if (o.gone && s.net->findNode(o.mac) >= 0) return;
+  }
+  s.forgot = (now - leaveAt) / 1000;
+}
+
+static void boot(int n) {
+  SimNode &s = nodes[n];
+  char tag[16];                 // setPlayerName() trims it to a tag
+
+  s.net->setup(false);
+  snprintf(tag, sizeof(tag), "Node%02d", n + 1);
+  s.net->setPlayerName(tag);
+  s.net->setRelay(relayRun);
+  s.net->begin();
+  s.up = true;
+  wake(n, now);
+}
+
+/*
+ *  One pass of the NET task's loop, charged procUs if it handled a
+ *  packet, then sleep until the next packet or timer.
+ */
+static void service(int n) {
+  SimNode &s = nodes[n];
+  int before = s.net->pending();
+
+  s.serviceAt = -1;
+  if (s.gone) return;
+  s.net->poll(0);
+
+  // What the game gets, relayed or not, copies weeded out
+  gm_packet_t pkt;
+  while (s.gameQ && xQueueReceive(s.gameQ, &pkt, 0)) {
+    int64_t sentAt;
+    int h = std::min((int)pkt.hops, SIM_HOPS - 1);
+
+    memcpy(&sentAt, pkt.payload, sizeof(sentAt));
+    s.gameHeard++;
+    s.hopHeard[h]++;
+    s.hopLat[h] += now - sentAt;
+  }
+
+  if (s.net->pending() < before) {
+    int64_t lat = now - s.arrivals.front();
+    s.arrivals.pop_front();
+    s.latSum += lat;
+    s.latMax = std::max(s.latMax, lat);
+    s.latN++;
+    s.busyUntil = now + cfg.procUs;
+  }
+
+  checkDiscovery(n);
+  checkForgotten(n);
+
+  if (s.net->pending() > 0) {
+    wake(n, s.busyUntil);
+  } else {
+    wake(n, now + (int64_t)s.net->nextTimer() * 1000);
+  }
+}
+
+/*
+ *  Carrier sense: a frame can be heard one slot after it starts, by
+ *  the nodes in its range.  Returns when the channel will be free for
+ *  node n, or 0 if it's free now.
+ */
+static int64_t channelBusy(int n) {
+  int64_t until = 0;
+
+  if (!cfg.csma) return 0;
+  for (Frame *f : onAir) {
+    if (f->start + SIM_SLOT_US <= now && hears(n, f->src)) until = std::max(until, f->end);
+  }
+  return until;
+}
+
+/*
+ *  Switch a node off, politely (GOODBYE) or not.
+ */
+static void leave(int n) {
+  SimNode &s = nodes[n];
+
+  if (!s.up) return;
+  if (n % 2 == 0) s.net->sendGoodbye();
+  s.gone = true;
+}
+
+/*
+ *  The first player hosts a game session and the others join it.
+ */
+static void startSession(int n) {
+  SimNode &s = nodes[n];
+  int host = playerIds[0];
+
+  if (!s.up || s.gone) return;
+
+  if (!s.gameQ) {
+    int q = s.net->createQueue(16);
+    s.net->addFilter(q, GM_TICTAC);
+    s.gameQ = s.net->getHandle(q);
+  }
+
+  if (cfg.gameBcast) return;
+
+  if (n == host) {
+    s.net->hostSession(GM_TICTAC);
+  } else if (!s.net->sessionJoined()) {
+    s.net->joinSession(nodes[host].net->getSession(), GM_TICTAC, nodes[host].mac);
+
+    // The JOIN or the roster can get lost; ask again
+    post(now + 200000, evSession, n);
+  }
+}
+
+static void sendGame(int n) {
+  SimNode &s = nodes[n];
+  gm_packet_t pkt;
+
+  if (s.gone) return;
+
+  memset(&pkt, 0, sizeof(pkt));
+  pkt.pktType = GM_TICTAC;
+  pkt.length = 16;
+  memcpy(pkt.srcAddr, s.mac, ADDR_LEN);
+  memcpy(pkt.payload, &now, sizeof(now));
+
+  if (cfg.gameBcast) {
+    memcpy(pkt.dstAddr, bcastMAC, ADDR_LEN);
+    if (s.net->sendPkt(&pkt) == ESP_OK) s.gameSent++;
+  } else if (s.net->sessionMembers() > 1) {
+    if (s.net->sendSession(&pkt) == ESP_OK) s.gameSent++;
+  }
+
+  post(now + 1000000 / cfg.gameHz + randUpTo(2000), evGame, n);
+}
+
+static void txAttempt(int n) {
+  SimNode &s = nodes[n];
+  Frame *f = s.txq.front();
+  int64_t busy = channelBusy(n);
+
+  if (busy) {
+    post(busy + SIM_DIFS_US + randUpTo(SIM_CW) * SIM_SLOT_US, evTxAttempt, n);
+    return;
+  }
+
+  f->start = now;
+  f->end = now + airtime(f->data.size());
+  f->collided = false;
+  f->overlaps.clear();
+
+  for (Frame *o : onAir) {
+    if (o->end > now) {
+      o->collided = true;
+      o->overlaps.push_back(n);
+      f->collided = true;
+      f->overlaps.push_back(o->src);
+    }
+  }
+
+  onAir.push_back(f);
+  post(f->end, evTxEnd, n, f);
+}
+
+/*
+ *  A frame leaves the air: decide, per receiver, whether it made it.
+ */
+static void txEnd(int n, Frame *f) {
+  SimNode &s = nodes[n];
+  bool bcast = memcmp(f->dst, bcastMAC, ADDR_LEN) == 0;
+  bool acked = false;
+
+  onAir.erase(std::find(onAir.begin(), onAir.end(), f));
+  airBusy += f->end - std::max(f->start, airBusyEnd);
+  airBusyEnd = std::max(airBusyEnd, f->end);
+  frames++;
+  if (f->collided) collisions++;
+
+  for (size_t r = 0; r < nodes.size(); r++) {
+    SimNode &d = nodes[r];
+
+    if ((int)r == n || !d.up || d.gone || !hears(r, n)) continue;
+    if (!bcast && memcmp(d.mac, f->dst, ADDR_LEN) != 0) continue;
+
+    bool clash = false;
+    for (int o : f->overlaps) clash |= hears(r, o);
+
+    bool ok = !clash && std::uniform_real_distribution<double>(0, 1)(rng) >= linkLoss[n][r];
+    bool final = bcast || ok || f->tries >= cfg.retries;
+
+    if (final) d.expected++;
+
+    if (ok) {
+      d.heard++;
+      acked = true;
+      f->refs++;
+      post(f->end + cfg.latencyUs + randUpTo(cfg.jitterUs), evDeliver, r, f);
+    } else if (final) {
+      if (clash) d.collided++;
+      else d.lost++;
+    }
+  }
+
+  // Unicasts retry until acked; the frame is freed after delivery
+  if (!bcast && !acked && f->tries < cfg.retries) {
+    f->tries++;
+    post(now + SIM_DIFS_US + randUpTo(SIM_CW) * SIM_SLOT_US, evTxAttempt, n);
+    return;
+  }
+
+  // The radio's verdict on a unicast
+  if (!bcast) s.net->sendDone(f->dst, acked);
+
+  s.txq.pop_front();
+  if (!acked) delete f;
+
+  if (!s.txq.empty()) {
+    post(now + SIM_DIFS_US + randUpTo(SIM_CW) * SIM_SLOT_US, evTxAttempt, n);
+  } else {
+    s.txPending = false;
+  }
+}
+
+static void deliver(int n, Frame *f) {
+  SimNode &s = nodes[n];
+  int overflow = s.net->getStat(pktRecvOverflow);
+
+  int foreign = s.net->getStat(pktForeign);
+
+  if (s.gone) {
+    if (--f->refs == 0) delete f;
+    return;
+  }
+
+  s.net->signal(nodes[f->src].mac, linkRSSI[f->src][n] + (int)randUpTo(6) - 3);
+  s.net->receive(nodes[f->src].mac, f->data.data(), f->data.size());
+  if (s.net->getStat(pktRecvOverflow) == overflow && s.net->getStat(pktForeign) == foreign) {
+    s.arrivals.push_back(f->end);
+    wake(n, now);
+  }
+
+  if (f->data[offsetof(gm_packet_t, pktType)] == GM_TICTAC) {
+    if (s.player) {
+      // Counted when it's dispatched
+    } else if (s.net->getStat(pktForeign) != foreign) {
+      s.gameDropped++;
+    } else {
+      s.gameQueued++;
+    }
+  }
+
+  // Broadcasts are shared by all their receivers; free on the last
+  if (--f->refs == 0) delete f;
+}
+
+/*
+ *  One simulation with n nodes.
+ */
+static void runOnce(int count) {
+  nodes.assign(count, SimNode());
+  events = decltype(events)();
+  onAir.clear();
+  rng.seed(cfg.seed * 1000 + count);
+  seqNo = 0;
+  now = 0;
+  airBusyEnd = airBusy = 0;
+  collisions = frames = 0;
+  base = hostMicros();
+  placeNodes(count);
+
+  for (int i = 0; i < count; i++) {
+    SimNode &s = nodes[i];
+    uint8_t mac[ADDR_LEN] = { 0x02, 0x47, 0x4d, 0x00, (uint8_t)((i + 1) >> 8), (uint8_t)(i + 1) };
+
+    memcpy(s.mac, mac, ADDR_LEN);
+    s.net = new NetworkTask;
+    s.bootAt = (int64_t)randUpTo(cfg.spreadMs) * 1000;
+    post(s.bootAt, evBoot, i);
+  }
+
+  int64_t end = (int64_t)cfg.seconds * 1000000;
+
+  // The last nodes leave, so the first ones' numbering stays the same
+  int leavers = (int)(cfg.leave * count + 0.5);
+  leaveAt = leavers ? end / 2 : -1;
+  for (int i = count - leavers; i < count; i++) post(leaveAt, evLeave, i);
+
+  // Players start once everyone's up.  With a topology they're spread
+  // out as far as they go (the ends of the line, opposite corners)
+  int nPlayers = std::min(cfg.players, count);
+
+  playerIds.clear();
+  for (int k = 0; k < nPlayers; k++) {
+    if (cfg.topology == topoFull || nPlayers == 1) playerIds.push_back(k);
+    else playerIds.push_back((int)lround((double)k * (count - 1) / (nPlayers - 1)));
+  }
+
+  gameStart = -1;
+  if (cfg.gameHz) {
+    gameStart = (int64_t)cfg.spreadMs * 1000 + 1000000;
+    for (int k = 0; k < nPlayers; k++) {
+      int i = playerIds[k];
+      nodes[i].player = true;
+      post(gameStart + k * 1000, evSession, i);
+      post(gameStart + 500000 + randUpTo(2000), evGame, i);
+    }
+    if (cfg.hostLeaves) post(end / 2, evLeave, playerIds[0]);
+  }
+
+  while (!events.empty() && events.top().t <= end) {
+    Event e = events.top();
+    events.pop();
+
+    setClock(e.t);
+    cur = &nodes[e.node];
+
+    switch (e.type) {
+      case evBoot:      boot(e.node); break;
+      case evService:   if (e.gen == cur->serviceGen) service(e.node); break;
+      case evTxAttempt: txAttempt(e.node); break;
+      case evTxEnd:     txEnd(e.node, e.frame); break;
+      case evDeliver:   deliver(e.node, e.frame); break;
+      case evLeave:     leave(e.node); break;
+      case evSession:   startSession(e.node); break;
+      case evGame:      sendGame(e.node); break;
+    }
+  }
+
+  setClock(end);
+  cur = nullptr;
+}
+
+/*
+ *  Reporting
+ */
+typedef struct simResult {
+  double air;
+  double gameDeliv;
+  int64_t hopLat[SIM_HOPS];
+  int hopHeard[SIM_HOPS];
+} sim_result_t;
+
+static sim_result_t result;
+
+static void report(int count) {
+  int expected = 0, heard = 0, coll = 0, overflow = 0, sent = 0, peerFull = 0, found = 0;
+  int64_t latSum = 0, latMax = 0, discSum = 0, discMax = 0, forgotSum = 0, forgotMax = 0;
+  int latN = 0, discN = 0, forgotN = 0, stale = 0;
+  int want = std::min(count - 1, MAX_PLAYERS - 1);
+
+  if (cfg.verbose) {
+    printf("\nnetsim: %d nodes\n", count);
+    printf("node   sent  expect   heard  deliv%%  coll  lost  ovfl  lat avg/max us   known  disc ms\n");
+  }
+
+  for (int i = 0; i < count; i++) {
+    SimNode &s = nodes[i];
+    int known = 0;
+
+    for (int p = 1; p < MAX_PLAYERS; p++) {
+      if (s.net->getPlayer(p)->tag[0]) known++;
+    }
+
+    expected += s.expected;
+    heard += s.heard;
+    coll += s.collided;
+    overflow += s.net->getStat(pktRecvOverflow);
+    sent += s.sent;
+    peerFull += s.peerFull;
+    latSum += s.latSum;
+    latN += s.latN;
+    latMax = std::max(latMax, s.latMax);
+    found += known;
+    if (s.discovered >= 0) {
+      discSum += s.discovered;
+      discMax = std::max(discMax, s.discovered);
+      discN++;
+    }
+    if (s.forgot >= 0) {
+      forgotSum += s.forgot;
+      forgotMax = std::max(forgotMax, s.forgot);
+      forgotN++;
+    }
+    if (!s.gone) {
+      for (SimNode &o : nodes) {
+        if (o.gone && s.net->findNode(o.mac) >= 0) stale++;
+      }
+    }
+
+    if (cfg.verbose) {
+      printf("%4d %6d %7d %7d %7.1f %5d %5d %5d %7d/%-7d %4d/%-2d %8lld\n", i + 1, s.sent, s.expected, s.heard,
+             s.expected ? 100.0 * s.heard / s.expected : 100.0, s.collided, s.lost, s.net->getStat(pktRecvOverflow),
+             (int)(s.latN ? s.latSum / s.latN : 0), (int)s.latMax, known, count - 1, (long long)s.discovered);
+    }
+  }
+
+  if (cfg.verbose) printf("\n");
+
+  memset(&result, 0, sizeof(result));
+  result.air = 100.0 * airBusy / ((int64_t)cfg.seconds * 1000000);
+
+  // Nothing to average (nobody discovered, nobody left): "-"
+  char discAvg[16] = "-", discWorst[16] = "-", forgotAvg[16] = "-", forgotWorst[16] = "-";
+  if (discN) {
+    snprintf(discAvg, sizeof(discAvg), "%d", (int)(discSum / discN));
+    snprintf(discWorst, sizeof(discWorst), "%d", (int)discMax);
+  }
+  if (forgotN) {
+    snprintf(forgotAvg, sizeof(forgotAvg), "%d", (int)(forgotSum / forgotN));
+    snprintf(forgotWorst, sizeof(forgotWorst), "%d", (int)forgotMax);
+  }
+
+  printf("%5d %7.1f %7d %6.1f %6.1f %8d %8d %9s %9s %6.1f %6d %8d %6d %10s %10s\n", count,
+         expected ? 100.0 * heard / expected : 100.0,
+         overflow,
+         100.0 * airBusy / ((int64_t)cfg.seconds * 1000000),
+         frames ? 100.0 * collisions / frames : 0.0,
+         (int)(latN ? latSum / latN : 0), (int)latMax,
+         discAvg, discWorst,
+         want ? 100.0 * found / (count * want) : 100.0,
+         discN, peerFull, stale,
+         forgotAvg, forgotWorst);
+
+  if (!cfg.gameHz) return;
+
+  // Game: how the players fared, and what it cost everyone else
+  int players = 0, bystanders = 0, sentG = 0, heardG = 0, queuedG = 0, droppedG = 0;
+  int relayed = 0, suppressed = 0;
+  int host = -1;
+  bool agree = true;
+  double secs = cfg.seconds - gameStart / 1e6;
+
+  for (int i = 0; i < count; i++) {
+    SimNode &s = nodes[i];
+
+    relayed += s.net->getStat(pktRelayed);
+    suppressed += s.net->getStat(pktSuppressed);
+
+    if (s.player) {
+      players++;
+      sentG += s.gameSent;
+      heardG += s.gameHeard;
+      for (int h = 0; h < SIM_HOPS; h++) {
+        result.hopHeard[h] += s.hopHeard[h];
+        result.hopLat[h] += s.hopLat[h];
+      }
+      if (s.gone) continue;
+
+      // Everyone still playing should name the same host
+      int h = -1;
+      for (int j = 0; j < count; j++) {
+        if (!cfg.gameBcast && s.net->sessionMembers() > 0 && nodes[j].net->sessionHost() && !nodes[j].gone) h = j;
+      }
+      if (host < 0) host = h;
+      else if (h != host) agree = false;
+    } else if (!s.gone) {
+      bystanders++;
+      queuedG += s.gameQueued;
+      droppedG += s.gameDropped;
+    }
+  }
+
+  result.gameDeliv = sentG && players > 1 ? 100.0 * heardG / (sentG * (players - 1)) : 0.0;
+
+  printf("       game: %d players at %uHz, %s, %d sent, %.1f%% delivered; per bystander %.1f queued/s, %.1f dropped early/s",
+         players, cfg.gameHz, cfg.gameBcast ? "broadcast" : "session", sentG, result.gameDeliv,
+         bystanders ? queuedG / secs / bystanders : 0.0, bystanders ? droppedG / secs / bystanders : 0.0);
+  if (!cfg.gameBcast) printf("; host node %d%s", host + 1, agree ? "" : " (players disagree!)");
+  printf("\n");
+
+  // Where the packets that made it came from, and how long they took
+  printf("       hops:");
+  for (int h = 0; h < SIM_HOPS; h++) {
+    if (!result.hopHeard[h]) continue;
+    printf(" %d: %d at %.1fms", h, result.hopHeard[h], result.hopLat[h] / 1000.0 / result.hopHeard[h]);
+  }
+  if (relayRun) printf("; relays forwarded %d, held back %d", relayed, suppressed);
+  printf("\n");
+
+  // The link metrics, as the first player sees the others
+  SimNode &h0 = nodes[playerIds[0]];
+
+  printf("      links:");
+  for (size_t k = 1; k < playerIds.size(); k++) {
+    gm_link_stats_t l;
+    char rtt[16], p95[16], loss[16], probeLoss[16], rssi[16];
+
+    if (h0.gone || !h0.net->getLinkStats(h0.net->findNode(nodes[playerIds[k]].mac), &l)) continue;
+
+    // Unknowns as "-", like SysInfo (a relayed player's broadcasts
+    // aren't heard directly, so there's no loss figure for it)
+    if (l.rtt < 0) snprintf(rtt, sizeof(rtt), "-");
+    else snprintf(rtt, sizeof(rtt), "%.1fms", l.rtt / 1000.0);
+    if (l.rttP95 < 0) snprintf(p95, sizeof(p95), "-");
+    else snprintf(p95, sizeof(p95), "%.1fms", l.rttP95 / 1000.0);
+    if (l.loss < 0) snprintf(loss, sizeof(loss), "-");
+    else snprintf(loss, sizeof(loss), "%d%%", l.loss);
+    if (l.probeLoss < 0) snprintf(probeLoss, sizeof(probeLoss), "-");
+    else snprintf(probeLoss, sizeof(probeLoss), "%d%%", l.probeLoss);
+    if (l.rssi == 0) snprintf(rssi, sizeof(rssi), "-");
+    else snprintf(rssi, sizeof(rssi), "%d", l.rssi);
+
+    printf("%s node %d rtt %s p95 %s (%d), loss %s, ping loss %s, %s dBm, tx %d/%d failed",
+           k > 1 ? ";" : "", playerIds[k] + 1, rtt, p95, l.rttSamples, loss, probeLoss,
+           rssi, l.txFailed, l.txAcked + l.txFailed);
+  }
+  printf("\n");
+}
+
+/*
+ *  Same run with relays off and on: what relaying bought, and what
+ *  each hop costs in latency and airtime.
+ */
+static void compareRelay(int count, const sim_result_t &off, const sim_result_t &on) {
+  double first = 0, last = 0;
+  int lo = -1, hi = -1;
+
+  printf("      relay: delivery %.1f%% -> %.1f%% (%+.1f), air %.1f%% -> %.1f%%", off.gameDeliv, on.gameDeliv,
+         on.gameDeliv - off.gameDeliv, off.air, on.air);
+
+  // Mean latency by hop count, then the cost of each extra hop
+  for (int h = 0; h < SIM_HOPS; h++) {
+    if (!on.hopHeard[h]) continue;
+    last = on.hopLat[h] / 1000.0 / on.hopHeard[h];
+    printf("%s %.1fms at %d hop%s", lo < 0 ? "; latency" : ",", last, h, h == 1 ? "" : "s");
+    if (lo < 0) {
+      lo = h;
+      first = last;
+    }
+    hi = h;
+  }
+  if (hi > lo) printf(" (%+.1fms per hop)", (last - first) / (hi - lo));
+  printf("\n");
+}
+
+/*
+ *  Stand-ins for the ESP-NOW driver, routed to the current node.
+ */
+const uint8_t *hostNodeMAC() {
+  static const uint8_t none[ADDR_LEN] = { 0x02, 0x47, 0x4d, 0x00, 0x00, 0x00 };
+  return cur ? cur->mac : none;
+}
+
+esp_err_t esp_now_init() {
+  return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb) {
+  // Frames are handed straight to NetworkTask::receive()
+  return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb) {
+  // ...and ACKs to sendDone(), RSSI to signal()
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t cb) {
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t *filter) {
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous(bool en) {
+  return ESP_OK;
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len) {
+  if (!cur) return ESP_ERR_ESPNOW_NOT_INIT;
+  if (len > ESP_NOW_MAX_DATA_LEN) return ESP_ERR_ESPNOW_ARG;
+  if (!esp_now_is_peer_exist(peer_addr)) return ESP_ERR_ESPNOW_NOT_FOUND;
+
+  Frame *f = new Frame;
+  f->src = cur - nodes.data();
+  memcpy(f->dst, peer_addr, ADDR_LEN);
+  f->data.assign(data, data + len);
+
+  cur->txq.push_back(f);
+  cur->sent++;
+  if (!cur->txPending) {
+    cur->txPending = true;
+    post(now + SIM_DIFS_US + randUpTo(SIM_CW) * SIM_SLOT_US, evTxAttempt, f->src);
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer) {
+  if (!cur) return ESP_ERR_ESPNOW_NOT_INIT;
+  if (cur->peers.size() >= ESP_NOW_MAX_TOTAL_PEER_NUM) {
+    cur->peerFull++;
+    return ESP_ERR_ESPNOW_FULL;
+  }
+  if (!cur->peers.insert(std::string((const char *)peer->peer_addr, ADDR_LEN)).second) return ESP_ERR_ESPNOW_EXIST;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr) {
+  if (!cur) return ESP_ERR_ESPNOW_NOT_INIT;
+  if (!cur->peers.erase(std::string((const char *)peer_addr, ADDR_LEN))) return ESP_ERR_ESPNOW_NOT_FOUND;
+  return ESP_OK;
+}
+
+bool esp_now_is_peer_exist(const uint8_t *peer_addr) {
+  return cur && cur->peers.count(std::string((const char *)peer_addr, ADDR_LEN)) > 0;
+}
+
+/*
+ *  The network task asks the menu what's running, for HELLOs.
+ */
+MenuTask::MenuTask()
+  : GMTask("MENU", 8192, MENU_PRIORITY) {
+}
+
+void MenuTask::setup(bool rsvp) {
+}
+
+void MenuTask::run() {
+}
+
+char *MenuTask::getCurrentApp() {
+  return (char *)"MENU";
+}
+
+MenuTask menuTask;
+
+static void usage() {
+  printf("usage: netsim [options]\n"
+         "  --nodes LIST     node counts to run, e.g. 2,5,10,20 (default)\n"
+         "  --seconds S      simulated time per run (60)\n"
+         "  --loss P         per-receiver frame loss, 0-1 (0.02)\n"
+         "  --latency US     radio to callback delay (200)\n"
+         "  --jitter US      plus up to this much (300)\n"
+         "  --rate KBPS      PHY rate (1000)\n"
+         "  --proc US        NET task time per packet (400)\n"
+         "  --spread MS      power-on times spread over this (2000)\n"
+         "  --retries N      unicast retransmissions (3)\n"
+         "  --aloha          no carrier sense\n"
+         "  --leave F        fraction of nodes that leave halfway (0)\n"
+         "  --game HZ        first nodes play a game, HZ packets/s each (0)\n"
+         "  --players N      how many play (2)\n"
+         "  --broadcast      game goes by broadcast instead of a session\n"
+         "  --host-leaves    game host leaves halfway\n"
+         "  --topology T     full (default), line, grid or random\n"
+         "  --range R        radio range in node spacings (1.5)\n"
+         "  --relay          run each twice, relay mode off then on\n"
+         "  --seed N         random seed (1)\n"
+         "  --verbose        per-node tables\n");
+}
+
+// A numeric option, or a complaint and false if it isn't one or is out of range
+static bool numArg(const char *name, const char *arg, double lo, double hi, double *v) {
+  char *end;
+
+  *v = strtod(arg, &end);
+  if (end == arg || *end || *v < lo || *v > hi) {
+    fprintf(stderr, "netsim: --%s must be a number from %g to %g\n", name, lo, hi);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  static const struct option opts[] = {
+    { "nodes", required_argument, nullptr, 'n' },
+    { "seconds", required_argument, nullptr, 's' },
+    { "loss", required_argument, nullptr, 'l' },
+    { "latency", required_argument, nullptr, 'L' },
+    { "jitter", required_argument, nullptr, 'j' },
+    { "rate", required_argument, nullptr, 'r' },
+    { "proc", required_argument, nullptr, 'p' },
+    { "spread", required_argument, nullptr, 'S' },
+    { "retries", required_argument, nullptr, 'R' },
+    { "aloha", no_argument, nullptr, 'a' },
+    { "leave", required_argument, nullptr, 'g' },
+    { "game", required_argument, nullptr, 'G' },
+    { "players", required_argument, nullptr, 'P' },
+    { "broadcast", no_argument, nullptr, 'B' },
+    { "host-leaves", no_argument, nullptr, 'H' },
+    { "topology", required_argument, nullptr, 't' },
+    { "range", required_argument, nullptr, 'D' },
+    { "relay", no_argument, nullptr, 'y' },
+    { "seed", required_argument, nullptr, 'x' },
+    { "verbose", no_argument, nullptr, 'v' },
+    { "help", no_argument, nullptr, 'h' },
+    { nullptr, 0, nullptr, 0 }
+  };
+  const char *list = "2,5,10,20";
+  double v;
+  int c;
+
+  while ((c = getopt_long(argc, argv, "n:s:l:L:j:r:p:S:R:ag:G:P:BHt:D:yx:vh", opts, nullptr)) != -1) {
+    switch (c) {
+      case 'n': list = optarg; break;
+      case 's': if (!numArg("seconds", optarg, 1, 86400, &v)) return 1; cfg.seconds = v; break;
+      case 'l': if (!numArg("loss", optarg, 0, 1, &v)) return 1; cfg.loss = v; break;
+      case 'L': if (!numArg("latency", optarg, 0, 1e6, &v)) return 1; cfg.latencyUs = v; break;
+      case 'j': if (!numArg("jitter", optarg, 0, 1e6, &v)) return 1; cfg.jitterUs = v; break;
+      case 'r': if (!numArg("rate", optarg, 1, 1e6, &v)) return 1; cfg.rateKbps = v; break;
+      case 'p': if (!numArg("proc", optarg, 0, 1e6, &v)) return 1; cfg.procUs = v; break;
+      case 'S': if (!numArg("spread", optarg, 0, 1e6, &v)) return 1; cfg.spreadMs = v; break;
+      case 'R': if (!numArg("retries", optarg, 0, 15, &v)) return 1; cfg.retries = v; break;
+      case 'a': cfg.csma = false; break;
+      case 'g': if (!numArg("leave", optarg, 0, 1, &v)) return 1; cfg.leave = v; break;
+      case 'G': if (!numArg("game", optarg, 0, 1000, &v)) return 1; cfg.gameHz = v; break;
+      case 'P': if (!numArg("players", optarg, 1, MAX_PLAYERS, &v)) return 1; cfg.players = v; break;
+      case 'B': cfg.gameBcast = true; break;
+      case 'H': cfg.hostLeaves = true; break;
+      case 't':
+        if (!strcmp(optarg, "full")) cfg.topology = topoFull;
+        else if (!strcmp(optarg, "line")) cfg.topology = topoLine;
+        else if (!strcmp(optarg, "grid")) cfg.topology = topoGrid;
+        else if (!strcmp(optarg, "random")) cfg.topology = topoRandom;
+        else { usage(); return 1; }
+        break;
+      case 'D': if (!numArg("range", optarg, 0, 1000, &v)) return 1; cfg.range = v; break;
+      case 'y': cfg.relay = true; break;
+      case 'x': cfg.seed = atoi(optarg); break;
+      case 'v': cfg.verbose = true; break;
+      default:  usage(); return c == 'h' ? 0 : 1;
+    }
+  }
+
+  for (const char *p = list; *p;) {
+    int n = atoi(p);
+    if (n > 0) cfg.nodes.push_back(n);
+    p = strchr(p, ',');
+    if (!p) break;
+    p++;
+  }
+
+  hostSerialQuiet(true);
+  hostUseVirtualClock(true);
+
+  printf("netsim: %us per run, loss %.1f%%, latency %u+%uus, %ukbps, proc %uus, %s, %d retries, seed %u\n",
+         cfg.seconds, cfg.loss * 100, cfg.latencyUs, cfg.jitterUs, cfg.rateKbps, cfg.procUs,
+         cfg.csma ? "CSMA" : "ALOHA", cfg.retries, cfg.seed);
+  printf("netsim: MAX_PLAYERS %d, MAX_PEERS %d, MAX_PENDING %d, HELLO %d-%dms (keepalive %dms), PLAYER_TIMEOUT %dms\n",
+         MAX_PLAYERS, MAX_PEERS, MAX_PENDING, IFF_IMIN, IFF_IMAX, IFF_KEEPALIVE, PLAYER_TIMEOUT);
+  if (cfg.leave > 0) printf("netsim: %.0f%% of nodes leave at %us\n", cfg.leave * 100, cfg.seconds / 2);
+  if (cfg.topology != topoFull) {
+    static const char *names[] = { "full", "line", "grid", "random" };
+    printf("netsim: %s topology, range %.1f\n", names[cfg.topology], cfg.range);
+  }
+  if (cfg.relay) printf("netsim: relay off, then on (TTL %d, %d copies hold a relay back)\n", RELAY_TTL, RELAY_REDUNDANCY);
+  printf("\n");
+  printf("nodes  deliv%%    ovfl   air%%  coll%%  lat avg  lat max  disc avg  disc max  known%%  discN  peerfull  stale  forgot avg  forgot max\n");
+
+  for (int n : cfg.nodes) {
+    sim_result_t off;
+
+    relayRun = false;
+    runOnce(n);
+    report(n);
+
+    if (cfg.relay) {
+      off = result;
+      relayRun = true;
+      runOnce(n);
+      report(n);
+      if (cfg.gameHz) compareRelay(n, off, result);
+    }
+  }
+
+  fflush(stdout);
+  _exit(0);
+}
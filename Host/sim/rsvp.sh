@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+#  Two-node invitation test for the host build
+#
+#  Node 1 picks TicTacToe from the menu and invites; node 2 gets the
+#  RSVP on its menu.  First node 2 says yes, and both sides must log
+#  an RSVP time-to-start line.  Then node 2 says no, and node 1 must
+#  give up with "No takers".
+#
+#    Host/sim/rsvp.sh [build dir]
+#
+
+BUILD=${1:-build}
+GM=$BUILD/gameman
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+# Menu is up about 5s after start: down, down, B
+PICK="5500:27:0,5580:27:1,5800:27:0,5880:27:1,6100:33:0,6180:33:1"
+
+if [ ! -x "$GM" ]; then
+  echo "rsvp: no $GM (build first)" >&2
+  exit 2
+fi
+
+fail=0
+
+# Accept: B on node 2 about 2s after the invite shows up
+GM_HOST_NODE=2 GM_HOST_RUN_MS=14000 GM_HOST_BUTTONS="8000:33:0,8080:33:1" $GM > "$OUT/guest" 2>&1 &
+GM_HOST_NODE=1 GM_HOST_RUN_MS=14000 GM_HOST_BUTTONS="$PICK" $GM > "$OUT/host" 2>&1
+wait
+
+for side in host guest; do
+  line=$(grep "^RSVP,TicTacToe,$side," "$OUT/$side")
+  if [ -n "$line" ]; then
+    echo "rsvp: accept: $line"
+  else
+    echo "rsvp: accept: FAIL, no time-to-start from the $side"
+    fail=1
+  fi
+done
+
+# Decline: C on node 2; the host keeps asking until it runs out of tries
+GM_HOST_NODE=2 GM_HOST_RUN_MS=24000 GM_HOST_BUTTONS="8000:4:0,8080:4:1" $GM > "$OUT/guest" 2>&1 &
+GM_HOST_NODE=1 GM_HOST_RUN_MS=24000 GM_HOST_BUTTONS="$PICK" $GM > "$OUT/host" 2>&1
+wait
+
+if grep -q "No game: No takers" "$OUT/host" && ! grep -q "^RSVP," "$OUT/guest"; then
+  echo "rsvp: decline: ok"
+else
+  echo "rsvp: decline: FAIL"
+  fail=1
+fi
+
+exit $fail
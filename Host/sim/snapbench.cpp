@@ -0,0 +1,295 @@
+/*
+ *  snapbench.cpp - Bytes per tick for snapshot replication
+ *
+ *  Abstract:
+ *      Plays a made-up four player arena game (positions, headings,
+ *      hit points, up to 16 shots in flight, a map of pickups) at a
+ *      fixed tick rate.  The first player owns the world and
+ *      replicates it with the real Replicator (Code/snapshot.cpp) to
+ *      the other three over links that lose packets and ACKs at
+ *      random and deliver the rest a tick or more later.  Each run
+ *      reports what went on the air per tick against sending the
+ *      whole state every tick, how far behind the others' copies ran,
+ *      and whether any copy ever differed from what the owner had at
+ *      that sequence number (it mustn't).
+ *
+ *        snapbench [--ticks N] [--hz HZ] [--loss LIST] [--latency T]
+ *                  [--seed N]
+ *
+ *      Runs are deterministic for a given --seed.
+ *
+ *  Team 14 Project
+ *  Portland State University
+ *  ECE411 Fall 2023
+ */
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+
+#include "snapshot.h"
+
+#define BENCH_PLAYERS   4
+#define BENCH_SHOTS    16
+#define BENCH_ARENA   128   // pixels square
+#define BENCH_HEADER  ((int)offsetof(gm_packet_t, payload))
+
+// The replicated state: about what a Mazewar would need
+typedef struct benchWorld {
+  uint16_t tick;
+  struct {
+    int16_t x, y;
+    uint8_t heading;        // 0-7
+    uint8_t hp;
+    uint16_t score;
+    uint8_t ammo;
+    uint8_t flags;
+  } player[BENCH_PLAYERS];
+  struct {
+    int16_t x, y;
+    int8_t dx, dy;
+    uint8_t owner;
+    uint8_t ttl;            // 0: not in flight
+  } shot[BENCH_SHOTS];
+  uint8_t pickups[32];      // one bit per spot
+} bench_world_t;
+
+typedef struct benchConfig {
+  int ticks = 1200;
+  int hz = 20;
+  std::vector<double> loss = { 0, 0.05, 0.2 };
+  int latency = 1;          // ticks, each way
+  uint32_t seed = 1;
+} bench_config_t;
+
+struct InFlight {
+  int due;                  // tick it arrives
+  int to;                   // node
+  gm_packet_t pkt;
+};
+
+static bench_config_t cfg;
+static std::mt19937 rng;
+
+static bool chance(double p) {
+  return std::uniform_real_distribution<double>(0, 1)(rng) < p;
+}
+
+static int randUpTo(int n) {
+  return std::uniform_int_distribution<int>(0, n - 1)(rng);
+}
+
+/*
+ *  One tick of the game: most players move, some turn or fire, shots
+ *  fly and sometimes hit, and now and then a pickup comes or goes.
+ */
+static void step(bench_world_t *w) {
+  static const int8_t dx[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+  static const int8_t dy[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+
+  w->tick++;
+
+  for (int p = 0; p < BENCH_PLAYERS; p++) {
+    auto &pl = w->player[p];
+
+    if (chance(0.1)) pl.heading = (pl.heading + (chance(0.5) ? 1 : 7)) % 8;
+    if (chance(0.7)) {
+      pl.x = constrain(pl.x + dx[pl.heading], 0, BENCH_ARENA - 1);
+      pl.y = constrain(pl.y + dy[pl.heading], 0, BENCH_ARENA - 1);
+    }
+
+    if (pl.ammo && chance(0.05)) {
+      for (int s = 0; s < BENCH_SHOTS; s++) {
+        if (w->shot[s].ttl) continue;
+        w->shot[s] = { pl.x, pl.y, (int8_t)(dx[pl.heading] * 3), (int8_t)(dy[pl.heading] * 3), (uint8_t)p, 20 };
+        pl.ammo--;
+        break;
+      }
+    }
+    if (chance(0.01)) pl.ammo = 10;
+    pl.flags = pl.hp < 30;
+  }
+
+  for (int s = 0; s < BENCH_SHOTS; s++) {
+    auto &sh = w->shot[s];
+
+    if (!sh.ttl) continue;
+    sh.x += sh.dx;
+    sh.y += sh.dy;
+    sh.ttl--;
+
+    if (chance(0.02)) {
+      int victim = randUpTo(BENCH_PLAYERS);
+
+      if (victim != sh.owner && w->player[victim].hp) {
+        w->player[victim].hp -= std::min(10, (int)w->player[victim].hp);
+        w->player[sh.owner].score += 10;
+        sh.ttl = 0;
+      }
+    }
+    if (!sh.ttl) sh = {};
+  }
+
+  if (chance(0.02)) w->pickups[randUpTo(32)] ^= 1 << randUpTo(8);
+}
+
+static void nodeMAC(int n, uint8_t *mac) {
+  uint8_t m[ADDR_LEN] = { 0x02, 0x47, 0x4d, 0x53, 0x42, (uint8_t)(n + 1) };
+
+  memcpy(mac, m, ADDR_LEN);
+}
+
+static int macNode(const uint8_t *mac) {
+  return mac[ADDR_LEN - 1] - 1;
+}
+
+// The port layer wants one; nothing here uses the radio
+const uint8_t *hostNodeMAC() {
+  static uint8_t mac[ADDR_LEN];
+
+  nodeMAC(0, mac);
+  return mac;
+}
+
+static void runOnce(double loss) {
+  bench_world_t world = {}, copies[BENCH_PLAYERS] = {};
+  std::vector<bench_world_t> truth(SNAP_HISTORY * 4);
+  Replicator snap[BENCH_PLAYERS];
+  std::deque<InFlight> air;
+  uint8_t mac[ADDR_LEN];
+  long bytes = 0, ackBytes = 0, behind = 0, behindMax = 0, mismatches = 0, samples = 0;
+
+  rng.seed(cfg.seed);
+
+  for (int p = 0; p < BENCH_PLAYERS; p++) {
+    world.player[p] = { (int16_t)(20 + 30 * p), (int16_t)(20 + 30 * p), (uint8_t)(p * 2), 100, 0, 10, 0 };
+    nodeMAC(p, mac);
+    snap[p].begin(GM_MAZEWAR, p == 0 ? (void *)&world : (void *)&copies[p], sizeof(bench_world_t), mac);
+  }
+  for (int p = 1; p < BENCH_PLAYERS; p++) {
+    nodeMAC(p, mac);
+    snap[0].addPeer(mac);
+  }
+
+  for (int t = 0; t < cfg.ticks; t++) {
+    gm_packet_t pkt;
+    bool all;
+
+    step(&world);
+    uint16_t s = snap[0].update();
+    truth[s % truth.size()] = world;
+
+    // Everybody sends what they have; each copy is lost (or not) on its own
+    for (int p = 0; p < BENCH_PLAYERS; p++) {
+      while (snap[p].next(&pkt, &all)) {
+        bytes += BENCH_HEADER + pkt.length;
+        if (p != 0) ackBytes += BENCH_HEADER + pkt.length;
+
+        for (int q = 0; q < BENCH_PLAYERS; q++) {
+          if (q == p) continue;
+          if (!all && macNode(pkt.dstAddr) != q) continue;
+          if (chance(loss)) continue;
+          air.push_back({ t + cfg.latency, q, pkt });
+        }
+      }
+    }
+
+    // Deliver what's due, then check every copy against the real thing
+    while (!air.empty() && air.front().due <= t + 1) {
+      InFlight f = air.front();
+      air.pop_front();
+
+      if (snap[f.to].receive(&f.pkt) && f.to != 0) {
+        uint16_t got = snap[f.to].sequence();
+
+        if (memcmp(&copies[f.to], &truth[got % truth.size()], sizeof(bench_world_t)) != 0) mismatches++;
+      }
+    }
+
+    for (int p = 1; p < BENCH_PLAYERS; p++) {
+      long lag = snap[p].sequence() ? (uint16_t)(s - snap[p].sequence()) : s;
+
+      behind += lag;
+      behindMax = std::max(behindMax, lag);
+      samples++;
+    }
+  }
+
+  snap_stats_t owner, guest;
+  snap[0].getStats(&owner);
+  snap[1].getStats(&guest);
+
+  int full = BENCH_HEADER + SNAP_HEADER + sizeof(bench_world_t);
+  printf("%5.0f%%  %6.1f  %6.1f  %6.1f  %6.1f  %5.0f%%   %5u / %-5u  %5.2f  %5ld  %8u   %s\n",
+         loss * 100, (double)bytes / cfg.ticks, (double)(bytes - ackBytes) / cfg.ticks,
+         (double)ackBytes / cfg.ticks, (double)full, 100.0 * bytes / ((double)full * cfg.ticks),
+         owner.fulls, owner.deltas, (double)behind / samples, behindMax, guest.unusable,
+         mismatches ? "DESYNC" : "ok");
+  if (mismatches) printf("       %ld copies differed from the owner's snapshot\n", mismatches);
+}
+
+static void usage() {
+  fprintf(stderr,
+    "usage: snapbench [options]\n"
+    "  --ticks N       ticks per run (1200)\n"
+    "  --hz HZ         tick rate, for bytes per second (20)\n"
+    "  --loss LIST     packet loss rates to run, e.g. 0,0.05,0.2 (default)\n"
+    "  --latency T     ticks each way (1)\n"
+    "  --seed N        random seed (1)\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  static const struct option opts[] = {
+    { "ticks",   required_argument, nullptr, 't' },
+    { "hz",      required_argument, nullptr, 'z' },
+    { "loss",    required_argument, nullptr, 'l' },
+    { "latency", required_argument, nullptr, 'a' },
+    { "seed",    required_argument, nullptr, 's' },
+    { "help",    no_argument,       nullptr, 'h' },
+    { nullptr, 0, nullptr, 0 }
+  };
+  int c;
+
+  while ((c = getopt_long(argc, argv, "", opts, nullptr)) != -1) {
+    switch (c) {
+      case 't': cfg.ticks = atoi(optarg); break;
+      case 'z': cfg.hz = atoi(optarg); break;
+      case 'a': cfg.latency = std::max(1, atoi(optarg)); break;
+      case 's': cfg.seed = strtoul(optarg, nullptr, 0); break;
+      case 'l': {
+        std::string list = optarg;
+        cfg.loss.clear();
+        for (size_t pos = 0; pos != std::string::npos; ) {
+          size_t comma = list.find(',', pos);
+          cfg.loss.push_back(atof(list.substr(pos, comma - pos).c_str()));
+          pos = comma == std::string::npos ? comma : comma + 1;
+        }
+        break;
+      }
+      default: usage();
+    }
+  }
+  if (cfg.ticks <= 0 || cfg.hz <= 0) usage();
+
+  printf("snapbench: %d players, %zu byte state, %d ticks at %dHz, latency %d tick%s, seed %u\n\n",
+         BENCH_PLAYERS, sizeof(bench_world_t), cfg.ticks, cfg.hz, cfg.latency, cfg.latency == 1 ? "" : "s",
+         cfg.seed);
+  printf(" loss  B/tick   snaps    acks  full B  %%full   full / delta    lag  lag max  unusable  copies\n");
+
+  for (double loss : cfg.loss) runOnce(loss);
+
+  printf("\nB/tick is everything on the air per tick, packet headers included:\n"
+         "the owner's snapshots and diffs, and the others' ACKs.  full B is the\n"
+         "whole state sent once a tick as one session broadcast (%.1f kB/s at\n"
+         "%dHz; three times that as unicasts), and %%full compares with it.  lag\n"
+         "is how many ticks the others' copies are behind.\n",
+         (BENCH_HEADER + SNAP_HEADER + sizeof(bench_world_t)) * cfg.hz / 1000.0, cfg.hz);
+  return 0;
+}